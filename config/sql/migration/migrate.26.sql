@@ -0,0 +1,10 @@
+-- Don't modify this! Create a new migration instead--see docs/ota-client-guide/modules/ROOT/pages/schema-migrations.adoc
+SAVEPOINT MIGRATION;
+
+CREATE INDEX installed_versions_ecu_serial ON installed_versions(ecu_serial, id);
+CREATE INDEX installed_versions_pending ON installed_versions(ecu_serial) WHERE is_pending = 1;
+
+DELETE FROM version;
+INSERT INTO version VALUES(26);
+
+RELEASE MIGRATION;
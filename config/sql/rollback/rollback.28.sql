@@ -0,0 +1,13 @@
+-- Don't modify this! Create a new migration instead--see docs/ota-client-guide/modules/ROOT/pages/schema-migrations.adoc
+SAVEPOINT ROLLBACK_MIGRATION;
+
+CREATE TABLE target_images_migrate(targetname TEXT PRIMARY KEY, real_size INTEGER NOT NULL DEFAULT 0, sha256 TEXT NOT NULL DEFAULT "", sha512 TEXT NOT NULL DEFAULT "", filename TEXT NOT NULL);
+INSERT INTO target_images_migrate(targetname, real_size, sha256, sha512, filename) SELECT target_images.targetname, target_images.real_size, target_images.sha256, target_images.sha512, target_images.filename FROM target_images;
+
+DROP TABLE target_images;
+ALTER TABLE target_images_migrate RENAME TO target_images;
+
+DELETE FROM version;
+INSERT INTO version VALUES(27);
+
+RELEASE ROLLBACK_MIGRATION;
@@ -14,6 +14,7 @@ class SotaUptaneClient;
 class INvStorage;
 
 namespace api {
+class BandwidthLimiter;
 class CommandQueue;
 }
 
@@ -30,6 +31,7 @@ class Aktualizr {
    * @throw boost::filesystem::filesystem_error
    * @throw std::bad_alloc (memory allocation failure)
    * @throw std::runtime_error (filesystem failure; libsodium initialization failure)
+   * @throw std::invalid_argument (malformed `uptane.bandwidth_schedule`)
    */
   explicit Aktualizr(const Config& config);
 
@@ -285,6 +287,26 @@ class Aktualizr {
    */
   void Abort();
 
+  /**
+   * Limit the bandwidth shared by Target downloads, OSTree pulls and uploads to
+   * Secondaries, e.g. while other traffic uses the link. This overrides the
+   * limits of the configuration until ClearBandwidthLimit() is called.
+   *
+   * @param bytes_per_sec The limit, 0 for no limit.
+   */
+  void SetBandwidthLimit(uint64_t bytes_per_sec);
+
+  /**
+   * Go back to the bandwidth limits of the configuration.
+   */
+  void ClearBandwidthLimit();
+
+  /**
+   * Tell whether the network is currently metered, which applies
+   * `uptane.bandwidth_metered_limit` of the configuration.
+   */
+  void SetMeteredNetwork(bool metered);
+
   /**
    * Synchronously run an Uptane cycle: check for updates, download any new
    * targets, install them, and send a manifest back to the server.
@@ -368,6 +390,7 @@ class Aktualizr {
 
   std::shared_ptr<INvStorage> storage_;
   std::shared_ptr<event::Channel> sig_;
+  std::shared_ptr<api::BandwidthLimiter> bandwidth_limiter_;
   std::unique_ptr<api::CommandQueue> api_queue_;
 };
 
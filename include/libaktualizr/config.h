@@ -72,6 +72,14 @@ struct UptaneConfig {
   bool force_install_completion{false};
   boost::filesystem::path secondary_config_file;
   uint64_t secondary_preinstall_wait_sec{600U};
+  // Maximum number of Secondaries of the same type sending firmware data at once, 0 for no limit
+  uint64_t secondary_link_concurrency{0U};
+  // Bandwidth shared by downloads and uploads to Secondaries, in bytes per second, 0 for no limit
+  uint64_t bandwidth_limit{0U};
+  // Limit while the network is metered, see Aktualizr::SetMeteredNetwork(), 0 for the same as bandwidth_limit
+  uint64_t bandwidth_metered_limit{0U};
+  // Limits at given times of day, replacing bandwidth_limit, e.g. "08:00-18:00=65536,22:00-06:00=0"
+  std::string bandwidth_schedule;
 
   void updateFromPropertyTree(const boost::property_tree::ptree& pt);
   void writeToStream(std::ostream& out_stream) const;
@@ -94,8 +102,20 @@ struct PackageConfig {
   std::string os;
   boost::filesystem::path sysroot;
   std::string ostree_server;
+  // Caching proxy of ostree_server run for OSTree Secondaries, disabled if the
+  // port is 0. The address is the IPv4 address of the Primary in the network of
+  // the Secondaries, the only one the proxy listens on.
+  uint16_t ostree_proxy_port{0};
+  std::string ostree_proxy_address;
+  boost::filesystem::path ostree_proxy_cache{"/var/sota/ostree_proxy"};
+  uint64_t ostree_proxy_cache_size{512ULL << 20U};
   boost::filesystem::path images_path{"/var/sota/images"};
+  // Maximum total size of the files in images_path, 0 for no limit
+  uint64_t images_quota{0};
   boost::filesystem::path packages_file{"/usr/package.manifest"};
+  // Always hash downloaded Targets again when verifying them, instead of
+  // trusting an unchanged file to still match the hash it was verified against.
+  bool full_target_verification{false};
 
   // Options for simulation
   bool fake_need_reboot{false};
@@ -122,6 +142,10 @@ struct StorageConfig {
 
   // SQLite storage
   utils::BasedPath sqldb_path{"sql.db"};  // based on `/var/sota`
+  // Retention of history in the SQLite storage, 0 means unlimited
+  int max_installed_versions{0};  // per ECU, current and pending versions are always kept
+  int max_report_events{0};       // oldest events are dropped first
+  int max_root_versions{0};       // per repository, older Roots may be needed to update Secondaries
 
   void updateFromPropertyTree(const boost::property_tree::ptree& pt);
   void writeToStream(std::ostream& out_stream) const;
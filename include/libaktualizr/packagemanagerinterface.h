@@ -71,6 +71,14 @@ class PackageManagerInterface {
   virtual std::vector<Uptane::Target> getTargetFiles();
 
  protected:
+  // Downloads are written next to their final location, to a file of their
+  // own, and only moved there once verified, so that a file named after a hash
+  // always has that content.
+  std::ofstream createPartialTargetFile(const Uptane::Target& target);
+  void completeTargetFile(const Uptane::Target& target);
+  bool reuseStoredTargetFile(const Uptane::Target& target);
+  void evictTargetFiles(const Uptane::Target& target, uint64_t required_bytes);
+
   PackageConfig config;
   std::shared_ptr<INvStorage> storage_;
   std::shared_ptr<HttpInterface> http_;
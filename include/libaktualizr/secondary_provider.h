@@ -1,25 +1,84 @@
 #ifndef UPTANE_SECONDARY_PROVIDER_H
 #define UPTANE_SECONDARY_PROVIDER_H
 
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "libaktualizr/config.h"
 #include "libaktualizr/packagemanagerinterface.h"
 #include "libaktualizr/types.h"
 
+class ImageFanOut;
+class ImageSharing;
 class INvStorage;
+class OstreeProxy;
 
 class SecondaryProviderBuilder;
 
+/**
+ * Reads the image of a Target in chunks, to send it to a Secondary.
+ */
+class TargetImageReader {
+ public:
+  TargetImageReader() = default;
+  virtual ~TargetImageReader() = default;
+  TargetImageReader(const TargetImageReader&) = delete;
+  TargetImageReader(TargetImageReader&&) = delete;
+  TargetImageReader& operator=(const TargetImageReader&) = delete;
+  TargetImageReader& operator=(TargetImageReader&&) = delete;
+
+  /**
+   * Next chunk of the image, nullptr after the end. Throws std::runtime_error
+   * if the image cannot be read or does not match the Target.
+   */
+  virtual std::shared_ptr<const std::string> next() = 0;
+};
+
+/**
+ * Limit to the number of Secondaries sharing a link that exchange firmware
+ * data at the same time. Used as a lock, e.g. with std::lock_guard; a limit
+ * of 0 means no limit.
+ */
+class LinkLimiter {
+ public:
+  explicit LinkLimiter(uint64_t limit) : limit_{limit} {}
+
+  void lock();
+  void unlock();
+
+ private:
+  const uint64_t limit_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  uint64_t used_{0};
+};
+
 class SecondaryProvider {
  public:
   friend class SecondaryProviderBuilder;
+  friend class ImageSharing;
 
   bool getMetadata(Uptane::MetaBundle* meta_bundle, const Uptane::Target& target) const;
   bool getDirectorMetadata(Uptane::MetaBundle* meta_bundle) const;
   bool getImageRepoMetadata(Uptane::MetaBundle* meta_bundle, const Uptane::Target& target) const;
   std::string getTreehubCredentials() const;
+  /** URL of Treehub for the Secondaries: that of the proxy if one is configured */
+  std::string getTreehubUrl(const std::string& ca, const std::string& cert, const std::string& pkey) const;
   std::ifstream getTargetFileHandle(const Uptane::Target& target) const;
+  /**
+   * Reader of the image of a Target for the given Secondary: shared with the
+   * other Secondaries receiving the same image at the same time, read
+   * directly from the file otherwise.
+   */
+  std::unique_ptr<TargetImageReader> getTargetImageReader(const Uptane::Target& target,
+                                                          const Uptane::EcuSerial& receiver) const;
+  /** Limit to the concurrent firmware transfers on a link shared by Secondaries */
+  std::shared_ptr<LinkLimiter> getLinkLimiter(const std::string& link) const;
 
  private:
   SecondaryProvider(Config& config_in, std::shared_ptr<const INvStorage> storage_in,
@@ -30,6 +89,13 @@ class SecondaryProvider {
   Config& config_;
   std::shared_ptr<const INvStorage> storage_;
   std::shared_ptr<const PackageManagerInterface> package_manager_;
+  // Started when first needed, as the TLS credentials are only available
+  // after provisioning.
+  mutable std::mutex ostree_proxy_mutex_;
+  mutable std::shared_ptr<OstreeProxy> ostree_proxy_;
+  mutable std::mutex fan_out_mutex_;
+  mutable std::map<std::string, std::weak_ptr<ImageFanOut>> fan_outs_;
+  mutable std::map<std::string, std::shared_ptr<LinkLimiter>> link_limiters_;
 };
 
 #endif  // UPTANE_SECONDARY_PROVIDER_H
@@ -11,6 +11,7 @@
 #include "logging/logging.h"
 #include "storage/invstorage.h"
 #include "storage/sql_utils.h"
+#include "storage/sqlstorage.h"
 #include "utilities/aktualizr_version.h"
 
 namespace bpo = boost::program_options;
@@ -74,6 +75,7 @@ int main(int argc, char **argv) {
     ("director-targets",  "Outputs targets.json from Director repo")
     ("root-version",  bpo::value<int>(), "Use with --image-root or --director-root to specify the version to output")
     ("allow-migrate", "Opens database in read/write mode to make possible to migrate database if needed")
+    ("compact-db", "Rewrites the database once so that it shrinks after pruning; run while aktualizr is stopped")
     ("wait-until-provisioned", "Outputs metadata when device already provisioned");
   // Support old names and variations due to common typos.
   hidden.add_options()
@@ -110,7 +112,7 @@ int main(int argc, char **argv) {
     bool secondary_db = false;
 
     bool readonly = true;
-    if (vm.count("allow-migrate") != 0U) {
+    if (vm.count("allow-migrate") != 0U || vm.count("compact-db") != 0U) {
       readonly = false;
     }
 
@@ -334,6 +336,16 @@ int main(int argc, char **argv) {
       cmd_trigger = true;
     }
 
+    if (vm.count("compact-db") != 0U) {
+      auto *sql_storage = dynamic_cast<SQLStorage *>(storage.get());
+      if (sql_storage == nullptr || !sql_storage->enableIncrementalVacuum()) {
+        std::cout << "Failed to switch the database to incremental auto-vacuum" << std::endl;
+        return EXIT_FAILURE;
+      }
+      std::cout << "The database uses incremental auto-vacuum" << std::endl;
+      cmd_trigger = true;
+    }
+
     if (cmd_trigger) {
       return EXIT_SUCCESS;
     }
@@ -5,7 +5,11 @@
 #include <boost/bind/bind.hpp>
 #include <boost/filesystem.hpp>
 
+#include <sys/socket.h>
+
 #include <algorithm>
+#include <chrono>
+#include <future>
 #include <unordered_map>
 
 #include "ipuptanesecondary.h"
@@ -86,6 +90,7 @@ class SecondaryWaiter {
       return;
     }
 
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_.total_seconds());
     timer_.expires_from_now(timeout_);
     timer_.async_wait([&](const boost::system::error_code& error_code) {
       if (!!error_code) {
@@ -99,9 +104,40 @@ class SecondaryWaiter {
     });
     accept();
     io_context_.run();
+
+    // Registration in the storage is done from this thread only, in the order
+    // the Secondaries have connected.
+    for (auto& accepted : accepted_secondaries_) {
+      if (accepted.secondary.wait_until(deadline) != std::future_status::ready) {
+        LOG_ERROR << "Timeout while getting information from the Secondary (" << accepted.ip << ":" << accepted.port
+                  << ")";
+        // Unblock the background task, so that it does not hold up startup
+        ::shutdown(accepted.socket->native_handle(), SHUT_RDWR);
+        continue;
+      }
+      auto secondary = accepted.secondary.get();
+      if (secondary) {
+        connected_secondaries_.push_back(secondary);
+        // set ip/port in the db so that we can match everything later
+        Json::Value d;
+        d["ip"] = accepted.ip;
+        d["port"] = accepted.port;
+        d["verification_type"] = Uptane::VerificationTypeToString(accepted.verification_type);
+        aktualizr_.SetSecondaryData(secondary->getSerial(), Utils::jsonToCanonicalStr(d));
+      }
+    }
   }
 
  private:
+  struct AcceptedSecondary {
+    std::string ip;
+    uint16_t port;
+    VerificationType verification_type;
+    // Closed once the background task is done with it
+    std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+    std::future<SecondaryInterface::Ptr> secondary;
+  };
+
   void accept() {
     LOG_INFO << "Waiting for connection from " << secondaries_to_wait_for_.size() << " Secondaries...";
     acceptor_.async_accept(con_socket_,
@@ -115,26 +151,28 @@ class SecondaryWaiter {
       auto it = secondaries_to_wait_for_.find(key(sec_ip, sec_port));
       if (it == secondaries_to_wait_for_.end()) {
         LOG_INFO << "Unexpected connection from a Secondary: (" << sec_ip << ":" << sec_port << ")";
+        boost::system::error_code ignored;
+        con_socket_.close(ignored);
+        accept();
         return;
       }
 
       LOG_INFO << "Accepted connection from a Secondary: (" << sec_ip << ":" << sec_port << ")";
-      try {
-        auto secondary = Uptane::IpUptaneSecondary::create(sec_ip, sec_port, it->second, con_socket_.native_handle());
-        if (secondary) {
-          connected_secondaries_.push_back(secondary);
-          // set ip/port in the db so that we can match everything later
-          Json::Value d;
-          d["ip"] = sec_ip;
-          d["port"] = sec_port;
-          d["verification_type"] = Uptane::VerificationTypeToString(it->second);
-          aktualizr_.SetSecondaryData(secondary->getSerial(), Utils::jsonToCanonicalStr(d));
+      // Get the information from the Secondary in the background and keep
+      // accepting connections from the other ones in the meantime.
+      auto socket = std::make_shared<boost::asio::ip::tcp::socket>(std::move(con_socket_));
+      const VerificationType verification_type = it->second;
+      auto secondary = std::async(std::launch::async, [socket, sec_ip, sec_port, verification_type]() {
+        SecondaryInterface::Ptr sec;
+        try {
+          sec = Uptane::IpUptaneSecondary::create(sec_ip, sec_port, verification_type, socket->native_handle());
+        } catch (const std::exception& exc) {
+          LOG_ERROR << "Failed to initialize a Secondary: " << exc.what();
         }
-      } catch (const std::exception& exc) {
-        LOG_ERROR << "Failed to initialize a Secondary: " << exc.what();
-      }
-      con_socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both);
-      con_socket_.close();
+        ::shutdown(socket->native_handle(), SHUT_RDWR);
+        return sec;
+      });
+      accepted_secondaries_.push_back({sec_ip, sec_port, verification_type, socket, std::move(secondary)});
 
       secondaries_to_wait_for_.erase(it);
       if (!secondaries_to_wait_for_.empty()) {
@@ -160,6 +198,7 @@ class SecondaryWaiter {
 
   Secondaries& connected_secondaries_;
   std::unordered_map<std::string, VerificationType> secondaries_to_wait_for_;
+  std::vector<AcceptedSecondary> accepted_secondaries_;
 };
 
 // Four options for each Secondary:
@@ -168,13 +207,19 @@ class SecondaryWaiter {
 // cause re-registration.
 // 3. Same as 2 but cannot connect: abort.
 // 4. Secondary is stored but not configured: it must have been removed. Skip it. This will cause re-registration.
+//
+// The Secondaries are all contacted at the same time, so that the startup time
+// is bound by the slowest one rather than by the sum of their timeouts.
 static Secondaries createIPSecondaries(const IPSecondariesConfig& config, Aktualizr& aktualizr) {
   Secondaries result;
   SecondaryWaiter sec_waiter{aktualizr, config.secondaries_wait_port, config.secondaries_timeout_s, result};
   auto secondaries_info = aktualizr.GetSecondaries();
 
+  // Stored information for each configured Secondary, nullptr if it is new.
+  std::vector<const SecondaryInfo*> infos;
+  std::vector<std::future<SecondaryInterface::Ptr>> connections;
+
   for (const auto& cfg : config.secondaries_cfg) {
-    SecondaryInterface::Ptr secondary;
     const SecondaryInfo* info = nullptr;
 
     // Try to match the configured Secondaries to stored Secondaries.
@@ -197,9 +242,30 @@ static Secondaries createIPSecondaries(const IPSecondariesConfig& config, Aktual
       d["verification_type"] = Uptane::VerificationTypeToString(cfg.verification_type);
       aktualizr.SetSecondaryData(info->serial, Utils::jsonToCanonicalStr(d));
       LOG_INFO << "Migrated a single IP Secondary to new storage format.";
-    } else if (f == secondaries_info.cend()) {
+    } else if (f != secondaries_info.cend()) {
+      // The configured Secondary was found in storage.
+      info = &(*f);
+    }
+
+    infos.push_back(info);
+    if (info == nullptr) {
       // Secondary was not found in storage; it must be new.
-      secondary = Uptane::IpUptaneSecondary::connectAndCreate(cfg.ip, cfg.port, cfg.verification_type);
+      connections.push_back(std::async(std::launch::async, [&cfg]() {
+        return Uptane::IpUptaneSecondary::connectAndCreate(cfg.ip, cfg.port, cfg.verification_type);
+      }));
+    } else {
+      connections.push_back(std::async(std::launch::async, [&cfg, info]() {
+        return Uptane::IpUptaneSecondary::connectAndCheck(cfg.ip, cfg.port, cfg.verification_type, info->serial,
+                                                          info->hw_id, info->pub_key);
+      }));
+    }
+  }
+
+  for (size_t k = 0; k < config.secondaries_cfg.size(); ++k) {
+    const auto& cfg = config.secondaries_cfg[k];
+    SecondaryInterface::Ptr secondary = connections[k].get();
+
+    if (infos[k] == nullptr) {
       if (secondary == nullptr) {
         LOG_DEBUG << "Could not connect to IP Secondary at " << cfg.ip << ":" << cfg.port
                   << "; now trying to wait for it.";
@@ -214,18 +280,11 @@ static Secondaries createIPSecondaries(const IPSecondariesConfig& config, Aktual
         aktualizr.SetSecondaryData(secondary->getSerial(), Utils::jsonToCanonicalStr(d));
       }
       continue;
-    } else {
-      // The configured Secondary was found in storage.
-      info = &(*f);
     }
 
     if (secondary == nullptr) {
-      secondary = Uptane::IpUptaneSecondary::connectAndCheck(cfg.ip, cfg.port, cfg.verification_type, info->serial,
-                                                             info->hw_id, info->pub_key);
-      if (secondary == nullptr) {
-        throw std::runtime_error("Unable to connect to or verify IP Secondary at " + cfg.ip + ":" +
-                                 std::to_string(cfg.port));
-      }
+      throw std::runtime_error("Unable to connect to or verify IP Secondary at " + cfg.ip + ":" +
+                               std::to_string(cfg.port));
     }
 
     result.push_back(secondary);
@@ -6,6 +6,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
 
+#include "compression.h"
 #include "crypto/keymanager.h"
 #include "libaktualizr/types.h"
 #include "logging/logging.h"
@@ -26,6 +27,15 @@ AktualizrSecondary::AktualizrSecondary(AktualizrSecondaryConfig config, std::sha
 PublicKey AktualizrSecondary::publicKey() const { return keys_->UptanePublicKey(); }
 
 Uptane::Manifest AktualizrSecondary::getManifest() const {
+  std::lock_guard<std::mutex> guard(manifest_mutex_);
+  if (installing_) {
+    // Answered right away, with the image installed before the installation
+    return install_manifest_;
+  }
+  return assembleManifest();
+}
+
+Uptane::Manifest AktualizrSecondary::assembleManifest() const {
   Uptane::InstalledImageInfo installed_image_info;
   Uptane::Manifest manifest;
 
@@ -47,6 +57,27 @@ data::InstallationResult AktualizrSecondary::install() {
                                     "Aborting target image installation; no valid target found.");
   }
 
+  // The installed image and its state are not read by manifest requests until
+  // the installation is over.
+  {
+    std::lock_guard<std::mutex> guard(manifest_mutex_);
+    install_manifest_ = assembleManifest();
+    installing_ = true;
+  }
+  data::InstallationResult result;
+  try {
+    result = installPending();
+  } catch (...) {
+    std::lock_guard<std::mutex> guard(manifest_mutex_);
+    installing_ = false;
+    throw;
+  }
+  std::lock_guard<std::mutex> guard(manifest_mutex_);
+  installing_ = false;
+  return result;
+}
+
+data::InstallationResult AktualizrSecondary::installPending() {
   auto target_name = pending_target_.filename();
   auto result = installPendingTarget(pending_target_);
 
@@ -241,14 +272,19 @@ void AktualizrSecondary::uptaneInitialize() {
 }
 
 void AktualizrSecondary::registerHandlers() {
+  // Queries that do not depend on in-memory state modified by the other handlers
+  // are answered even while an image is being received or installed.
   registerHandler(AKIpUptaneMes_PR_getInfoReq,
-                  std::bind(&AktualizrSecondary::getInfoHdlr, this, std::placeholders::_1, std::placeholders::_2));
+                  std::bind(&AktualizrSecondary::getInfoHdlr, this, std::placeholders::_1, std::placeholders::_2),
+                  Concurrency::kConcurrent);
 
   registerHandler(AKIpUptaneMes_PR_versionReq,
-                  std::bind(&AktualizrSecondary::versionHdlr, std::placeholders::_1, std::placeholders::_2));
+                  std::bind(&AktualizrSecondary::versionHdlr, std::placeholders::_1, std::placeholders::_2),
+                  Concurrency::kConcurrent);
 
   registerHandler(AKIpUptaneMes_PR_manifestReq,
-                  std::bind(&AktualizrSecondary::getManifestHdlr, this, std::placeholders::_1, std::placeholders::_2));
+                  std::bind(&AktualizrSecondary::getManifestHdlr, this, std::placeholders::_1, std::placeholders::_2),
+                  Concurrency::kConcurrent);
 
   registerHandler(AKIpUptaneMes_PR_rootVerReq,
                   std::bind(&AktualizrSecondary::getRootVerHdlr, this, std::placeholders::_1, std::placeholders::_2));
@@ -290,8 +326,26 @@ MsgHandler::ReturnCode AktualizrSecondary::versionHdlr(Asn1Message& in_msg, Asn1
              << ". Please consider upgrading the Secondary.";
   }
 
+  // Pick the first compression method offered by the Primary that is supported
+  // here, if the Primary knows about compression at all.
+  auto compression = Uptane::UploadCompression::kNone;
+  const AKCompressionList_t* offered = version_req->compression;
+  if (offered != nullptr) {
+    for (int i = 0; i < offered->list.count; i++) {
+      const auto method = static_cast<Uptane::UploadCompression>(*offered->list.array[i]);
+      if (method != Uptane::UploadCompression::kNone && Uptane::isCompressionSupported(method)) {
+        compression = method;
+        break;
+      }
+    }
+  }
+
   auto m = out_msg.present(AKIpUptaneMes_PR_versionResp).versionResp();
   m->version = version;
+  if (offered != nullptr) {
+    m->compression = Asn1Allocation<AKCompression_t>();
+    *m->compression = static_cast<AKCompression_t>(compression);
+  }
 
   return ReturnCode::kOk;
 }
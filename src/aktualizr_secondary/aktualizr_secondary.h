@@ -1,6 +1,8 @@
 #ifndef AKTUALIZR_SECONDARY_H
 #define AKTUALIZR_SECONDARY_H
 
+#include <mutex>
+
 #include "aktualizr_secondary_config.h"
 #include "msg_handler.h"
 #include "uptane/directorrepository.h"
@@ -52,6 +54,8 @@ class AktualizrSecondary : public MsgDispatcher {
                            std::string& json);
   data::InstallationResult verifyMetadata(const Uptane::SecondaryMetadata& metadata);
   data::InstallationResult findTargets();
+  Uptane::Manifest assembleManifest() const;
+  data::InstallationResult installPending();
   void uptaneInitialize();
   void registerHandlers();
 
@@ -76,6 +80,12 @@ class AktualizrSecondary : public MsgDispatcher {
   Uptane::DirectorRepository director_repo_;
   Uptane::ImageRepository image_repo_;
   Uptane::Target pending_target_{Uptane::Target::Unknown()};
+  // Manifests are served concurrently with the other requests. During an
+  // installation, the one signed just before it is served rather than one
+  // of a half-installed image.
+  mutable std::mutex manifest_mutex_;
+  bool installing_{false};
+  Uptane::Manifest install_manifest_;
 };
 
 #endif  // AKTUALIZR_SECONDARY_H
@@ -34,14 +34,15 @@ AktualizrSecondaryFile::AktualizrSecondaryFile(const AktualizrSecondaryConfig& c
 
 void AktualizrSecondaryFile::initialize() { initPendingTargetIfAny(); }
 
-data::InstallationResult AktualizrSecondaryFile::receiveData(const uint8_t* data, size_t size) {
+data::InstallationResult AktualizrSecondaryFile::receiveData(const uint8_t* data, size_t size,
+                                                             Uptane::UploadCompression compression) {
   if (!getPendingTarget().IsValid()) {
     LOG_ERROR << "Aborting image download; no valid target found.";
     return data::InstallationResult(data::ResultCode::Numeric::kGeneralError,
                                     "Aborting image download; no valid target found.");
   }
 
-  return update_agent_->receiveData(getPendingTarget(), data, size);
+  return update_agent_->receiveData(getPendingTarget(), data, size, compression);
 }
 
 bool AktualizrSecondaryFile::isTargetSupported(const Uptane::Target& target) const {
@@ -75,7 +76,12 @@ MsgHandler::ReturnCode AktualizrSecondaryFile::uploadDataHdlr(Asn1Message& in_ms
     return ReturnCode::kOk;
   }
 
-  auto result = receiveData(in_msg.uploadDataReq()->data.buf, static_cast<size_t>(rec_buf_size));
+  auto compression = Uptane::UploadCompression::kNone;
+  if (in_msg.uploadDataReq()->compression != nullptr) {
+    compression = static_cast<Uptane::UploadCompression>(*in_msg.uploadDataReq()->compression);
+  }
+
+  auto result = receiveData(in_msg.uploadDataReq()->data.buf, static_cast<size_t>(rec_buf_size), compression);
 
   auto m = out_msg.present(AKIpUptaneMes_PR_uploadDataResp).uploadDataResp();
   m->result = static_cast<AKInstallationResultCode_t>(result.result_code.num_code);
@@ -4,6 +4,7 @@
 #include <memory>
 
 #include "aktualizr_secondary.h"
+#include "compression.h"
 
 class FileUpdateAgent;
 
@@ -16,7 +17,8 @@ class AktualizrSecondaryFile : public AktualizrSecondary {
                          std::shared_ptr<FileUpdateAgent> update_agent = nullptr);
 
   void initialize() override;
-  data::InstallationResult receiveData(const uint8_t* data, size_t size);
+  data::InstallationResult receiveData(const uint8_t* data, size_t size,
+                                       Uptane::UploadCompression compression = Uptane::UploadCompression::kNone);
 
  protected:
   bool getInstalledImageInfo(Uptane::InstalledImageInfo& installed_image_info) const override;
@@ -3,9 +3,12 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/optional/optional_io.hpp>
+#include <chrono>
 #include <fstream>
+#include <future>
 
 #include "aktualizr_secondary_file.h"
+#include "compression.h"
 #include "crypto/keymanager.h"
 #include "libaktualizr/types.h"
 #include "storage/invstorage.h"
@@ -455,6 +458,108 @@ TEST_F(SecondaryTest, InvalidImageData) {
   EXPECT_FALSE(secondary_->install().isSuccess());
 }
 
+/* An image fully received before a restart can still be installed. */
+TEST_F(SecondaryTest, InstallAfterRestart) {
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+  ASSERT_EQ(sendImageFile(), data::ResultCode::Numeric::kOk);
+
+  FileUpdateAgent restarted_agent(secondary_.targetFilepath(), "");
+  const auto result = restarted_agent.install(secondary_->getPendingTarget());
+  ASSERT_TRUE(result.isSuccess()) << result.description;
+  EXPECT_EQ(Utils::readFile(secondary_.targetFilepath()),
+            Utils::readFile(uptane_repo_.getTargetImagePath(default_target_)));
+}
+
+/* An image partially received before a restart is discarded when it is sent
+ * again. */
+TEST_F(SecondaryTest, ReceiveAgainAfterRestart) {
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+  const std::string image = Utils::readFile(uptane_repo_.getTargetImagePath(default_target_));
+  const auto target = secondary_->getPendingTarget();
+  {
+    FileUpdateAgent agent(secondary_.targetFilepath(), "");
+    const auto result = agent.receiveData(target, reinterpret_cast<const uint8_t*>(image.data()), send_buffer_size);
+    ASSERT_TRUE(result.isSuccess());
+  }
+
+  FileUpdateAgent restarted_agent(secondary_.targetFilepath(), "");
+  for (size_t pos = 0; pos < image.size(); pos += send_buffer_size) {
+    const size_t size = std::min(static_cast<size_t>(send_buffer_size), image.size() - pos);
+    ASSERT_TRUE(
+        restarted_agent.receiveData(target, reinterpret_cast<const uint8_t*>(image.data()) + pos, size).isSuccess());
+  }
+  const auto result = restarted_agent.install(target);
+  ASSERT_TRUE(result.isSuccess()) << result.description;
+  EXPECT_EQ(Utils::readFile(secondary_.targetFilepath()), image);
+}
+
+/* A manifest requested during an installation is answered right away, with
+ * the image installed before it rather than a half-installed one. */
+TEST_F(SecondaryTest, ManifestDuringInstall) {
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+  ASSERT_EQ(sendImageFile(), data::ResultCode::Numeric::kOk);
+
+  std::promise<void> installing;
+  std::promise<void> proceed;
+  auto proceed_future = proceed.get_future().share();
+  EXPECT_CALL(update_agent_, install).WillOnce([this, &installing, proceed_future](const Uptane::Target& target) {
+    installing.set_value();
+    proceed_future.wait();
+    return update_agent_.FileUpdateAgent::install(target);
+  });
+
+  auto install = std::async(std::launch::async, [this]() { return secondary_->install(); });
+  installing.get_future().wait();
+  auto manifest = std::async(std::launch::async, [this]() { return secondary_->getManifest(); });
+  const bool answered = manifest.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+  proceed.set_value();
+  ASSERT_TRUE(answered);
+
+  const Hash new_image_hash =
+      Hash::generate(Hash::Type::kSha256, Utils::readFile(uptane_repo_.getTargetImagePath(default_target_)));
+  EXPECT_NE(manifest.get().installedImageHash(), new_image_hash);
+  ASSERT_TRUE(install.get().isSuccess());
+  EXPECT_EQ(secondary_->getManifest().installedImageHash(), new_image_hash);
+}
+
+/* A compressed image is decompressed and hashed as it is received. */
+TEST_F(SecondaryTest, CompressedImage) {
+  if (!Uptane::isCompressionSupported(Uptane::UploadCompression::kZstd)) {
+    return;
+  }
+  EXPECT_CALL(update_agent_, install).Times(1);
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+
+  const std::string image = Utils::readFile(uptane_repo_.getTargetImagePath(default_target_));
+  Uptane::StreamCompressor compressor(Uptane::UploadCompression::kZstd);
+  std::string compressed;
+  compressor.compress(reinterpret_cast<const uint8_t*>(image.data()), image.size(), true, compressed);
+
+  const size_t piece = send_buffer_size;
+  for (size_t pos = 0; pos < compressed.size(); pos += piece) {
+    auto result = secondary_->receiveData(reinterpret_cast<const uint8_t*>(compressed.data()) + pos,
+                                          std::min(piece, compressed.size() - pos), Uptane::UploadCompression::kZstd);
+    ASSERT_TRUE(result.isSuccess()) << result.description;
+  }
+  ASSERT_TRUE(secondary_->install().isSuccess());
+
+  verifyTargetAndManifest();
+}
+
+TEST_F(SecondaryTest, CorruptedCompressedImage) {
+  if (!Uptane::isCompressionSupported(Uptane::UploadCompression::kZstd)) {
+    return;
+  }
+  EXPECT_CALL(update_agent_, receiveData).Times(0);
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+
+  const std::string garbage(send_buffer_size, 'x');
+  auto result = secondary_->receiveData(reinterpret_cast<const uint8_t*>(garbage.data()), garbage.size(),
+                                        Uptane::UploadCompression::kZstd);
+  EXPECT_EQ(result.result_code, data::ResultCode::Numeric::kDownloadFailed);
+  EXPECT_FALSE(secondary_->install().isSuccess());
+}
+
 class SecondaryTestTuf
     : public SecondaryTest,
       public ::testing::WithParamInterface<std::pair<std::vector<std::string>, boost::optional<std::string>>> {
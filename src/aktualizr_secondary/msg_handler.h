@@ -1,7 +1,10 @@
 #ifndef MSG_HANDLER_H
 #define MSG_HANDLER_H
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include "AKIpUptaneMes.h"
@@ -25,16 +28,30 @@ class MsgDispatcher : public MsgHandler {
  public:
   using Handler = std::function<ReturnCode(Asn1Message&, Asn1Message&)>;
 
-  void registerHandler(AKIpUptaneMes_PR msg_id, Handler handler);
+  /**
+   * Requests may be handled concurrently when several Primary sessions are
+   * open. Exclusive handlers are serialized with each other; concurrent
+   * handlers must only read state and may run alongside any other handler,
+   * e.g. to answer a manifest request while an installation is in progress.
+   */
+  enum class Concurrency { kExclusive, kConcurrent };
+
+  void registerHandler(AKIpUptaneMes_PR msg_id, Handler handler, Concurrency concurrency = Concurrency::kExclusive);
   ReturnCode handleMsg(const Asn1Message::Ptr& in_msg, Asn1Message::Ptr& out_msg) override;
 
  protected:
   void clearHandlers();
 
-  unsigned int last_msg_ = 0;
+  std::atomic<unsigned int> last_msg_{0};
 
  private:
-  std::unordered_map<unsigned int, Handler> handler_map_;
+  struct HandlerEntry {
+    Handler handler;
+    Concurrency concurrency;
+  };
+
+  std::unordered_map<unsigned int, HandlerEntry> handler_map_;
+  std::mutex exclusive_mutex_;
 };
 
 #endif  // MSG_HANDLER_H
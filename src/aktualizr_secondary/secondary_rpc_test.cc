@@ -1,9 +1,11 @@
+#include <future>
 #include <thread>
 
 #include <gtest/gtest.h>
 #include <netinet/tcp.h>
 #include <boost/filesystem.hpp>
 
+#include "compression.h"
 #include "crypto/crypto.h"
 #include "ipuptanesecondary.h"
 #include "libaktualizr/packagemanagerfactory.h"
@@ -64,6 +66,8 @@ class SecondaryMock : public MsgDispatcher {
   }
 
   void resetImageHash() const { hasher_->reset(); }
+  void acceptCompression(bool accept) { accept_compression_ = accept; }
+  uint64_t getCompressedDataSize() const { return compressed_data_size_; }
   Hash getReceivedImageHash() const { return hasher_->getHash(); }
   size_t getReceivedImageSize() const { return boost::filesystem::file_size(image_filepath_); }
 
@@ -143,14 +147,22 @@ class SecondaryMock : public MsgDispatcher {
   }
 
   MsgHandler::ReturnCode versionHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
-    (void)in_msg;
-
     auto m = out_msg.present(AKIpUptaneMes_PR_versionResp).versionResp();
     if (handler_version_ == HandlerVersion::kV1) {
       m->version = 1;
     } else {
       m->version = 2;
     }
+    const AKCompressionList_t* offered = in_msg.versionReq()->compression;
+    if (accept_compression_ && offered != nullptr) {
+      m->compression = Asn1Allocation<AKCompression_t>();
+      *m->compression = AKCompression_none;
+      for (int i = 0; i < offered->list.count; i++) {
+        if (*offered->list.array[i] == AKCompression_zstd) {
+          *m->compression = AKCompression_zstd;
+        }
+      }
+    }
 
     return ReturnCode::kOk;
   }
@@ -299,7 +311,21 @@ class SecondaryMock : public MsgDispatcher {
     }
 
     size_t data_size = static_cast<size_t>(in_msg.uploadDataReq()->data.size);
-    auto result = receiveImageData(in_msg.uploadDataReq()->data.buf, data_size);
+    data::InstallationResult result;
+    if (in_msg.uploadDataReq()->compression != nullptr) {
+      if (!decompressor_) {
+        decompressor_ = std_::make_unique<Uptane::StreamDecompressor>(
+            static_cast<Uptane::UploadCompression>(*in_msg.uploadDataReq()->compression));
+      }
+      compressed_data_size_ += data_size;
+      decompressor_->decompress(in_msg.uploadDataReq()->data.buf, data_size, [this](const uint8_t* out, size_t size) {
+        receiveImageData(out, size);
+        return true;
+      });
+      result = data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+    } else {
+      result = receiveImageData(in_msg.uploadDataReq()->data.buf, data_size);
+    }
 
     auto m = out_msg.present(AKIpUptaneMes_PR_uploadDataResp).uploadDataResp();
     m->result = static_cast<AKInstallationResultCode_t>(result.result_code.num_code);
@@ -434,6 +460,9 @@ class SecondaryMock : public MsgDispatcher {
   std::unordered_map<unsigned int, Handler> handler_map_;
   std::string tls_creds_;
   std::string received_firmware_data_;
+  bool accept_compression_{false};
+  std::unique_ptr<Uptane::StreamDecompressor> decompressor_;
+  uint64_t compressed_data_size_{0};
   VerificationType vtype_;
   HandlerVersion handler_version_;
 };
@@ -775,6 +804,49 @@ TEST_F(SecondaryRpcUpgrade, VersionUpgrade) {
   installOstreeRev();
 }
 
+class SecondaryRpcCompression : public SecondaryRpcCommon {
+ protected:
+  SecondaryRpcCompression() : SecondaryRpcCommon(1024 * 100 + 1, HandlerVersion::kV2, VerificationType::kFull) {}
+};
+
+/* Compression is negotiated with the protocol version, and images are sent
+ * compressed unless their metadata says otherwise. */
+TEST_F(SecondaryRpcCompression, CompressedUpload) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  if (!Uptane::isCompressionSupported(Uptane::UploadCompression::kZstd)) {
+    secondary_.acceptCompression(true);
+    sendAndInstallBinaryImage();
+    EXPECT_EQ(secondary_.getCompressedDataSize(), 0U);
+    return;
+  }
+
+  // Not accepted by the Secondary
+  sendAndInstallBinaryImage();
+  EXPECT_EQ(secondary_.getCompressedDataSize(), 0U);
+
+  secondary_.acceptCompression(true);
+  secondary_.resetImageHash();
+  sendAndInstallBinaryImage();
+  EXPECT_GT(secondary_.getCompressedDataSize(), 0U);
+  EXPECT_LT(secondary_.getCompressedDataSize(), image_file_.size());
+}
+
+TEST_F(SecondaryRpcCompression, OptOut) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  secondary_.acceptCompression(true);
+
+  Uptane::Target target = image_file_.createTarget(package_manager_);
+  Json::Value custom = target.custom_data();
+  custom["compressUpload"] = false;
+  target.updateCustom(custom);
+
+  EXPECT_TRUE(ip_secondary_->putMetadata(target).isSuccess());
+  EXPECT_TRUE(ip_secondary_->sendFirmware(target, nullptr).isSuccess());
+  EXPECT_TRUE(ip_secondary_->install(target, nullptr).isSuccess());
+  EXPECT_EQ(image_file_.hash(), secondary_.getReceivedImageHash());
+  EXPECT_EQ(secondary_.getCompressedDataSize(), 0U);
+}
+
 TEST(SecondaryTcpServer, TestIpSecondaryIfSecondaryIsNotRunning) {
   in_port_t secondary_port = TestUtils::getFreePortAsInt();
   SecondaryInterface::Ptr ip_secondary;
@@ -857,16 +929,28 @@ class SecondaryRpcTestPositive : public ::testing::Test, public MsgHandler {
   std::thread secondary_server_thread_;
 };
 
-/* This test fails because the Secondary TCP server implementation is a
- * single-threaded, synchronous and blocking hence it cannot accept any new
- * connections until the current one is closed. Therefore, if a client/Primary
- * does not close its socket for some reason then Secondary becomes
- * "unavailable" */
-// TEST_F(SecondaryRpcTestPositive, primaryNotClosingSocket) {
-//  ConnectionSocket con_sock{"127.0.0.1", secondary_server_.port()};
-//  con_sock.connect();
-//  ASSERT_EQ(sendInstallMsg(), AKIpUptaneMes_PR_installResp);
-//}
+/* A Primary that does not close its socket must not make the Secondary
+ * "unavailable" for other connections. */
+TEST_F(SecondaryRpcTestPositive, primaryNotClosingSocket) {
+  ConnectionSocket con_sock{"127.0.0.1", secondary_server_.port()};
+  con_sock.connect();
+  ASSERT_EQ(sendInstallMsg(), AKIpUptaneMes_PR_installResp);
+}
+
+/* A Primary that stops in the middle of a message must not block other
+ * connections either. */
+TEST_F(SecondaryRpcTestPositive, primarySendingIncompleteMsg) {
+  Asn1Message::Ptr req(Asn1Message::Empty());
+  req->present(AKIpUptaneMes_PR_installReq);
+  SetString(&req->installReq()->hash, "target_name");
+  std::string encoded;
+  der_encode(&asn_DEF_AKIpUptaneMes, &req->msg_, Asn1StringAppendCallback, &encoded);
+
+  ConnectionSocket con_sock{"127.0.0.1", secondary_server_.port()};
+  con_sock.connect();
+  send(*con_sock, encoded.data(), encoded.size() / 2, 0);
+  ASSERT_EQ(sendInstallMsg(), AKIpUptaneMes_PR_installResp);
+}
 
 TEST_F(SecondaryRpcTestPositive, primaryConnectAndDisconnect) {
   ConnectionSocket{"127.0.0.1", secondary_server_.port()}.connect();
@@ -913,6 +997,74 @@ TEST_F(SecondaryRpcTestPositive, primaryConnectAndSendGarbage) {
   ASSERT_EQ(sendInstallMsg(), AKIpUptaneMes_PR_installResp);
 }
 
+/* Installation blocks until the test releases it, while information requests
+ * are registered as concurrent handlers. */
+class SecondaryRpcTestConcurrent : public ::testing::Test, public MsgDispatcher {
+ protected:
+  SecondaryRpcTestConcurrent() : secondary_server_{*this, "", 0} {
+    registerHandler(AKIpUptaneMes_PR_getInfoReq,
+                    std::bind(&SecondaryRpcTestConcurrent::getInfoHdlr, this, std::placeholders::_1,
+                              std::placeholders::_2),
+                    Concurrency::kConcurrent);
+    registerHandler(AKIpUptaneMes_PR_installReq,
+                    std::bind(&SecondaryRpcTestConcurrent::installHdlr, this, std::placeholders::_1,
+                              std::placeholders::_2));
+    secondary_server_thread_ = std::thread([&]() { secondary_server_.run(); });
+    secondary_server_.wait_until_running();
+  }
+
+  ~SecondaryRpcTestConcurrent() {
+    secondary_server_.stop();
+    secondary_server_thread_.join();
+  }
+
+  ReturnCode getInfoHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
+    (void)in_msg;
+    auto info_resp = out_msg.present(AKIpUptaneMes_PR_getInfoResp).getInfoResp();
+    SetString(&info_resp->ecuSerial, "serial");
+    SetString(&info_resp->hwId, "hw_id");
+    info_resp->keyType = static_cast<AKIpUptaneKeyType_t>(KeyType::kED25519);
+    SetString(&info_resp->key, "key");
+    return ReturnCode::kOk;
+  }
+
+  ReturnCode installHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
+    (void)in_msg;
+    install_started_.set_value();
+    install_release_.get_future().wait();
+    out_msg.present(AKIpUptaneMes_PR_installResp).installResp()->result = AKInstallationResultCode_ok;
+    return ReturnCode::kOk;
+  }
+
+  AKIpUptaneMes_PR sendMsg(AKIpUptaneMes_PR msg_id) {
+    Asn1Message::Ptr req(Asn1Message::Empty());
+    req->present(msg_id);
+    if (msg_id == AKIpUptaneMes_PR_installReq) {
+      SetString(&req->installReq()->hash, "target_name");
+    }
+    std::pair<std::string, uint16_t> secondary_server_addr{"127.0.0.1", secondary_server_.port()};
+    return Asn1Rpc(req, secondary_server_addr)->present();
+  }
+
+  std::promise<void> install_started_;
+  std::promise<void> install_release_;
+  SecondaryTcpServer secondary_server_;
+  std::thread secondary_server_thread_;
+};
+
+TEST_F(SecondaryRpcTestConcurrent, infoDuringInstall) {
+  auto install_result = std::async(std::launch::async, [this]() { return sendMsg(AKIpUptaneMes_PR_installReq); });
+  install_started_.get_future().wait();
+
+  // The installation is still in progress, but other requests are served
+  EXPECT_EQ(sendMsg(AKIpUptaneMes_PR_getInfoReq), AKIpUptaneMes_PR_getInfoResp);
+  EXPECT_EQ(sendMsg(AKIpUptaneMes_PR_getInfoReq), AKIpUptaneMes_PR_getInfoResp);
+  EXPECT_EQ(install_result.wait_for(std::chrono::milliseconds(0)), std::future_status::timeout);
+
+  install_release_.set_value();
+  EXPECT_EQ(install_result.get(), AKIpUptaneMes_PR_installResp);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
 
@@ -1,13 +1,27 @@
 #include "secondary_tcp_server.h"
 
+#include <fcntl.h>
 #include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <system_error>
 
 #include "AKInstallationResultCode.h"
 #include "AKIpUptaneMes.h"
 #include "asn1/asn1_message.h"
 #include "logging/logging.h"
 #include "msg_handler.h"
-#include "utilities/dequeue_buffer.h"
+
+struct SecondaryTcpServer::Session {
+  explicit Session(int fd) : socket(fd) {}
+
+  Socket socket;
+  Asn1Receiver receiver;
+  Asn1Message::Ptr request;
+  bool keep_open{true};
+};
 
 SecondaryTcpServer::SecondaryTcpServer(MsgHandler &msg_handler, const std::string &primary_ip, in_port_t primary_port,
                                        in_port_t port, bool reboot_after_install)
@@ -16,6 +30,14 @@ SecondaryTcpServer::SecondaryTcpServer(MsgHandler &msg_handler, const std::strin
       keep_running_(true),
       reboot_after_install_(reboot_after_install),
       is_running_(false) {
+  if (pipe(wake_pipe_) < 0) {
+    throw std::system_error(errno, std::system_category(), "pipe");
+  }
+  for (int fd : wake_pipe_) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+
   if (primary_ip.empty()) {
     return;
   }
@@ -29,50 +51,102 @@ SecondaryTcpServer::SecondaryTcpServer(MsgHandler &msg_handler, const std::strin
   }
 }
 
+SecondaryTcpServer::~SecondaryTcpServer() {
+  for (int fd : wake_pipe_) {
+    if (fd != -1) {
+      ::close(fd);
+    }
+  }
+}
+
 void SecondaryTcpServer::run() {
   if (listen(*listen_socket_, SOMAXCONN) < 0) {
     throw std::system_error(errno, std::system_category(), "listen");
   }
   LOG_INFO << "Secondary TCP server listening on " << listen_socket_.ToString();
 
+  {
+    std::unique_lock<std::mutex> lock(requests_mutex_);
+    workers_stop_ = false;
+  }
+  for (size_t i = 0; i < kWorkerThreads; ++i) {
+    workers_.emplace_back([this]() { workerLoop(); });
+  }
+
   {
     std::unique_lock<std::mutex> lock(running_condition_mutex_);
     is_running_ = true;
     running_condition_.notify_all();
   }
 
-  bool first_connection = true;
+  // Sessions waiting for data from the Primary. Sessions that are being served
+  // by a worker are not polled.
+  std::vector<SessionPtr> idle_sessions;
+  std::vector<pollfd> poll_fds;
 
   while (keep_running_.load()) {
-    sockaddr_storage peer_sa{};
-    socklen_t peer_sa_size = sizeof(sockaddr_storage);
-
-    LOG_DEBUG << "Waiting for connection from Primary...";
-    int con_fd = accept(*listen_socket_, reinterpret_cast<sockaddr *>(&peer_sa), &peer_sa_size);
-    if (con_fd == -1) {
-      // Accept can fail if a client closes connection/client socket before a TCP handshake completes or
-      // a network connection goes down in the middle of a TCP handshake procedure. At first glance it looks like
-      // we can just continue listening/accepting new connections in such cases instead of exiting from the server loop
-      // which leads to exiting of the overall daemon process.
-      // But, accept() failure, potentially can be caused by some incorrect state of the listening socket
-      // which means that it will keep returning error, so, exiting from the daemon process and letting
-      // systemd to restart it looks like the most reliable solution that covers all edge cases.
-      LOG_INFO << "Socket accept failed, aborting.";
+    std::deque<SessionPtr> finished;
+    {
+      std::unique_lock<std::mutex> lock(requests_mutex_);
+      finished.swap(finished_requests_);
+    }
+    for (auto &session : finished) {
+      resumeSession(std::move(session), idle_sessions);
+    }
+
+    poll_fds.clear();
+    poll_fds.push_back({wake_pipe_[0], POLLIN, 0});
+    poll_fds.push_back({*listen_socket_, POLLIN, 0});
+    for (const auto &session : idle_sessions) {
+      poll_fds.push_back({*session->socket, POLLIN, 0});
+    }
+
+    LOG_TRACE << "Waiting for requests from Primary...";
+    if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_ERROR << "Failed to poll server sockets: " << strerror(errno);
       break;
     }
 
-    if (first_connection) {
-      LOG_INFO << "Primary connected.";
-      first_connection = false;
-    } else {
-      LOG_DEBUG << "Primary reconnected.";
+    if (poll_fds[0].revents != 0) {
+      drainWakeUps();
     }
-    auto continue_running = HandleOneConnection(*Socket(con_fd));
-    if (!continue_running) {
-      keep_running_.store(false);
+
+    // Sessions that have been dropped or handed over to a worker are removed
+    // from idle_sessions, so collect the ready ones first.
+    std::vector<SessionPtr> ready_sessions;
+    for (size_t i = 2; i < poll_fds.size(); ++i) {
+      if (poll_fds[i].revents != 0) {
+        ready_sessions.push_back(idle_sessions[i - 2]);
+      }
     }
-    LOG_DEBUG << "Primary disconnected.";
+    for (const auto &session : ready_sessions) {
+      readSession(session, idle_sessions);
+    }
+
+    if ((poll_fds[1].revents & POLLIN) != 0) {
+      acceptConnection(idle_sessions);
+    } else if (poll_fds[1].revents != 0) {
+      LOG_INFO << "Listening socket failed, aborting.";
+      break;
+    }
+  }
+  keep_running_.store(false);
+
+  {
+    std::unique_lock<std::mutex> lock(requests_mutex_);
+    workers_stop_ = true;
+    pending_requests_.clear();
+    requests_condition_.notify_all();
+  }
+  // Requests that are already being handled are allowed to complete
+  for (auto &worker : workers_) {
+    worker.join();
   }
+  workers_.clear();
+  finished_requests_.clear();
 
   {
     std::unique_lock<std::mutex> lock(running_condition_mutex_);
@@ -86,87 +160,169 @@ void SecondaryTcpServer::run() {
 void SecondaryTcpServer::stop() {
   LOG_DEBUG << "Stopping Secondary TCP server...";
   keep_running_.store(false);
-  // unblock accept
-  ConnectionSocket("localhost", listen_socket_.port()).connect();
+  wakeUp();
 }
 
 in_port_t SecondaryTcpServer::port() const { return listen_socket_.port(); }
-SecondaryTcpServer::ExitReason SecondaryTcpServer::exit_reason() const { return exit_reason_; }
+SecondaryTcpServer::ExitReason SecondaryTcpServer::exit_reason() const { return exit_reason_.load(); }
+
+void SecondaryTcpServer::acceptConnection(std::vector<SessionPtr> &idle_sessions) {
+  sockaddr_storage peer_sa{};
+  socklen_t peer_sa_size = sizeof(sockaddr_storage);
+
+  int con_fd = accept(*listen_socket_, reinterpret_cast<sockaddr *>(&peer_sa), &peer_sa_size);
+  if (con_fd == -1) {
+    // Accept can fail if a client closes connection/client socket before a TCP handshake completes or
+    // a network connection goes down in the middle of a TCP handshake procedure. At first glance it looks like
+    // we can just continue listening/accepting new connections in such cases instead of exiting from the server loop
+    // which leads to exiting of the overall daemon process.
+    // But, accept() failure, potentially can be caused by some incorrect state of the listening socket
+    // which means that it will keep returning error, so, exiting from the daemon process and letting
+    // systemd to restart it looks like the most reliable solution that covers all edge cases.
+    LOG_INFO << "Socket accept failed, aborting.";
+    keep_running_.store(false);
+    return;
+  }
+  fcntl(con_fd, F_SETFD, FD_CLOEXEC);
+
+  LOG_DEBUG << "Primary connected, " << idle_sessions.size() + 1 << " idle session(s).";
+  idle_sessions.push_back(std::make_shared<Session>(con_fd));
+}
+
+void SecondaryTcpServer::readSession(const SessionPtr &session, std::vector<SessionPtr> &idle_sessions) {
+  auto status = session->receiver.read(*session->socket, session->request);
+  if (status == Asn1Receiver::Status::kIncomplete) {
+    return;
+  }
+
+  idle_sessions.erase(std::find(idle_sessions.begin(), idle_sessions.end(), session));
+  if (status == Asn1Receiver::Status::kMessage) {
+    enqueueRequest(session);
+  } else {
+    LOG_DEBUG << "Primary disconnected.";
+  }
+}
+
+void SecondaryTcpServer::resumeSession(SessionPtr session, std::vector<SessionPtr> &idle_sessions) {
+  if (!session->keep_open) {
+    LOG_DEBUG << "Primary session closed.";
+    return;
+  }
+
+  switch (session->receiver.decodeBuffered(session->request)) {
+    case Asn1Receiver::Status::kMessage:
+      enqueueRequest(std::move(session));
+      break;
+    case Asn1Receiver::Status::kIncomplete:
+      idle_sessions.push_back(std::move(session));
+      break;
+    default:
+      break;
+  }
+}
+
+void SecondaryTcpServer::enqueueRequest(SessionPtr session) {
+  std::unique_lock<std::mutex> lock(requests_mutex_);
+  pending_requests_.push_back(std::move(session));
+  requests_condition_.notify_one();
+}
+
+void SecondaryTcpServer::workerLoop() {
+  while (true) {
+    SessionPtr session;
+    {
+      std::unique_lock<std::mutex> lock(requests_mutex_);
+      requests_condition_.wait(lock, [this] { return workers_stop_ || !pending_requests_.empty(); });
+      if (workers_stop_) {
+        return;
+      }
+      session = std::move(pending_requests_.front());
+      pending_requests_.pop_front();
+    }
+
+    Asn1Message::Ptr request_msg;
+    request_msg.swap(session->request);
+    bool keep_running_server = true;
+    session->keep_open = HandleRequest(*session->socket, request_msg, keep_running_server);
+    if (!keep_running_server) {
+      keep_running_.store(false);
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(requests_mutex_);
+      finished_requests_.push_back(std::move(session));
+    }
+    wakeUp();
+  }
+}
+
+void SecondaryTcpServer::wakeUp() {
+  const char c = 0;
+  // The pipe being full means that a wake-up is already pending
+  if (write(wake_pipe_[1], &c, 1) < 0 && errno != EAGAIN) {
+    LOG_ERROR << "Failed to wake up Secondary TCP server: " << strerror(errno);
+  }
+}
+
+void SecondaryTcpServer::drainWakeUps() {
+  std::array<char, 64> buf{};
+  while (read(wake_pipe_[0], buf.data(), buf.size()) > 0) {
+  }
+}
 
 static bool sendResponseMessage(int socket_fd, const Asn1Message::Ptr &resp_msg);
 
 bool SecondaryTcpServer::HandleOneConnection(int socket) {
   // Outside the message loop, because one recv() may have parts of 2 messages
-  // Note that one recv() call returning 2+ messages doesn't work at the
-  // moment. This shouldn't be a problem until we have messages that aren't
-  // strictly request/response
-  DequeueBuffer buffer;
+  Asn1Receiver receiver;
   bool keep_running_server = true;
   bool keep_running_current_session = true;
 
   while (keep_running_current_session) {  // Keep reading until we get an error
-    // Read an incoming message
-    AKIpUptaneMes_t *m = nullptr;
-    asn_dec_rval_t res{};
-    asn_codec_ctx_s context{};
-    ssize_t received;
-
-    do {
-      received = recv(socket, buffer.Tail(), buffer.TailSpace(), 0);
-      if (received < 0) {
-        LOG_ERROR << "Failed to read data from a server socket: " << strerror(errno);
-        break;
-      }
-      buffer.HaveEnqueued(static_cast<size_t>(received));
-      res = ber_decode(&context, &asn_DEF_AKIpUptaneMes, reinterpret_cast<void **>(&m), buffer.Head(), buffer.Size());
-      buffer.Consume(res.consumed);
-    } while (res.code == RC_WMORE && received > 0);
-    // Note that ber_decode allocates *m even on failure, so this must always be done
-    Asn1Message::Ptr request_msg = Asn1Message::FromRaw(&m);
-
-    if (received == 0) {
-      LOG_TRACE << "Primary has closed a connection socket";
-      break;
+    Asn1Message::Ptr request_msg;
+    auto status = receiver.decodeBuffered(request_msg);
+    while (status == Asn1Receiver::Status::kIncomplete) {
+      status = receiver.read(socket, request_msg);
     }
-
-    if (received < 0) {
-      LOG_ERROR << "Error while reading message data from a socket: " << strerror(errno);
+    if (status != Asn1Receiver::Status::kMessage) {
       break;
     }
 
-    if (res.code != RC_OK) {
-      LOG_ERROR << "Failed to decode a message received from Primary";
-      break;
-    }
+    keep_running_current_session = HandleRequest(socket, request_msg, keep_running_server);
+  }  // Go back round and read another message
 
-    LOG_DEBUG << "Received a request from Primary: " << request_msg->toStr();
-    Asn1Message::Ptr response_msg = Asn1Message::Empty();
-    MsgHandler::ReturnCode handle_status_code = msg_handler_.handleMsg(request_msg, response_msg);
+  return keep_running_server;
+}
 
-    switch (handle_status_code) {
-      case MsgHandler::ReturnCode::kRebootRequired: {
-        exit_reason_ = ExitReason::kRebootNeeded;
-        keep_running_current_session = sendResponseMessage(socket, response_msg);
-        if (reboot_after_install_) {
-          keep_running_server = keep_running_current_session = false;
-        }
-        break;
-      }
-      case MsgHandler::ReturnCode::kOk: {
-        keep_running_current_session = sendResponseMessage(socket, response_msg);
-        break;
-      }
-      case MsgHandler::ReturnCode::kUnkownMsg:
-      default: {
-        // TODO: consider sending NOT_SUPPORTED/Unknown message and closing connection socket
-        keep_running_current_session = false;
-        LOG_INFO << "Unsupported message received from Primary: " << request_msg->toStr();
-      }
-    }  // switch
+bool SecondaryTcpServer::HandleRequest(int socket, const Asn1Message::Ptr &request_msg, bool &keep_running_server) {
+  bool keep_running_current_session = true;
 
-  }  // Go back round and read another message
+  LOG_DEBUG << "Received a request from Primary: " << request_msg->toStr();
+  Asn1Message::Ptr response_msg = Asn1Message::Empty();
+  MsgHandler::ReturnCode handle_status_code = msg_handler_.handleMsg(request_msg, response_msg);
 
-  return keep_running_server;
+  switch (handle_status_code) {
+    case MsgHandler::ReturnCode::kRebootRequired: {
+      exit_reason_.store(ExitReason::kRebootNeeded);
+      keep_running_current_session = sendResponseMessage(socket, response_msg);
+      if (reboot_after_install_) {
+        keep_running_server = keep_running_current_session = false;
+      }
+      break;
+    }
+    case MsgHandler::ReturnCode::kOk: {
+      keep_running_current_session = sendResponseMessage(socket, response_msg);
+      break;
+    }
+    case MsgHandler::ReturnCode::kUnkownMsg:
+    default: {
+      // TODO: consider sending NOT_SUPPORTED/Unknown message and closing connection socket
+      keep_running_current_session = false;
+      LOG_INFO << "Unsupported message received from Primary: " << request_msg->toStr();
+    }
+  }  // switch
+
+  return keep_running_current_session;
   // Parse error => Shutdown the socket
   // write error => Shutdown the socket
   // Timeout on write => shutdown
@@ -179,13 +335,16 @@ void SecondaryTcpServer::wait_until_running(int timeout) {
 
 bool sendResponseMessage(int socket_fd, const Asn1Message::Ptr &resp_msg) {
   LOG_DEBUG << "Encoding and sending response message";
+  // One per worker thread, so that its buffer is reused
+  static thread_local Asn1Encoder encoder;
 
   int optval = 0;
   setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(int));
-  asn_enc_rval_t encode_result = der_encode(&asn_DEF_AKIpUptaneMes, &resp_msg->msg_, Asn1SocketWriteCallback,
-                                            reinterpret_cast<void *>(&socket_fd));
-  if (encode_result.encoded == -1) {
+  if (!encoder.encode(resp_msg)) {
     LOG_ERROR << "Failed to encode a response message";
+    return false;
+  }
+  if (!encoder.send(socket_fd)) {
     return false;  // write error
   }
   optval = 1;
@@ -3,15 +3,27 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include "utilities/utils.h"
 
+#include "asn1/asn1_message.h"
+
 class MsgHandler;
 
 /**
  * Listens on a socket, decodes calls (ASN.1) and forwards them to an Uptane Secondary
- * implementation
+ * implementation.
+ *
+ * Several Primary sessions can be open at the same time: a single thread polls
+ * the listening socket and all idle sessions and decodes requests as their data
+ * arrives, while complete requests are handled by a small pool of worker
+ * threads. A stalled session or a long-running installation therefore does not
+ * prevent other sessions from being served.
  */
 class SecondaryTcpServer {
  public:
@@ -23,7 +35,7 @@ class SecondaryTcpServer {
 
   SecondaryTcpServer(MsgHandler& msg_handler, const std::string& primary_ip, in_port_t primary_port, in_port_t port = 0,
                      bool reboot_after_install = false);
-  ~SecondaryTcpServer() = default;
+  ~SecondaryTcpServer();
   SecondaryTcpServer(const SecondaryTcpServer&) = delete;
   SecondaryTcpServer(SecondaryTcpServer&&) = delete;
   SecondaryTcpServer& operator=(const SecondaryTcpServer&) = delete;
@@ -41,13 +53,39 @@ class SecondaryTcpServer {
   ExitReason exit_reason() const;
 
  private:
+  // Number of requests that can be handled at the same time
+  static constexpr size_t kWorkerThreads{4};
+
+  struct Session;
+  using SessionPtr = std::shared_ptr<Session>;
+
   bool HandleOneConnection(int socket);
+  bool HandleRequest(int socket, const Asn1Message::Ptr& request_msg, bool& keep_running_server);
+  void acceptConnection(std::vector<SessionPtr>& idle_sessions);
+  void readSession(const SessionPtr& session, std::vector<SessionPtr>& idle_sessions);
+  void resumeSession(SessionPtr session, std::vector<SessionPtr>& idle_sessions);
+  void enqueueRequest(SessionPtr session);
+  void workerLoop();
+  void wakeUp();
+  void drainWakeUps();
 
   MsgHandler& msg_handler_;
   ListenSocket listen_socket_;
   std::atomic<bool> keep_running_;
   bool reboot_after_install_;
-  ExitReason exit_reason_{ExitReason::kNotApplicable};
+  std::atomic<ExitReason> exit_reason_{ExitReason::kNotApplicable};
+
+  // Self-pipe to interrupt poll() from stop() and from the worker threads
+  int wake_pipe_[2]{-1, -1};
+
+  std::vector<std::thread> workers_;
+  std::mutex requests_mutex_;
+  std::condition_variable requests_condition_;
+  bool workers_stop_{false};
+  // Sessions with a complete request waiting for a worker
+  std::deque<SessionPtr> pending_requests_;
+  // Sessions whose request has been handled, to be polled again
+  std::deque<SessionPtr> finished_requests_;
 
   bool is_running_;
   std::mutex running_condition_mutex_;
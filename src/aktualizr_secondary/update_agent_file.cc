@@ -1,11 +1,18 @@
 #include "update_agent_file.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <boost/filesystem.hpp>
 
+#include <cerrno>
+#include <cstring>
 #include <fstream>
 #include "crypto/crypto.h"
 #include "logging/logging.h"
 #include "uptane/manifest.h"
+#include "utilities/utils.h"
 
 // TODO(OTA-4939): Unify this with the check in
 // SotaUptaneClient::getNewTargets() and make it more generic.
@@ -29,7 +36,15 @@ bool FileUpdateAgent::getInstalledImageInfo(Uptane::InstalledImageInfo& installe
   return true;
 }
 
+FileUpdateAgent::~FileUpdateAgent() { closeNewTarget(false); }
+
 data::InstallationResult FileUpdateAgent::install(const Uptane::Target& target) {
+  decompressor_.reset();
+  if (!closeNewTarget(true)) {
+    discardNewTarget();
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                    "Failed to write the new target image");
+  }
   if (!boost::filesystem::exists(new_target_filepath_)) {
     LOG_ERROR << "The target image has not been received";
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
@@ -40,20 +55,28 @@ data::InstallationResult FileUpdateAgent::install(const Uptane::Target& target)
   if (received_target_image_size != target.length()) {
     LOG_ERROR << "Received image size does not match the size specified in Target metadata: "
               << received_target_image_size << " != " << target.length();
-    boost::filesystem::remove(new_target_filepath_);
+    discardNewTarget();
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
                                     "Received image size does not match the size specified in Target metadata: " +
                                         std::to_string(received_target_image_size) +
                                         " != " + std::to_string(target.length()));
   }
 
-  if (!target.MatchHash(new_target_hasher_->getHash())) {
-    LOG_ERROR << "The received image's hash does not match the hash specified in Target metadata: "
-              << new_target_hasher_->getHash() << " != " << getTargetHash(target).HashString();
+  if (new_target_hasher_ == nullptr && !loadHasherState(target)) {
+    LOG_ERROR << "The image received before a restart cannot be verified and has to be sent again";
+    discardNewTarget();
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                    "The image received before a restart cannot be verified and has to be sent again");
+  }
+
+  const Hash received_hash = new_target_hasher_->getHash();
+  if (!target.MatchHash(received_hash)) {
+    LOG_ERROR << "The received image's hash does not match the hash specified in Target metadata: " << received_hash
+              << " != " << getTargetHash(target).HashString();
+    discardNewTarget();
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
                                     "The received image's hash does not match the hash specified in Target metadata: " +
-                                        new_target_hasher_->getHash().HashString() +
-                                        " != " + getTargetHash(target).HashString());
+                                        received_hash.HashString() + " != " + getTargetHash(target).HashString());
   }
 
   boost::filesystem::rename(new_target_filepath_, target_filepath_);
@@ -69,7 +92,7 @@ data::InstallationResult FileUpdateAgent::install(const Uptane::Target& target)
   }
 
   current_target_name_ = target.filename();
-  new_target_hasher_.reset();
+  discardNewTarget();
   return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
 }
 
@@ -82,65 +105,211 @@ data::InstallationResult FileUpdateAgent::applyPendingInstall(const Uptane::Targ
 }
 
 data::InstallationResult FileUpdateAgent::receiveData(const Uptane::Target& target, const uint8_t* data, size_t size) {
-  std::ofstream target_file(new_target_filepath_.c_str(),
-                            std::ofstream::out | std::ofstream::binary | std::ofstream::app);
+  if (new_target_fd_ < 0) {
+    auto result = openNewTarget(target);
+    if (!result.isSuccess()) {
+      return result;
+    }
+  }
+
+  if (received_size_ >= target.length()) {
+    LOG_ERROR << "The size of the received image data exceeds the expected Target image size: " << received_size_
+              << " != " << target.length();
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                    "The size of the received image data exceeds the expected Target image size: " +
+                                        std::to_string(received_size_) + " != " + std::to_string(target.length()));
+  }
+
+  write_buffer_.append(reinterpret_cast<const char*>(data), size);
+  received_size_ += size;
+  new_target_hasher_->update(data, size);
+
+  LOG_DEBUG << "Received and stored data of a new target image."
+               " Received in this request (bytes): "
+            << size << "; total received so far: " << received_size_ << "; expected total: " << target.length();
 
-  if (!target_file.good()) {
-    LOG_ERROR << "Failed to open a new target image file";
+  if (received_size_ >= target.length()) {
+    // The image is complete: make it durable along with the state of its hash
+    if (!closeNewTarget(true)) {
+      discardNewTarget();
+      return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                      "Failed to write the new target image");
+    }
+    saveHasherState(target);
+    if (received_size_ == target.length()) {
+      LOG_INFO << "Successfully received and stored new target image of " << received_size_ << " bytes.";
+    }
+  } else if (write_buffer_.size() >= kWriteBufferSize && !flushNewTarget()) {
+    LOG_ERROR << "Failed to write the new target image: " << std::strerror(errno);
+    discardNewTarget();
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                    "Failed to write the new target image");
+  }
+
+  return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+}
+
+data::InstallationResult FileUpdateAgent::receiveData(const Uptane::Target& target, const uint8_t* data, size_t size,
+                                                      Uptane::UploadCompression compression) {
+  if (compression == Uptane::UploadCompression::kNone) {
+    return receiveData(target, data, size);
+  }
+
+  // Anything but the continuation of the current compressed stream starts a new one
+  if (!decompressor_ || decompressor_->finished() || decompressed_target_ != target.filename() ||
+      decompressed_offset_ + decompressor_->output_size() != received_size_) {
+    try {
+      decompressor_ = std_::make_unique<Uptane::StreamDecompressor>(compression);
+    } catch (const std::exception& e) {
+      LOG_ERROR << "Failed to start the decompression of the received data: " << e.what();
+      return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                      std::string("Failed to start the decompression of the received data: ") +
+                                          e.what());
+    }
+    decompressed_target_ = target.filename();
+    decompressed_offset_ = received_size_;
+  }
+
+  auto result = data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+  try {
+    decompressor_->decompress(data, size, [this, &target, &result](const uint8_t* out, size_t out_size) {
+      result = receiveData(target, out, out_size);
+      return result.isSuccess();
+    });
+  } catch (const std::exception& e) {
+    LOG_ERROR << "Failed to decompress the received data: " << e.what();
+    result = data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                      std::string("Failed to decompress the received data: ") + e.what());
+  }
+  if (!result.isSuccess()) {
+    decompressor_.reset();
+  }
+  return result;
+}
+
+Hash FileUpdateAgent::getTargetHash(const Uptane::Target& target) {
+  // TODO(OTA-4831): check target.hashes() size.
+  return target.hashes()[0];
+}
+
+data::InstallationResult FileUpdateAgent::openNewTarget(const Uptane::Target& target) {
+  new_target_fd_ = ::open(new_target_filepath_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (new_target_fd_ < 0) {
+    LOG_ERROR << "Failed to open a new target image file: " << std::strerror(errno);
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
                                     "Failed to open a new target image file");
   }
 
-  auto current_new_image_size = target_file.tellp();
-  if (-1 == current_new_image_size) {
+  struct stat st {};
+  if (::fstat(new_target_fd_, &st) != 0) {
     LOG_ERROR << "Failed to obtain a size of the new target image that is being uploaded";
-    target_file.close();
+    closeNewTarget(false);
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
                                     "Failed to obtain a size of the new target image that is being uploaded");
   }
+  received_size_ = static_cast<uint64_t>(st.st_size);
 
-  if (static_cast<uint64_t>(current_new_image_size) >= target.length()) {
-    LOG_ERROR << "The size of the received image data exceeds the expected Target image size: "
-              << current_new_image_size << " != " << target.length();
-    target_file.close();
-    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
-                                    "The size of the received image data exceeds the expected Target image size: " +
-                                        std::to_string(current_new_image_size) +
-                                        " != " + std::to_string(target.length()));
+  // Left over from before a restart: the Primary sends the image from the
+  // start again.
+  if (received_size_ > 0 && new_target_hasher_ == nullptr) {
+    LOG_WARNING << "Discarding " << received_size_ << " bytes of a previously received target image";
+    if (::ftruncate(new_target_fd_, 0) != 0) {
+      LOG_ERROR << "Failed to discard the previously received target image: " << std::strerror(errno);
+      closeNewTarget(false);
+      return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                      "Failed to discard the previously received target image");
+    }
+    received_size_ = 0;
   }
-
-  if (current_new_image_size == 0) {
+  if (received_size_ == 0) {
     new_target_hasher_ = MultiPartHasher::create(getTargetHash(target).type());
+    boost::system::error_code ec;
+    boost::filesystem::remove(hasher_state_filepath_, ec);
   }
 
-  target_file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
-  auto written_data_size = target_file.tellp() - current_new_image_size;
-
-  if (written_data_size < 0 || static_cast<size_t>(written_data_size) != size) {
-    LOG_ERROR << "The size of data written is not equal to the received data size: " << written_data_size
-              << " != " << size;
-    target_file.close();
-    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
-                                    "The size of data written is not equal to the received data size: " +
-                                        std::to_string(written_data_size) + " != " + std::to_string(size));
+  // Reserve the space without changing the size of the file, which is checked
+  // on installation. Not all file systems support it.
+  if (target.length() > received_size_ &&
+      ::fallocate(new_target_fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(received_size_),
+                  static_cast<off_t>(target.length() - received_size_)) != 0) {
+    LOG_DEBUG << "Could not preallocate the new target image: " << std::strerror(errno);
   }
+  write_buffer_.reserve(kWriteBufferSize);
+  return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+}
 
-  target_file.close();
+bool FileUpdateAgent::flushNewTarget() {
+  size_t written = 0;
+  while (written < write_buffer_.size()) {
+    const ssize_t res = ::write(new_target_fd_, write_buffer_.data() + written, write_buffer_.size() - written);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += static_cast<size_t>(res);
+  }
+  write_buffer_.clear();
+  return true;
+}
 
-  auto total_size = current_new_image_size + written_data_size;
-  LOG_DEBUG << "Received and stored data of a new target image."
-               " Received in this request (bytes): "
-            << size << "; total received so far: " << total_size << "; expected total: " << target.length();
-  if (static_cast<uint64_t>(total_size) == target.length()) {
-    LOG_INFO << "Successfully received and stored new target image of " << total_size << " bytes.";
+bool FileUpdateAgent::closeNewTarget(bool sync) {
+  if (new_target_fd_ < 0) {
+    return true;
+  }
+  bool res = flushNewTarget() && (!sync || ::fsync(new_target_fd_) == 0);
+  if (!res) {
+    LOG_ERROR << "Failed to write the new target image: " << std::strerror(errno);
+  }
+  if (::close(new_target_fd_) != 0) {
+    res = false;
   }
+  new_target_fd_ = -1;
+  std::string().swap(write_buffer_);
+  return res;
+}
 
-  new_target_hasher_->update(data, size);
+void FileUpdateAgent::discardNewTarget() {
+  closeNewTarget(false);
+  boost::system::error_code ec;
+  boost::filesystem::remove(new_target_filepath_, ec);
+  boost::filesystem::remove(hasher_state_filepath_, ec);
+  new_target_hasher_.reset();
+  received_size_ = 0;
+}
 
-  return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+void FileUpdateAgent::saveHasherState(const Uptane::Target& target) const {
+  Json::Value state;
+  state["target"] = target.filename();
+  state["size"] = static_cast<Json::UInt64>(received_size_);
+  state["hasher"] = Utils::toBase64(new_target_hasher_->getState());
+  try {
+    Utils::writeFile(hasher_state_filepath_, state);
+  } catch (const std::exception& e) {
+    LOG_WARNING << "Could not save the state of the received image's hash: " << e.what();
+  }
 }
 
-Hash FileUpdateAgent::getTargetHash(const Uptane::Target& target) {
-  // TODO(OTA-4831): check target.hashes() size.
-  return target.hashes()[0];
+bool FileUpdateAgent::loadHasherState(const Uptane::Target& target) {
+  if (!boost::filesystem::exists(hasher_state_filepath_)) {
+    return false;
+  }
+  try {
+    const Json::Value state = Utils::parseJSONFile(hasher_state_filepath_);
+    const uint64_t size = boost::filesystem::file_size(new_target_filepath_);
+    if (state["target"].asString() != target.filename() || state["size"].asUInt64() != size) {
+      return false;
+    }
+    auto hasher = MultiPartHasher::create(getTargetHash(target).type());
+    if (!hasher->setState(Utils::fromBase64(state["hasher"].asString()))) {
+      return false;
+    }
+    new_target_hasher_ = hasher;
+    received_size_ = size;
+    return true;
+  } catch (const std::exception& e) {
+    LOG_WARNING << "Could not load the state of the received image's hash: " << e.what();
+    return false;
+  }
 }
@@ -1,6 +1,7 @@
 #ifndef AKTUALIZR_SECONDARY_UPDATE_AGENT_FILE_H
 #define AKTUALIZR_SECONDARY_UPDATE_AGENT_FILE_H
 
+#include "compression.h"
 #include "update_agent.h"
 
 class FileUpdateAgent : public UpdateAgent {
@@ -8,24 +9,52 @@ class FileUpdateAgent : public UpdateAgent {
   FileUpdateAgent(boost::filesystem::path target_filepath, std::string target_name)
       : target_filepath_{std::move(target_filepath)},
         new_target_filepath_{target_filepath_.string() + ".newtarget"},
+        hasher_state_filepath_{target_filepath_.string() + ".newtarget.state"},
         current_target_name_{std::move(target_name)} {}
+  ~FileUpdateAgent() override;
+  FileUpdateAgent(const FileUpdateAgent&) = delete;
+  FileUpdateAgent(FileUpdateAgent&&) = delete;
+  FileUpdateAgent& operator=(const FileUpdateAgent&) = delete;
+  FileUpdateAgent& operator=(FileUpdateAgent&&) = delete;
 
   bool isTargetSupported(const Uptane::Target& target) const override;
   bool getInstalledImageInfo(Uptane::InstalledImageInfo& installed_image_info) const override;
 
   virtual data::InstallationResult receiveData(const Uptane::Target& target, const uint8_t* data, size_t size);
+  // Decompress the data on the fly and hand it over to receiveData() above
+  data::InstallationResult receiveData(const Uptane::Target& target, const uint8_t* data, size_t size,
+                                       Uptane::UploadCompression compression);
   data::InstallationResult install(const Uptane::Target& target) override;
 
   void completeInstall() override;
   data::InstallationResult applyPendingInstall(const Uptane::Target& target) override;
 
  private:
+  // Received data is written in large blocks rather than piece by piece
+  static constexpr size_t kWriteBufferSize{1024 * 1024};
+
   static Hash getTargetHash(const Uptane::Target& target);
+  data::InstallationResult openNewTarget(const Uptane::Target& target);
+  bool flushNewTarget();
+  bool closeNewTarget(bool sync);
+  void discardNewTarget();
+  void saveHasherState(const Uptane::Target& target) const;
+  bool loadHasherState(const Uptane::Target& target);
 
   const boost::filesystem::path target_filepath_;
   const boost::filesystem::path new_target_filepath_;
+  // Lets a fully received image be installed after a restart
+  const boost::filesystem::path hasher_state_filepath_;
   std::string current_target_name_;
   std::shared_ptr<MultiPartHasher> new_target_hasher_;
+  // The image being received, open from its first piece until it is complete
+  int new_target_fd_{-1};
+  std::string write_buffer_;
+  uint64_t received_size_{0};
+  // State of the compressed upload in progress, if any
+  std::unique_ptr<Uptane::StreamDecompressor> decompressor_;
+  std::string decompressed_target_;
+  uint64_t decompressed_offset_{0};
 };
 
 #endif  // AKTUALIZR_SECONDARY_UPDATE_AGENT_FILE_H
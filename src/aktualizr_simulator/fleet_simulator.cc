@@ -0,0 +1,332 @@
+#include "fleet_simulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <thread>
+
+#include <sodium.h>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "http/httpclient.h"
+#include "logging/logging.h"
+#include "primary/sotauptaneclient.h"
+#include "storage/invstorage.h"
+#include "utilities/utils.h"
+#include "virtualsecondary.h"
+
+namespace fs = boost::filesystem;
+
+void LatencyStats::record(const std::string &phase, Duration latency) {
+  std::lock_guard<std::mutex> guard(m_);
+  phases_[phase].samples.push_back(latency);
+}
+
+void LatencyStats::recordFailure(const std::string &phase) {
+  std::lock_guard<std::mutex> guard(m_);
+  ++phases_[phase].failures;
+}
+
+std::vector<std::string> LatencyStats::phases() const {
+  std::lock_guard<std::mutex> guard(m_);
+  std::vector<std::string> res;
+  for (const auto &phase : phases_) {
+    res.push_back(phase.first);
+  }
+  return res;
+}
+
+size_t LatencyStats::count(const std::string &phase) const {
+  std::lock_guard<std::mutex> guard(m_);
+  const auto it = phases_.find(phase);
+  return it == phases_.end() ? 0 : it->second.samples.size();
+}
+
+size_t LatencyStats::failures(const std::string &phase) const {
+  std::lock_guard<std::mutex> guard(m_);
+  const auto it = phases_.find(phase);
+  return it == phases_.end() ? 0 : it->second.failures;
+}
+
+LatencyStats::Duration LatencyStats::percentile(const std::string &phase, double p) const {
+  std::vector<Duration> samples;
+  {
+    std::lock_guard<std::mutex> guard(m_);
+    const auto it = phases_.find(phase);
+    if (it != phases_.end()) {
+      samples = it->second.samples;
+    }
+  }
+  return percentileOf(std::move(samples), p);
+}
+
+LatencyStats::Duration LatencyStats::percentileOf(std::vector<Duration> samples, double p) {
+  if (samples.empty()) {
+    return Duration::zero();
+  }
+  p = std::min(std::max(p, 0.), 100.);
+  // Nearest-rank method: the smallest sample such that p% of the samples are
+  // less than or equal to it.
+  auto rank = static_cast<size_t>(std::ceil(p / 100. * static_cast<double>(samples.size())));
+  rank = std::max<size_t>(rank, 1);
+  const auto nth = samples.begin() + static_cast<std::ptrdiff_t>(rank - 1);
+  std::nth_element(samples.begin(), nth, samples.end());
+  return *nth;
+}
+
+Json::Value LatencyStats::toJson() const {
+  Json::Value res(Json::objectValue);
+  for (const auto &phase : phases()) {
+    Json::Value &entry = res[phase];
+    entry["count"] = static_cast<Json::UInt64>(count(phase));
+    entry["failures"] = static_cast<Json::UInt64>(failures(phase));
+    for (const double p : {50., 90., 99., 100.}) {
+      const std::string key = p < 100. ? "p" + std::to_string(static_cast<int>(p)) + "_us" : "max_us";
+      entry[key] = static_cast<Json::Int64>(percentile(phase, p).count());
+    }
+  }
+  return res;
+}
+
+void LatencyStats::print(std::ostream &os) const {
+  const auto to_ms = [](Duration d) { return static_cast<double>(d.count()) / 1000.; };
+
+  os << std::left << std::setw(16) << "phase" << std::right << std::setw(10) << "count" << std::setw(10) << "failed"
+     << std::setw(12) << "p50 (ms)" << std::setw(12) << "p90 (ms)" << std::setw(12) << "p99 (ms)" << std::setw(12)
+     << "max (ms)" << "\n";
+  os << std::fixed << std::setprecision(1);
+  for (const auto &phase : phases()) {
+    os << std::left << std::setw(16) << phase << std::right << std::setw(10) << count(phase) << std::setw(10)
+       << failures(phase) << std::setw(12) << to_ms(percentile(phase, 50)) << std::setw(12)
+       << to_ms(percentile(phase, 90)) << std::setw(12) << to_ms(percentile(phase, 99)) << std::setw(12)
+       << to_ms(percentile(phase, 100)) << "\n";
+  }
+}
+
+SimulatedDevice::SimulatedDevice(Config config, std::shared_ptr<HttpInterface> http,
+                                 const FleetSimulatorConfig &sim_config, LatencyStats &stats,
+                                 const api::FlowControlToken *flow_control)
+    : config_(std::move(config)),
+      http_(std::move(http)),
+      sim_config_(sim_config),
+      stats_(stats),
+      flow_control_(flow_control) {
+  storage_ = INvStorage::newStorage(config_.storage);
+  storage_->importData(config_.import);
+}
+
+void SimulatedDevice::start() {
+  auto client = std_::make_unique<SotaUptaneClient>(config_, storage_, http_, nullptr, flow_control_);
+
+  for (int i = 0; i < sim_config_.secondaries; ++i) {
+    const fs::path sec_dir = config_.storage.path / ("secondary-" + std::to_string(i));
+    Utils::createDirectories(sec_dir, S_IRWXU);
+
+    Primary::VirtualSecondaryConfig sec_config;
+    sec_config.partial_verifying = false;
+    sec_config.full_client_dir = sec_dir;
+    sec_config.ecu_serial = config_.storage.path.filename().string() + "-secondary-" + std::to_string(i);
+    sec_config.ecu_hardware_id = sim_config_.secondary_hardware_id;
+    sec_config.ecu_private_key = "sec.priv";
+    sec_config.ecu_public_key = "sec.pub";
+    sec_config.firmware_path = sec_dir / "firmware.txt";
+    sec_config.target_name_path = sec_dir / "firmware_name.txt";
+    sec_config.metadata_path = sec_dir / "secondary_metadata";
+    sec_config.key_type = config_.uptane.key_type;
+    client->addSecondary(std::make_shared<Primary::VirtualSecondary>(sec_config));
+  }
+
+  client->initialize();
+  client_ = std::move(client);
+}
+
+// Defined here, where SotaUptaneClient is a complete type
+SimulatedDevice::~SimulatedDevice() = default;
+
+template <typename T>
+T SimulatedDevice::timed(const std::string &phase, const std::function<T()> &operation) {
+  const auto start = std::chrono::steady_clock::now();
+  try {
+    T result = operation();
+    stats_.record(phase, std::chrono::duration_cast<LatencyStats::Duration>(std::chrono::steady_clock::now() - start));
+    return result;
+  } catch (...) {
+    stats_.record(phase, std::chrono::duration_cast<LatencyStats::Duration>(std::chrono::steady_clock::now() - start));
+    stats_.recordFailure(phase);
+    throw;
+  }
+}
+
+void SimulatedDevice::cycle() {
+  if (!client_) {
+    // Like a freshly started aktualizr: provisions if needed and finalizes
+    // updates that were pending before the (simulated) reboot
+    timed<bool>("initialize", [this]() {
+      start();
+      return true;
+    });
+  }
+  if (!sent_device_data_) {
+    timed<bool>("device_data", [this]() {
+      client_->sendDeviceData();
+      return true;
+    });
+    sent_device_data_ = true;
+  }
+
+  const auto update_result =
+      timed<result::UpdateCheck>("check_updates", [this]() { return client_->fetchMeta(); });
+  if (update_result.status == result::UpdateStatus::kError) {
+    stats_.recordFailure("check_updates");
+  }
+
+  if (!update_result.updates.empty()) {
+    const auto download_result = timed<result::Download>(
+        "download", [this, &update_result]() { return client_->downloadImages(update_result.updates); });
+    if (download_result.status == result::DownloadStatus::kSuccess && !download_result.updates.empty()) {
+      const auto install_result = timed<result::Install>(
+          "install", [this, &download_result]() { return client_->uptaneInstall(download_result.updates); });
+      if (!install_result.dev_report.isSuccess() && !install_result.dev_report.needCompletion()) {
+        stats_.recordFailure("install");
+      }
+      if (client_->isInstallCompletionRequired()) {
+        // Simulate a reboot; the client is recreated at the start of the next cycle
+        client_->completeInstall();
+        client_.reset();
+        return;
+      }
+    } else if (download_result.status != result::DownloadStatus::kNothingToDownload) {
+      stats_.recordFailure("download");
+    }
+  }
+
+  const bool manifest_sent = timed<bool>("manifest", [this]() { return client_->putManifest(); });
+  if (!manifest_sent) {
+    stats_.recordFailure("manifest");
+  }
+}
+
+struct FleetSimulator::Slot {
+  Slot(boost::asio::io_context &io, int index_in) : timer(io), index(index_in) {}
+
+  boost::asio::steady_timer timer;
+  const int index;
+  api::FlowControlToken flow_control;
+  std::unique_ptr<SimulatedDevice> device;
+  int cycles_done{0};
+};
+
+FleetSimulator::FleetSimulator(const Config &base_config, FleetSimulatorConfig sim_config, HttpFactory http_factory)
+    : base_config_(base_config),
+      sim_config_(std::move(sim_config)),
+      http_factory_(std::move(http_factory)),
+      rng_(std::random_device{}()) {
+  if (sodium_init() == -1) {  // Note that sodium_init doesn't require a matching 'sodium_deinit'
+    throw std::runtime_error("Unable to initialize libsodium");
+  }
+  if (sim_config_.devices <= 0 || sim_config_.threads <= 0 || sim_config_.secondaries < 0 || sim_config_.cycles < 0) {
+    throw std::invalid_argument("Invalid fleet simulator configuration");
+  }
+  if (!http_factory_) {
+    http_factory_ = []() { return std::make_shared<HttpClient>(); };
+  }
+
+  // Each device generates its own identity and talks to its own Secondaries
+  base_config_.provision.device_id.clear();
+  base_config_.provision.primary_ecu_serial.clear();
+  base_config_.uptane.secondary_config_file.clear();
+
+  for (int i = 0; i < sim_config_.devices; ++i) {
+    slots_.push_back(std::make_shared<Slot>(io_, i));
+  }
+}
+
+FleetSimulator::~FleetSimulator() {
+  stop();
+  // Devices have to go before the io_context which owns their timers
+  slots_.clear();
+}
+
+void FleetSimulator::run() {
+  auto work = boost::asio::make_work_guard(io_);
+  active_devices_ = sim_config_.devices;
+  for (const auto &slot : slots_) {
+    // Spread the first check-ins of the fleet over one poll interval
+    schedule(slot, initialDelay());
+  }
+
+  std::vector<std::thread> pool;
+  for (int i = 1; i < sim_config_.threads; ++i) {
+    pool.emplace_back([this]() { io_.run(); });
+  }
+  io_.run();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+}
+
+void FleetSimulator::stop() {
+  if (stopped_.exchange(true)) {
+    return;
+  }
+  for (const auto &slot : slots_) {
+    slot->flow_control.setAbort();
+  }
+  io_.stop();
+}
+
+void FleetSimulator::schedule(const std::shared_ptr<Slot> &slot, std::chrono::milliseconds delay) {
+  slot->timer.expires_after(delay);
+  slot->timer.async_wait([this, slot](const boost::system::error_code &ec) {
+    if (ec || stopped_) {
+      return;
+    }
+    runCycle(slot);
+  });
+}
+
+void FleetSimulator::runCycle(const std::shared_ptr<Slot> &slot) {
+  try {
+    if (!slot->device) {
+      Config config = base_config_;
+      const fs::path device_dir = sim_config_.storage_dir / ("device-" + std::to_string(slot->index));
+      Utils::createDirectories(device_dir, S_IRWXU);
+      config.storage.path = device_dir;
+      config.pacman.images_path = device_dir / "images";
+      config.bootloader.reboot_sentinel_dir = device_dir;
+      slot->device =
+          std_::make_unique<SimulatedDevice>(config, http_factory_(), sim_config_, stats_, &slot->flow_control);
+    }
+    slot->device->cycle();
+  } catch (const std::exception &e) {
+    LOG_DEBUG << "Simulated device " << slot->index << " cycle failed: " << e.what();
+  }
+
+  ++slot->cycles_done;
+  if (sim_config_.cycles != 0 && slot->cycles_done >= sim_config_.cycles) {
+    deviceDone();
+  } else {
+    schedule(slot, nextDelay());
+  }
+}
+
+void FleetSimulator::deviceDone() {
+  if (--active_devices_ == 0) {
+    io_.stop();
+  }
+}
+
+std::chrono::milliseconds FleetSimulator::nextDelay() {
+  const auto jitter = sim_config_.jitter.count();
+  std::lock_guard<std::mutex> guard(rng_mutex_);
+  std::uniform_int_distribution<int64_t> dist(-jitter, jitter);
+  return std::max(sim_config_.poll_interval + std::chrono::milliseconds(dist(rng_)), std::chrono::milliseconds(0));
+}
+
+std::chrono::milliseconds FleetSimulator::initialDelay() {
+  const auto interval = sim_config_.poll_interval.count();
+  std::lock_guard<std::mutex> guard(rng_mutex_);
+  std::uniform_int_distribution<int64_t> dist(0, std::max<int64_t>(interval - 1, 0));
+  return std::chrono::milliseconds(dist(rng_));
+}
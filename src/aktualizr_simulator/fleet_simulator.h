@@ -0,0 +1,157 @@
+#ifndef AKTUALIZR_SIMULATOR_FLEET_SIMULATOR_H_
+#define AKTUALIZR_SIMULATOR_FLEET_SIMULATOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/filesystem/path.hpp>
+#include "json/json.h"
+
+#include "libaktualizr/config.h"
+#include "utilities/flow_control.h"
+
+class HttpInterface;
+class INvStorage;
+class SotaUptaneClient;
+
+/**
+ * Thread-safe collection of per-phase latency samples.
+ */
+class LatencyStats {
+ public:
+  using Duration = std::chrono::microseconds;
+
+  void record(const std::string &phase, Duration latency);
+  void recordFailure(const std::string &phase);
+
+  std::vector<std::string> phases() const;
+  size_t count(const std::string &phase) const;
+  size_t failures(const std::string &phase) const;
+  /**
+   * Nearest-rank percentile of the recorded samples, p in [0, 100].
+   */
+  Duration percentile(const std::string &phase, double p) const;
+
+  Json::Value toJson() const;
+  void print(std::ostream &os) const;
+
+ private:
+  struct PhaseSamples {
+    std::vector<Duration> samples;
+    size_t failures{0};
+  };
+
+  static Duration percentileOf(std::vector<Duration> samples, double p);
+
+  mutable std::mutex m_;
+  std::map<std::string, PhaseSamples> phases_;
+};
+
+struct FleetSimulatorConfig {
+  /** Number of simulated Primaries */
+  int devices{100};
+  /** Number of VirtualSecondary instances attached to each Primary */
+  int secondaries{1};
+  /** Size of the thread pool shared by all simulated devices */
+  int threads{8};
+  /** Update cycles to run per device; 0 means run until stopped */
+  int cycles{1};
+  std::chrono::milliseconds poll_interval{std::chrono::seconds(10)};
+  /** Each poll interval is shifted by a random amount in [-jitter, +jitter] */
+  std::chrono::milliseconds jitter{std::chrono::seconds(1)};
+  /** Every device gets its own subdirectory with its SQLite storage, images and Secondaries */
+  boost::filesystem::path storage_dir;
+  std::string secondary_hardware_id{"simulated_secondary"};
+};
+
+/**
+ * A single simulated Primary with its own storage and Secondaries. Not
+ * thread-safe: the simulator makes sure that only one cycle of a given device
+ * runs at any time.
+ */
+class SimulatedDevice {
+ public:
+  SimulatedDevice(Config config, std::shared_ptr<HttpInterface> http, const FleetSimulatorConfig &sim_config,
+                  LatencyStats &stats, const api::FlowControlToken *flow_control);
+  ~SimulatedDevice();
+  SimulatedDevice(const SimulatedDevice &) = delete;
+  SimulatedDevice(SimulatedDevice &&) = delete;
+  SimulatedDevice &operator=(const SimulatedDevice &) = delete;
+  SimulatedDevice &operator=(SimulatedDevice &&) = delete;
+
+  /**
+   * Run one update cycle, equivalent to Aktualizr::UptaneCycle(). The first
+   * cycle also initializes and provisions the device.
+   */
+  void cycle();
+
+ private:
+  void start();
+  template <typename T>
+  T timed(const std::string &phase, const std::function<T()> &operation);
+
+  Config config_;
+  std::shared_ptr<HttpInterface> http_;
+  const FleetSimulatorConfig &sim_config_;
+  LatencyStats &stats_;
+  const api::FlowControlToken *flow_control_;
+  std::shared_ptr<INvStorage> storage_;
+  std::unique_ptr<SotaUptaneClient> client_;
+  bool sent_device_data_{false};
+};
+
+/**
+ * Runs many independent simulated Primaries in a single process. All devices
+ * share one event loop which is driven by a fixed-size thread pool, so the
+ * cost of the simulation is bound by the amount of work done rather than by
+ * the number of devices.
+ */
+class FleetSimulator {
+ public:
+  using HttpFactory = std::function<std::shared_ptr<HttpInterface>()>;
+
+  FleetSimulator(const Config &base_config, FleetSimulatorConfig sim_config, HttpFactory http_factory = nullptr);
+  ~FleetSimulator();
+  FleetSimulator(const FleetSimulator &) = delete;
+  FleetSimulator(FleetSimulator &&) = delete;
+  FleetSimulator &operator=(const FleetSimulator &) = delete;
+  FleetSimulator &operator=(FleetSimulator &&) = delete;
+
+  /** Block until all devices have completed their cycles or stop() is called. */
+  void run();
+  /** Thread-safe; may be called from a signal handler thread. */
+  void stop();
+
+  const LatencyStats &stats() const { return stats_; }
+
+ private:
+  struct Slot;
+
+  void schedule(const std::shared_ptr<Slot> &slot, std::chrono::milliseconds delay);
+  void runCycle(const std::shared_ptr<Slot> &slot);
+  void deviceDone();
+  std::chrono::milliseconds nextDelay();
+  std::chrono::milliseconds initialDelay();
+
+  Config base_config_;
+  FleetSimulatorConfig sim_config_;
+  HttpFactory http_factory_;
+  LatencyStats stats_;
+  boost::asio::io_context io_;
+  std::vector<std::shared_ptr<Slot>> slots_;
+  std::atomic<int> active_devices_{0};
+  std::atomic<bool> stopped_{false};
+  std::mutex rng_mutex_;
+  std::mt19937 rng_;
+};
+
+#endif  // AKTUALIZR_SIMULATOR_FLEET_SIMULATOR_H_
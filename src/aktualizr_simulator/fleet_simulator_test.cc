@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include <boost/filesystem.hpp>
+
+#include "fleet_simulator.h"
+#include "httpfake.h"
+#include "logging/logging.h"
+#include "metafake.h"
+#include "uptane_test_common.h"
+#include "utilities/utils.h"
+
+static boost::filesystem::path fake_meta_dir;
+
+/*
+ * Percentiles use the nearest-rank method over the recorded samples.
+ */
+TEST(FleetSimulator, LatencyPercentiles) {
+  LatencyStats stats;
+  for (int i = 1; i <= 100; ++i) {
+    stats.record("phase", std::chrono::microseconds(i));
+  }
+  stats.recordFailure("phase");
+
+  EXPECT_EQ(stats.count("phase"), 100U);
+  EXPECT_EQ(stats.failures("phase"), 1U);
+  EXPECT_EQ(stats.percentile("phase", 50), std::chrono::microseconds(50));
+  EXPECT_EQ(stats.percentile("phase", 99), std::chrono::microseconds(99));
+  EXPECT_EQ(stats.percentile("phase", 100), std::chrono::microseconds(100));
+  EXPECT_EQ(stats.percentile("unknown", 50), std::chrono::microseconds(0));
+
+  const Json::Value json = stats.toJson();
+  EXPECT_EQ(json["phase"]["count"].asUInt(), 100U);
+  EXPECT_EQ(json["phase"]["p90_us"].asInt64(), 90);
+}
+
+/*
+ * Invalid simulator parameters are rejected before any device is created.
+ */
+TEST(FleetSimulator, InvalidConfig) {
+  TemporaryDirectory temp_dir;
+  Config conf = UptaneTestCommon::makeTestConfig(temp_dir, "http://localhost");
+  FleetSimulatorConfig sim_config;
+  sim_config.storage_dir = temp_dir.Path();
+  sim_config.devices = 0;
+  EXPECT_THROW(FleetSimulator(conf, sim_config), std::invalid_argument);
+}
+
+/*
+ * Several devices with virtual Secondaries run complete update cycles against a
+ * fake backend on a small shared thread pool.
+ */
+TEST(FleetSimulator, RunCycles) {
+  TemporaryDirectory temp_dir;
+  Config conf = UptaneTestCommon::makeTestConfig(temp_dir, "http://localhost");
+
+  FleetSimulatorConfig sim_config;
+  sim_config.devices = 5;
+  sim_config.secondaries = 2;
+  sim_config.threads = 2;
+  sim_config.cycles = 2;
+  sim_config.poll_interval = std::chrono::milliseconds(10);
+  sim_config.jitter = std::chrono::milliseconds(5);
+  sim_config.storage_dir = temp_dir / "devices";
+
+  std::atomic<int> http_count{0};
+  auto http_factory = [&temp_dir, &http_count]() {
+    const auto dir = temp_dir / ("http-" + std::to_string(http_count++));
+    boost::filesystem::create_directories(dir);
+    return std::make_shared<HttpFake>(dir, "noupdates", fake_meta_dir);
+  };
+
+  FleetSimulator simulator(conf, sim_config, http_factory);
+  simulator.run();
+
+  const LatencyStats &stats = simulator.stats();
+  EXPECT_EQ(stats.count("initialize"), 5U);
+  EXPECT_EQ(stats.count("check_updates"), 10U);
+  EXPECT_EQ(stats.count("manifest"), 10U);
+  EXPECT_EQ(stats.failures("initialize"), 0U);
+  EXPECT_EQ(stats.failures("check_updates"), 0U);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(boost::filesystem::exists(sim_config.storage_dir / ("device-" + std::to_string(i)) / "sql.db"));
+  }
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  logger_init();
+  logger_set_threshold(boost::log::trivial::warning);
+
+  TemporaryDirectory tmp_dir;
+  fake_meta_dir = tmp_dir.Path();
+  CreateFakeRepoMetaData(fake_meta_dir);
+
+  return RUN_ALL_TESTS();
+}
+#endif
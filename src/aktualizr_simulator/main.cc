@@ -0,0 +1,118 @@
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "fleet_simulator.h"
+#include "libaktualizr/config.h"
+#include "logging/logging.h"
+#include "utilities/aktualizr_version.h"
+#include "utilities/sig_handler.h"
+#include "utilities/utils.h"
+
+namespace bpo = boost::program_options;
+
+static void checkInfoOptions(const bpo::options_description &description, const bpo::variables_map &vm) {
+  if (vm.count("help") != 0 || (vm.count("config") == 0 && vm.count("version") == 0)) {
+    std::cout << description << '\n';
+    exit(EXIT_SUCCESS);
+  }
+  if (vm.count("version") != 0) {
+    std::cout << "Current aktualizr-simulator version is: " << aktualizr_version() << "\n";
+    exit(EXIT_SUCCESS);
+  }
+}
+
+static bpo::variables_map parseOptions(int argc, char **argv) {
+  bpo::options_description description(
+      "aktualizr-simulator runs a fleet of simulated Primaries in one process to load-test a backend");
+  // clang-format off
+  description.add_options()
+      ("help,h", "print usage")
+      ("version,v", "Current aktualizr-simulator version")
+      ("config,c", bpo::value<std::vector<boost::filesystem::path> >()->composing(), "configuration file or directory shared by all simulated devices, mandatory")
+      ("loglevel", bpo::value<int>(), "set log level 0-5 (trace, debug, info, warning, error, fatal)")
+      ("tls-server", bpo::value<std::string>(), "URL of device gateway")
+      ("repo-server", bpo::value<std::string>(), "URL of the Uptane Image repository")
+      ("director-server", bpo::value<std::string>(), "URL of the Uptane Director repository")
+      ("devices,n", bpo::value<int>()->default_value(100), "number of simulated Primaries")
+      ("secondaries", bpo::value<int>()->default_value(1), "number of virtual Secondaries per Primary")
+      ("threads", bpo::value<int>()->default_value(8), "size of the thread pool shared by all devices")
+      ("cycles", bpo::value<int>()->default_value(1), "update cycles to run per device, 0 to run until interrupted")
+      ("poll-interval", bpo::value<double>()->default_value(10), "seconds between two update cycles of a device")
+      ("jitter", bpo::value<double>()->default_value(1), "maximum random deviation from the poll interval, in seconds")
+      ("storage-dir", bpo::value<boost::filesystem::path>(), "directory holding the storage of all devices; a temporary directory by default (use a tmpfs to keep everything in memory)")
+      ("stats-file", bpo::value<boost::filesystem::path>(), "write per-phase latency statistics to this file in JSON format");
+  // clang-format on
+
+  bpo::variables_map vm;
+  try {
+    bpo::basic_parsed_options<char> parsed_options = bpo::command_line_parser(argc, argv).options(description).run();
+    bpo::store(parsed_options, vm);
+    checkInfoOptions(description, vm);
+    bpo::notify(vm);
+  } catch (const bpo::error &ex) {
+    std::cout << ex.what() << std::endl;
+    std::cout << description;
+    exit(EXIT_FAILURE);
+  }
+
+  return vm;
+}
+
+static std::chrono::milliseconds secondsOption(const bpo::variables_map &vm, const char *name) {
+  return std::chrono::milliseconds(static_cast<int64_t>(vm[name].as<double>() * 1000));
+}
+
+int main(int argc, char *argv[]) {
+  logger_init(isatty(1) == 1);
+  logger_set_threshold(boost::log::trivial::info);
+
+  bpo::variables_map commandline_map = parseOptions(argc, argv);
+
+  int r = EXIT_FAILURE;
+  try {
+    Config config(commandline_map);
+    if (commandline_map.count("loglevel") == 0) {
+      // Thousands of devices logging at the info level are hardly readable
+      logger_set_threshold(boost::log::trivial::warning);
+    }
+
+    std::unique_ptr<TemporaryDirectory> temp_dir;
+    FleetSimulatorConfig sim_config;
+    sim_config.devices = commandline_map["devices"].as<int>();
+    sim_config.secondaries = commandline_map["secondaries"].as<int>();
+    sim_config.threads = commandline_map["threads"].as<int>();
+    sim_config.cycles = commandline_map["cycles"].as<int>();
+    sim_config.poll_interval = secondsOption(commandline_map, "poll-interval");
+    sim_config.jitter = secondsOption(commandline_map, "jitter");
+    if (commandline_map.count("storage-dir") != 0) {
+      sim_config.storage_dir = commandline_map["storage-dir"].as<boost::filesystem::path>();
+    } else {
+      temp_dir = std_::make_unique<TemporaryDirectory>("aktualizr-simulator");
+      sim_config.storage_dir = temp_dir->Path();
+    }
+
+    FleetSimulator simulator(config, sim_config);
+    SigHandler::get().start([&simulator]() { simulator.stop(); });
+    SigHandler::signal(SIGINT);
+    SigHandler::signal(SIGTERM);
+
+    std::cout << "Simulating " << sim_config.devices << " devices with " << sim_config.secondaries
+              << " Secondaries each on " << sim_config.threads << " threads" << std::endl;
+    simulator.run();
+
+    simulator.stats().print(std::cout);
+    if (commandline_map.count("stats-file") != 0) {
+      Utils::writeFile(commandline_map["stats-file"].as<boost::filesystem::path>(),
+                       Utils::jsonToStr(simulator.stats().toJson()));
+    }
+
+    r = EXIT_SUCCESS;
+  } catch (const std::exception &ex) {
+    LOG_ERROR << ex.what();
+  }
+  return r;
+}
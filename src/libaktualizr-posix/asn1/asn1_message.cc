@@ -2,10 +2,11 @@
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <climits>
+#include <cstring>
 
 #include "asn1_message.h"
 #include "logging/logging.h"
-#include "utilities/dequeue_buffer.h"
 #include "utilities/utils.h"
 
 #ifndef MSG_NOSIGNAL
@@ -52,8 +53,340 @@ void SetString(OCTET_STRING_t* dest, const std::string& str) {
   OCTET_STRING_fromBuf(dest, str.c_str(), static_cast<int>(str.size()));
 }
 
+void Asn1Message::borrow(OCTET_STRING_t* field, const char* data, size_t size, std::shared_ptr<const void> owner) {
+  field->buf = reinterpret_cast<uint8_t*>(const_cast<char*>(data));
+  field->size = static_cast<decltype(field->size)>(size);
+  borrowed_.push_back(field);
+  owner_ = std::move(owner);
+}
+
+namespace {
+
+// An uploadDataReq is the [10] alternative of AKIpUptaneMes, which wraps an
+// AKUploadDataReqMes SEQUENCE (see messages/ipuptane_message.asn1)
+constexpr uint8_t kUploadDataReqTag{0xaa};
+constexpr uint8_t kSequenceTag{0x30};
+constexpr uint8_t kOctetStringTag{0x04};
+constexpr uint8_t kEnumeratedTag{0x0a};
+// Longest length accepted, in bytes of its encoding
+constexpr size_t kMaxLengthBytes{4};
+
+enum class HeaderResult { kOk, kIncomplete, kInvalid };
+
+/**
+ * Parse the tag and length of a DER encoded value. DER does not allow the
+ * indefinite length form, so it is rejected.
+ */
+HeaderResult parseHeader(const uint8_t* data, size_t size, size_t* header_size, size_t* length) {
+  size_t pos = 0;
+  if (size == 0) {
+    return HeaderResult::kIncomplete;
+  }
+  if ((data[pos++] & 0x1fU) == 0x1fU) {
+    // High tag number form
+    do {
+      if (pos >= size) {
+        return HeaderResult::kIncomplete;
+      }
+      if (pos > sizeof(uint32_t)) {
+        return HeaderResult::kInvalid;
+      }
+    } while ((data[pos++] & 0x80U) != 0);
+  }
+  if (pos >= size) {
+    return HeaderResult::kIncomplete;
+  }
+
+  const uint8_t first = data[pos++];
+  size_t len = first;
+  if ((first & 0x80U) != 0) {
+    const size_t bytes = first & 0x7fU;
+    if (bytes == 0 || bytes > kMaxLengthBytes) {
+      return HeaderResult::kInvalid;
+    }
+    if (size - pos < bytes) {
+      return HeaderResult::kIncomplete;
+    }
+    len = 0;
+    for (size_t k = 0; k < bytes; ++k) {
+      len = (len << 8U) | data[pos++];
+    }
+  }
+  if (len > SIZE_MAX - pos) {
+    return HeaderResult::kInvalid;
+  }
+  *header_size = pos;
+  *length = len;
+  return HeaderResult::kOk;
+}
+
+/**
+ * Read the value at *pos, which must have the given tag and end before `end`.
+ */
+bool readValue(const uint8_t* data, size_t end, size_t* pos, uint8_t tag, size_t* content, size_t* length) {
+  size_t header_size = 0;
+  if (*pos >= end || data[*pos] != tag ||
+      parseHeader(data + *pos, end - *pos, &header_size, length) != HeaderResult::kOk ||
+      *length > end - *pos - header_size) {
+    return false;
+  }
+  *content = *pos + header_size;
+  *pos = *content + *length;
+  return true;
+}
+
+/**
+ * Decode an uploadDataReq without copying its data. Anything unexpected, such
+ * as a later extension of the message, is left to ber_decode().
+ */
+Asn1Message::Ptr decodeUploadDataReq(const char* data, size_t size, const std::shared_ptr<const void>& owner) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+  size_t pos = 0;
+  size_t content = 0;
+  size_t length = 0;
+  if (!readValue(bytes, size, &pos, kUploadDataReqTag, &content, &length) || pos != size) {
+    return nullptr;
+  }
+  pos = content;
+  if (!readValue(bytes, size, &pos, kSequenceTag, &content, &length) || pos != size) {
+    return nullptr;
+  }
+  pos = content;
+  size_t data_start = 0;
+  size_t data_size = 0;
+  if (!readValue(bytes, size, &pos, kOctetStringTag, &data_start, &data_size)) {
+    return nullptr;
+  }
+
+  bool has_compression = false;
+  long compression = 0;  // NOLINT(google-runtime-int)
+  if (pos < size) {
+    if (!readValue(bytes, size, &pos, kEnumeratedTag, &content, &length) || length == 0 ||
+        length > sizeof(compression)) {
+      return nullptr;
+    }
+    // Two's complement, most significant byte first
+    auto value = static_cast<unsigned long>((bytes[content] & 0x80U) != 0 ? -1 : 0);  // NOLINT(google-runtime-int)
+    for (size_t k = 0; k < length; ++k) {
+      value = (value << 8U) | bytes[content + k];
+    }
+    compression = static_cast<long>(value);  // NOLINT(google-runtime-int)
+    has_compression = true;
+  }
+  if (pos != size) {
+    return nullptr;
+  }
+
+  Asn1Message::Ptr msg = Asn1Message::Empty();
+  msg->present(AKIpUptaneMes_PR_uploadDataReq);
+  auto req = msg->uploadDataReq();
+  msg->borrow(&req->data, data + data_start, data_size, owner);
+  if (has_compression) {
+    req->compression = Asn1Allocation<AKCompression_t>();
+    *req->compression = compression;
+  }
+  return msg;
+}
+
+}  // namespace
+
+Asn1Message::Ptr Asn1Decode(const char* data, size_t size, const std::shared_ptr<const void>& owner) {
+  if (owner != nullptr) {
+    Asn1Message::Ptr msg = decodeUploadDataReq(data, size, owner);
+    if (msg != nullptr) {
+      return msg;
+    }
+  }
+
+  AKIpUptaneMes_t* m = nullptr;
+  asn_codec_ctx_s context{};
+  const asn_dec_rval_t res = ber_decode(&context, &asn_DEF_AKIpUptaneMes, reinterpret_cast<void**>(&m), data, size);
+  // Note that ber_decode allocates *m even on failure, so this must always be done
+  Asn1Message::Ptr msg = Asn1Message::FromRaw(&m);
+  if (res.code != RC_OK || res.consumed != size) {
+    return nullptr;
+  }
+  return msg;
+}
+
+Asn1Encoder::Asn1Encoder() { buffer_.reserve(kInitialSize); }
+
+bool Asn1Encoder::encode(const Asn1Message::Ptr& msg) {
+  buffer_.clear();
+  pieces_.clear();
+  size_ = 0;
+  const asn_enc_rval_t res = der_encode(&asn_DEF_AKIpUptaneMes, &msg->msg_, append, this);
+  return res.encoded != -1;
+}
+
+int Asn1Encoder::append(const void* buffer, size_t size, void* priv) {
+  auto* encoder = static_cast<Asn1Encoder*>(priv);
+  const auto* data = static_cast<const char*>(buffer);
+  // der_encode() passes the contents of OCTET STRINGs straight from the
+  // message; everything it builds on the fly (tags, lengths, integers) is short
+  if (size >= kBorrowSize) {
+    encoder->pieces_.push_back({data, 0, size});
+  } else {
+    if (!encoder->pieces_.empty() && encoder->pieces_.back().data == nullptr) {
+      encoder->pieces_.back().size += size;
+    } else {
+      encoder->pieces_.push_back({nullptr, encoder->buffer_.size(), size});
+    }
+    encoder->buffer_.insert(encoder->buffer_.end(), data, data + size);
+  }
+  encoder->size_ += size;
+  return 0;
+}
+
+bool Asn1Encoder::send(int socket) {
+  iov_.clear();
+  for (const auto& piece : pieces_) {
+    iov_.push_back({const_cast<char*>(pieceData(piece)), piece.size});
+  }
+
+  size_t first = 0;
+  while (first < iov_.size()) {
+    msghdr hdr{};
+    hdr.msg_iov = &iov_[first];
+    hdr.msg_iovlen = std::min(iov_.size() - first, static_cast<size_t>(IOV_MAX));
+    const ssize_t written = sendmsg(socket, &hdr, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_ERROR << "write: " << std::strerror(errno);
+      return false;
+    }
+    // Skip what has been written, which may end in the middle of a piece
+    auto left = static_cast<size_t>(written);
+    while (first < iov_.size() && left >= iov_[first].iov_len) {
+      left -= iov_[first].iov_len;
+      ++first;
+    }
+    if (left > 0) {
+      iov_[first].iov_base = static_cast<char*>(iov_[first].iov_base) + left;
+      iov_[first].iov_len -= left;
+    }
+  }
+  return true;
+}
+
+std::string Asn1Encoder::str() const {
+  std::string res;
+  res.reserve(size_);
+  for (const auto& piece : pieces_) {
+    res.append(pieceData(piece), piece.size);
+  }
+  return res;
+}
+
+Asn1Receiver::Status Asn1Receiver::read(int socket, Asn1Message::Ptr& msg) {
+  // Grow the buffer geometrically up to the size of the message
+  const size_t pending = tail_ - head_;
+  size_t space = kReadSize;
+  if (message_size_ > pending) {
+    space = std::max(kReadSize, std::min(message_size_ - pending, pending));
+  }
+  reserve(space);
+
+  const ssize_t received = recv(socket, buffer_->data() + tail_, buffer_->size() - tail_, 0);
+  if (received == 0) {
+    LOG_TRACE << "Peer has closed a connection socket";
+    return Status::kClosed;
+  }
+  if (received < 0) {
+    LOG_ERROR << "Failed to read data from a connection socket: " << strerror(errno);
+    return Status::kError;
+  }
+  LOG_TRACE << "Received " << received << " bytes";
+  tail_ += static_cast<size_t>(received);
+  return decodeBuffered(msg);
+}
+
+Asn1Receiver::Status Asn1Receiver::decodeBuffered(Asn1Message::Ptr& msg) {
+  const size_t pending = tail_ - head_;
+  if (pending == 0) {
+    return Status::kIncomplete;
+  }
+  const char* data = buffer_->data() + head_;
+  if (message_size_ == 0) {
+    size_t header_size = 0;
+    size_t length = 0;
+    switch (parseHeader(reinterpret_cast<const uint8_t*>(data), pending, &header_size, &length)) {
+      case HeaderResult::kIncomplete:
+        return Status::kIncomplete;
+      case HeaderResult::kInvalid:
+        LOG_ERROR << "Received a message with an invalid header";
+        return Status::kError;
+      default:
+        break;
+    }
+    message_size_ = header_size + length;
+  }
+  if (pending < message_size_) {
+    return Status::kIncomplete;
+  }
+
+  msg = Asn1Decode(data, message_size_, buffer_);
+  head_ += message_size_;
+  message_size_ = 0;
+  if (head_ == tail_ && buffer_->size() > kMaxIdleSize) {
+    // Messages still borrowing from it keep it alive
+    buffer_.reset();
+    head_ = tail_ = 0;
+  }
+  if (msg == nullptr) {
+    LOG_ERROR << "Failed to decode a received message";
+    return Status::kError;
+  }
+  return Status::kMessage;
+}
+
+void Asn1Receiver::clear() {
+  // The next data would be received at the start of the buffer: it is left to
+  // the messages still borrowing from it, if any.
+  if (buffer_ != nullptr && (buffer_.use_count() > 1 || buffer_->size() > kMaxIdleSize)) {
+    buffer_.reset();
+  }
+  head_ = tail_ = 0;
+  message_size_ = 0;
+}
+
+void Asn1Receiver::reserve(size_t space) {
+  if (buffer_ != nullptr && buffer_->size() - tail_ >= space) {
+    return;
+  }
+  const size_t pending = tail_ - head_;
+  if (buffer_ != nullptr && buffer_.use_count() == 1) {
+    std::memmove(buffer_->data(), buffer_->data() + head_, pending);
+    if (buffer_->size() < pending + space) {
+      buffer_->resize(pending + space);
+    }
+  } else {
+    // Messages that have been decoded from the current buffer may point into
+    // it, so it is left to them
+    auto buffer = std::make_shared<std::vector<char>>(std::max(pending + space, buffer_ ? buffer_->size() : 0));
+    if (pending > 0) {
+      std::memcpy(buffer->data(), buffer_->data() + head_, pending);
+    }
+    buffer_ = std::move(buffer);
+  }
+  head_ = 0;
+  tail_ = pending;
+}
+
 Asn1Message::Ptr Asn1Rpc(const Asn1Message::Ptr& tx, int con_fd) {
-  der_encode(&asn_DEF_AKIpUptaneMes, &tx->msg_, Asn1SocketWriteCallback, &con_fd);
+  // Kept from one call to the next, so that their buffers are reused
+  static thread_local Asn1Encoder encoder;
+  static thread_local Asn1Receiver receiver;
+
+  if (!encoder.encode(tx)) {
+    LOG_ERROR << "Failed to encode a " << tx->toStr() << " message";
+    return Asn1Message::Empty();
+  }
+  if (!encoder.send(con_fd)) {
+    return Asn1Message::Empty();
+  }
 
   // Bounce TCP_NODELAY to flush the TCP send buffer
   int no_delay = 1;
@@ -61,31 +394,17 @@ Asn1Message::Ptr Asn1Rpc(const Asn1Message::Ptr& tx, int con_fd) {
   no_delay = 0;
   setsockopt(con_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(int));
 
-  AKIpUptaneMes_t* m = nullptr;
-  asn_dec_rval_t res;
-  asn_codec_ctx_s context{};
-  DequeueBuffer buffer;
-  ssize_t received;
+  receiver.clear();
+  Asn1Message::Ptr msg;
+  Asn1Receiver::Status status;
   do {
-    res.code = RC_FAIL;
-    received = recv(con_fd, buffer.Tail(), buffer.TailSpace(), 0);
-    if (received < 0) {
-      LOG_ERROR << "Failed to read data from a connection socket: " << strerror(errno);
-      break;
-    }
-    LOG_TRACE << "Asn1Rpc read " << Utils::toBase64(std::string(buffer.Tail(), static_cast<size_t>(received)));
-    buffer.HaveEnqueued(static_cast<size_t>(received));
-    res = ber_decode(&context, &asn_DEF_AKIpUptaneMes, reinterpret_cast<void**>(&m), buffer.Head(), buffer.Size());
-    buffer.Consume(res.consumed);
-  } while (res.code == RC_WMORE && received > 0);
-  // Note that ber_decode allocates *m even on failure, so this must always be done
-  Asn1Message::Ptr msg = Asn1Message::FromRaw(&m);
+    status = receiver.read(con_fd, msg);
+  } while (status == Asn1Receiver::Status::kIncomplete);
 
-  if (res.code != RC_OK) {
+  if (status != Asn1Receiver::Status::kMessage) {
     LOG_DEBUG << "Asn1Rpc decoding failed";
-    msg->present(AKIpUptaneMes_PR_NOTHING);
+    return Asn1Message::Empty();
   }
-
   return msg;
 }
 
@@ -1,5 +1,9 @@
 #ifndef ASN1_MESSAGE_H_
 #define ASN1_MESSAGE_H_
+#include <sys/uio.h>
+#include <memory>
+#include <vector>
+
 #include <boost/intrusive_ptr.hpp>
 
 #include "AKIpUptaneMes.h"
@@ -37,7 +41,14 @@ class Asn1Message {
   template <typename T>
   using SubPtr = Asn1Sub<T>;
 
-  ~Asn1Message() { ASN_STRUCT_FREE_CONTENTS_ONLY(asn_DEF_AKIpUptaneMes, &msg_); }
+  ~Asn1Message() {
+    // Borrowed data belongs to someone else
+    for (auto* field : borrowed_) {
+      field->buf = nullptr;
+      field->size = 0;
+    }
+    ASN_STRUCT_FREE_CONTENTS_ONLY(asn_DEF_AKIpUptaneMes, &msg_);
+  }
   Asn1Message(const Asn1Message&) = delete;
   Asn1Message(Asn1Message&&) = delete;
   Asn1Message operator=(const Asn1Message&) = delete;
@@ -55,6 +66,13 @@ class Asn1Message {
    */
   static Asn1Message::Ptr FromRaw(AKIpUptaneMes_t** msg) { return new Asn1Message(msg); }
 
+  /**
+   * Make an OCTET STRING of the message point to data that it does not own,
+   * e.g. the buffer the message has been received into. `owner` keeps the data
+   * alive as long as the message. The field must not be modified afterwards.
+   */
+  void borrow(OCTET_STRING_t* field, const char* data, size_t size, std::shared_ptr<const void> owner);
+
   friend void intrusive_ptr_add_ref(Asn1Message* msg) { msg->ref_count_++; }
 
   // noinline is necessary to work around a gcc 12 use-after-free analysis FP
@@ -148,6 +166,8 @@ class Asn1Message {
 
  private:
   int ref_count_{0};
+  std::vector<OCTET_STRING_t*> borrowed_;
+  std::shared_ptr<const void> owner_;
 
   Asn1Message() = default;
 
@@ -179,6 +199,97 @@ std::string ToString(const OCTET_STRING_t& octet_str);
 
 void SetString(OCTET_STRING_t* dest, const std::string& str);
 
+/**
+ * Decode one complete DER encoded message. The data of an uploadDataReq is
+ * borrowed from `owner`, which holds `data`, instead of being copied; other
+ * messages are decoded with ber_decode(). Returns nullptr if the message cannot
+ * be decoded.
+ */
+Asn1Message::Ptr Asn1Decode(const char* data, size_t size, const std::shared_ptr<const void>& owner = nullptr);
+
+/**
+ * Encodes messages into a buffer that is reused from one message to the next,
+ * and sends them with a single sendmsg() call. Large parts of a message, such
+ * as firmware data, are not copied but sent from the message itself, which has
+ * to be kept unchanged until it has been sent.
+ */
+class Asn1Encoder {
+ public:
+  Asn1Encoder();
+
+  bool encode(const Asn1Message::Ptr& msg);
+  /**
+   * Send the last encoded message. Returns false on a socket error.
+   */
+  bool send(int socket);
+
+  size_t size() const { return size_; }
+  std::string str() const;
+
+ private:
+  // Smaller parts are copied into the buffer
+  static constexpr size_t kBorrowSize{256};
+  static constexpr size_t kInitialSize{4096};
+
+  struct Piece {
+    const char* data;  // nullptr if in buffer_
+    size_t offset;
+    size_t size;
+  };
+
+  static int append(const void* buffer, size_t size, void* priv);
+  const char* pieceData(const Piece& piece) const {
+    return piece.data != nullptr ? piece.data : &buffer_[piece.offset];
+  }
+
+  std::vector<char> buffer_;
+  std::vector<Piece> pieces_;
+  std::vector<iovec> iov_;
+  size_t size_{0};
+};
+
+/**
+ * Receives messages from a socket. Each message is received whole, from the
+ * length in its header, into a buffer that is reused from one message to the
+ * next, and decoded with Asn1Decode(). As data is received as it arrives, a
+ * large message can be received over many poll() iterations without blocking
+ * other sockets.
+ */
+class Asn1Receiver {
+ public:
+  enum class Status { kIncomplete, kMessage, kClosed, kError };
+
+  /**
+   * Read once from the socket and decode a message if it is complete.
+   */
+  Status read(int socket, Asn1Message::Ptr& msg);
+
+  /**
+   * Decode data that has already been received, e.g. the beginning of the next
+   * message that came with the end of the previous one.
+   */
+  Status decodeBuffered(Asn1Message::Ptr& msg);
+
+  /**
+   * Drop the data received so far.
+   */
+  void clear();
+
+ private:
+  static constexpr size_t kReadSize{4096};
+  // A larger buffer is released once a message has been received
+  static constexpr size_t kMaxIdleSize{1024 * 1024};
+
+  void reserve(size_t space);
+
+  // Shared with the messages that borrow data from it
+  std::shared_ptr<std::vector<char>> buffer_;
+  size_t head_{0};
+  size_t tail_{0};
+  // Size of the message at head_, 0 until its header has been received
+  size_t message_size_{0};
+};
+
 /**
  * Open a TCP connection to client; send a message and wait for a
  * response.
@@ -4,6 +4,9 @@
 
 #include <gtest/gtest.h>
 
+#include <sys/socket.h>
+#include <unistd.h>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <string>
@@ -282,6 +285,152 @@ TEST(Asn1Common, Asn1MessageFromRawNull) {
   Asn1Message::FromRaw(&m);
 }
 
+static Asn1Message::Ptr makeUploadDataReq(const std::string& data, bool compressed) {
+  Asn1Message::Ptr msg = Asn1Message::Empty();
+  msg->present(AKIpUptaneMes_PR_uploadDataReq);
+  auto req = msg->uploadDataReq();
+  SetString(&req->data, data);
+  if (compressed) {
+    req->compression = Asn1Allocation<AKCompression_t>();
+    *req->compression = AKCompression_zstd;
+  }
+  return msg;
+}
+
+static std::string derEncode(const Asn1Message::Ptr& msg) {
+  std::string encoded;
+  der_encode(&asn_DEF_AKIpUptaneMes, &msg->msg_, Asn1StringAppendCallback, &encoded);
+  return encoded;
+}
+
+class Asn1SocketPair : public ::testing::Test {
+ protected:
+  Asn1SocketPair() {
+    int fds[2];
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    in_ = fds[0];
+    out_ = fds[1];
+  }
+  ~Asn1SocketPair() override {
+    ::close(in_);
+    ::close(out_);
+  }
+
+  /* Write from another thread, in pieces of the given size */
+  std::future<void> write(std::string data, size_t piece) {
+    return std::async(std::launch::async, [this, data, piece]() {
+      for (size_t pos = 0; pos < data.size(); pos += piece) {
+        const size_t size = std::min(piece, data.size() - pos);
+        ASSERT_EQ(send(out_, data.data() + pos, size, 0), static_cast<ssize_t>(size));
+      }
+    });
+  }
+
+  Asn1Receiver::Status receive(Asn1Receiver& receiver, Asn1Message::Ptr& msg) {
+    auto status = receiver.decodeBuffered(msg);
+    while (status == Asn1Receiver::Status::kIncomplete) {
+      status = receiver.read(in_, msg);
+    }
+    return status;
+  }
+
+  int in_{-1};
+  int out_{-1};
+};
+
+/* The encoder produces the same as der_encode(), whether or not it copies the
+ * parts of a message. */
+TEST_F(Asn1SocketPair, EncoderSameAsDerEncode) {
+  Asn1Encoder encoder;
+  for (const auto& msg : {makeUploadDataReq(std::string(100000, 'd'), true), makeUploadDataReq("small", false)}) {
+    ASSERT_TRUE(encoder.encode(msg));
+    const std::string expected = derEncode(msg);
+    EXPECT_EQ(encoder.size(), expected.size());
+    EXPECT_EQ(encoder.str(), expected);
+
+    ASSERT_TRUE(encoder.send(out_));
+    std::string received(expected.size(), '\0');
+    ASSERT_EQ(recv(in_, &received[0], received.size(), MSG_WAITALL), static_cast<ssize_t>(received.size()));
+    EXPECT_EQ(received, expected);
+  }
+}
+
+/* A message is received whole over many reads, and its data is borrowed from
+ * the receive buffer without being corrupted by the next messages. */
+TEST_F(Asn1SocketPair, ReceiveUploadData) {
+  std::string data;
+  for (size_t k = 0; data.size() < 300000; ++k) {
+    data += "chunk " + std::to_string(k) + "\n";
+  }
+  auto writer = write(derEncode(makeUploadDataReq(data, true)) + derEncode(makeUploadDataReq("next", false)), 1000);
+
+  Asn1Receiver receiver;
+  Asn1Message::Ptr first;
+  ASSERT_EQ(receive(receiver, first), Asn1Receiver::Status::kMessage);
+  ASSERT_EQ(first->present(), AKIpUptaneMes_PR_uploadDataReq);
+  Asn1Message::Ptr second;
+  ASSERT_EQ(receive(receiver, second), Asn1Receiver::Status::kMessage);
+  writer.get();
+
+  ASSERT_EQ(second->present(), AKIpUptaneMes_PR_uploadDataReq);
+  EXPECT_EQ(ToString(second->uploadDataReq()->data), "next");
+  EXPECT_EQ(second->uploadDataReq()->compression, nullptr);
+  EXPECT_EQ(ToString(first->uploadDataReq()->data), data);
+  ASSERT_NE(first->uploadDataReq()->compression, nullptr);
+  EXPECT_EQ(*first->uploadDataReq()->compression, AKCompression_zstd);
+}
+
+/* Other messages are decoded with ber_decode(), also when several of them come
+ * with a single read. */
+TEST_F(Asn1SocketPair, ReceiveOtherMessages) {
+  Asn1Message::Ptr version_req = Asn1Message::Empty();
+  version_req->present(AKIpUptaneMes_PR_versionReq);
+  version_req->versionReq()->version = 2;
+  Asn1Message::Ptr install_req = Asn1Message::Empty();
+  install_req->present(AKIpUptaneMes_PR_installReq);
+  SetString(&install_req->installReq()->hash, "target_name");
+  write(derEncode(version_req) + derEncode(install_req), 1 << 20).get();
+
+  Asn1Receiver receiver;
+  Asn1Message::Ptr msg;
+  ASSERT_EQ(receiver.read(in_, msg), Asn1Receiver::Status::kMessage);
+  ASSERT_EQ(msg->present(), AKIpUptaneMes_PR_versionReq);
+  EXPECT_EQ(msg->versionReq()->version, 2);
+  ASSERT_EQ(receiver.decodeBuffered(msg), Asn1Receiver::Status::kMessage);
+  ASSERT_EQ(msg->present(), AKIpUptaneMes_PR_installReq);
+  EXPECT_EQ(ToString(msg->installReq()->hash), "target_name");
+  EXPECT_EQ(receiver.decodeBuffered(msg), Asn1Receiver::Status::kIncomplete);
+}
+
+/* Dropping the data received so far does not let the next message overwrite
+ * the data still borrowed by the previous one. */
+TEST_F(Asn1SocketPair, ClearKeepsBorrowedData) {
+  Asn1Receiver receiver;
+  Asn1Message::Ptr first;
+  write(derEncode(makeUploadDataReq("first data", false)), 1 << 20).get();
+  ASSERT_EQ(receive(receiver, first), Asn1Receiver::Status::kMessage);
+
+  receiver.clear();
+  Asn1Message::Ptr second;
+  write(derEncode(makeUploadDataReq("other data", false)), 1 << 20).get();
+  ASSERT_EQ(receive(receiver, second), Asn1Receiver::Status::kMessage);
+  EXPECT_EQ(ToString(second->uploadDataReq()->data), "other data");
+  EXPECT_EQ(ToString(first->uploadDataReq()->data), "first data");
+}
+
+/* Indefinite lengths are not DER, and a closed socket is reported as such. */
+TEST_F(Asn1SocketPair, ReceiveInvalid) {
+  Asn1Receiver receiver;
+  Asn1Message::Ptr msg;
+  write(std::string("\x30\x80\x04\x00\x00\x00", 6), 6).get();
+  EXPECT_EQ(receiver.read(in_, msg), Asn1Receiver::Status::kError);
+
+  receiver.clear();
+  ::close(out_);
+  out_ = -1;
+  EXPECT_EQ(receiver.read(in_, msg), Asn1Receiver::Status::kClosed);
+}
+
 #ifndef __NO_MAIN__
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,155 @@
+#include "compression.h"
+
+#include <stdexcept>
+#include <vector>
+
+#ifdef BUILD_ZSTD
+#include <zstd.h>
+#endif
+
+namespace Uptane {
+
+bool isCompressionSupported(UploadCompression compression) {
+  switch (compression) {
+    case UploadCompression::kNone:
+      return true;
+    case UploadCompression::kZstd:
+#ifdef BUILD_ZSTD
+      return true;
+#else
+      return false;
+#endif
+    default:
+      return false;
+  }
+}
+
+static void checkSupported(UploadCompression compression) {
+  if (!isCompressionSupported(compression)) {
+    throw std::runtime_error("Unsupported compression method: " + std::to_string(static_cast<int>(compression)));
+  }
+}
+
+#ifdef BUILD_ZSTD
+static void checkZstd(size_t ret, const std::string& what) {
+  if (ZSTD_isError(ret) != 0U) {
+    throw std::runtime_error(what + ": " + ZSTD_getErrorName(ret));
+  }
+}
+#endif
+
+struct StreamCompressor::Impl {
+  UploadCompression compression{UploadCompression::kNone};
+#ifdef BUILD_ZSTD
+  // Fast enough not to slow down the transfer on a Primary, with most of the gain of the higher levels
+  static constexpr int kLevel{3};
+  ZSTD_CCtx* cctx{nullptr};
+  std::vector<uint8_t> buffer;
+#endif
+};
+
+StreamCompressor::StreamCompressor(UploadCompression compression) : impl_{new Impl} {
+  checkSupported(compression);
+  impl_->compression = compression;
+#ifdef BUILD_ZSTD
+  if (compression == UploadCompression::kZstd) {
+    impl_->cctx = ZSTD_createCCtx();
+    if (impl_->cctx == nullptr) {
+      throw std::runtime_error("Could not create a zstd compression context");
+    }
+    checkZstd(ZSTD_CCtx_setParameter(impl_->cctx, ZSTD_c_compressionLevel, Impl::kLevel), "zstd compression level");
+    impl_->buffer.resize(ZSTD_CStreamOutSize());
+  }
+#endif
+}
+
+StreamCompressor::~StreamCompressor() {
+#ifdef BUILD_ZSTD
+  ZSTD_freeCCtx(impl_->cctx);
+#endif
+}
+
+void StreamCompressor::compress(const uint8_t* data, size_t size, bool last, std::string& out) {
+  if (impl_->compression == UploadCompression::kNone) {
+    out.append(reinterpret_cast<const char*>(data), size);
+    return;
+  }
+#ifdef BUILD_ZSTD
+  ZSTD_inBuffer input{data, size, 0};
+  const ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+  for (;;) {
+    ZSTD_outBuffer output{impl_->buffer.data(), impl_->buffer.size(), 0};
+    const size_t remaining = ZSTD_compressStream2(impl_->cctx, &output, &input, mode);
+    checkZstd(remaining, "zstd compression failed");
+    out.append(reinterpret_cast<const char*>(impl_->buffer.data()), output.pos);
+    if (last ? remaining == 0 : input.pos == input.size) {
+      break;
+    }
+  }
+#else
+  (void)last;
+#endif
+}
+
+struct StreamDecompressor::Impl {
+  UploadCompression compression{UploadCompression::kNone};
+  bool finished{false};
+  uint64_t output_size{0};
+#ifdef BUILD_ZSTD
+  ZSTD_DCtx* dctx{nullptr};
+  std::vector<uint8_t> buffer;
+#endif
+};
+
+StreamDecompressor::StreamDecompressor(UploadCompression compression) : impl_{new Impl} {
+  checkSupported(compression);
+  impl_->compression = compression;
+#ifdef BUILD_ZSTD
+  if (compression == UploadCompression::kZstd) {
+    impl_->dctx = ZSTD_createDCtx();
+    if (impl_->dctx == nullptr) {
+      throw std::runtime_error("Could not create a zstd decompression context");
+    }
+    impl_->buffer.resize(ZSTD_DStreamOutSize());
+  }
+#endif
+}
+
+StreamDecompressor::~StreamDecompressor() {
+#ifdef BUILD_ZSTD
+  ZSTD_freeDCtx(impl_->dctx);
+#endif
+}
+
+bool StreamDecompressor::decompress(const uint8_t* data, size_t size, const Sink& sink) {
+  if (impl_->compression == UploadCompression::kNone) {
+    impl_->output_size += size;
+    return sink(data, size);
+  }
+#ifdef BUILD_ZSTD
+  ZSTD_inBuffer input{data, size, 0};
+  bool output_full = false;
+  while (input.pos < input.size || (output_full && !impl_->finished)) {
+    if (impl_->finished) {
+      throw std::runtime_error("Unexpected data after the end of the compressed stream");
+    }
+    ZSTD_outBuffer output{impl_->buffer.data(), impl_->buffer.size(), 0};
+    const size_t ret = ZSTD_decompressStream(impl_->dctx, &output, &input);
+    checkZstd(ret, "zstd decompression failed");
+    impl_->finished = ret == 0;
+    // A full output buffer may leave more output to be flushed, even with all of the input consumed
+    output_full = output.pos == output.size;
+    impl_->output_size += output.pos;
+    if (output.pos > 0 && !sink(impl_->buffer.data(), output.pos)) {
+      return false;
+    }
+  }
+#endif
+  return true;
+}
+
+bool StreamDecompressor::finished() const { return impl_->finished; }
+
+uint64_t StreamDecompressor::output_size() const { return impl_->output_size; }
+
+}  // namespace Uptane
@@ -0,0 +1,67 @@
+#ifndef UPTANE_COMPRESSION_H_
+#define UPTANE_COMPRESSION_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace Uptane {
+
+/* Compression of the firmware data sent to IP Secondaries. The values are those
+ * of AKCompression in the IP protocol. */
+enum class UploadCompression { kNone = 0, kZstd = 1 };
+
+/* Whether this build can compress and decompress with the given method. zstd
+ * is only available when built with BUILD_ZSTD. */
+bool isCompressionSupported(UploadCompression compression);
+
+/* Compress a stream of data piece by piece. Throws std::runtime_error on
+ * failure. */
+class StreamCompressor {
+ public:
+  explicit StreamCompressor(UploadCompression compression);
+  ~StreamCompressor();
+  StreamCompressor(const StreamCompressor&) = delete;
+  StreamCompressor(StreamCompressor&&) = delete;
+  StreamCompressor& operator=(const StreamCompressor&) = delete;
+  StreamCompressor& operator=(StreamCompressor&&) = delete;
+
+  /* Append to `out` the compressed output available after `size` bytes of
+   * input. `last` ends the stream and flushes everything that is left. */
+  void compress(const uint8_t* data, size_t size, bool last, std::string& out);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/* Decompress a stream of data piece by piece, handing the output to a sink as
+ * it comes, so that a small piece of input that expands a lot does not have to
+ * be held in memory. Throws std::runtime_error on corrupted input. */
+class StreamDecompressor {
+ public:
+  /* Returns false to stop the decompression */
+  using Sink = std::function<bool(const uint8_t* data, size_t size)>;
+
+  explicit StreamDecompressor(UploadCompression compression);
+  ~StreamDecompressor();
+  StreamDecompressor(const StreamDecompressor&) = delete;
+  StreamDecompressor(StreamDecompressor&&) = delete;
+  StreamDecompressor& operator=(const StreamDecompressor&) = delete;
+  StreamDecompressor& operator=(StreamDecompressor&&) = delete;
+
+  /* Returns false if the sink stopped the decompression. */
+  bool decompress(const uint8_t* data, size_t size, const Sink& sink);
+  /* The end of the compressed stream has been reached. */
+  bool finished() const;
+  uint64_t output_size() const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace Uptane
+
+#endif  // UPTANE_COMPRESSION_H_
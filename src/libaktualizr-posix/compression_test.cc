@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "compression.h"
+
+using Uptane::StreamCompressor;
+using Uptane::StreamDecompressor;
+using Uptane::UploadCompression;
+
+static std::string compressibleData(size_t size) {
+  std::string data;
+  data.reserve(size);
+  for (size_t k = 0; data.size() < size; ++k) {
+    data += "firmware block " + std::to_string(k % 100) + "\n";
+  }
+  data.resize(size);
+  return data;
+}
+
+/* Compress and decompress back in pieces of the given size. */
+static std::string roundTrip(UploadCompression compression, const std::string& data, size_t piece,
+                             std::string* compressed_out = nullptr) {
+  StreamCompressor compressor(compression);
+  std::string compressed;
+  for (size_t pos = 0; pos < data.size(); pos += piece) {
+    const size_t size = std::min(piece, data.size() - pos);
+    compressor.compress(reinterpret_cast<const uint8_t*>(data.data() + pos), size, pos + size == data.size(),
+                        compressed);
+  }
+
+  StreamDecompressor decompressor(compression);
+  std::string result;
+  auto sink = [&result](const uint8_t* out, size_t size) {
+    result.append(reinterpret_cast<const char*>(out), size);
+    return true;
+  };
+  for (size_t pos = 0; pos < compressed.size(); pos += piece) {
+    const size_t size = std::min(piece, compressed.size() - pos);
+    EXPECT_TRUE(decompressor.decompress(reinterpret_cast<const uint8_t*>(compressed.data() + pos), size, sink));
+  }
+  EXPECT_EQ(decompressor.output_size(), result.size());
+  if (compression != UploadCompression::kNone) {
+    EXPECT_TRUE(decompressor.finished());
+  }
+  if (compressed_out != nullptr) {
+    *compressed_out = compressed;
+  }
+  return result;
+}
+
+TEST(Compression, None) {
+  const std::string data = compressibleData(5000);
+  std::string compressed;
+  EXPECT_EQ(roundTrip(UploadCompression::kNone, data, 1024, &compressed), data);
+  EXPECT_EQ(compressed, data);
+}
+
+TEST(Compression, Zstd) {
+  if (!Uptane::isCompressionSupported(UploadCompression::kZstd)) {
+    EXPECT_THROW(StreamCompressor{UploadCompression::kZstd}, std::runtime_error);
+    EXPECT_THROW(StreamDecompressor{UploadCompression::kZstd}, std::runtime_error);
+    return;
+  }
+  for (size_t size : {static_cast<size_t>(1), static_cast<size_t>(1024), static_cast<size_t>(1 << 20) + 1}) {
+    const std::string data = compressibleData(size);
+    std::string compressed;
+    EXPECT_EQ(roundTrip(UploadCompression::kZstd, data, 1024, &compressed), data);
+    if (size > 1024) {
+      EXPECT_LT(compressed.size(), data.size() / 4);
+    }
+  }
+}
+
+/* A small piece of input that expands a lot is handed out to the sink in
+ * bounded pieces. */
+TEST(Compression, ZstdExpansion) {
+  if (!Uptane::isCompressionSupported(UploadCompression::kZstd)) {
+    return;
+  }
+  const std::string data(16 << 20, '\0');
+  StreamCompressor compressor(UploadCompression::kZstd);
+  std::string compressed;
+  compressor.compress(reinterpret_cast<const uint8_t*>(data.data()), data.size(), true, compressed);
+  ASSERT_LT(compressed.size(), 1024U);
+
+  StreamDecompressor decompressor(UploadCompression::kZstd);
+  size_t max_piece = 0;
+  EXPECT_TRUE(decompressor.decompress(reinterpret_cast<const uint8_t*>(compressed.data()), compressed.size(),
+                                      [&max_piece](const uint8_t* out, size_t size) {
+                                        (void)out;
+                                        max_piece = std::max(max_piece, size);
+                                        return true;
+                                      }));
+  EXPECT_EQ(decompressor.output_size(), data.size());
+  EXPECT_TRUE(decompressor.finished());
+  EXPECT_LE(max_piece, 1U << 20);
+}
+
+TEST(Compression, ZstdCorrupted) {
+  if (!Uptane::isCompressionSupported(UploadCompression::kZstd)) {
+    return;
+  }
+  const std::string garbage(100, 'x');
+  StreamDecompressor decompressor(UploadCompression::kZstd);
+  EXPECT_THROW(decompressor.decompress(reinterpret_cast<const uint8_t*>(garbage.data()), garbage.size(),
+                                       [](const uint8_t*, size_t) { return true; }),
+               std::runtime_error);
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
@@ -8,6 +8,7 @@
 #include <memory>
 
 #include "asn1/asn1_message.h"
+#include "compression.h"
 #include "der_encoder.h"
 #include "libaktualizr/secondary_provider.h"
 #include "logging/logging.h"
@@ -120,6 +121,13 @@ void IpUptaneSecondary::getSecondaryVersion() const {
   req->present(AKIpUptaneMes_PR_versionReq);
   auto m = req->versionReq();
   m->version = latest_version;
+  if (isCompressionSupported(UploadCompression::kZstd)) {
+    m->compression = Asn1Allocation<AKCompressionList_t>();
+    auto* zstd = Asn1Allocation<AKCompression_t>();
+    *zstd = AKCompression_zstd;
+    ASN_SEQUENCE_ADD(m->compression, zstd);
+  }
+  upload_compression_ = UploadCompression::kNone;
   auto resp = Asn1Rpc(req, getAddr());
 
   if (resp->present() != AKIpUptaneMes_PR_versionResp) {
@@ -145,6 +153,33 @@ void IpUptaneSecondary::getSecondaryVersion() const {
               << latest_version << "! Communication will most likely fail!";
     protocol_version = latest_version;
   }
+
+  // Older Secondaries do not know about compression and leave it out.
+  if (r->compression != nullptr) {
+    const auto compression = static_cast<UploadCompression>(*r->compression);
+    if (isCompressionSupported(compression)) {
+      upload_compression_ = compression;
+    } else {
+      LOG_WARNING << "Secondary " << getSerial() << " chose an unsupported compression method: " << *r->compression;
+    }
+  }
+  LOG_DEBUG << "Using compression method " << static_cast<int>(upload_compression_) << " for Secondary "
+            << getSerial();
+}
+
+/* Already compressed images can be left uncompressed on the way to the
+ * Secondary by setting "compressUpload" to false in the custom metadata of the
+ * Target. */
+UploadCompression IpUptaneSecondary::uploadCompression(const Uptane::Target& target) const {
+  if (upload_compression_ == UploadCompression::kNone) {
+    return UploadCompression::kNone;
+  }
+  const Json::Value custom = target.custom_data();
+  if (custom.isObject() && custom.isMember("compressUpload") && !custom["compressUpload"].asBool()) {
+    LOG_DEBUG << "Not compressing " << target.filename() << " as set in its metadata";
+    return UploadCompression::kNone;
+  }
+  return upload_compression_;
 }
 
 data::InstallationResult IpUptaneSecondary::putMetadata(const Target& target) {
@@ -368,7 +403,7 @@ data::InstallationResult IpUptaneSecondary::sendFirmware(const Uptane::Target& t
   }
 
   if (protocol_version == 2) {
-    return sendFirmware_v2(target);
+    return sendFirmware_v2(target, flow_control);
   }
   if (protocol_version == 1) {
     return sendFirmware_v1(target);
@@ -413,12 +448,13 @@ data::InstallationResult IpUptaneSecondary::sendFirmware_v1(const Uptane::Target
   return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "");
 }
 
-data::InstallationResult IpUptaneSecondary::sendFirmware_v2(const Uptane::Target& target) {
+data::InstallationResult IpUptaneSecondary::sendFirmware_v2(const Uptane::Target& target,
+                                                            const api::FlowControlToken* flow_control) {
   LOG_INFO << "Instructing Secondary " << getSerial() << " to receive target " << target.filename();
   if (target.IsOstree()) {
     return downloadOstreeRev(target);
   } else {
-    return uploadFirmware(target);
+    return uploadFirmware(target, flow_control);
   }
 }
 
@@ -496,43 +532,121 @@ data::InstallationResult IpUptaneSecondary::downloadOstreeRev(const Uptane::Targ
   return data::InstallationResult(static_cast<data::ResultCode::Numeric>(r->result), ToString(r->description));
 }
 
-data::InstallationResult IpUptaneSecondary::uploadFirmware(const Uptane::Target& target) {
+data::InstallationResult IpUptaneSecondary::uploadFirmware(const Uptane::Target& target,
+                                                           const api::FlowControlToken* flow_control) {
   LOG_INFO << "Uploading the target image (" << target.filename() << ") "
            << "to the Secondary (" << getSerial() << ")";
 
-  auto upload_result = data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "");
+  const UploadCompression compression = uploadCompression(target);
+  try {
+    // Possibly shared with other Secondaries receiving the same image
+    auto image_reader = secondary_provider_->getTargetImageReader(target, getSerial());
+    if (compression != UploadCompression::kNone) {
+      return uploadCompressedFirmware(target, *image_reader, compression, flow_control);
+    }
 
-  auto image_reader = secondary_provider_->getTargetFileHandle(target);
+    const uint64_t image_size = target.length();
+    const size_t size = 1024;
+    uint64_t total_send_data = 0;
+    auto upload_data_result = data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+
+    // Read up to the end even when everything has been sent, as that is where
+    // a shared image is checked against its hash.
+    std::shared_ptr<const std::string> chunk;
+    while (upload_data_result.isSuccess() && (chunk = image_reader->next()) != nullptr) {
+      const auto chunk_size = static_cast<size_t>(std::min<uint64_t>(chunk->size(), image_size - total_send_data));
+      for (size_t pos = 0; pos < chunk_size && upload_data_result.isSuccess(); pos += size) {
+        const size_t piece = std::min(size, chunk_size - pos);
+        upload_data_result =
+            uploadFirmwareData(reinterpret_cast<const uint8_t*>(chunk->data()) + pos, piece, flow_control);
+        total_send_data += piece;
+      }
+    }
+    if (!upload_data_result.isSuccess()) {
+      return upload_data_result;
+    }
+    if (total_send_data != image_size) {
+      return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "Incomplete upload");
+    }
+    return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+  } catch (const std::exception& e) {
+    LOG_ERROR << "Failed to upload the target image: " << e.what();
+    return data::InstallationResult(data::ResultCode::Numeric::kInternalError,
+                                    std::string("Failed to upload the target image: ") + e.what());
+  }
+}
 
-  uint64_t image_size = target.length();
+/* The image is compressed as it is read, and the compressed stream is sent in
+ * pieces of the same size as uncompressed data would be. */
+data::InstallationResult IpUptaneSecondary::uploadCompressedFirmware(const Uptane::Target& target,
+                                                                     TargetImageReader& image_reader,
+                                                                     UploadCompression compression,
+                                                                     const api::FlowControlToken* flow_control) {
+  const uint64_t image_size = target.length();
   const size_t size = 1024;
-  size_t total_send_data = 0;
-  std::array<uint8_t, size> buf{};
+  uint64_t total_read_data = 0;
+  uint64_t total_send_data = 0;
   auto upload_data_result = data::InstallationResult(data::ResultCode::Numeric::kOk, "");
 
-  while (total_send_data < image_size && upload_data_result.isSuccess()) {
-    image_reader.read(reinterpret_cast<char*>(buf.data()), buf.size());
-    upload_data_result = uploadFirmwareData(buf.data(), static_cast<size_t>(image_reader.gcount()));
-    total_send_data += static_cast<size_t>(image_reader.gcount());
+  StreamCompressor compressor(compression);
+  std::string compressed;
+  bool last = false;
+  while (!last && upload_data_result.isSuccess()) {
+    auto chunk = image_reader.next();
+    last = chunk == nullptr;
+    size_t read_size = 0;
+    if (!last) {
+      read_size = static_cast<size_t>(std::min<uint64_t>(chunk->size(), image_size - total_read_data));
+      total_read_data += read_size;
+    }
+    compressor.compress(last ? nullptr : reinterpret_cast<const uint8_t*>(chunk->data()), read_size, last,
+                        compressed);
+
+    // Send the full pieces, and everything once the end has been reached
+    size_t sent = 0;
+    while (upload_data_result.isSuccess() &&
+           (compressed.size() - sent >= size || (last && sent < compressed.size()))) {
+      const size_t piece = std::min(size, compressed.size() - sent);
+      upload_data_result = uploadFirmwareData(reinterpret_cast<const uint8_t*>(compressed.data()) + sent, piece,
+                                              flow_control, compression);
+      sent += piece;
+    }
+    compressed.erase(0, sent);
+    total_send_data += sent;
   }
-  if (upload_data_result.isSuccess() && total_send_data == image_size) {
-    upload_result = data::InstallationResult(data::ResultCode::Numeric::kOk, "");
-  } else if (!upload_data_result.isSuccess()) {
-    upload_result = upload_data_result;
-  } else {
-    upload_result = data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "Incomplete upload");
+
+  if (!upload_data_result.isSuccess()) {
+    return upload_data_result;
   }
-  image_reader.close();
-  return upload_result;
+  if (total_read_data != image_size) {
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "Incomplete upload");
+  }
+  LOG_INFO << "Sent " << total_send_data << " bytes of compressed data for an image of " << image_size << " bytes";
+  return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
 }
 
-data::InstallationResult IpUptaneSecondary::uploadFirmwareData(const uint8_t* data, size_t size) {
+data::InstallationResult IpUptaneSecondary::uploadFirmwareData(const uint8_t* data, size_t size,
+                                                               const api::FlowControlToken* flow_control,
+                                                               UploadCompression compression) {
+  // Shares the bandwidth limit with the downloads
+  if (flow_control != nullptr && !flow_control->consume(size)) {
+    return data::InstallationResult(data::ResultCode::Numeric::kOperationCancelled, "");
+  }
+
   Asn1Message::Ptr req(Asn1Message::Empty());
   req->present(AKIpUptaneMes_PR_uploadDataReq);
 
   auto m = req->uploadDataReq();
   OCTET_STRING_fromBuf(&m->data, reinterpret_cast<const char*>(data), static_cast<int>(size));
-  auto resp = Asn1Rpc(req, getAddr());
+  if (compression != UploadCompression::kNone) {
+    m->compression = Asn1Allocation<AKCompression_t>();
+    *m->compression = static_cast<AKCompression_t>(compression);
+  }
+  Asn1Message::Ptr resp;
+  {
+    std::lock_guard<LinkLimiter> link_guard(*secondary_provider_->getLinkLimiter(Type()));
+    resp = Asn1Rpc(req, getAddr());
+  }
 
   if (resp->present() == AKIpUptaneMes_PR_NOTHING) {
     LOG_ERROR << "Secondary " << getSerial() << " failed to respond to a request to receive firmware data.";
@@ -1,11 +1,15 @@
 #ifndef UPTANE_IPUPTANESECONDARY_H_
 #define UPTANE_IPUPTANESECONDARY_H_
 
+#include <fstream>
+
+#include "compression.h"
 #include "libaktualizr/secondaryinterface.h"
 #include "libaktualizr/types.h"
 
 struct AKMetaCollection;
 using AKMetaCollection_t = struct AKMetaCollection;
+class TargetImageReader;
 
 namespace Uptane {
 
@@ -43,18 +47,24 @@ class IpUptaneSecondary : public SecondaryInterface {
  private:
   const std::pair<std::string, uint16_t>& getAddr() const { return addr_; }
   void getSecondaryVersion() const;
+  UploadCompression uploadCompression(const Uptane::Target& target) const;
   data::InstallationResult putMetadata_v1(const Uptane::MetaBundle& meta_bundle);
   data::InstallationResult putMetadata_v2(const Uptane::MetaBundle& meta_bundle);
   data::InstallationResult sendFirmware_v1(const Uptane::Target& target);
-  data::InstallationResult sendFirmware_v2(const Uptane::Target& target);
+  data::InstallationResult sendFirmware_v2(const Uptane::Target& target, const api::FlowControlToken* flow_control);
   data::InstallationResult install_v1(const Uptane::Target& target);
   data::InstallationResult install_v2(const Uptane::Target& target);
   static void addMetadata(const Uptane::MetaBundle& meta_bundle, Uptane::RepositoryType repo, const Uptane::Role& role,
                           AKMetaCollection_t& collection);
   data::InstallationResult invokeInstallOnSecondary(const Uptane::Target& target);
   data::InstallationResult downloadOstreeRev(const Uptane::Target& target);
-  data::InstallationResult uploadFirmware(const Uptane::Target& target);
-  data::InstallationResult uploadFirmwareData(const uint8_t* data, size_t size);
+  data::InstallationResult uploadFirmware(const Uptane::Target& target, const api::FlowControlToken* flow_control);
+  data::InstallationResult uploadCompressedFirmware(const Uptane::Target& target, TargetImageReader& image_reader,
+                                                    UploadCompression compression,
+                                                    const api::FlowControlToken* flow_control);
+  data::InstallationResult uploadFirmwareData(const uint8_t* data, size_t size,
+                                              const api::FlowControlToken* flow_control,
+                                              UploadCompression compression = UploadCompression::kNone);
 
   std::shared_ptr<SecondaryProvider> secondary_provider_;
   const std::pair<std::string, uint16_t> addr_;
@@ -63,6 +73,8 @@ class IpUptaneSecondary : public SecondaryInterface {
   const HardwareIdentifier hw_id_;
   const PublicKey pub_key_;
   mutable uint32_t protocol_version{0};
+  // Negotiated along with the protocol version
+  mutable UploadCompression upload_compression_{UploadCompression::kNone};
 };
 
 }  // namespace Uptane
@@ -94,6 +94,10 @@ void UptaneConfig::updateFromPropertyTree(const boost::property_tree::ptree& pt)
   CopyFromConfig(force_install_completion, "force_install_completion", pt);
   CopyFromConfig(secondary_config_file, "secondary_config_file", pt);
   CopyFromConfig(secondary_preinstall_wait_sec, "secondary_preinstall_wait_sec", pt);
+  CopyFromConfig(secondary_link_concurrency, "secondary_link_concurrency", pt);
+  CopyFromConfig(bandwidth_limit, "bandwidth_limit", pt);
+  CopyFromConfig(bandwidth_metered_limit, "bandwidth_metered_limit", pt);
+  CopyFromConfig(bandwidth_schedule, "bandwidth_schedule", pt);
 }
 
 void UptaneConfig::writeToStream(std::ostream& out_stream) const {
@@ -105,6 +109,10 @@ void UptaneConfig::writeToStream(std::ostream& out_stream) const {
   writeOption(out_stream, force_install_completion, "force_install_completion");
   writeOption(out_stream, secondary_config_file, "secondary_config_file");
   writeOption(out_stream, secondary_preinstall_wait_sec, "secondary_preinstall_wait_sec");
+  writeOption(out_stream, secondary_link_concurrency, "secondary_link_concurrency");
+  writeOption(out_stream, bandwidth_limit, "bandwidth_limit");
+  writeOption(out_stream, bandwidth_metered_limit, "bandwidth_metered_limit");
+  writeOption(out_stream, bandwidth_schedule, "bandwidth_schedule");
 }
 
 /**
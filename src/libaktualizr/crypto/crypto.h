@@ -8,6 +8,7 @@
 #include <algorithm>  // for copy
 #include <array>      // for array
 #include <cstdint>    // for uint64_t
+#include <cstring>    // for memcpy
 #include <memory>     // for shared_ptr
 #include <string>     // for string
 
@@ -40,6 +41,10 @@ class MultiPartHasher {
   virtual void reset() = 0;
   virtual std::string getHexDigest() = 0;
   virtual Hash getHash() = 0;
+  // Raw state of the hash in progress, to carry on with it later, e.g. after a
+  // restart. Only meant to be restored by the same build.
+  virtual std::string getState() const = 0;
+  virtual bool setState(const std::string &state) = 0;
 };
 
 class MultiPartSHA512Hasher : public MultiPartHasher {
@@ -54,6 +59,14 @@ class MultiPartSHA512Hasher : public MultiPartHasher {
   void reset() override { crypto_hash_sha512_init(&state_); }
   std::string getHexDigest() override;
   Hash getHash() override { return Hash(Hash::Type::kSha512, getHexDigest()); }
+  std::string getState() const override { return std::string(reinterpret_cast<const char *>(&state_), sizeof(state_)); }
+  bool setState(const std::string &state) override {
+    if (state.size() != sizeof(state_)) {
+      return false;
+    }
+    std::memcpy(&state_, state.data(), sizeof(state_));
+    return true;
+  }
 
  private:
   crypto_hash_sha512_state state_{};
@@ -72,6 +85,14 @@ class MultiPartSHA256Hasher : public MultiPartHasher {
   std::string getHexDigest() override;
 
   Hash getHash() override { return Hash(Hash::Type::kSha256, getHexDigest()); }
+  std::string getState() const override { return std::string(reinterpret_cast<const char *>(&state_), sizeof(state_)); }
+  bool setState(const std::string &state) override {
+    if (state.size() != sizeof(state_)) {
+      return false;
+    }
+    std::memcpy(&state_, state.data(), sizeof(state_));
+    return true;
+  }
 
  private:
   crypto_hash_sha256_state state_{};
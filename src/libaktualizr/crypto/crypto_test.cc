@@ -41,6 +41,23 @@ TEST(crypto, Sha512) {
   EXPECT_EQ(expected_result, result);
 }
 
+/* A multi-part hash can be carried on with from its saved state. */
+TEST(crypto, MultiPartHasherState) {
+  const std::string first = "This is string ";
+  const std::string second = "for testing";
+  for (auto type : {Hash::Type::kSha256, Hash::Type::kSha512}) {
+    auto hasher = MultiPartHasher::create(type);
+    hasher->update(reinterpret_cast<const unsigned char *>(first.data()), first.size());
+
+    auto resumed = MultiPartHasher::create(type);
+    ASSERT_TRUE(resumed->setState(hasher->getState()));
+    resumed->update(reinterpret_cast<const unsigned char *>(second.data()), second.size());
+    EXPECT_EQ(resumed->getHash(), Hash::generate(type, first + second));
+
+    EXPECT_FALSE(resumed->setState("too short"));
+  }
+}
+
 /* Sign and verify a file with RSA key stored in a file. */
 TEST(crypto, SignVerifyRsaFile) {
   std::string text = "This is text for sign";
@@ -3,7 +3,6 @@
 #include <stdexcept>
 #include <utility>
 
-#include <boost/filesystem.hpp>
 #include <boost/scoped_array.hpp>
 
 #include "crypto/crypto.h"
@@ -34,6 +33,22 @@ KeyManager::KeyManager(std::shared_ptr<INvStorage> backend, KeyManagerConfig con
   }
 }
 
+/**
+ * Write a TLS credential to its temporary file, unless the file already holds
+ * it: keys are loaded again before each download, and mostly do not change.
+ */
+static void putTlsFile(std::unique_ptr<TemporaryFile> &file, std::string &contents, const std::string &value,
+                       const std::string &name) {
+  if (value.empty() || (file != nullptr && value == contents)) {
+    return;
+  }
+  if (file == nullptr) {
+    file = std_::make_unique<TemporaryFile>(name);
+  }
+  file->PutContents(value);
+  contents = value;
+}
+
 void KeyManager::loadKeys(const std::string *pkey_content, const std::string *cert_content,
                           const std::string *ca_content) {
   if (config_.tls_pkey_source == CryptoSource::kFile) {
@@ -43,12 +58,7 @@ void KeyManager::loadKeys(const std::string *pkey_content, const std::string *ce
     } else {
       backend_->loadTlsPkey(&pkey);
     }
-    if (!pkey.empty()) {
-      if (tmp_pkey_file == nullptr) {
-        tmp_pkey_file = std_::make_unique<TemporaryFile>("tls-pkey");
-      }
-      tmp_pkey_file->PutContents(pkey);
-    }
+    putTlsFile(tmp_pkey_file, tmp_pkey_contents, pkey, "tls-pkey");
   }
   if (config_.tls_cert_source == CryptoSource::kFile) {
     std::string cert;
@@ -57,12 +67,7 @@ void KeyManager::loadKeys(const std::string *pkey_content, const std::string *ce
     } else {
       backend_->loadTlsCert(&cert);
     }
-    if (!cert.empty()) {
-      if (tmp_cert_file == nullptr) {
-        tmp_cert_file = std_::make_unique<TemporaryFile>("tls-cert");
-      }
-      tmp_cert_file->PutContents(cert);
-    }
+    putTlsFile(tmp_cert_file, tmp_cert_contents, cert, "tls-cert");
   }
   if (config_.tls_ca_source == CryptoSource::kFile) {
     std::string ca;
@@ -71,12 +76,7 @@ void KeyManager::loadKeys(const std::string *pkey_content, const std::string *ce
     } else {
       backend_->loadTlsCa(&ca);
     }
-    if (!ca.empty()) {
-      if (tmp_ca_file == nullptr) {
-        tmp_ca_file = std_::make_unique<TemporaryFile>("tls-ca");
-      }
-      tmp_ca_file->PutContents(ca);
-    }
+    putTlsFile(tmp_ca_file, tmp_ca_contents, ca, "tls-ca");
   }
 }
 
@@ -89,7 +89,7 @@ std::string KeyManager::getPkeyFile() const {
     pkey_file = (*p11_)->getItemFullId(config_.p11.tls_pkey_id);
   }
   if (config_.tls_pkey_source == CryptoSource::kFile) {
-    if (tmp_pkey_file && !boost::filesystem::is_empty(tmp_pkey_file->PathString())) {
+    if (tmp_pkey_file && !tmp_pkey_contents.empty()) {
       pkey_file = tmp_pkey_file->PathString();
     }
   }
@@ -105,7 +105,7 @@ std::string KeyManager::getCertFile() const {
     cert_file = (*p11_)->getItemFullId(config_.p11.tls_clientcert_id);
   }
   if (config_.tls_cert_source == CryptoSource::kFile) {
-    if (tmp_cert_file && !boost::filesystem::is_empty(tmp_cert_file->PathString())) {
+    if (tmp_cert_file && !tmp_cert_contents.empty()) {
       cert_file = tmp_cert_file->PathString();
     }
   }
@@ -121,7 +121,7 @@ std::string KeyManager::getCaFile() const {
     ca_file = (*p11_)->getItemFullId(config_.p11.tls_cacert_id);
   }
   if (config_.tls_ca_source == CryptoSource::kFile) {
-    if (tmp_ca_file && !boost::filesystem::is_empty(tmp_ca_file->PathString())) {
+    if (tmp_ca_file && !tmp_ca_contents.empty()) {
       ca_file = tmp_ca_file->PathString();
     }
   }
@@ -45,6 +45,10 @@ class KeyManager {
   std::unique_ptr<TemporaryFile> tmp_pkey_file;
   std::unique_ptr<TemporaryFile> tmp_cert_file;
   std::unique_ptr<TemporaryFile> tmp_ca_file;
+  // What the temporary files hold
+  std::string tmp_pkey_contents;
+  std::string tmp_cert_contents;
+  std::string tmp_ca_contents;
 };
 
 #endif  // KEYMANAGER_H_
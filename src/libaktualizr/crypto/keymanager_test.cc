@@ -113,6 +113,30 @@ TEST(KeyManager, InitFileValid) {
   EXPECT_EQ(cert, Utils::readFile(cert_file));
 }
 
+/* Loading the keys again keeps the same files, which follow changes to the
+ * stored credentials. */
+TEST(KeyManager, LoadKeysAgain) {
+  Config config;
+  TemporaryDirectory temp_dir;
+  config.storage.path = temp_dir.Path();
+  std::shared_ptr<INvStorage> storage = INvStorage::newStorage(config.storage);
+  storage->storeTlsCa(Utils::readFile("tests/test_data/prov/root.crt"));
+  storage->storeTlsPkey(Utils::readFile("tests/test_data/prov/pkey.pem"));
+  storage->storeTlsCert(Utils::readFile("tests/test_data/prov/client.pem"));
+  KeyManager keys(storage, config.keymanagerConfig());
+
+  keys.loadKeys();
+  const std::string cert_file = keys.getCertFile();
+  keys.loadKeys();
+  EXPECT_EQ(keys.getCertFile(), cert_file);
+
+  const std::string new_cert = Utils::readFile("tests/test_data/prov/root.crt");
+  storage->storeTlsCert(new_cert);
+  keys.loadKeys();
+  EXPECT_EQ(keys.getCertFile(), cert_file);
+  EXPECT_EQ(Utils::readFile(cert_file), new_cert);
+}
+
 #ifdef BUILD_P11
 
 class P11KeyManager : public ::testing::Test {
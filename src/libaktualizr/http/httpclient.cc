@@ -107,6 +107,16 @@ HttpClient::~HttpClient() {
   curl_easy_cleanup(curl);
 }
 
+#if CURL_AT_LEAST_VERSION(7, 77, 0)
+static void setBlob(CURL* curl_handler, CURLoption option, const std::string& data) {
+  curl_blob blob{};
+  blob.data = const_cast<char*>(data.data());
+  blob.len = data.size();
+  blob.flags = CURL_BLOB_COPY;  // Also copied along with the handle by curl_easy_duphandle()
+  curlEasySetoptWrapper(curl_handler, option, &blob);
+}
+#endif
+
 void HttpClient::setCerts(const std::string& ca, CryptoSource ca_source, const std::string& cert,
                           CryptoSource cert_source, const std::string& pkey, CryptoSource pkey_source) {
   curlEasySetoptWrapper(curl, CURLOPT_SSL_VERIFYPEER, 1);
@@ -116,20 +126,30 @@ void HttpClient::setCerts(const std::string& ca, CryptoSource ca_source, const s
   if (ca_source == CryptoSource::kPkcs11) {
     throw std::runtime_error("Accessing CA certificate on PKCS11 devices isn't currently supported");
   }
+#if CURL_AT_LEAST_VERSION(7, 77, 0)
+  // Credentials are handed over in memory, so that they do not have to be
+  // written to files which curl then reads again for every connection
+  setBlob(curl, CURLOPT_CAINFO_BLOB, ca);
+#else
   std::unique_ptr<TemporaryFile> tmp_ca_file = std_::make_unique<TemporaryFile>("tls-ca");
   tmp_ca_file->PutContents(ca);
   curlEasySetoptWrapper(curl, CURLOPT_CAINFO, tmp_ca_file->Path().c_str());
   tls_ca_file = std::move_if_noexcept(tmp_ca_file);
+#endif
 
   if (cert_source == CryptoSource::kPkcs11) {
     curlEasySetoptWrapper(curl, CURLOPT_SSLCERT, cert.c_str());
     curlEasySetoptWrapper(curl, CURLOPT_SSLCERTTYPE, "ENG");
   } else {  // cert_source == CryptoSource::kFile
+#if CURL_AT_LEAST_VERSION(7, 77, 0)
+    setBlob(curl, CURLOPT_SSLCERT_BLOB, cert);
+#else
     std::unique_ptr<TemporaryFile> tmp_cert_file = std_::make_unique<TemporaryFile>("tls-cert");
     tmp_cert_file->PutContents(cert);
     curlEasySetoptWrapper(curl, CURLOPT_SSLCERT, tmp_cert_file->Path().c_str());
-    curlEasySetoptWrapper(curl, CURLOPT_SSLCERTTYPE, "PEM");
     tls_cert_file = std::move_if_noexcept(tmp_cert_file);
+#endif
+    curlEasySetoptWrapper(curl, CURLOPT_SSLCERTTYPE, "PEM");
   }
   pkcs11_cert = (cert_source == CryptoSource::kPkcs11);
 
@@ -139,11 +159,15 @@ void HttpClient::setCerts(const std::string& ca, CryptoSource ca_source, const s
     curlEasySetoptWrapper(curl, CURLOPT_SSLKEY, pkey.c_str());
     curlEasySetoptWrapper(curl, CURLOPT_SSLKEYTYPE, "ENG");
   } else {  // pkey_source == CryptoSource::kFile
+#if CURL_AT_LEAST_VERSION(7, 77, 0)
+    setBlob(curl, CURLOPT_SSLKEY_BLOB, pkey);
+#else
     std::unique_ptr<TemporaryFile> tmp_pkey_file = std_::make_unique<TemporaryFile>("tls-pkey");
     tmp_pkey_file->PutContents(pkey);
     curlEasySetoptWrapper(curl, CURLOPT_SSLKEY, tmp_pkey_file->Path().c_str());
-    curlEasySetoptWrapper(curl, CURLOPT_SSLKEYTYPE, "PEM");
     tls_pkey_file = std::move_if_noexcept(tmp_pkey_file);
+#endif
+    curlEasySetoptWrapper(curl, CURLOPT_SSLKEYTYPE, "PEM");
   }
   pkcs11_key = (pkey_source == CryptoSource::kPkcs11);
 }
@@ -356,6 +356,146 @@ TEST(Fetcher, DownloadOstreeFail) {
   EXPECT_EQ(http->counter, 1);
 }
 
+/* Download a target only once when several targets have the same content.
+ * Keep the content while any of them is still stored. */
+TEST(Fetcher, DownloadDeduplicated) {
+  TemporaryDirectory temp_dir;
+  config.storage.path = temp_dir.Path();
+  config.pacman.images_path = temp_dir.Path() / "images";
+  config.uptane.repo_server = server;
+
+  std::shared_ptr<INvStorage> storage(new SQLStorage(config.storage, false));
+  auto http = std::make_shared<HttpZeroLength>(temp_dir.Path());
+  auto pacman = std::make_shared<PackageManagerFake>(config.pacman, config.bootloader, storage, http);
+  KeyManager keys(storage, config.keymanagerConfig());
+  Uptane::Fetcher fetcher(config, http);
+
+  const std::string hash = "5feceb66ffc86f38d952786c6d696c79c2dbc239dd4e91b46729d73a27fb57e9";
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = hash;
+  target_json["length"] = 1;
+  Uptane::Target target("fake_file", target_json);
+  Uptane::Target other_target("other_file", target_json);
+
+  EXPECT_TRUE(pacman->fetchTarget(target, fetcher, keys, progress_cb, nullptr));
+  EXPECT_TRUE(pacman->fetchTarget(other_target, fetcher, keys, progress_cb, nullptr));
+  EXPECT_EQ(http->counter, 1);
+  EXPECT_EQ(pacman->verifyTarget(target), TargetStatus::kGood);
+  EXPECT_EQ(pacman->verifyTarget(other_target), TargetStatus::kGood);
+  // Complete downloads are moved to their final name.
+  EXPECT_TRUE(boost::filesystem::exists(config.pacman.images_path / hash));
+  for (const auto& entry : boost::filesystem::directory_iterator(config.pacman.images_path)) {
+    EXPECT_NE(entry.path().extension(), ".part");
+  }
+
+  pacman->removeTargetFile(target);
+  EXPECT_EQ(pacman->verifyTarget(target), TargetStatus::kNotFound);
+  EXPECT_EQ(pacman->verifyTarget(other_target), TargetStatus::kGood);
+
+  pacman->removeTargetFile(other_target);
+  EXPECT_EQ(pacman->verifyTarget(other_target), TargetStatus::kNotFound);
+  EXPECT_FALSE(boost::filesystem::exists(config.pacman.images_path / hash));
+}
+
+class PartialPackageManager : public PackageManagerFake {
+ public:
+  using PackageManagerFake::PackageManagerFake;
+  using PackageManagerInterface::createPartialTargetFile;
+};
+
+/* Targets with the same content being downloaded at the same time do not
+ * write to the same partial file. */
+TEST(Fetcher, PartialDownloadsSeparate) {
+  TemporaryDirectory temp_dir;
+  config.storage.path = temp_dir.Path();
+  config.pacman.images_path = temp_dir.Path() / "images";
+
+  std::shared_ptr<INvStorage> storage(new SQLStorage(config.storage, false));
+  auto http = std::make_shared<HttpZeroLength>(temp_dir.Path());
+  PartialPackageManager pacman(config.pacman, config.bootloader, storage, http);
+
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = "5feceb66ffc86f38d952786c6d696c79c2dbc239dd4e91b46729d73a27fb57e9";
+  target_json["length"] = 2;
+  Uptane::Target target("fake_file", target_json);
+  Uptane::Target other_target("other_file", target_json);
+
+  auto file = pacman.createPartialTargetFile(target);
+  file << "a";
+  file.close();
+  auto other_file = pacman.createPartialTargetFile(other_target);
+  other_file.close();
+
+  const std::string filename = storage->getTargetFilename(target.filename());
+  EXPECT_NE(filename, storage->getTargetFilename(other_target.filename()));
+  EXPECT_EQ(Utils::readFile(config.pacman.images_path / filename), "a");
+}
+
+class HttpContent : public HttpFake {
+ public:
+  HttpContent(const boost::filesystem::path& test_dir_in) : HttpFake(test_dir_in) {}
+  HttpResponse download(const std::string& url, curl_write_callback write_cb, curl_xferinfo_callback progress_cb,
+                        void* userp, curl_off_t from) override {
+    (void)progress_cb;
+    (void)from;
+
+    // The content of each target is the last character of its name.
+    std::string content = url.substr(url.size() - 1);
+    write_cb(const_cast<char*>(&content[0]), 1, 1, userp);
+    counter++;
+    return HttpResponse(content, 200, CURLE_OK, "");
+  }
+
+  int counter = 0;
+};
+
+/* Delete the least recently used targets to stay within the images quota.
+ * Never delete installed targets. */
+TEST(Fetcher, ImagesQuota) {
+  TemporaryDirectory temp_dir;
+  Config quota_config = config;
+  quota_config.storage.path = temp_dir.Path();
+  quota_config.pacman.images_path = temp_dir.Path() / "images";
+  quota_config.pacman.images_quota = 2;
+  quota_config.uptane.repo_server = server;
+
+  std::shared_ptr<INvStorage> storage(new SQLStorage(quota_config.storage, false));
+  auto http = std::make_shared<HttpContent>(temp_dir.Path());
+  auto pacman = std::make_shared<PackageManagerFake>(quota_config.pacman, quota_config.bootloader, storage, http);
+  KeyManager keys(storage, quota_config.keymanagerConfig());
+  Uptane::Fetcher fetcher(quota_config, http);
+
+  auto make_target = [](const std::string& name, const std::string& hash) {
+    Json::Value target_json;
+    target_json["hashes"]["sha256"] = hash;
+    target_json["length"] = 1;
+    return Uptane::Target(name, target_json);
+  };
+  Uptane::Target target0 = make_target("file0", "5feceb66ffc86f38d952786c6d696c79c2dbc239dd4e91b46729d73a27fb57e9");
+  Uptane::Target target1 = make_target("file1", "6b86b273ff34fce19d6b804eff5a3f5747ada4eaa22f1d49c01e52ddb7875b4b");
+  Uptane::Target target2 = make_target("file2", "d4735e3a265e16eee03f59718b9b5d03019c07d8b6c51f90da3a666eec13ab35");
+
+  storage->storeEcuSerials({{Uptane::EcuSerial("primary"), Uptane::HardwareIdentifier("primary_hw")}});
+  EXPECT_TRUE(pacman->fetchTarget(target0, fetcher, keys, progress_cb, nullptr));
+  EXPECT_TRUE(pacman->fetchTarget(target1, fetcher, keys, progress_cb, nullptr));
+  storage->saveInstalledVersion("primary", target0, InstalledVersionUpdateMode::kCurrent, "");
+
+  // file0 is the least recently used, but it is installed.
+  EXPECT_TRUE(pacman->fetchTarget(target2, fetcher, keys, progress_cb, nullptr));
+  EXPECT_EQ(http->counter, 3);
+  EXPECT_EQ(pacman->verifyTarget(target0), TargetStatus::kGood);
+  EXPECT_EQ(pacman->verifyTarget(target1), TargetStatus::kNotFound);
+  EXPECT_EQ(pacman->verifyTarget(target2), TargetStatus::kGood);
+
+  // Once something else is installed, file0 can go.
+  storage->saveInstalledVersion("primary", target2, InstalledVersionUpdateMode::kCurrent, "");
+  EXPECT_TRUE(pacman->fetchTarget(target1, fetcher, keys, progress_cb, nullptr));
+  EXPECT_EQ(http->counter, 4);
+  EXPECT_EQ(pacman->verifyTarget(target0), TargetStatus::kNotFound);
+  EXPECT_EQ(pacman->verifyTarget(target1), TargetStatus::kGood);
+  EXPECT_EQ(pacman->verifyTarget(target2), TargetStatus::kGood);
+}
+
 #ifndef __NO_MAIN__
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
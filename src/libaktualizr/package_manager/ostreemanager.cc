@@ -28,6 +28,15 @@ static void aktualizr_progress_cb(OstreeAsyncProgress *progress, gpointer data)
   if (mt->token != nullptr && !mt->token->canContinue()) {
     g_cancellable_cancel(mt->cancellable.get());
   }
+  // Keep the pull within the bandwidth limit: as this runs in the main context
+  // of the pull, waiting here holds back its fetches as well.
+  const guint64 bytes_transferred = ostree_async_progress_get_uint64(progress, "bytes-transferred");
+  if (mt->token != nullptr && bytes_transferred > mt->bytes_transferred) {
+    if (!mt->token->consume(bytes_transferred - mt->bytes_transferred)) {
+      g_cancellable_cancel(mt->cancellable.get());
+    }
+  }
+  mt->bytes_transferred = bytes_transferred;
 
   g_autofree char *status = ostree_async_progress_get_status(progress);
   guint scanning = ostree_async_progress_get_uint(progress, "scanning");
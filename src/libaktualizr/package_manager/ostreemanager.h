@@ -34,6 +34,7 @@ struct PullMetaStruct {
         progress_cb{std::move(progress_cb_in)} {}
   Uptane::Target target;
   unsigned int percent_complete{0};
+  guint64 bytes_transferred{0};
   const api::FlowControlToken *token;
   GObjectUniquePtr<GCancellable> cancellable;
   OstreeProgressCb progress_cb;
@@ -11,10 +11,22 @@ void PackageConfig::updateFromPropertyTree(const boost::property_tree::ptree& pt
       CopyFromConfig(sysroot, cp.first, pt);
     } else if (cp.first == "ostree_server") {
       CopyFromConfig(ostree_server, cp.first, pt);
+    } else if (cp.first == "ostree_proxy_port") {
+      CopyFromConfig(ostree_proxy_port, cp.first, pt);
+    } else if (cp.first == "ostree_proxy_address") {
+      CopyFromConfig(ostree_proxy_address, cp.first, pt);
+    } else if (cp.first == "ostree_proxy_cache") {
+      CopyFromConfig(ostree_proxy_cache, cp.first, pt);
+    } else if (cp.first == "ostree_proxy_cache_size") {
+      CopyFromConfig(ostree_proxy_cache_size, cp.first, pt);
     } else if (cp.first == "images_path") {
       CopyFromConfig(images_path, cp.first, pt);
+    } else if (cp.first == "images_quota") {
+      CopyFromConfig(images_quota, cp.first, pt);
     } else if (cp.first == "packages_file") {
       CopyFromConfig(packages_file, cp.first, pt);
+    } else if (cp.first == "full_target_verification") {
+      CopyFromConfig(full_target_verification, cp.first, pt);
     } else if (cp.first == "fake_need_reboot") {
       CopyFromConfig(fake_need_reboot, cp.first, pt);
     } else if (cp.first == "booted") {
@@ -30,8 +42,14 @@ void PackageConfig::writeToStream(std::ostream& out_stream) const {
   writeOption(out_stream, os, "os");
   writeOption(out_stream, sysroot, "sysroot");
   writeOption(out_stream, ostree_server, "ostree_server");
+  writeOption(out_stream, ostree_proxy_port, "ostree_proxy_port");
+  writeOption(out_stream, ostree_proxy_address, "ostree_proxy_address");
+  writeOption(out_stream, ostree_proxy_cache, "ostree_proxy_cache");
+  writeOption(out_stream, ostree_proxy_cache_size, "ostree_proxy_cache_size");
   writeOption(out_stream, images_path, "images_path");
+  writeOption(out_stream, images_quota, "images_quota");
   writeOption(out_stream, packages_file, "packages_file");
+  writeOption(out_stream, full_target_verification, "full_target_verification");
   writeOption(out_stream, fake_need_reboot, "fake_need_reboot");
   writeOption(out_stream, booted, "booted");
 
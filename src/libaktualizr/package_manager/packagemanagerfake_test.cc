@@ -5,6 +5,10 @@
 #include <sstream>
 #include <string>
 
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+
 #include <boost/filesystem.hpp>
 
 #include "crypto/crypto.h"
@@ -159,6 +163,66 @@ TEST(PackageManagerFake, Verify) {
   EXPECT_EQ(fakepm.verifyTarget(target), TargetStatus::kGood);
 }
 
+/*
+ * Remember verified targets and trust them while the file does not change.
+ * Verify the hash again when the file changes.
+ * Always verify the hash again if configured to.
+ */
+TEST(PackageManagerFake, VerifyRemembered) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_NONE;
+  config.pacman.images_path = temp_dir.Path() / "images";
+  config.storage.path = temp_dir.Path();
+  std::shared_ptr<INvStorage> storage = INvStorage::newStorage(config.storage);
+
+  Uptane::EcuMap primary_ecu{{Uptane::EcuSerial("primary"), Uptane::HardwareIdentifier("primary_hw")}};
+  const std::string content = "good";
+  const std::string hash = Crypto::sha256digestHex(content);
+  Uptane::Target target("some-pkg", primary_ecu, {Hash(Hash::Type::kSha256, hash)}, content.size());
+
+  PackageManagerFake fakepm(config.pacman, config.bootloader, storage, nullptr);
+  auto whandle = fakepm.createTargetFile(target);
+  whandle << content;
+  whandle.close();
+
+  // A file that was just written is not trusted without hashing it.
+  EXPECT_EQ(fakepm.verifyTarget(target), TargetStatus::kGood);
+  EXPECT_FALSE(storage->loadTargetVerification(target.filename(), nullptr));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  EXPECT_EQ(fakepm.verifyTarget(target), TargetStatus::kGood);
+  TargetVerification verified;
+  ASSERT_TRUE(storage->loadTargetVerification(target.filename(), &verified));
+  EXPECT_EQ(verified.hash, "sha256:" + hash);
+  EXPECT_EQ(verified.size, 4);
+
+  // Modified in place: the change is noticed and the file is hashed again.
+  const auto path = config.pacman.images_path / hash;
+  Utils::writeFile(path, std::string("bad!"));
+  EXPECT_EQ(fakepm.verifyTarget(target), TargetStatus::kHashMismatch);
+
+  // A record matching the file is trusted without reading it...
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  struct stat st {};
+  ASSERT_EQ(stat(path.c_str(), &st), 0);
+  verified.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  verified.ctime_ns = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+  verified.inode = static_cast<int64_t>(st.st_ino);
+  storage->storeTargetVerification(target.filename(), verified);
+  EXPECT_EQ(fakepm.verifyTarget(target), TargetStatus::kGood);
+
+  // ...unless configured not to.
+  config.pacman.full_target_verification = true;
+  PackageManagerFake fullpm(config.pacman, config.bootloader, storage, nullptr);
+  EXPECT_EQ(fullpm.verifyTarget(target), TargetStatus::kHashMismatch);
+
+  // Writing the file again forgets about it.
+  whandle = fakepm.createTargetFile(target);
+  whandle.close();
+  EXPECT_FALSE(storage->loadTargetVerification(target.filename(), nullptr));
+}
+
 TEST(PackageManagerFake, FinalizeAfterReboot) {
   TemporaryDirectory temp_dir;
   Config config;
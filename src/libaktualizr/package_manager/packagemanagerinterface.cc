@@ -1,8 +1,12 @@
 #include "libaktualizr/packagemanagerinterface.h"
 
+#include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <boost/filesystem.hpp>
+#include <algorithm>
 #include <chrono>
+#include <map>
+#include <set>
 
 #include "crypto/crypto.h"
 #include "crypto/keymanager.h"
@@ -54,6 +58,11 @@ static size_t DownloadHandler(char* contents, size_t size, size_t nmemb, void* u
   if ((ds->downloaded_length + downloaded) > expected) {
     return downloaded + 1;  // curl will abort if return unexpected size;
   }
+  // Keeps all transfers within the bandwidth limit; ProgressHandler stops the
+  // download if it is aborted meanwhile.
+  if (ds->token != nullptr) {
+    ds->token->consume(downloaded);
+  }
 
   ds->fhandle.write(contents, static_cast<std::streamsize>(downloaded));
   ds->hasher().update(reinterpret_cast<const unsigned char*>(contents), downloaded);
@@ -98,6 +107,38 @@ static void restoreHasherState(MultiPartHasher& hasher, std::ifstream data) {
   } while (data.gcount() != 0);
 }
 
+static std::string verificationHash(const Uptane::Target& target) {
+  return target.hashes()[0].TypeString() + ":" + target.hashes()[0].HashString();
+}
+
+// What identifies the content of a file without reading it, as long as it is
+// not modified behind our back without updating its metadata.
+static boost::optional<TargetVerification> fileFingerprint(const std::string& path, const Uptane::Target& target) {
+  struct stat st {};
+  if (stat(path.c_str(), &st) != 0) {
+    return boost::none;
+  }
+  TargetVerification fingerprint;
+  fingerprint.hash = verificationHash(target);
+  fingerprint.size = static_cast<int64_t>(st.st_size);
+  fingerprint.device = static_cast<int64_t>(st.st_dev);
+  fingerprint.inode = static_cast<int64_t>(st.st_ino);
+  fingerprint.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  fingerprint.ctime_ns = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+  return fingerprint;
+}
+
+// A file changed within the timestamp granularity of the filesystem right
+// after it was fingerprinted could be changed again without its times
+// changing: only trust fingerprints taken well after the last change.
+static bool isRacy(const TargetVerification& fingerprint) {
+  static constexpr int64_t racy_window_ns = 1000000000;
+  struct timespec now {};
+  clock_gettime(CLOCK_REALTIME, &now);
+  const int64_t now_ns = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+  return now_ns - fingerprint.ctime_ns < racy_window_ns;
+}
+
 bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::Fetcher& fetcher,
                                           const KeyManager& keys, const FetcherProgressCb& progress_cb,
                                           const api::FlowControlToken* token) {
@@ -110,6 +151,12 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
     TargetStatus exists = PackageManagerInterface::verifyTarget(target);
     if (exists == TargetStatus::kGood) {
       LOG_INFO << "Image already downloaded; skipping download";
+      completeTargetFile(target);
+      storage_->touchTargetFile(target.filename());
+      return true;
+    }
+    if (exists != TargetStatus::kIncomplete && reuseStoredTargetFile(target)) {
+      LOG_INFO << "Image already downloaded for another Target with the same content; skipping download";
       return true;
     }
     std::unique_ptr<DownloadMetaStruct> ds = std_::make_unique<DownloadMetaStruct>(target, progress_cb, token);
@@ -128,10 +175,11 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
       // If the target was found, but is oversized or the hash doesn't match,
       // just start over.
       LOG_DEBUG << "Initiating download of file " << target.filename();
-      ds->fhandle = createTargetFile(target);
+      ds->fhandle = createPartialTargetFile(target);
     }
 
     const uint64_t required_bytes = target.length() - ds->downloaded_length;
+    evictTargetFiles(target, required_bytes);
     if (!checkAvailableDiskSpace(required_bytes)) {
       throw std::runtime_error("Insufficient disk space available to download target");
     }
@@ -151,7 +199,7 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
                        " try to download the image from the beginning: "
                     << target_url;
         ds = std_::make_unique<DownloadMetaStruct>(target, progress_cb, token);
-        ds->fhandle = createTargetFile(target);
+        ds->fhandle = createPartialTargetFile(target);
         continue;
       }
 
@@ -178,6 +226,10 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
       throw Uptane::TargetHashMismatch(target.filename());
     }
     ds->fhandle.close();
+    completeTargetFile(target);
+    // No fingerprint is recorded here: the file has just been written, so its
+    // fingerprint cannot be trusted yet (see isRacy()). The first verifyTarget()
+    // after the racy window reads the file once and records it.
     result = true;
   } catch (const std::exception& e) {
     LOG_WARNING << "Error while downloading a target: " << e.what();
@@ -198,6 +250,17 @@ TargetStatus PackageManagerInterface::verifyTarget(const Uptane::Target& target)
     return TargetStatus::kOversized;
   }
 
+  // The file has already been verified and has not changed since: no need to
+  // read it all again.
+  const auto fingerprint = fileFingerprint(target_exists->second, target);
+  if (!config.full_target_verification && fingerprint) {
+    TargetVerification verified;
+    if (storage_->loadTargetVerification(target.filename(), &verified) && verified == *fingerprint) {
+      LOG_DEBUG << "File " << target.filename() << " is unchanged since it was last verified.";
+      return TargetStatus::kGood;
+    }
+  }
+
   // Even if the file exists and the length matches, recheck the hash.
   DownloadMetaStruct ds(target, nullptr, nullptr);
   ds.downloaded_length = target_exists->first;
@@ -207,6 +270,12 @@ TargetStatus PackageManagerInterface::verifyTarget(const Uptane::Target& target)
     return TargetStatus::kHashMismatch;
   }
 
+  // Only remember the result if the file has not changed while it was being
+  // read.
+  if (fingerprint && !isRacy(*fingerprint) && fileFingerprint(target_exists->second, target) == fingerprint) {
+    storage_->storeTargetVerification(target.filename(), *fingerprint);
+  }
+
   return TargetStatus::kGood;
 }
 
@@ -282,8 +351,131 @@ void PackageManagerInterface::removeTargetFile(const Uptane::Target& target) {
   if (!file) {
     throw std::runtime_error("File doesn't exist for target " + target.filename());
   }
-  boost::filesystem::remove(file->second);
+  const std::string filename = storage_->getTargetFilename(target.filename());
   storage_->deleteTargetInfo(target.filename());
+
+  // The file may still hold the content of other Targets
+  const auto files = storage_->loadTargetFiles();
+  const bool shared = std::any_of(files.cbegin(), files.cend(),
+                                  [&filename](const StoredTargetFile& f) { return f.filename == filename; });
+  if (!shared) {
+    boost::filesystem::remove(file->second);
+  }
+}
+
+std::ofstream PackageManagerInterface::createPartialTargetFile(const Uptane::Target& target) {
+  // Named after the Target too, as Targets with the same content may be
+  // downloaded at the same time.
+  std::string filename =
+      target.hashes()[0].HashString() + "." + Crypto::sha256digestHex(target.filename()).substr(0, 16) + ".part";
+  std::string filepath = (config.images_path / filename).string();
+  boost::filesystem::create_directories(config.images_path);
+  std::ofstream stream(filepath, std::ios::binary | std::ios::ate);
+  if (!stream.good()) {
+    throw std::runtime_error("Can't write to file " + filepath);
+  }
+  storage_->storeTargetFilename(target.filename(), filename);
+  return stream;
+}
+
+void PackageManagerInterface::completeTargetFile(const Uptane::Target& target) {
+  const std::string filename = target.hashes()[0].HashString();
+  const std::string current = storage_->getTargetFilename(target.filename());
+  if (current == filename) {
+    return;
+  }
+  // Atomically replaces whatever other Targets with the same hash referred to
+  // with verified content.
+  boost::filesystem::rename(config.images_path / current, config.images_path / filename);
+  storage_->storeTargetFilename(target.filename(), filename);
+}
+
+bool PackageManagerInterface::reuseStoredTargetFile(const Uptane::Target& target) {
+  const std::string filename = target.hashes()[0].HashString();
+  const auto path = config.images_path / filename;
+  boost::system::error_code ec;
+  if (!boost::filesystem::is_regular_file(path, ec) || boost::filesystem::file_size(path, ec) != target.length()) {
+    return false;
+  }
+
+  storage_->storeTargetFilename(target.filename(), filename);
+  if (PackageManagerInterface::verifyTarget(target) != TargetStatus::kGood) {
+    // Leave the file alone, downloading this Target will replace it.
+    storage_->deleteTargetInfo(target.filename());
+    return false;
+  }
+  return true;
+}
+
+void PackageManagerInterface::evictTargetFiles(const Uptane::Target& target, const uint64_t required_bytes) {
+  if (config.images_quota == 0) {
+    return;
+  }
+
+  // Files in least recently used order, along with the Targets they hold
+  const auto files = storage_->loadTargetFiles();
+  std::vector<std::string> filenames;
+  std::map<std::string, std::vector<std::string>> targetnames;
+  for (auto it = files.crbegin(); it != files.crend(); ++it) {
+    auto& names = targetnames[it->filename];
+    if (names.empty()) {
+      filenames.push_back(it->filename);
+    }
+    names.push_back(it->targetname);
+  }
+  std::reverse(filenames.begin(), filenames.end());
+
+  std::map<std::string, uint64_t> sizes;
+  uint64_t used = 0;
+  for (const auto& filename : filenames) {
+    boost::system::error_code ec;
+    const auto size = boost::filesystem::file_size(config.images_path / filename, ec);
+    if (!ec) {
+      sizes[filename] = size;
+      used += size;
+    }
+  }
+  if (used + required_bytes <= config.images_quota) {
+    return;
+  }
+
+  // Never evict what is installed or about to be installed
+  std::set<std::string> pinned{target.filename()};
+  EcuSerials serials;
+  storage_->loadEcuSerials(&serials);
+  for (const auto& serial : serials) {
+    boost::optional<Uptane::Target> current;
+    boost::optional<Uptane::Target> pending;
+    storage_->loadInstalledVersions(serial.first.ToString(), &current, &pending);
+    if (current) {
+      pinned.insert(current->filename());
+    }
+    if (pending) {
+      pinned.insert(pending->filename());
+    }
+  }
+
+  for (const auto& filename : filenames) {
+    if (used + required_bytes <= config.images_quota) {
+      break;
+    }
+    const auto& names = targetnames[filename];
+    if (std::any_of(names.cbegin(), names.cend(), [&pinned](const std::string& n) { return pinned.count(n) != 0; })) {
+      continue;
+    }
+    LOG_INFO << "Deleting least recently used file " << filename << " to stay within the images quota";
+    for (const auto& name : names) {
+      storage_->deleteTargetInfo(name);
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove(config.images_path / filename, ec);
+    used -= sizes[filename];
+  }
+
+  if (used + required_bytes > config.images_quota) {
+    LOG_WARNING << "Downloading " << target.filename() << " exceeds the images quota of " << config.images_quota
+                << " bytes";
+  }
 }
 
 std::vector<Uptane::Target> PackageManagerInterface::getTargetFiles() {
@@ -7,6 +7,7 @@
 #include "libaktualizr/events.h"
 #include "primary/sotauptaneclient.h"
 #include "utilities/apiqueue.h"
+#include "utilities/bandwidth_limiter.h"
 #include "utilities/timer.h"
 
 using std::shared_ptr;
@@ -24,7 +25,13 @@ Aktualizr::Aktualizr(Config config, std::shared_ptr<INvStorage> storage_in,
   storage_ = std::move(storage_in);
   storage_->importData(config_.import);
 
-  uptane_client_ = std::make_shared<SotaUptaneClient>(config_, storage_, http_in, sig_, api_queue_->FlowControlToken());
+  bandwidth_limiter_ = std::make_shared<api::BandwidthLimiter>(
+      config_.uptane.bandwidth_limit, config_.uptane.bandwidth_metered_limit,
+      api::BandwidthLimiter::parseSchedule(config_.uptane.bandwidth_schedule));
+  api_queue_->setBandwidthLimiter(bandwidth_limiter_);
+
+  // Each API command runs with its own token, see SotaUptaneClient::FlowControlScope
+  uptane_client_ = std::make_shared<SotaUptaneClient>(config_, storage_, http_in, sig_, nullptr);
 }
 
 Aktualizr::~Aktualizr() { api_queue_.reset(nullptr); }
@@ -125,7 +132,7 @@ std::vector<SecondaryInfo> Aktualizr::GetSecondaries() const {
 
 std::future<result::CampaignCheck> Aktualizr::CampaignCheck() {
   std::function<result::CampaignCheck()> task([this] { return uptane_client_->campaignCheck(); });
-  return api_queue_->enqueue(std::move(task));
+  return api_queue_->enqueue(api::CommandType::kCampaignCheck, std::move(task));
 }
 
 std::future<void> Aktualizr::CampaignControl(const std::string &campaign_id, campaign::Cmd cmd) {
@@ -144,28 +151,40 @@ std::future<void> Aktualizr::CampaignControl(const std::string &campaign_id, cam
         break;
     }
   });
-  return api_queue_->enqueue(std::move(task));
+  return api_queue_->enqueue(api::CommandType::kCampaignControl, std::move(task));
 }
 
 void Aktualizr::SetCustomHardwareInfo(Json::Value hwinfo) { uptane_client_->setCustomHardwareInfo(std::move(hwinfo)); }
 std::future<void> Aktualizr::SendDeviceData() {
   std::function<void()> task([this] { uptane_client_->sendDeviceData(); });
-  return api_queue_->enqueue(std::move(task));
+  return api_queue_->enqueue(api::CommandType::kSendDeviceData, std::move(task));
 }
 
 std::future<result::UpdateCheck> Aktualizr::CheckUpdates() {
-  std::function<result::UpdateCheck()> task([this] { return uptane_client_->fetchMeta(); });
-  return api_queue_->enqueue(std::move(task));
+  std::function<result::UpdateCheck(const api::FlowControlToken *)> task(
+      [this](const api::FlowControlToken *flow_control) {
+        SotaUptaneClient::FlowControlScope scope(flow_control);
+        return uptane_client_->fetchMeta();
+      });
+  return api_queue_->enqueue(api::CommandType::kCheckUpdates, std::move(task));
 }
 
 std::future<result::Download> Aktualizr::Download(const std::vector<Uptane::Target> &updates) {
-  std::function<result::Download()> task([this, updates]() { return uptane_client_->downloadImages(updates); });
-  return api_queue_->enqueue(std::move(task));
+  std::function<result::Download(const api::FlowControlToken *)> task(
+      [this, updates](const api::FlowControlToken *flow_control) {
+        SotaUptaneClient::FlowControlScope scope(flow_control);
+        return uptane_client_->downloadImages(updates);
+      });
+  return api_queue_->enqueue(api::CommandType::kDownload, std::move(task));
 }
 
 std::future<result::Install> Aktualizr::Install(const std::vector<Uptane::Target> &updates) {
-  std::function<result::Install()> task([this, updates] { return uptane_client_->uptaneInstall(updates); });
-  return api_queue_->enqueue(std::move(task));
+  std::function<result::Install(const api::FlowControlToken *)> task(
+      [this, updates](const api::FlowControlToken *flow_control) {
+        SotaUptaneClient::FlowControlScope scope(flow_control);
+        return uptane_client_->uptaneInstall(updates);
+      });
+  return api_queue_->enqueue(api::CommandType::kInstall, std::move(task));
 }
 
 bool Aktualizr::SetInstallationRawReport(const std::string &custom_raw_report) {
@@ -174,7 +193,7 @@ bool Aktualizr::SetInstallationRawReport(const std::string &custom_raw_report) {
 
 std::future<bool> Aktualizr::SendManifest(const Json::Value &custom) {
   std::function<bool()> task([this, custom]() { return uptane_client_->putManifest(custom); });
-  return api_queue_->enqueue(std::move(task));
+  return api_queue_->enqueue(api::CommandType::kSendManifest, std::move(task));
 }
 
 result::Pause Aktualizr::Pause() {
@@ -197,6 +216,12 @@ result::Pause Aktualizr::Resume() {
 
 void Aktualizr::Abort() { api_queue_->abort(); }
 
+void Aktualizr::SetBandwidthLimit(uint64_t bytes_per_sec) { bandwidth_limiter_->setOverride(bytes_per_sec); }
+
+void Aktualizr::ClearBandwidthLimit() { bandwidth_limiter_->clearOverride(); }
+
+void Aktualizr::SetMeteredNetwork(bool metered) { bandwidth_limiter_->setMetered(metered); }
+
 boost::signals2::connection Aktualizr::SetSignalHandler(
     const std::function<void(shared_ptr<event::BaseEvent>)> &handler) {
   return sig_->connect(handler);
@@ -0,0 +1,171 @@
+#include "image_fanout.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "logging/logging.h"
+
+constexpr size_t ImageFanOut::kChunkSize;
+constexpr size_t ImageFanOut::kWindow;
+constexpr size_t ImageFanOut::kLeft;
+
+ImageFanOut::ImageFanOut(std::ifstream source, Uptane::Target target, const std::vector<Uptane::EcuSerial>& receivers,
+                         size_t chunk_size, size_t window)
+    : source_{std::move(source)},
+      target_{std::move(target)},
+      chunk_size_{chunk_size},
+      window_{std::max(window, static_cast<size_t>(1))} {
+  if (!target_.hashes().empty()) {
+    hasher_ = MultiPartHasher::create(target_.hashes()[0].type());
+  }
+  for (const auto& receiver : receivers) {
+    positions_[receiver] = 0;
+  }
+}
+
+std::shared_ptr<const std::string> ImageFanOut::get(const Uptane::EcuSerial& receiver, size_t index) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto position = positions_.find(receiver);
+  if (position == positions_.end() || position->second == kLeft) {
+    throw std::logic_error("ECU " + receiver.ToString() + " does not receive " + target_.filename());
+  }
+  if (index < first_chunk_) {
+    throw std::logic_error("Chunk " + std::to_string(index) + " of " + target_.filename() + " has been released");
+  }
+
+  const size_t before = slowest();
+  position->second = index;
+  if (slowest() != before) {
+    releasePassed();
+    cv_.notify_all();
+  }
+
+  for (;;) {
+    if (!error_.empty()) {
+      throw std::runtime_error(error_);
+    }
+    if (index < first_chunk_ + chunks_.size()) {
+      return chunks_[index - first_chunk_];
+    }
+    if (end_) {
+      return nullptr;
+    }
+    // slowest() <= index, as this receiver counts as well
+    if (!reading_ && index - slowest() < window_) {
+      readChunk(lock);
+      continue;
+    }
+    cv_.wait(lock);
+  }
+}
+
+void ImageFanOut::readChunk(std::unique_lock<std::mutex>& lock) {
+  reading_ = true;
+  lock.unlock();
+
+  // Only the reader touches the file and the hasher
+  auto chunk = std::make_shared<std::string>(chunk_size_, '\0');
+  source_.read(&(*chunk)[0], static_cast<std::streamsize>(chunk_size_));
+  const auto read_size = static_cast<size_t>(source_.gcount());
+  chunk->resize(read_size);
+  if (hasher_ != nullptr) {
+    hasher_->update(reinterpret_cast<const unsigned char*>(chunk->data()), read_size);
+  }
+  std::string error;
+  const bool end = read_size < chunk_size_;
+  if (end) {
+    if (source_.bad() || !source_.eof()) {
+      error = "Could not read the image of " + target_.filename();
+    } else if (hasher_ != nullptr && !target_.MatchHash(hasher_->getHash())) {
+      error = "The image of " + target_.filename() + " does not match its hash";
+    }
+  }
+
+  lock.lock();
+  reading_ = false;
+  if (read_size > 0) {
+    chunks_.push_back(std::move(chunk));
+    ++chunks_read_;
+  }
+  end_ = end;
+  if (!error.empty()) {
+    LOG_ERROR << error;
+    error_ = error;
+  }
+  cv_.notify_all();
+}
+
+void ImageFanOut::leave(const Uptane::EcuSerial& receiver) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto position = positions_.find(receiver);
+  if (position == positions_.end() || position->second == kLeft) {
+    return;
+  }
+  position->second = kLeft;
+  releasePassed();
+  cv_.notify_all();
+}
+
+bool ImageFanOut::hasReceiver(const Uptane::EcuSerial& receiver) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto position = positions_.find(receiver);
+  return position != positions_.end() && position->second != kLeft;
+}
+
+size_t ImageFanOut::chunks_read() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return chunks_read_;
+}
+
+size_t ImageFanOut::slowest() const {
+  size_t res = kLeft;
+  for (const auto& position : positions_) {
+    res = std::min(res, position.second);
+  }
+  return res;
+}
+
+void ImageFanOut::releasePassed() {
+  const size_t until = slowest();
+  while (!chunks_.empty() && first_chunk_ < until) {
+    chunks_.pop_front();
+    ++first_chunk_;
+  }
+}
+
+SharedImageReader::SharedImageReader(std::shared_ptr<ImageFanOut> fan_out, Uptane::EcuSerial receiver)
+    : fan_out_{std::move(fan_out)}, receiver_{std::move(receiver)} {}
+
+SharedImageReader::~SharedImageReader() { fan_out_->leave(receiver_); }
+
+std::shared_ptr<const std::string> SharedImageReader::next() { return fan_out_->get(receiver_, index_++); }
+
+std::shared_ptr<const std::string> FileImageReader::next() {
+  auto chunk = std::make_shared<std::string>(ImageFanOut::kChunkSize, '\0');
+  source_.read(&(*chunk)[0], static_cast<std::streamsize>(chunk->size()));
+  chunk->resize(static_cast<size_t>(source_.gcount()));
+  if (chunk->empty()) {
+    return nullptr;
+  }
+  return chunk;
+}
+
+void LinkLimiter::lock() {
+  if (limit_ == 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]() { return used_ < limit_; });
+  ++used_;
+}
+
+void LinkLimiter::unlock() {
+  if (limit_ == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    --used_;
+  }
+  cv_.notify_one();
+}
@@ -0,0 +1,126 @@
+#ifndef IMAGE_FANOUT_H_
+#define IMAGE_FANOUT_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "libaktualizr/secondary_provider.h"
+#include "libaktualizr/types.h"
+
+/**
+ * Image of a Target read once for all the Secondaries it is sent to at the same
+ * time.
+ *
+ * The image is read and hashed in chunks, which are handed out to the
+ * receivers as shared buffers and released once every receiver is past them.
+ * A receiver cannot get more than `window` chunks ahead of the slowest one, so
+ * that memory use stays bounded. A receiver that gives up has to leave(), so as
+ * not to hold the others back.
+ */
+class ImageFanOut {
+ public:
+  static constexpr size_t kChunkSize{64 * 1024};
+  static constexpr size_t kWindow{16};
+
+  ImageFanOut(std::ifstream source, Uptane::Target target, const std::vector<Uptane::EcuSerial>& receivers,
+              size_t chunk_size = kChunkSize, size_t window = kWindow);
+
+  /**
+   * Chunk number `index` of the image, or nullptr after the end. Chunks are to
+   * be asked for in order. Blocks while the receiver is too far ahead of the
+   * slowest one. Throws std::runtime_error if the image cannot be read or does
+   * not match the Target.
+   */
+  std::shared_ptr<const std::string> get(const Uptane::EcuSerial& receiver, size_t index);
+  void leave(const Uptane::EcuSerial& receiver);
+  bool hasReceiver(const Uptane::EcuSerial& receiver) const;
+
+  const Uptane::Target& target() const { return target_; }
+  /** Number of chunks read from the image so far */
+  size_t chunks_read() const;
+
+ private:
+  static constexpr size_t kLeft{std::numeric_limits<size_t>::max()};
+
+  size_t slowest() const;
+  void releasePassed();
+  void readChunk(std::unique_lock<std::mutex>& lock);
+
+  std::ifstream source_;
+  const Uptane::Target target_;
+  const size_t chunk_size_;
+  const size_t window_;
+  MultiPartHasher::Ptr hasher_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  // Next chunk needed by each receiver, kLeft for those who left
+  std::map<Uptane::EcuSerial, size_t> positions_;
+  std::deque<std::shared_ptr<const std::string>> chunks_;
+  size_t first_chunk_{0};
+  size_t chunks_read_{0};
+  bool reading_{false};
+  bool end_{false};
+  std::string error_;
+};
+
+/**
+ * Reader of an image shared with other Secondaries through an ImageFanOut.
+ * Leaves the fan-out when destroyed.
+ */
+class SharedImageReader : public TargetImageReader {
+ public:
+  SharedImageReader(std::shared_ptr<ImageFanOut> fan_out, Uptane::EcuSerial receiver);
+  ~SharedImageReader() override;
+  SharedImageReader(const SharedImageReader&) = delete;
+  SharedImageReader(SharedImageReader&&) = delete;
+  SharedImageReader& operator=(const SharedImageReader&) = delete;
+  SharedImageReader& operator=(SharedImageReader&&) = delete;
+
+  std::shared_ptr<const std::string> next() override;
+
+ private:
+  std::shared_ptr<ImageFanOut> fan_out_;
+  const Uptane::EcuSerial receiver_;
+  size_t index_{0};
+};
+
+/**
+ * Reader of an image directly from its file, for a single Secondary.
+ */
+class FileImageReader : public TargetImageReader {
+ public:
+  explicit FileImageReader(std::ifstream source) : source_{std::move(source)} {}
+
+  std::shared_ptr<const std::string> next() override;
+
+ private:
+  std::ifstream source_;
+};
+
+/**
+ * Sharing of the images sent to several Secondaries, kept out of the public
+ * interface of SecondaryProvider.
+ */
+class ImageSharing {
+ public:
+  /**
+   * Read the image of a Target only once for all the given Secondaries: the
+   * readers that SecondaryProvider hands out to them share it as long as the
+   * returned object is kept.
+   */
+  static std::shared_ptr<ImageFanOut> shareTargetImage(const SecondaryProvider& provider,
+                                                       const Uptane::Target& target,
+                                                       const std::vector<Uptane::EcuSerial>& receivers);
+};
+
+#endif  // IMAGE_FANOUT_H_
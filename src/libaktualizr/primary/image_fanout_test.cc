@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "image_fanout.h"
+#include "utilities/utils.h"
+
+static const size_t chunk_size = 1000;
+
+class ImageFanOutTest : public ::testing::Test {
+ protected:
+  ImageFanOutTest() {
+    for (size_t k = 0; image_.size() < 10 * chunk_size + 123; ++k) {
+      image_ += "image block " + std::to_string(k) + "\n";
+    }
+    image_path_ = temp_dir_ / "image";
+    Utils::writeFile(image_path_, image_);
+  }
+
+  Uptane::Target target(const std::string& sha256) const {
+    return Uptane::Target("image", Uptane::EcuMap{}, std::vector<Hash>{Hash(Hash::Type::kSha256, sha256)},
+                          image_.size());
+  }
+  Uptane::Target target() const { return target(Crypto::sha256digestHex(image_)); }
+
+  std::ifstream open() const { return std::ifstream(image_path_.string(), std::ios::binary); }
+
+  TemporaryDirectory temp_dir_;
+  boost::filesystem::path image_path_;
+  std::string image_;
+  const std::vector<Uptane::EcuSerial> receivers_{Uptane::EcuSerial("ecu1"), Uptane::EcuSerial("ecu2"),
+                                                  Uptane::EcuSerial("ecu3"), Uptane::EcuSerial("ecu4")};
+};
+
+static std::string readAll(TargetImageReader& reader) {
+  std::string res;
+  for (auto chunk = reader.next(); chunk != nullptr; chunk = reader.next()) {
+    res += *chunk;
+  }
+  return res;
+}
+
+/* The image is read once for all the receivers, which all get all of it. */
+TEST_F(ImageFanOutTest, ReadOnce) {
+  auto fan_out = std::make_shared<ImageFanOut>(open(), target(), receivers_, chunk_size, 2);
+
+  std::vector<std::future<std::string>> results;
+  for (const auto& receiver : receivers_) {
+    results.push_back(std::async(std::launch::async, [fan_out, receiver]() {
+      SharedImageReader reader(fan_out, receiver);
+      return readAll(reader);
+    }));
+  }
+  for (auto& result : results) {
+    EXPECT_EQ(result.get(), image_);
+  }
+  EXPECT_EQ(fan_out->chunks_read(), 11U);
+}
+
+/* A receiver cannot get further than the window ahead of the slowest one,
+ * until the latter advances or leaves. */
+TEST_F(ImageFanOutTest, Backpressure) {
+  const std::vector<Uptane::EcuSerial> receivers{receivers_[0], receivers_[1]};
+  auto fan_out = std::make_shared<ImageFanOut>(open(), target(), receivers, chunk_size, 2);
+
+  SharedImageReader slow(fan_out, receivers[1]);
+  auto fast = std::async(std::launch::async, [fan_out, &receivers]() {
+    SharedImageReader reader(fan_out, receivers[0]);
+    return readAll(reader);
+  });
+  EXPECT_EQ(fast.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+  EXPECT_EQ(fan_out->chunks_read(), 2U);
+
+  EXPECT_EQ(*slow.next(), image_.substr(0, chunk_size));
+  EXPECT_EQ(*slow.next(), image_.substr(chunk_size, chunk_size));
+  EXPECT_EQ(fast.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+  EXPECT_EQ(fan_out->chunks_read(), 3U);
+
+  fan_out->leave(receivers[1]);
+  EXPECT_FALSE(fan_out->hasReceiver(receivers[1]));
+  EXPECT_EQ(fast.get(), image_);
+  EXPECT_THROW(slow.next(), std::logic_error);
+}
+
+/* An image that does not match its Target is not handed out completely. */
+TEST_F(ImageFanOutTest, HashMismatch) {
+  auto fan_out = std::make_shared<ImageFanOut>(open(), target(Crypto::sha256digestHex("other")), receivers_,
+                                               chunk_size, 2);
+  std::vector<std::future<std::string>> results;
+  for (const auto& receiver : receivers_) {
+    results.push_back(std::async(std::launch::async, [fan_out, receiver]() {
+      SharedImageReader reader(fan_out, receiver);
+      return readAll(reader);
+    }));
+  }
+  for (auto& result : results) {
+    EXPECT_THROW(result.get(), std::runtime_error);
+  }
+}
+
+/* Without a fan-out, the image is read directly from the file. */
+TEST_F(ImageFanOutTest, PrivateReader) {
+  FileImageReader reader(open());
+  EXPECT_EQ(readAll(reader), image_);
+}
+
+/* No more than the limit holds the link at the same time. */
+TEST(LinkLimiter, Limit) {
+  LinkLimiter limiter(2);
+  limiter.lock();
+  limiter.lock();
+  auto third = std::async(std::launch::async, [&limiter]() { std::lock_guard<LinkLimiter> guard(limiter); });
+  EXPECT_EQ(third.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+  limiter.unlock();
+  third.get();
+  limiter.unlock();
+
+  LinkLimiter unlimited(0);
+  for (int k = 0; k < 10; ++k) {
+    unlimited.lock();
+  }
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
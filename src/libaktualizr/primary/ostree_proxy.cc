@@ -0,0 +1,434 @@
+#include "ostree_proxy.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include "logging/logging.h"
+
+struct OstreeProxy::Connection {
+  explicit Connection(int fd) : socket(fd) {}
+
+  Socket socket;
+  std::thread thread;
+  std::atomic<bool> done{false};
+};
+
+static bool sendAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+static bool sendStatus(int fd, const long status, const char* reason) {  // NOLINT(google-runtime-int)
+  const std::string response =
+      "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\nContent-Length: 0\r\n\r\n";
+  return sendAll(fd, response.data(), response.size());
+}
+
+static const char* reasonPhrase(const long status) {  // NOLINT(google-runtime-int)
+  switch (status) {
+    case 200:
+      return "OK";
+    case 400:
+      return "Bad Request";
+    case 403:
+      return "Forbidden";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 502:
+      return "Bad Gateway";
+    default:
+      return "Error";
+  }
+}
+
+// Send the content of a file as the response, closes the file descriptor.
+static bool sendFile(int sock, int file_fd, bool head) {
+  const off_t size = lseek(file_fd, 0, SEEK_END);
+  lseek(file_fd, 0, SEEK_SET);
+  const std::string header = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " +
+                             std::to_string(size) + "\r\n\r\n";
+  bool ok = sendAll(sock, header.data(), header.size());
+  std::array<char, 64 * 1024> buf{};
+  while (ok && !head) {
+    const ssize_t read_bytes = read(file_fd, buf.data(), buf.size());
+    if (read_bytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (read_bytes <= 0) {
+      ok = read_bytes == 0;
+      break;
+    }
+    ok = sendAll(sock, buf.data(), static_cast<size_t>(read_bytes));
+  }
+  ::close(file_fd);
+  return ok;
+}
+
+OstreeProxy::OstreeProxy(std::string upstream_url, const std::string& ca, const std::string& cert,
+                         const std::string& pkey, boost::filesystem::path cache_dir, const uint64_t cache_size,
+                         const in_port_t port, const std::string& listen_address)
+    : upstream_url_(boost::algorithm::trim_right_copy_if(upstream_url, boost::is_any_of("/"))),
+      cache_dir_(std::move(cache_dir)),
+      cache_size_(cache_size),
+      listen_socket_(port, listen_address) {
+  if (!ca.empty() || !cert.empty() || !pkey.empty()) {
+    http_.setCerts(ca, CryptoSource::kFile, cert, CryptoSource::kFile, pkey, CryptoSource::kFile);
+  }
+  loadCache();
+  if (::listen(*listen_socket_, SOMAXCONN) < 0) {
+    throw std::system_error(errno, std::system_category(), "listen");
+  }
+  accept_thread_ = std::thread(&OstreeProxy::acceptLoop, this);
+  LOG_INFO << "OSTree proxy of " << upstream_url_ << " listening on " << listen_address << ":" << listen_socket_.port();
+}
+
+OstreeProxy::~OstreeProxy() {
+  running_ = false;
+  accept_thread_.join();
+  std::lock_guard<std::mutex> guard(connections_mutex_);
+  for (auto& connection : connections_) {
+    ::shutdown(*connection->socket, SHUT_RDWR);
+    connection->thread.join();
+  }
+}
+
+uint64_t OstreeProxy::cache_used() const {
+  std::lock_guard<std::mutex> guard(cache_mutex_);
+  return cache_used_;
+}
+
+void OstreeProxy::acceptLoop() {
+  while (running_) {
+    pollfd pfd{*listen_socket_, POLLIN, 0};
+    // Poll with a timeout, so that the proxy can be stopped
+    if (poll(&pfd, 1, 200) <= 0) {
+      continue;
+    }
+    const int fd = accept(*listen_socket_, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    timeval timeout{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // A Secondary that stops reading is given up on
+    timeval send_timeout{kIdleTimeoutSec, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    std::lock_guard<std::mutex> guard(connections_mutex_);
+    for (auto it = connections_.begin(); it != connections_.end();) {
+      if ((*it)->done) {
+        (*it)->thread.join();
+        it = connections_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (connections_.size() >= kMaxConnections) {
+      LOG_WARNING << "Too many connections to the OSTree proxy, refusing a new one";
+      ::close(fd);
+      continue;
+    }
+    connections_.push_back(std_::make_unique<Connection>(fd));
+    Connection& connection = *connections_.back();
+    connection.thread = std::thread([this, &connection]() {
+      serveConnection(connection);
+      connection.done = true;
+    });
+  }
+}
+
+void OstreeProxy::serveConnection(Connection& connection) {
+  const int fd = *connection.socket;
+  std::unique_ptr<HttpClient> http;
+  {
+    // Duplicating a curl handle is not thread-safe
+    std::lock_guard<std::mutex> guard(cache_mutex_);
+    http = std_::make_unique<HttpClient>(http_);
+  }
+
+  std::string buffer;
+  int idle_sec = 0;
+  while (running_) {
+    const size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+      if (buffer.size() > 16 * 1024) {
+        sendStatus(fd, 400, reasonPhrase(400));
+        return;
+      }
+      std::array<char, 4096> buf{};
+      const ssize_t received = recv(fd, buf.data(), buf.size(), 0);
+      if (received < 0 && (errno == EAGAIN || errno == EINTR)) {
+        if (++idle_sec >= kIdleTimeoutSec) {
+          return;
+        }
+        continue;
+      }
+      if (received <= 0) {
+        return;
+      }
+      idle_sec = 0;
+      buffer.append(buf.data(), static_cast<size_t>(received));
+      continue;
+    }
+
+    const std::string header = buffer.substr(0, header_end);
+    buffer.erase(0, header_end + 4);
+
+    std::istringstream request_line(header.substr(0, header.find("\r\n")));
+    std::string method;
+    std::string path;
+    std::string version;
+    request_line >> method >> path >> version;
+    const bool keep_alive = version == "HTTP/1.1" && !boost::algorithm::icontains(header, "connection: close");
+
+    if (method != "GET" && method != "HEAD") {
+      sendStatus(fd, 405, reasonPhrase(405));
+      return;
+    }
+    path = path.substr(0, path.find('?'));
+    if (path.empty() || path[0] != '/' || path.find("..") != std::string::npos) {
+      sendStatus(fd, 400, reasonPhrase(400));
+      return;
+    }
+
+    try {
+      serveRequest(fd, *http, path, method == "HEAD");
+    } catch (const std::exception& e) {
+      LOG_ERROR << "OSTree proxy failed to serve " << path << ": " << e.what();
+      return;
+    }
+    if (!keep_alive) {
+      return;
+    }
+  }
+}
+
+void OstreeProxy::serveRequest(const int fd, HttpClient& http, const std::string& path, const bool head) {
+  if (!isForwarded(path)) {
+    // Not found rather than forbidden, so that OSTree goes on without a summary
+    sendStatus(fd, 404, reasonPhrase(404));
+    return;
+  }
+  if (isCacheable(path)) {
+    serveCached(fd, http, path, head);
+    return;
+  }
+
+  const boost::filesystem::path temp = newTempFile();
+  const long status = fetch(http, path, temp);  // NOLINT(google-runtime-int)
+  if (status == 200) {
+    const int file_fd = ::open(temp.c_str(), O_RDONLY | O_CLOEXEC);
+    boost::filesystem::remove(temp);
+    if (file_fd < 0 || !sendFile(fd, file_fd, head)) {
+      throw std::runtime_error("could not send response");
+    }
+    return;
+  }
+  boost::system::error_code ec;
+  boost::filesystem::remove(temp, ec);
+  sendStatus(fd, status == 0 ? 502 : status, reasonPhrase(status == 0 ? 502 : status));
+}
+
+void OstreeProxy::serveCached(const int fd, HttpClient& http, const std::string& path, const bool head) {
+  // A cached file can be evicted between being fetched and opened, in which
+  // case it is fetched again.
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    std::shared_future<long> result;  // NOLINT(google-runtime-int)
+    std::promise<long> promise;       // NOLINT(google-runtime-int)
+    bool fetching = false;
+    int file_fd = -1;
+    {
+      std::lock_guard<std::mutex> guard(cache_mutex_);
+      file_fd = openCached(path);
+      if (file_fd < 0) {
+        auto it = in_flight_.find(path);
+        if (it != in_flight_.end()) {
+          result = it->second;
+        } else {
+          result = promise.get_future().share();
+          in_flight_.emplace(path, result);
+          fetching = true;
+        }
+      }
+    }
+
+    // Sent without holding the lock, so that a slow Secondary does not hold up
+    // the others. The file stays readable if it is evicted in the meantime.
+    if (file_fd >= 0) {
+      if (attempt == 0) {
+        ++cache_hits_;
+      }
+      if (!sendFile(fd, file_fd, head)) {
+        throw std::runtime_error("could not send response");
+      }
+      return;
+    }
+
+    if (fetching) {
+      // Whatever happens, the waiting requests must be released and the path
+      // fetched again by the next request: errors are reported as status 0.
+      long status = 0;  // NOLINT(google-runtime-int)
+      boost::filesystem::path temp;
+      try {
+        temp = newTempFile();
+        status = fetch(http, path, temp);
+        if (status == 200) {
+          addToCache(path, temp);
+        }
+      } catch (const std::exception& e) {
+        LOG_ERROR << "OSTree proxy failed to fetch " << path << ": " << e.what();
+        status = 0;
+      }
+      if (status != 200 && !temp.empty()) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(temp, ec);
+      }
+      {
+        std::lock_guard<std::mutex> guard(cache_mutex_);
+        in_flight_.erase(path);
+      }
+      promise.set_value(status);
+    }
+
+    const long status = result.get();  // NOLINT(google-runtime-int)
+    if (status != 200) {
+      sendStatus(fd, status == 0 ? 502 : status, reasonPhrase(status == 0 ? 502 : status));
+      return;
+    }
+  }
+  sendStatus(fd, 502, reasonPhrase(502));
+}
+
+long OstreeProxy::fetch(HttpClient& http, const std::string& path,  // NOLINT(google-runtime-int)
+                        const boost::filesystem::path& dest) {
+  std::ofstream file(dest.string(), std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("could not write " + dest.string());
+  }
+  ++upstream_requests_;
+  const HttpResponse response = http.download(
+      upstream_url_ + path,
+      [](char* contents, size_t size, size_t nmemb, void* userp) -> size_t {
+        auto* out = static_cast<std::ofstream*>(userp);
+        out->write(contents, static_cast<std::streamsize>(size * nmemb));
+        return out->good() ? size * nmemb : 0;
+      },
+      nullptr, &file, 0);
+  file.close();
+  if (response.curl_code != CURLE_OK || !file) {
+    LOG_WARNING << "OSTree proxy could not fetch " << path << ": " << response.getStatusStr();
+    return 0;
+  }
+  return response.http_status_code;
+}
+
+void OstreeProxy::addToCache(const std::string& path, const boost::filesystem::path& file) {
+  const uint64_t size = boost::filesystem::file_size(file);
+  const boost::filesystem::path dest = cache_dir_ / path;
+  boost::filesystem::create_directories(dest.parent_path());
+  boost::filesystem::rename(file, dest);
+
+  std::lock_guard<std::mutex> guard(cache_mutex_);
+  auto existing = cache_.find(path);
+  if (existing != cache_.end()) {
+    cache_used_ -= existing->second.size;
+    lru_.erase(existing->second.lru);
+    cache_.erase(existing);
+  }
+  lru_.push_back(path);
+  cache_[path] = CacheEntry{size, std::prev(lru_.end())};
+  cache_used_ += size;
+
+  evict();
+}
+
+// Must be called with cache_mutex_ held, unless the proxy is not running yet
+void OstreeProxy::evict() {
+  // Files being sent stay readable after being removed
+  while (cache_used_ > cache_size_ && !lru_.empty()) {
+    const std::string evicted = lru_.front();
+    lru_.pop_front();
+    cache_used_ -= cache_[evicted].size;
+    cache_.erase(evicted);
+    boost::system::error_code ec;
+    boost::filesystem::remove(cache_dir_ / evicted, ec);
+  }
+}
+
+// Must be called with cache_mutex_ held
+int OstreeProxy::openCached(const std::string& path) {
+  auto it = cache_.find(path);
+  if (it == cache_.end()) {
+    return -1;
+  }
+  lru_.splice(lru_.end(), lru_, it->second.lru);
+  return ::open((cache_dir_ / path).c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+void OstreeProxy::loadCache() {
+  boost::filesystem::remove_all(cache_dir_ / "tmp");
+  boost::filesystem::create_directories(cache_dir_ / "tmp");
+
+  std::vector<std::pair<std::time_t, std::string>> files;
+  for (const char* dir : {"objects", "deltas"}) {
+    if (!boost::filesystem::is_directory(cache_dir_ / dir)) {
+      continue;
+    }
+    for (boost::filesystem::recursive_directory_iterator it(cache_dir_ / dir), end; it != end; ++it) {
+      if (boost::filesystem::is_regular_file(it->path())) {
+        const std::string relative = "/" + it->path().lexically_relative(cache_dir_).string();
+        files.emplace_back(boost::filesystem::last_write_time(it->path()), relative);
+      }
+    }
+  }
+  std::sort(files.begin(), files.end());
+  for (const auto& file : files) {
+    const uint64_t size = boost::filesystem::file_size(cache_dir_ / file.second);
+    lru_.push_back(file.second);
+    cache_[file.second] = CacheEntry{size, std::prev(lru_.end())};
+    cache_used_ += size;
+  }
+  // The maximum size may have been lowered since the files were cached
+  evict();
+  if (!files.empty()) {
+    LOG_INFO << "OSTree proxy cache holds " << files.size() << " files, " << cache_used_ << " bytes";
+  }
+}
+
+boost::filesystem::path OstreeProxy::newTempFile() {
+  std::lock_guard<std::mutex> guard(cache_mutex_);
+  return cache_dir_ / "tmp" / std::to_string(temp_counter_++);
+}
+
+// Only what OSTree needs to pull is forwarded with the credentials of the Primary
+bool OstreeProxy::isForwarded(const std::string& path) {
+  return path == "/config" || boost::algorithm::starts_with(path, "/refs/") || isCacheable(path);
+}
+
+bool OstreeProxy::isCacheable(const std::string& path) {
+  return boost::algorithm::starts_with(path, "/objects/") || boost::algorithm::starts_with(path, "/deltas/");
+}
@@ -0,0 +1,110 @@
+#ifndef OSTREE_PROXY_H_
+#define OSTREE_PROXY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <boost/filesystem/path.hpp>
+
+#include "http/httpclient.h"
+#include "utilities/utils.h"
+
+/**
+ * Caching HTTP proxy of Treehub, run on the Primary for OSTree Secondaries.
+ *
+ * Secondaries pull from the proxy instead of from Treehub, so that an object
+ * needed by several Secondaries only goes once over the uplink of the vehicle.
+ * Objects and static deltas are content-addressed and therefore cached on disk
+ * (up to a maximum size, least recently used first out). The repository
+ * config and the refs are forwarded without caching, and nothing else is.
+ * When several Secondaries ask for the same object at the same time, it is
+ * only fetched once.
+ *
+ * Requests to Treehub are made with the credentials of the Primary. The
+ * Secondaries connect with plain HTTP, on the address of the Primary in their
+ * network only: the content is verified by OSTree against the commit hash
+ * anyway.
+ */
+class OstreeProxy {
+ public:
+  /**
+   * Start the proxy. The TLS credentials are those to connect to Treehub with,
+   * left empty for a plain HTTP server. The proxy listens on the given IPv4
+   * address only.
+   */
+  OstreeProxy(std::string upstream_url, const std::string& ca, const std::string& cert, const std::string& pkey,
+              boost::filesystem::path cache_dir, uint64_t cache_size, in_port_t port = 0,
+              const std::string& listen_address = "127.0.0.1");
+  ~OstreeProxy();
+  OstreeProxy(const OstreeProxy&) = delete;
+  OstreeProxy(OstreeProxy&&) = delete;
+  OstreeProxy& operator=(const OstreeProxy&) = delete;
+  OstreeProxy& operator=(OstreeProxy&&) = delete;
+
+  in_port_t port() const { return listen_socket_.port(); }
+
+  /** Number of requests made to Treehub */
+  uint64_t upstream_requests() const { return upstream_requests_; }
+  /** Number of requests served from the cache without waiting for Treehub */
+  uint64_t cache_hits() const { return cache_hits_; }
+  uint64_t cache_used() const;
+
+ private:
+  // Connections served at the same time, further ones are refused
+  static constexpr size_t kMaxConnections{16};
+  // A connection is closed after staying idle for this long
+  static constexpr int kIdleTimeoutSec{60};
+
+  struct Connection;
+  struct CacheEntry {
+    uint64_t size;
+    std::list<std::string>::iterator lru;
+  };
+
+  void acceptLoop();
+  void serveConnection(Connection& connection);
+  void serveRequest(int fd, HttpClient& http, const std::string& path, bool head);
+  void serveCached(int fd, HttpClient& http, const std::string& path, bool head);
+  long fetch(HttpClient& http, const std::string& path,  // NOLINT(google-runtime-int)
+             const boost::filesystem::path& dest);
+  void addToCache(const std::string& path, const boost::filesystem::path& file);
+  int openCached(const std::string& path);
+  void evict();
+  void loadCache();
+  boost::filesystem::path newTempFile();
+  static bool isForwarded(const std::string& path);
+  static bool isCacheable(const std::string& path);
+
+  const std::string upstream_url_;
+  HttpClient http_;
+  const boost::filesystem::path cache_dir_;
+  const uint64_t cache_size_;
+  ListenSocket listen_socket_;
+  std::atomic<bool> running_{true};
+  std::thread accept_thread_;
+
+  std::mutex connections_mutex_;
+  std::list<std::unique_ptr<Connection>> connections_;
+
+  mutable std::mutex cache_mutex_;
+  // Cached paths, least recently used first
+  std::list<std::string> lru_;
+  std::unordered_map<std::string, CacheEntry> cache_;
+  uint64_t cache_used_{0};
+  // Paths being fetched, to be waited for rather than fetched again
+  std::map<std::string, std::shared_future<long>> in_flight_;  // NOLINT(google-runtime-int)
+  uint64_t temp_counter_{0};
+
+  std::atomic<uint64_t> upstream_requests_{0};
+  std::atomic<uint64_t> cache_hits_{0};
+};
+
+#endif  // OSTREE_PROXY_H_
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/process.hpp>
+
+#include "http/httpclient.h"
+#include "logging/logging.h"
+#include "ostree_proxy.h"
+#include "test_utils.h"
+#include "utilities/utils.h"
+
+static std::string treehub_server = "http://127.0.0.1:";
+static boost::filesystem::path treehub_dir;
+
+static const std::string object_path = "objects/ab/cdef0123456789.filez";
+static const std::string other_path = "objects/ab/0123456789cdef.filez";
+
+static std::string proxyUrl(const OstreeProxy& proxy) {
+  return "http://127.0.0.1:" + std::to_string(proxy.port()) + "/";
+}
+
+/* Serve objects from Treehub, and from the cache once they have been fetched. */
+TEST(OstreeProxy, CacheObjects) {
+  TemporaryDirectory cache_dir;
+  OstreeProxy proxy(treehub_server, "", "", "", cache_dir.Path(), 1 << 20);
+  HttpClient http;
+
+  for (int k = 0; k < 2; ++k) {
+    auto response = http.get(proxyUrl(proxy) + object_path, HttpInterface::kNoLimit, nullptr);
+    EXPECT_EQ(response.http_status_code, 200);
+    EXPECT_EQ(response.body, "object content");
+  }
+  EXPECT_EQ(proxy.upstream_requests(), 1U);
+  EXPECT_EQ(proxy.cache_hits(), 1U);
+
+  // The cache survives a restart.
+  OstreeProxy restarted(treehub_server, "", "", "", cache_dir.Path(), 1 << 20);
+  auto response = http.get(proxyUrl(restarted) + object_path, HttpInterface::kNoLimit, nullptr);
+  EXPECT_EQ(response.body, "object content");
+  EXPECT_EQ(restarted.upstream_requests(), 0U);
+}
+
+/* Fetch an object only once when several Secondaries ask for it at the same time. */
+TEST(OstreeProxy, ConcurrentRequests) {
+  TemporaryDirectory cache_dir;
+  OstreeProxy proxy(treehub_server, "", "", "", cache_dir.Path(), 1 << 20);
+
+  std::vector<std::future<HttpResponse>> responses;
+  for (int k = 0; k < 4; ++k) {
+    responses.push_back(std::async(std::launch::async, [&proxy]() {
+      HttpClient http;
+      return http.get(proxyUrl(proxy) + object_path, HttpInterface::kNoLimit, nullptr);
+    }));
+  }
+  for (auto& response : responses) {
+    auto r = response.get();
+    EXPECT_EQ(r.http_status_code, 200);
+    EXPECT_EQ(r.body, "object content");
+  }
+  EXPECT_EQ(proxy.upstream_requests(), 1U);
+}
+
+/* Forward errors and do not cache anything but objects and deltas. */
+TEST(OstreeProxy, Passthrough) {
+  TemporaryDirectory cache_dir;
+  OstreeProxy proxy(treehub_server, "", "", "", cache_dir.Path(), 1 << 20);
+  HttpClient http;
+
+  auto response = http.get(proxyUrl(proxy) + "objects/ab/missing.commit", HttpInterface::kNoLimit, nullptr);
+  EXPECT_EQ(response.http_status_code, 404);
+
+  for (int k = 0; k < 2; ++k) {
+    response = http.get(proxyUrl(proxy) + "config", HttpInterface::kNoLimit, nullptr);
+    EXPECT_EQ(response.http_status_code, 200);
+    EXPECT_EQ(response.body, "[core]\nrepo_version=1\nmode=archive-z2\n");
+  }
+  EXPECT_EQ(proxy.upstream_requests(), 3U);
+  EXPECT_EQ(proxy.cache_used(), 0U);
+}
+
+/* Only forward what OSTree needs to pull, with the credentials of the Primary. */
+TEST(OstreeProxy, OnlyRepositoryPaths) {
+  TemporaryDirectory cache_dir;
+  OstreeProxy proxy(treehub_server, "", "", "", cache_dir.Path(), 1 << 20);
+  HttpClient http;
+
+  for (const char* path : {"summary", "api/v1/user_repo/targets.json"}) {
+    auto response = http.get(proxyUrl(proxy) + path, HttpInterface::kNoLimit, nullptr);
+    EXPECT_NE(response.http_status_code, 200) << path;
+  }
+  EXPECT_EQ(proxy.upstream_requests(), 0U);
+}
+
+/* Evict the least recently used objects to stay within the cache size. */
+TEST(OstreeProxy, CacheSize) {
+  TemporaryDirectory cache_dir;
+  // Room for one object only
+  OstreeProxy proxy(treehub_server, "", "", "", cache_dir.Path(), 20);
+  HttpClient http;
+
+  http.get(proxyUrl(proxy) + object_path, HttpInterface::kNoLimit, nullptr);
+  http.get(proxyUrl(proxy) + other_path, HttpInterface::kNoLimit, nullptr);
+  EXPECT_LE(proxy.cache_used(), 20U);
+  EXPECT_FALSE(boost::filesystem::exists(cache_dir.Path() / object_path));
+  EXPECT_TRUE(boost::filesystem::exists(cache_dir.Path() / other_path));
+
+  auto response = http.get(proxyUrl(proxy) + object_path, HttpInterface::kNoLimit, nullptr);
+  EXPECT_EQ(response.body, "object content");
+  EXPECT_EQ(proxy.upstream_requests(), 3U);
+}
+
+/* Evict objects cached by a previous run when the cache is now too large. */
+TEST(OstreeProxy, CacheSizeAtStartup) {
+  TemporaryDirectory cache_dir;
+  {
+    OstreeProxy proxy(treehub_server, "", "", "", cache_dir.Path(), 1 << 20);
+    HttpClient http;
+    http.get(proxyUrl(proxy) + object_path, HttpInterface::kNoLimit, nullptr);
+    http.get(proxyUrl(proxy) + other_path, HttpInterface::kNoLimit, nullptr);
+    EXPECT_EQ(proxy.cache_used(), 34U);
+  }
+
+  OstreeProxy restarted(treehub_server, "", "", "", cache_dir.Path(), 20);
+  EXPECT_LE(restarted.cache_used(), 20U);
+  EXPECT_EQ(boost::filesystem::exists(cache_dir.Path() / object_path) +
+                boost::filesystem::exists(cache_dir.Path() / other_path),
+            1);
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  logger_init();
+  logger_set_threshold(boost::log::trivial::trace);
+
+  TemporaryDirectory repo_dir;
+  treehub_dir = repo_dir.Path();
+  Utils::writeFile(treehub_dir / object_path, std::string("object content"));
+  Utils::writeFile(treehub_dir / other_path, std::string("other object content"));
+  Utils::writeFile(treehub_dir / "config", std::string("[core]\nrepo_version=1\nmode=archive-z2\n"));
+
+  std::string port = TestUtils::getFreePort();
+  treehub_server += port;
+  // Slow down the server, so that concurrent requests overlap
+  boost::process::child server_process("tests/sota_tools/treehub_server.py", std::string("-p"), port,
+                                       std::string("-d"), treehub_dir.string(), std::string("-s0.5"));
+  TestUtils::waitForServer(treehub_server + "/");
+  return RUN_ALL_TESTS();
+}
+#endif  // __NO_MAIN__
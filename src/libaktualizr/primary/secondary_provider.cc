@@ -2,7 +2,9 @@
 
 #include <fstream>
 
+#include "image_fanout.h"
 #include "logging/logging.h"
+#include "ostree_proxy.h"
 #include "storage/invstorage.h"
 #include "uptane/tuf.h"
 #include "utilities/utils.h"
@@ -84,7 +86,7 @@ std::string SecondaryProvider::getTreehubCredentials() const {
     return "";
   }
 
-  const std::string treehub_url = config_.pacman.ostree_server;
+  const std::string treehub_url = getTreehubUrl(ca, cert, pkey);
   std::map<std::string, std::string> archive_map = {
       {"ca.pem", ca}, {"client.pem", cert}, {"pkey.pem", pkey}, {"server.url", treehub_url}};
 
@@ -99,6 +101,61 @@ std::string SecondaryProvider::getTreehubCredentials() const {
   }
 }
 
+std::string SecondaryProvider::getTreehubUrl(const std::string& ca, const std::string& cert,
+                                             const std::string& pkey) const {
+  const auto& pacman = config_.pacman;
+  if (pacman.ostree_proxy_port == 0 || pacman.ostree_proxy_address.empty()) {
+    return pacman.ostree_server;
+  }
+
+  std::lock_guard<std::mutex> guard(ostree_proxy_mutex_);
+  if (ostree_proxy_ == nullptr) {
+    try {
+      ostree_proxy_ = std::make_shared<OstreeProxy>(pacman.ostree_server, ca, cert, pkey, pacman.ostree_proxy_cache,
+                                                    pacman.ostree_proxy_cache_size, pacman.ostree_proxy_port,
+                                                    pacman.ostree_proxy_address);
+    } catch (const std::exception& e) {
+      LOG_ERROR << "Could not start the OSTree proxy, Secondaries will use Treehub directly: " << e.what();
+      return pacman.ostree_server;
+    }
+  }
+  return "http://" + pacman.ostree_proxy_address + ":" + std::to_string(ostree_proxy_->port());
+}
+
 std::ifstream SecondaryProvider::getTargetFileHandle(const Uptane::Target& target) const {
   return package_manager_->openTargetFile(target);
 }
+
+std::unique_ptr<TargetImageReader> SecondaryProvider::getTargetImageReader(const Uptane::Target& target,
+                                                                           const Uptane::EcuSerial& receiver) const {
+  std::shared_ptr<ImageFanOut> fan_out;
+  {
+    std::lock_guard<std::mutex> guard(fan_out_mutex_);
+    auto it = fan_outs_.find(target.filename());
+    if (it != fan_outs_.end()) {
+      fan_out = it->second.lock();
+    }
+  }
+  if (fan_out != nullptr && fan_out->target().MatchTarget(target) && fan_out->hasReceiver(receiver)) {
+    return std_::make_unique<SharedImageReader>(fan_out, receiver);
+  }
+  return std_::make_unique<FileImageReader>(getTargetFileHandle(target));
+}
+
+std::shared_ptr<ImageFanOut> ImageSharing::shareTargetImage(const SecondaryProvider& provider,
+                                                            const Uptane::Target& target,
+                                                            const std::vector<Uptane::EcuSerial>& receivers) {
+  auto fan_out = std::make_shared<ImageFanOut>(provider.getTargetFileHandle(target), target, receivers);
+  std::lock_guard<std::mutex> guard(provider.fan_out_mutex_);
+  provider.fan_outs_[target.filename()] = fan_out;
+  return fan_out;
+}
+
+std::shared_ptr<LinkLimiter> SecondaryProvider::getLinkLimiter(const std::string& link) const {
+  std::lock_guard<std::mutex> guard(fan_out_mutex_);
+  auto& limiter = link_limiters_[link];
+  if (limiter == nullptr) {
+    limiter = std::make_shared<LinkLimiter>(config_.uptane.secondary_link_concurrency);
+  }
+  return limiter;
+}
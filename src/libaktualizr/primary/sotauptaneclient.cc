@@ -2,6 +2,7 @@
 
 #include <fnmatch.h>
 #include <fstream>
+#include <future>
 #include <memory>
 #include <utility>
 
@@ -9,6 +10,7 @@
 #include "crypto/keymanager.h"
 #include "libaktualizr/campaign.h"
 #include "libaktualizr/types.h"
+#include "image_fanout.h"
 #include "logging/logging.h"
 #include "provisioner.h"
 #include "uptane/exceptions.h"
@@ -66,7 +68,10 @@ void SotaUptaneClient::addSecondary(const std::shared_ptr<SecondaryInterface> &s
   provisioner_.SecondariesWereChanged();
 }
 
+thread_local const api::FlowControlToken *SotaUptaneClient::FlowControlScope::current_{nullptr};
+
 bool SotaUptaneClient::attemptProvision() {
+  std::lock_guard<std::mutex> guard(provision_mutex_);
   bool already_provisioned = provisioner_.CurrentState() == Provisioner::State::kOk;
   if (already_provisioned) {
     return true;
@@ -423,6 +428,7 @@ void SotaUptaneClient::requiresProvision() {
 }
 
 void SotaUptaneClient::requiresAlreadyProvisioned() {
+  std::lock_guard<std::mutex> guard(provision_mutex_);
   if (provisioner_.CurrentState() != Provisioner::State::kOk) {
     throw NotProvisionedYet();
   }
@@ -431,7 +437,7 @@ void SotaUptaneClient::requiresAlreadyProvisioned() {
 void SotaUptaneClient::updateDirectorMeta() {
   requiresProvision();
   try {
-    director_repo.updateMeta(*storage, *uptane_fetcher, flow_control_);
+    director_repo.updateMeta(*storage, *uptane_fetcher, flowControl());
   } catch (const std::exception &e) {
     LOG_ERROR << "Director metadata update failed: " << e.what();
     throw;
@@ -441,7 +447,7 @@ void SotaUptaneClient::updateDirectorMeta() {
 void SotaUptaneClient::updateImageMeta() {
   requiresProvision();
   try {
-    image_repo.updateMeta(*storage, *uptane_fetcher, flow_control_);
+    image_repo.updateMeta(*storage, *uptane_fetcher, flowControl());
   } catch (const std::exception &e) {
     LOG_ERROR << "Failed to update Image repo metadata: " << e.what();
     throw;
@@ -644,7 +650,7 @@ std::unique_ptr<Uptane::Target> SotaUptaneClient::findTargetHelper(const Uptane:
     // Target name matches one of the patterns
 
     auto delegation = Uptane::getTrustedDelegation(delegate_role, cur_targets, image_repo, *storage, *uptane_fetcher,
-                                                   offline, flow_control_);
+                                                   offline, flowControl());
     if (delegation.isExpired(TimeStamp::Now())) {
       continue;
     }
@@ -751,8 +757,9 @@ std::pair<bool, Uptane::Target> SotaUptaneClient::downloadImage(const Uptane::Ta
 
   bool success = false;
   try {
-    KeyManager keys(storage, config.keymanagerConfig());
-    keys.loadKeys();
+    // The credentials may have changed since the last download, e.g. after
+    // provisioning; the files are only rewritten if they have
+    key_manager_->loadKeys();
     auto prog_cb = [this](const Uptane::Target &t, const std::string &description, unsigned int progress) {
       report_progress_cb(events_channel.get(), t, description, progress);
     };
@@ -765,10 +772,10 @@ std::pair<bool, Uptane::Target> SotaUptaneClient::downloadImage(const Uptane::Ta
       std::chrono::milliseconds wait(500);
 
       for (; tries < max_tries; tries++) {
-        success = package_manager_->fetchTarget(target, *uptane_fetcher, keys, prog_cb, flow_control_);
+        success = package_manager_->fetchTarget(target, *uptane_fetcher, *key_manager_, prog_cb, flowControl());
         // Skip trying to fetch the 'target' if control flow token transaction
         // was set to the 'abort' or 'pause' state, see the CommandQueue and FlowControlToken.
-        if (success || (flow_control_ != nullptr && flow_control_->hasAborted())) {
+        if (success || (flowControl() != nullptr && flowControl()->hasAborted())) {
           break;
         } else if (tries < max_tries - 1) {
           std::this_thread::sleep_for(wait);
@@ -803,7 +810,7 @@ std::pair<bool, Uptane::Target> SotaUptaneClient::downloadImage(const Uptane::Ta
 
 void SotaUptaneClient::uptaneIteration(std::vector<Uptane::Target> *targets, unsigned int *ecus_count) {
   updateDirectorMeta();
-  if (flow_control_ != nullptr && flow_control_->hasAborted()) {
+  if (flowControl() != nullptr && flowControl()->hasAborted()) {
     return;
   }
 
@@ -1242,33 +1249,43 @@ bool SotaUptaneClient::waitSecondariesReachable(const std::vector<Uptane::Target
 
   LOG_INFO << "Waiting for Secondaries to connect to start installation...";
 
-  auto deadline = std::chrono::system_clock::now() + std::chrono::seconds(config.uptane.secondary_preinstall_wait_sec);
-  while (std::chrono::system_clock::now() <= deadline) {
-    if (targeted_secondaries.empty()) {
-      return true;
-    }
-
-    for (auto sec_it = targeted_secondaries.begin(); sec_it != targeted_secondaries.end();) {
-      bool connected = false;
+  // Every Secondary is polled in its own task, so that an unreachable one
+  // does not delay the others, and the wait ends as soon as the last one has
+  // answered.
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(config.uptane.secondary_preinstall_wait_sec);
+  auto poll = [deadline](SecondaryInterface *secondary) {
+    auto retry_delay = std::chrono::milliseconds(100);
+    while (true) {
       try {
-        connected = sec_it->second->ping();
+        if (secondary->ping()) {
+          return true;
+        }
       } catch (const std::exception &ex) {
-        LOG_DEBUG << "Failed to ping Secondary with serial " << sec_it->first << ": " << ex.what();
+        LOG_DEBUG << "Failed to ping Secondary with serial " << secondary->getSerial() << ": " << ex.what();
       }
-      if (connected) {
-        sec_it = targeted_secondaries.erase(sec_it);
-      } else {
-        sec_it++;
+      if (std::chrono::steady_clock::now() + retry_delay > deadline) {
+        return false;
       }
+      std::this_thread::sleep_for(retry_delay);
+      retry_delay = std::min(2 * retry_delay, std::chrono::milliseconds(1000));
     }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-  }
+  };
 
+  std::vector<std::pair<SecondaryInterface *, std::future<bool>>> reachable;
   for (const auto &sec : targeted_secondaries) {
-    LOG_ERROR << "Secondary with serial " << sec.second->getSerial() << " failed to connect!";
+    reachable.emplace_back(sec.second, std::async(std::launch::async, poll, sec.second));
   }
 
-  return false;
+  bool all_reachable = true;
+  for (auto &r : reachable) {
+    if (!r.second.get()) {
+      LOG_ERROR << "Secondary with serial " << r.first->getSerial() << " failed to connect!";
+      all_reachable = false;
+    }
+  }
+
+  return all_reachable;
 }
 
 void SotaUptaneClient::storeInstallationFailure(const data::InstallationResult &result) {
@@ -1312,7 +1329,7 @@ data::InstallationResult SotaUptaneClient::rotateSecondaryRoot(Uptane::Repositor
       LOG_WARNING << "Couldn't find Root metadata in the storage, trying remote repo";
       try {
         uptane_fetcher->fetchRole(&root, Uptane::kMaxRootSize, repo, Uptane::Role::Root(),
-                                  Uptane::Version(version_to_send), flow_control_);
+                                  Uptane::Version(version_to_send), flowControl());
       } catch (const std::exception &e) {
         LOG_ERROR << "Root metadata could not be fetched for Secondary with serial " << secondary.getSerial()
                   << ", skipping to the next Secondary";
@@ -1408,8 +1425,11 @@ void SotaUptaneClient::sendMetadataToEcus(const std::vector<Uptane::Target> &tar
 }
 
 std::future<data::InstallationResult> SotaUptaneClient::sendFirmwareAsync(SecondaryInterface &secondary,
-                                                                          const Uptane::Target &target) {
-  auto f = [this, &secondary, target]() {
+                                                                          const Uptane::Target &target,
+                                                                          std::shared_ptr<ImageFanOut> fan_out) {
+  // Runs on another thread, see FlowControlScope
+  const api::FlowControlToken *flow_control = flowControl();
+  auto f = [this, &secondary, target, fan_out, flow_control]() {
     auto correlation_id = director_repo.getCorrelationId();
 
     sendEvent<event::InstallStarted>(secondary.getSerial());
@@ -1417,13 +1437,18 @@ std::future<data::InstallationResult> SotaUptaneClient::sendFirmwareAsync(Second
 
     data::InstallationResult result;
     try {
-      result = secondary.sendFirmware(target, flow_control_);
+      result = secondary.sendFirmware(target, flow_control);
       if (result.isSuccess()) {
-        result = secondary.install(target, flow_control_);
+        result = secondary.install(target, flow_control);
       }
     } catch (const std::exception &ex) {
       result = data::InstallationResult(data::ResultCode::Numeric::kInternalError, ex.what());
     }
+    // The Secondary may not have read the whole image, e.g. after an error
+    // or if it fetches the image by itself: do not hold the others back.
+    if (fan_out != nullptr) {
+      fan_out->leave(secondary.getSerial());
+    }
 
     if (result.result_code == data::ResultCode::Numeric::kNeedCompletion) {
       report_queue->enqueue(std_::make_unique<EcuInstallationAppliedReport>(secondary.getSerial(), correlation_id));
@@ -1446,22 +1471,35 @@ std::vector<result::Install::EcuReport> SotaUptaneClient::sendImagesToEcus(const
   const Uptane::EcuSerial &primary_ecu_serial = primaryEcuSerial();
   // target images should already have been downloaded to metadata_path/targets/
   for (auto targets_it = targets.cbegin(); targets_it != targets.cend(); ++targets_it) {
+    std::vector<Uptane::EcuSerial> receivers;
     for (auto ecus_it = targets_it->ecus().cbegin(); ecus_it != targets_it->ecus().cend(); ++ecus_it) {
       const Uptane::EcuSerial &ecu_serial = ecus_it->first;
 
       if (primary_ecu_serial == ecu_serial) {
         continue;
       }
-
-      auto f = secondaries.find(ecu_serial);
-      if (f == secondaries.end()) {
+      if (secondaries.find(ecu_serial) == secondaries.end()) {
         LOG_ERROR << "Target " << *targets_it << " has an unknown ECU serial";
         continue;
       }
+      receivers.push_back(ecu_serial);
+    }
+
+    // Read the image only once when it goes to several Secondaries. OSTree
+    // Secondaries fetch their update by themselves.
+    std::shared_ptr<ImageFanOut> fan_out;
+    if (receivers.size() > 1 && !targets_it->IsOstree()) {
+      try {
+        fan_out = ImageSharing::shareTargetImage(*secondary_provider_, *targets_it, receivers);
+      } catch (const std::exception &e) {
+        LOG_WARNING << "Could not share the image of " << targets_it->filename() << ": " << e.what();
+      }
+    }
 
-      SecondaryInterface &sec = *f->second;
+    for (const auto &ecu_serial : receivers) {
+      SecondaryInterface &sec = *secondaries[ecu_serial];
       firmwareFutures.emplace_back(result::Install::EcuReport(*targets_it, ecu_serial, data::InstallationResult()),
-                                   sendFirmwareAsync(sec, *targets_it));
+                                   sendFirmwareAsync(sec, *targets_it, fan_out));
     }
   }
 
@@ -1483,7 +1521,7 @@ std::vector<result::Install::EcuReport> SotaUptaneClient::sendImagesToEcus(const
 }
 
 Uptane::LazyTargetsList SotaUptaneClient::allTargets() const {
-  return Uptane::LazyTargetsList(image_repo, storage, uptane_fetcher, flow_control_);
+  return Uptane::LazyTargetsList(image_repo, storage, uptane_fetcher, flowControl());
 }
 
 void SotaUptaneClient::checkAndUpdatePendingSecondaries() {
@@ -33,6 +33,8 @@
 #include "uptane/tuf.h"
 #include "utilities/flow_control.h"
 
+class ImageFanOut;
+
 class SotaUptaneClient {
  public:
   /**
@@ -53,6 +55,28 @@ class SotaUptaneClient {
     explicit NotProvisionedYet() : std::runtime_error("Device is not provisioned on-line yet") {}
   };
 
+  /**
+   * Makes the calls from the current thread use the given token instead of the
+   * one passed to the constructor, e.g. the token of the API command being run.
+   * Several commands can run at the same time, each with its own token.
+   */
+  class FlowControlScope {
+   public:
+    explicit FlowControlScope(const api::FlowControlToken *flow_control) : previous_{current_} {
+      current_ = flow_control;
+    }
+    ~FlowControlScope() { current_ = previous_; }
+    FlowControlScope(const FlowControlScope &) = delete;
+    FlowControlScope(FlowControlScope &&) = delete;
+    FlowControlScope &operator=(const FlowControlScope &) = delete;
+    FlowControlScope &operator=(FlowControlScope &&) = delete;
+
+   private:
+    friend class SotaUptaneClient;
+    static thread_local const api::FlowControlToken *current_;
+    const api::FlowControlToken *previous_;
+  };
+
   SotaUptaneClient(Config &config_in, std::shared_ptr<INvStorage> storage_in, std::shared_ptr<HttpInterface> http_in,
                    std::shared_ptr<event::Channel> events_channel_in, const api::FlowControlToken *flow_control);
 
@@ -166,7 +190,8 @@ class SotaUptaneClient {
   data::InstallationResult rotateSecondaryRoot(Uptane::RepositoryType repo, SecondaryInterface &secondary);
   void sendMetadataToEcus(const std::vector<Uptane::Target> &targets, data::InstallationResult *result,
                           std::string *raw_installation_report);
-  std::future<data::InstallationResult> sendFirmwareAsync(SecondaryInterface &secondary, const Uptane::Target &target);
+  std::future<data::InstallationResult> sendFirmwareAsync(SecondaryInterface &secondary, const Uptane::Target &target,
+                                                          std::shared_ptr<ImageFanOut> fan_out = nullptr);
   std::vector<result::Install::EcuReport> sendImagesToEcus(const std::vector<Uptane::Target> &targets);
 
   bool putManifestSimple(const Json::Value &custom = Json::nullValue);
@@ -186,6 +211,10 @@ class SotaUptaneClient {
   Uptane::EcuSerial primaryEcuSerial() { return provisioner_.PrimaryEcuSerial(); }
   boost::optional<Uptane::HardwareIdentifier> getEcuHwId(const Uptane::EcuSerial &serial);
 
+  const api::FlowControlToken *flowControl() const {
+    return FlowControlScope::current_ != nullptr ? FlowControlScope::current_ : flow_control_;
+  }
+
   template <class T, class... Args>
   void sendEvent(Args &&...args) {
     std::shared_ptr<event::BaseEvent> event = std::make_shared<T>(std::forward<Args>(args)...);
@@ -212,6 +241,8 @@ class SotaUptaneClient {
   // ecu_serial => secondary*
   std::map<Uptane::EcuSerial, SecondaryInterface::Ptr> secondaries;
   std::mutex download_mutex;
+  // API commands that need provisioning can run at the same time
+  std::mutex provision_mutex_;
   Provisioner provisioner_;
   Json::Value custom_hardware_info_{Json::nullValue};
   const api::FlowControlToken *flow_control_;
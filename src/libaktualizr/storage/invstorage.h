@@ -36,6 +36,32 @@ struct MisconfiguredEcu {
 
 enum class InstalledVersionUpdateMode { kNone, kCurrent, kPending };
 
+// Identity of a downloaded Target file at the time its hash was last verified:
+// as long as the file still matches it, the hash does not need to be computed
+// again.
+struct TargetVerification {
+  std::string hash;  // "<type>:<hash>" of the Target the file was verified against
+  int64_t size{0};
+  int64_t device{0};
+  int64_t inode{0};
+  int64_t mtime_ns{0};
+  int64_t ctime_ns{0};
+
+  bool operator==(const TargetVerification& other) const {
+    return hash == other.hash && size == other.size && device == other.device && inode == other.inode &&
+           mtime_ns == other.mtime_ns && ctime_ns == other.ctime_ns;
+  }
+  bool operator!=(const TargetVerification& other) const { return !(*this == other); }
+};
+
+// A downloaded Target and the file in images_path holding its content. Several
+// Targets with the same content share the same file.
+struct StoredTargetFile {
+  std::string targetname;
+  std::string filename;
+  int64_t last_used;  // only meaningful relative to other Targets: larger is more recent
+};
+
 // Functions loading/storing multiple pieces of data are supposed to do so
 // atomically as far as implementation makes it possible.
 //
@@ -148,6 +174,11 @@ class INvStorage {
   virtual std::string getTargetFilename(const std::string& targetname) const = 0;
   virtual std::vector<std::string> getAllTargetNames() const = 0;
   virtual void deleteTargetInfo(const std::string& targetname) const = 0;
+  // All stored Targets, least recently used first
+  virtual std::vector<StoredTargetFile> loadTargetFiles() const = 0;
+  virtual void touchTargetFile(const std::string& targetname) const = 0;
+  virtual void storeTargetVerification(const std::string& targetname, const TargetVerification& verification) const = 0;
+  virtual bool loadTargetVerification(const std::string& targetname, TargetVerification* verification) const = 0;
 
   // Special constructors and utilities
   static std::shared_ptr<INvStorage> newStorage(const StorageConfig& config, bool readonly = false);
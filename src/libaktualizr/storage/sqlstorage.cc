@@ -11,6 +11,68 @@
 #include "sql_utils.h"
 #include "utilities/utils.h"
 
+// Number of free pages above which the database file is shrunk after history has been deleted.
+static constexpr int64_t kCompactFreePages = 16;
+
+// Return the pages freed by deletions to the filesystem. Cheap enough to be
+// called after every pruning, as only the free pages are touched.
+static void compactDb(SQLite3Guard& db) {
+  int64_t free_pages = 0;
+  {
+    auto statement = db.prepareStatement("PRAGMA freelist_count;");
+    if (statement.step() == SQLITE_ROW) {
+      free_pages = statement.get_result_col_int(0);
+    }
+  }
+  if (free_pages < kCompactFreePages) {
+    return;
+  }
+  if (db.exec("PRAGMA incremental_vacuum;", nullptr, nullptr) != SQLITE_OK) {
+    LOG_WARNING << "Failed to compact the database: " << db.errmsg();
+  }
+}
+
+// Switching an existing database to incremental auto-vacuum rewrites all of
+// it, which is only done at startup while that is quick, e.g. on new devices.
+static constexpr int64_t kMaxStartupVacuumSize = 1 << 20;
+
+bool SQLStorage::enableIncrementalVacuum(bool at_startup) {
+  SQLite3Guard db = dbConnection();
+
+  {
+    // 2 is INCREMENTAL
+    auto statement = db.prepareStatement("PRAGMA auto_vacuum;");
+    if (statement.step() != SQLITE_ROW) {
+      LOG_ERROR << "Failed to get auto-vacuum mode: " << db.errmsg();
+      return false;
+    }
+    if (statement.get_result_col_int(0) == 2) {
+      return true;
+    }
+  }
+
+  if (at_startup) {
+    auto page_count = db.prepareStatement("PRAGMA page_count;");
+    auto page_size = db.prepareStatement("PRAGMA page_size;");
+    if (page_count.step() != SQLITE_ROW || page_size.step() != SQLITE_ROW) {
+      LOG_ERROR << "Failed to get the database size: " << db.errmsg();
+      return false;
+    }
+    if (page_count.get_result_col_int(0) * page_size.get_result_col_int(0) > kMaxStartupVacuumSize) {
+      LOG_INFO << "The database is not compacted after pruning until it is switched to incremental auto-vacuum "
+                  "with aktualizr-info --compact-db";
+      return false;
+    }
+  }
+
+  LOG_DEBUG << "Enabling incremental auto-vacuum of the database";
+  if (db.exec("PRAGMA auto_vacuum = INCREMENTAL; VACUUM;", nullptr, nullptr) != SQLITE_OK) {
+    LOG_WARNING << "Failed to enable incremental auto-vacuum: " << db.errmsg();
+    return false;
+  }
+  return true;
+}
+
 // Find metadata with version set to -1 (e.g. after migration) and assign proper version to it.
 void SQLStorage::cleanMetaVersion(Uptane::RepositoryType repo, const Uptane::Role& role) {
   SQLite3Guard db = dbConnection();
@@ -69,6 +131,10 @@ SQLStorage::SQLStorage(const StorageConfig& config, bool readonly)
   } catch (...) {
     LOG_ERROR << "SQLite database metadata version migration failed";
   }
+
+  if (!readonly) {
+    enableIncrementalVacuum(true);
+  }
 }
 
 void SQLStorage::storePrimaryKeys(const std::string& public_key, const std::string& private_key) {
@@ -529,7 +595,24 @@ void SQLStorage::storeRoot(const std::string& data, Uptane::RepositoryType repo,
     return;
   }
 
+  bool pruned = false;
+  if (config_.max_root_versions > 0) {
+    auto prune_statement = db.prepareStatement<int, int, int, int, int>(
+        "DELETE FROM meta WHERE (repo=? AND meta_type=? AND version <= "
+        "(SELECT MAX(version) FROM meta WHERE (repo=? AND meta_type=?)) - ?);",
+        static_cast<int>(repo), Uptane::Role::Root().ToInt(), static_cast<int>(repo), Uptane::Role::Root().ToInt(),
+        config_.max_root_versions);
+    if (prune_statement.step() != SQLITE_DONE) {
+      LOG_WARNING << "Failed to prune old Root metadata: " << db.errmsg();
+    } else {
+      pruned = sqlite3_changes(db.get()) > 0;
+    }
+  }
+
   db.commitTransaction();
+  if (pruned) {
+    compactDb(db);
+  }
 }
 
 void SQLStorage::storeNonRoot(const std::string& data, Uptane::RepositoryType repo, const Uptane::Role role) {
@@ -1145,7 +1228,23 @@ void SQLStorage::saveInstalledVersion(const std::string& ecu_serial, const Uptan
     }
   }
 
+  bool pruned = false;
+  if (config_.max_installed_versions > 0) {
+    auto statement = db.prepareStatement<std::string, std::string, int>(
+        "DELETE FROM installed_versions WHERE ecu_serial = ? AND is_current = 0 AND is_pending = 0 AND id NOT IN "
+        "(SELECT id FROM installed_versions WHERE ecu_serial = ? ORDER BY id DESC LIMIT ?);",
+        ecu_serial_real, ecu_serial_real, config_.max_installed_versions);
+    if (statement.step() != SQLITE_DONE) {
+      LOG_WARNING << "Failed to prune installed versions: " << db.errmsg();
+    } else {
+      pruned = sqlite3_changes(db.get()) > 0;
+    }
+  }
+
   db.commitTransaction();
+  if (pruned) {
+    compactDb(db);
+  }
 }
 
 static void loadEcuMap(SQLite3Guard& db, std::string& ecu_serial, Uptane::EcuMap& ecu_map) {
@@ -1576,6 +1675,21 @@ void SQLStorage::saveReportEvent(const Json::Value& json_value) {
     LOG_ERROR << "Failed to save report event: " << db.errmsg();
     return;
   }
+
+  if (config_.max_report_events > 0) {
+    // ids are allocated as MAX(id) + 1, so this keeps exactly the newest events
+    auto del_statement = db.prepareStatement<int>(
+        "DELETE FROM report_events WHERE id <= (SELECT MAX(id) FROM report_events) - ?;", config_.max_report_events);
+    if (del_statement.step() != SQLITE_DONE) {
+      LOG_WARNING << "Failed to prune report events: " << db.errmsg();
+      return;
+    }
+    const int dropped = sqlite3_changes(db.get());
+    if (dropped > 0) {
+      LOG_WARNING << "Too many unsent report events, dropped the " << dropped << " oldest one(s)";
+      compactDb(db);
+    }
+  }
 }
 
 bool SQLStorage::loadReportEvents(Json::Value* report_array, int64_t* id_max, int limit) const {
@@ -1618,7 +1732,9 @@ void SQLStorage::deleteReportEvents(int64_t id_max) {
   auto statement = db.prepareStatement<int64_t>("DELETE FROM report_events WHERE id <= ?;", id_max);
   if (statement.step() != SQLITE_DONE) {
     LOG_ERROR << "Failed to clear report events: " << db.errmsg();
+    return;
   }
+  compactDb(db);
 }
 
 void SQLStorage::clearInstallationResults() {
@@ -1684,12 +1800,22 @@ void SQLStorage::clearDeviceData() {
 void SQLStorage::storeTargetFilename(const std::string& targetname, const std::string& filename) const {
   SQLite3Guard db = dbConnection();
   auto statement = db.prepareStatement<std::string, std::string>(
-      "INSERT OR REPLACE INTO target_images (targetname, filename) VALUES (?, ?);", targetname, filename);
+      "INSERT OR REPLACE INTO target_images (targetname, filename, last_used) VALUES (?, ?, (SELECT "
+      "IFNULL(MAX(last_used), 0) + 1 FROM target_images));",
+      targetname, filename);
 
   if (statement.step() != SQLITE_DONE) {
     LOG_ERROR << "Failed to store Target filename: " << db.errmsg();
     throw SQLException(std::string("Failed to store Target filename: ") + db.errmsg());
   }
+
+  // A new file is being written, whatever was verified before no longer applies
+  auto del_statement =
+      db.prepareStatement<std::string>("DELETE FROM target_verifications WHERE targetname = ?;", targetname);
+  if (del_statement.step() != SQLITE_DONE) {
+    LOG_ERROR << "Failed to clear Target verification: " << db.errmsg();
+    throw SQLException(std::string("Failed to clear Target verification: ") + db.errmsg());
+  }
 }
 
 std::string SQLStorage::getTargetFilename(const std::string& targetname) const {
@@ -1730,10 +1856,101 @@ std::vector<std::string> SQLStorage::getAllTargetNames() const {
 void SQLStorage::deleteTargetInfo(const std::string& targetname) const {
   SQLite3Guard db = dbConnection();
 
+  db.beginTransaction();
+
   auto statement = db.prepareStatement<std::string>("DELETE FROM target_images WHERE targetname=?;", targetname);
 
   if (statement.step() != SQLITE_DONE) {
     LOG_ERROR << "Failed to clear Target filenames: " << db.errmsg();
     throw SQLException(std::string("Failed to clear Target filenames: ") + db.errmsg());
   }
+
+  auto verification_statement =
+      db.prepareStatement<std::string>("DELETE FROM target_verifications WHERE targetname=?;", targetname);
+
+  if (verification_statement.step() != SQLITE_DONE) {
+    LOG_ERROR << "Failed to clear Target verification: " << db.errmsg();
+    throw SQLException(std::string("Failed to clear Target verification: ") + db.errmsg());
+  }
+
+  db.commitTransaction();
+}
+
+std::vector<StoredTargetFile> SQLStorage::loadTargetFiles() const {
+  SQLite3Guard db = dbConnection();
+
+  auto statement =
+      db.prepareStatement<>("SELECT targetname, filename, last_used FROM target_images ORDER BY last_used;");
+
+  std::vector<StoredTargetFile> files;
+
+  int result = statement.step();
+  while (result != SQLITE_DONE) {
+    if (result != SQLITE_ROW) {
+      LOG_ERROR << "Failed to get Target filenames: " << db.errmsg();
+      throw SQLException(std::string("Failed to get Target filenames: ") + db.errmsg());
+    }
+    files.push_back({statement.get_result_col_str(0).value(), statement.get_result_col_str(1).value(),
+                     statement.get_result_col_int(2)});
+    result = statement.step();
+  }
+  return files;
+}
+
+void SQLStorage::touchTargetFile(const std::string& targetname) const {
+  SQLite3Guard db = dbConnection();
+  // A counter rather than a timestamp: only the order matters, and it does not
+  // depend on the clock being right.
+  auto statement = db.prepareStatement<std::string>(
+      "UPDATE target_images SET last_used = (SELECT IFNULL(MAX(last_used), 0) + 1 FROM target_images) WHERE "
+      "targetname = ?;",
+      targetname);
+
+  if (statement.step() != SQLITE_DONE) {
+    LOG_ERROR << "Failed to update Target use: " << db.errmsg();
+    throw SQLException(std::string("Failed to update Target use: ") + db.errmsg());
+  }
+}
+
+void SQLStorage::storeTargetVerification(const std::string& targetname,
+                                         const TargetVerification& verification) const {
+  SQLite3Guard db = dbConnection();
+  auto statement = db.prepareStatement<std::string, std::string, int64_t, int64_t, int64_t, int64_t, int64_t>(
+      "INSERT OR REPLACE INTO target_verifications (targetname, hash, size, device, inode, mtime_ns, ctime_ns) "
+      "VALUES (?, ?, ?, ?, ?, ?, ?);",
+      targetname, verification.hash, verification.size, verification.device, verification.inode,
+      verification.mtime_ns, verification.ctime_ns);
+
+  if (statement.step() != SQLITE_DONE) {
+    LOG_ERROR << "Failed to store Target verification: " << db.errmsg();
+    throw SQLException(std::string("Failed to store Target verification: ") + db.errmsg());
+  }
+}
+
+bool SQLStorage::loadTargetVerification(const std::string& targetname, TargetVerification* verification) const {
+  SQLite3Guard db = dbConnection();
+
+  auto statement = db.prepareStatement<std::string>(
+      "SELECT hash, size, device, inode, mtime_ns, ctime_ns FROM target_verifications WHERE targetname = ?;",
+      targetname);
+
+  int result = statement.step();
+  if (result == SQLITE_DONE) {
+    return false;
+  }
+  if (result != SQLITE_ROW) {
+    LOG_ERROR << "Failed to get Target verification: " << db.errmsg();
+    return false;
+  }
+
+  if (verification != nullptr) {
+    verification->hash = statement.get_result_col_str(0).value();
+    verification->size = statement.get_result_col_int(1);
+    verification->device = statement.get_result_col_int(2);
+    verification->inode = statement.get_result_col_int(3);
+    verification->mtime_ns = statement.get_result_col_int(4);
+    verification->ctime_ns = statement.get_result_col_int(5);
+  }
+
+  return true;
 }
@@ -110,9 +110,21 @@ class SQLStorage : public SQLStorageBase, public INvStorage {
   std::string getTargetFilename(const std::string& targetname) const override;
   std::vector<std::string> getAllTargetNames() const override;
   void deleteTargetInfo(const std::string& targetname) const override;
+  std::vector<StoredTargetFile> loadTargetFiles() const override;
+  void touchTargetFile(const std::string& targetname) const override;
+  void storeTargetVerification(const std::string& targetname, const TargetVerification& verification) const override;
+  bool loadTargetVerification(const std::string& targetname, TargetVerification* verification) const override;
 
   StorageType type() override { return StorageType::kSqlite; };
 
+  /**
+   * Switch the database to incremental auto-vacuum, so that it shrinks after
+   * pruning. This rewrites the whole database once: at startup, it is only
+   * done for small databases.
+   * @return true if the database uses incremental auto-vacuum
+   */
+  bool enableIncrementalVacuum(bool at_startup = false);
+
  private:
   void cleanMetaVersion(Uptane::RepositoryType repo, const Uptane::Role& role);
 };
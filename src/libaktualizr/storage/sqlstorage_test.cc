@@ -17,7 +17,16 @@ typedef boost::tokenizer<boost::char_separator<char> > sql_tokenizer;
 static std::map<std::string, std::string> parseSchema() {
   std::map<std::string, std::string> result;
   std::vector<std::string> tokens;
-  enum { STATE_INIT, STATE_CREATE, STATE_INSERT, STATE_TABLE, STATE_NAME, STATE_TRIGGER, STATE_TRIGGER_END };
+  enum {
+    STATE_INIT,
+    STATE_CREATE,
+    STATE_INSERT,
+    STATE_INDEX,
+    STATE_TABLE,
+    STATE_NAME,
+    STATE_TRIGGER,
+    STATE_TRIGGER_END
+  };
   boost::char_separator<char> sep(" \"\t\r\n", "(),;");
   std::string schema(libaktualizr_current_schema);
   sql_tokenizer tok(schema, sep);
@@ -47,11 +56,14 @@ static std::map<std::string, std::string> parseSchema() {
           parsing_state = STATE_TABLE;
         } else if (token == "TRIGGER") {
           parsing_state = STATE_TRIGGER;
+        } else if (token == "INDEX") {
+          parsing_state = STATE_INDEX;
         } else {
           return {};
         }
         break;
       case STATE_INSERT:
+      case STATE_INDEX:
         // do not take these into account
         if (token == ";") {
           key.clear();
@@ -543,6 +555,220 @@ TEST(sqlstorage, store_and_load_report_events) {
   }
 }
 
+/* Pruning of the installation history keeps the newest, current and pending versions. */
+TEST(sqlstorage, installed_versions_retention) {
+  TemporaryDirectory temp_dir;
+  StorageConfig config;
+  config.path = temp_dir.Path();
+  config.max_installed_versions = 3;
+  SQLStorage storage(config, false);
+
+  Uptane::EcuMap primary_ecu{{Uptane::EcuSerial("primary"), Uptane::HardwareIdentifier("primary_hw")}};
+  storage.storeEcuSerials({{Uptane::EcuSerial("primary"), Uptane::HardwareIdentifier("primary_hw")},
+                           {Uptane::EcuSerial("secondary"), Uptane::HardwareIdentifier("secondary_hw")}});
+  auto make_target = [&primary_ecu](int k) {
+    return Uptane::Target{"update" + std::to_string(k) + ".bin", primary_ecu,
+                          {Hash{Hash::Type::kSha256, "256" + std::to_string(k)}}, static_cast<uint64_t>(k)};
+  };
+
+  storage.saveInstalledVersion("secondary", make_target(0), InstalledVersionUpdateMode::kCurrent, "");
+  storage.saveInstalledVersion("primary", make_target(1), InstalledVersionUpdateMode::kCurrent, "");
+  for (int k = 2; k < 10; ++k) {
+    storage.saveInstalledVersion("primary", make_target(k), InstalledVersionUpdateMode::kNone, "");
+  }
+  storage.saveInstalledVersion("primary", make_target(10), InstalledVersionUpdateMode::kPending, "");
+
+  {
+    std::vector<Uptane::Target> log;
+    EXPECT_TRUE(storage.loadInstallationLog("primary", &log, false));
+    // the three newest ones, plus the current one which is older
+    ASSERT_EQ(log.size(), 4);
+    EXPECT_EQ(log[0].filename(), "update1.bin");
+    EXPECT_EQ(log[1].filename(), "update8.bin");
+    EXPECT_EQ(log[3].filename(), "update10.bin");
+  }
+
+  boost::optional<Uptane::Target> current;
+  boost::optional<Uptane::Target> pending;
+  EXPECT_TRUE(storage.loadInstalledVersions("primary", &current, &pending, nullptr));
+  ASSERT_TRUE(!!current);
+  EXPECT_EQ(current->filename(), "update1.bin");
+  ASSERT_TRUE(!!pending);
+  EXPECT_EQ(pending->filename(), "update10.bin");
+
+  // other ECUs are not affected
+  std::vector<Uptane::Target> log;
+  EXPECT_TRUE(storage.loadInstallationLog("secondary", &log, false));
+  EXPECT_EQ(log.size(), 1);
+}
+
+/* The oldest report events are dropped when the limit is reached. */
+TEST(sqlstorage, report_events_retention) {
+  TemporaryDirectory temp_dir;
+  StorageConfig config;
+  config.path = temp_dir.Path();
+  config.max_report_events = 5;
+  SQLStorage storage(config, false);
+
+  for (int k = 0; k < 12; ++k) {
+    Json::Value event;
+    event["id"] = k;
+    storage.saveReportEvent(event);
+  }
+
+  Json::Value events{Json::arrayValue};
+  int64_t max_id = 0;
+  storage.loadReportEvents(&events, &max_id, -1);
+  ASSERT_EQ(events.size(), 5);
+  EXPECT_EQ(events[0]["id"].asInt(), 7);
+  EXPECT_EQ(events[4]["id"].asInt(), 11);
+
+  storage.deleteReportEvents(max_id);
+  storage.saveReportEvent(Utils::parseJSON(R"({"id": 12})"));
+  events = Json::Value{Json::arrayValue};
+  storage.loadReportEvents(&events, &max_id, -1);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0]["id"].asInt(), 12);
+}
+
+/* Only the newest Root versions are kept if a limit is set. */
+TEST(sqlstorage, root_versions_retention) {
+  TemporaryDirectory temp_dir;
+  StorageConfig config;
+  config.path = temp_dir.Path();
+  config.max_root_versions = 2;
+  SQLStorage storage(config, false);
+
+  for (int k = 1; k <= 4; ++k) {
+    storage.storeRoot("director_root_" + std::to_string(k), Uptane::RepositoryType::Director(), Uptane::Version(k));
+  }
+  storage.storeRoot("image_root_1", Uptane::RepositoryType::Image(), Uptane::Version(1));
+
+  std::string data;
+  EXPECT_FALSE(storage.loadRoot(&data, Uptane::RepositoryType::Director(), Uptane::Version(2)));
+  EXPECT_TRUE(storage.loadRoot(&data, Uptane::RepositoryType::Director(), Uptane::Version(3)));
+  EXPECT_EQ(data, "director_root_3");
+  EXPECT_TRUE(storage.loadRoot(&data, Uptane::RepositoryType::Director(), Uptane::Version()));
+  EXPECT_EQ(data, "director_root_4");
+  EXPECT_TRUE(storage.loadRoot(&data, Uptane::RepositoryType::Image(), Uptane::Version(1)));
+}
+
+/* The database is switched to incremental auto-vacuum so that it shrinks after pruning. */
+TEST(sqlstorage, incremental_vacuum) {
+  // database created before auto-vacuum was enabled
+  auto tdb = makeDbWithVersion(DbVersion(25));
+  StorageConfig config;
+  config.path = tdb.dir->Path();
+  config.sqldb_path = utils::BasedPath("test.db");
+
+  SQLStorage storage(config, false);
+  EXPECT_EQ(static_cast<int>(storage.getVersion()), 28);
+
+  SQLite3Guard db(tdb.db_path.c_str());
+  auto statement = db.prepareStatement("PRAGMA auto_vacuum;");
+  ASSERT_EQ(statement.step(), SQLITE_ROW);
+  // 2 is INCREMENTAL
+  EXPECT_EQ(statement.get_result_col_int(0), 2);
+}
+
+/* Large databases are not rewritten at startup, only when asked to. */
+TEST(sqlstorage, incremental_vacuum_large) {
+  auto tdb = makeDbWithVersion(DbVersion(25));
+  StorageConfig config;
+  config.path = tdb.dir->Path();
+  config.sqldb_path = utils::BasedPath("test.db");
+  {
+    SQLite3Guard db(tdb.db_path.c_str());
+    ASSERT_EQ(db.exec("CREATE TABLE filler(data BLOB); INSERT INTO filler VALUES (zeroblob(2097152));", nullptr,
+                      nullptr),
+              SQLITE_OK);
+  }
+  auto auto_vacuum = [&tdb]() {
+    SQLite3Guard db(tdb.db_path.c_str());
+    auto statement = db.prepareStatement("PRAGMA auto_vacuum;");
+    EXPECT_EQ(statement.step(), SQLITE_ROW);
+    return statement.get_result_col_int(0);
+  };
+
+  SQLStorage storage(config, false);
+  EXPECT_EQ(auto_vacuum(), 0);
+  EXPECT_TRUE(storage.enableIncrementalVacuum());
+  EXPECT_EQ(auto_vacuum(), 2);
+}
+
+/* Target verification records are stored, replaced and removed with the Target. */
+TEST(sqlstorage, target_verifications) {
+  TemporaryDirectory temp_dir;
+  StorageConfig config;
+  config.path = temp_dir.Path();
+  SQLStorage storage(config, false);
+
+  TargetVerification verification;
+  verification.hash = "sha256:abcd";
+  verification.size = 4;
+  verification.device = 2049;
+  verification.inode = 1234567;
+  verification.mtime_ns = 1600000000123456789;
+  verification.ctime_ns = 1600000000987654321;
+
+  TargetVerification loaded;
+  EXPECT_FALSE(storage.loadTargetVerification("target", &loaded));
+
+  storage.storeTargetFilename("target", "abcd");
+  storage.storeTargetVerification("target", verification);
+  ASSERT_TRUE(storage.loadTargetVerification("target", &loaded));
+  EXPECT_EQ(loaded, verification);
+
+  verification.size = 5;
+  storage.storeTargetVerification("target", verification);
+  ASSERT_TRUE(storage.loadTargetVerification("target", &loaded));
+  EXPECT_EQ(loaded.size, 5);
+
+  storage.storeTargetFilename("target", "abcd");
+  EXPECT_FALSE(storage.loadTargetVerification("target", &loaded));
+
+  storage.storeTargetVerification("target", verification);
+  storage.deleteTargetInfo("target");
+  EXPECT_FALSE(storage.loadTargetVerification("target", &loaded));
+}
+
+/* Lookups of the installation history must not scan the whole table. */
+TEST(sqlstorage, installed_versions_use_index) {
+  TemporaryDirectory temp_dir;
+  StorageConfig config;
+  config.path = temp_dir.Path();
+  SQLStorage storage(config, false);
+
+  const std::vector<std::string> queries{
+      "SELECT id, sha256, name, was_installed FROM installed_versions WHERE ecu_serial = ? ORDER BY id DESC LIMIT 1;",
+      "UPDATE installed_versions SET is_current = 0, is_pending = 0 WHERE ecu_serial = ?",
+      "UPDATE installed_versions SET is_pending = 0 WHERE ecu_serial = ?",
+      "DELETE FROM installed_versions WHERE ecu_serial = ? AND is_current = 0 AND is_pending = 0 AND id NOT IN "
+      "(SELECT id FROM installed_versions WHERE ecu_serial = ? ORDER BY id DESC LIMIT ?);",
+      "SELECT id, sha256, name, hashes, length, correlation_id, custom_meta FROM installed_versions WHERE "
+      "ecu_serial = ? ORDER BY id;",
+      "SELECT sha256, name, hashes, length, correlation_id, custom_meta FROM installed_versions WHERE "
+      "ecu_serial = ? AND is_current = 1 LIMIT 1;",
+      "SELECT sha256, name, hashes, length, correlation_id, custom_meta FROM installed_versions WHERE "
+      "ecu_serial = ? AND is_pending = 1 LIMIT 1;",
+      "SELECT count(*) FROM installed_versions where is_pending = 1",
+      "SELECT ecu_serial, sha256 FROM installed_versions where is_pending = 1"};
+
+  SQLite3Guard db(temp_dir / "sql.db");
+  for (const auto& query : queries) {
+    auto statement = db.prepareStatement("EXPLAIN QUERY PLAN " + query);
+    int rows = 0;
+    while (statement.step() == SQLITE_ROW) {
+      const std::string detail = statement.get_result_col_str(3).value_or("");
+      if (detail.find("installed_versions") != std::string::npos) {
+        EXPECT_NE(detail.find("USING"), std::string::npos) << query << ": " << detail;
+      }
+      ++rows;
+    }
+    EXPECT_GT(rows, 0) << query;
+  }
+}
+
 #ifndef __NO_MAIN__
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 
 #include <chrono>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include "utilities/apiqueue.h"
 
 using std::cout;
@@ -46,6 +49,96 @@ TEST(ApiQueue, Simple) {
   EXPECT_EQ(result.get(), 100);
 }
 
+/* Wait for a token to be aborted, as a long download would */
+static bool waitForAbort(const api::FlowControlToken* token) {
+  for (int k = 0; k < 1000; ++k) {
+    if (token->hasAborted()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+/* A long download holds back neither commands of other lanes, nor commands of
+ * its own type that are then aborted. */
+TEST(ApiQueue, Lanes) {
+  api::CommandQueue dut;
+  dut.run();
+  std::function<bool(const api::FlowControlToken*)> download(waitForAbort);
+  future<bool> downloaded = dut.enqueue(api::CommandType::kDownload, std::move(download));
+
+  std::function<bool(const api::FlowControlToken*)> campaign_check(
+      [](const api::FlowControlToken* token) { return token->hasAborted(); });
+  future<bool> campaign_checked = dut.enqueue(api::CommandType::kCampaignCheck, std::move(campaign_check));
+  ASSERT_EQ(campaign_checked.wait_for(std::chrono::seconds(10)), future_status::ready);
+  EXPECT_FALSE(campaign_checked.get());
+
+  // Uses the Uptane metadata, like the download
+  std::function<int()> check_updates([] { return 1; });
+  future<int> updates_checked = dut.enqueue(api::CommandType::kCheckUpdates, std::move(check_updates));
+  EXPECT_EQ(updates_checked.wait_for(std::chrono::milliseconds(200)), future_status::timeout);
+
+  dut.abort(api::CommandType::kDownload);
+  ASSERT_EQ(downloaded.wait_for(std::chrono::seconds(10)), future_status::ready);
+  EXPECT_TRUE(downloaded.get());
+  ASSERT_EQ(updates_checked.wait_for(std::chrono::seconds(10)), future_status::ready);
+  EXPECT_EQ(updates_checked.get(), 1);
+}
+
+/* Among the commands of a lane, those with a higher priority go first, while
+ * those that use a common resource run in order: campaign commands use none. */
+TEST(ApiQueue, Priorities) {
+  api::CommandQueue dut;
+  std::mutex m;
+  std::vector<std::string> order;
+  auto record = [&m, &order](const std::string& name) {
+    return std::function<void()>([&m, &order, name] {
+      std::lock_guard<std::mutex> guard(m);
+      order.push_back(name);
+    });
+  };
+  dut.enqueue(api::CommandType::kCheckUpdates, record("check_updates"));
+  dut.enqueue(api::CommandType::kCampaignCheck, record("campaign_check"));
+  auto last = dut.enqueue(api::CommandType::kGeneric, record("generic"));
+  dut.enqueue(api::CommandType::kCampaignControl, record("campaign_control"));
+  dut.run();
+  ASSERT_EQ(last.wait_for(std::chrono::seconds(10)), future_status::ready);
+
+  const std::vector<std::string> expected{"campaign_check", "campaign_control", "check_updates", "generic"};
+  EXPECT_EQ(order, expected);
+}
+
+/* Pausing one type of command does not pause the others. */
+TEST(ApiQueue, PauseType) {
+  api::CommandQueue dut;
+  dut.run();
+  std::promise<void> started;
+  std::promise<void> paused;
+  std::function<bool(const api::FlowControlToken*)> download([&started, &paused](const api::FlowControlToken* token) {
+    started.set_value();
+    while (token->canContinue(false)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    paused.set_value();
+    return token->canContinue();
+  });
+  future<bool> downloaded = dut.enqueue(api::CommandType::kDownload, std::move(download));
+  started.get_future().wait();
+  EXPECT_TRUE(dut.pause(api::CommandType::kDownload, true));
+  ASSERT_EQ(paused.get_future().wait_for(std::chrono::seconds(10)), future_status::ready);
+
+  std::function<bool(const api::FlowControlToken*)> send_manifest(
+      [](const api::FlowControlToken* token) { return token->canContinue(false); });
+  future<bool> manifest_sent = dut.enqueue(api::CommandType::kSendManifest, std::move(send_manifest));
+  ASSERT_EQ(manifest_sent.wait_for(std::chrono::seconds(10)), future_status::ready);
+  EXPECT_TRUE(manifest_sent.get());
+
+  EXPECT_TRUE(dut.pause(api::CommandType::kDownload, false));
+  ASSERT_EQ(downloaded.wait_for(std::chrono::seconds(10)), future_status::ready);
+  EXPECT_TRUE(downloaded.get());
+}
+
 #ifndef __NO_MAIN__
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -3,6 +3,33 @@
 
 namespace api {
 
+constexpr uint32_t CommandTraits::kUptaneRepos;
+constexpr uint32_t CommandTraits::kSecondaries;
+constexpr uint32_t CommandTraits::kDeviceReports;
+constexpr uint32_t CommandTraits::kAll;
+
+CommandTraits CommandTraits::of(CommandType type) {
+  switch (type) {
+    case CommandType::kCheckUpdates:
+      // Also sends the manifest and the network info
+      return {Lane::kNetworkMetadata, 1, kUptaneRepos | kSecondaries | kDeviceReports};
+    case CommandType::kCampaignCheck:
+    case CommandType::kCampaignControl:
+      return {Lane::kNetworkMetadata, 2, 0};
+    case CommandType::kDownload:
+      return {Lane::kBulkDownload, 0, kUptaneRepos};
+    case CommandType::kInstall:
+      return {Lane::kInstall, 0, kUptaneRepos | kSecondaries};
+    case CommandType::kSendManifest:
+      return {Lane::kReporting, 1, kSecondaries};
+    case CommandType::kSendDeviceData:
+      return {Lane::kReporting, 0, kDeviceReports};
+    case CommandType::kGeneric:
+    default:
+      return {Lane::kNetworkMetadata, 0, kAll};
+  }
+}
+
 CommandQueue::~CommandQueue() {
   try {
     abort(false);
@@ -15,23 +42,60 @@ CommandQueue::~CommandQueue() {
 
 void CommandQueue::run() {
   std::lock_guard<std::mutex> g(thread_m_);
-  if (!thread_.joinable()) {
-    thread_ = std::thread([this] {
-      Context ctx{.flow_control = &token_};
-      std::unique_lock<std::mutex> lock(m_);
-      for (;;) {
-        cv_.wait(lock, [this] { return (!queue_.empty() && !paused_) || shutdown_; });
-        if (shutdown_) {
-          break;
-        }
-        auto task = std::move(queue_.front());
-        queue_.pop();
-        lock.unlock();
-        task->PerformTask(&ctx);
-        lock.lock();
-      }
-    });
+  if (threads_.empty()) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      threads_.emplace_back([this, lane] { laneLoop(static_cast<Lane>(lane)); });
+    }
+  }
+}
+
+void CommandQueue::laneLoop(Lane lane) {
+  std::unique_lock<std::mutex> lock(m_);
+  for (;;) {
+    Entry entry;
+    cv_.wait(lock, [this, lane, &entry] { return shutdown_ || takeNext(lane, &entry); });
+    if (shutdown_) {
+      break;
+    }
+    lock.unlock();
+    Context ctx{.flow_control = entry.token.get()};
+    entry.task->PerformTask(&ctx);
+    lock.lock();
+    running_.remove_if([&entry](const Entry& e) { return e.seq == entry.seq; });
+    // The resources and the lane are free again
+    cv_.notify_all();
+  }
+}
+
+bool CommandQueue::takeNext(Lane lane, Entry* entry) {
+  if (paused_) {
+    return false;
+  }
+  uint32_t used = 0;
+  for (const auto& e : running_) {
+    if (e.traits.lane == lane) {
+      return false;
+    }
+    used |= e.traits.resources;
+  }
+
+  auto next = queue_.end();
+  for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+    const bool can_start = (it->traits.resources & used) == 0 && paused_types_.count(it->type) == 0;
+    if (can_start && it->traits.lane == lane && (next == queue_.end() || it->traits.priority > next->traits.priority)) {
+      next = it;
+    }
+    // Later commands do not overtake this one on its resources
+    used |= it->traits.resources;
+  }
+  if (next == queue_.end()) {
+    return false;
   }
+
+  *entry = std::move(*next);
+  queue_.erase(next);
+  running_.push_back(*entry);
+  return true;
 }
 
 bool CommandQueue::pause(bool do_pause) {
@@ -40,7 +104,31 @@ bool CommandQueue::pause(bool do_pause) {
     std::lock_guard<std::mutex> lock(m_);
     has_effect = paused_ != do_pause;
     paused_ = do_pause;
-    token_.setPause(do_pause);
+    for (auto& e : running_) {
+      if (paused_types_.count(e.type) == 0) {
+        e.token->setPause(do_pause);
+      }
+    }
+  }
+  cv_.notify_all();
+
+  return has_effect;
+}
+
+bool CommandQueue::pause(CommandType type, bool do_pause) {
+  bool has_effect;
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    if (do_pause) {
+      has_effect = paused_types_.insert(type).second;
+    } else {
+      has_effect = paused_types_.erase(type) != 0;
+    }
+    for (auto& e : running_) {
+      if (e.type == type) {
+        e.token->setPause(do_pause || paused_);
+      }
+    }
   }
   cv_.notify_all();
 
@@ -52,18 +140,21 @@ void CommandQueue::abort(bool restart_thread) {
     std::lock_guard<std::mutex> thread_g(thread_m_);
     {
       std::lock_guard<std::mutex> g(m_);
-      token_.setAbort();
+      for (auto& e : running_) {
+        e.token->setAbort();
+      }
       shutdown_ = true;
     }
     cv_.notify_all();
-    if (thread_.joinable()) {
-      thread_.join();
+    for (auto& thread : threads_) {
+      thread.join();
     }
+    threads_.clear();
     {
       // Flush the queue and reset to initial state
       std::lock_guard<std::mutex> g(m_);
-      std::queue<ICommand::Ptr>().swap(queue_);
-      token_.reset();
+      queue_.clear();
+      running_.clear();
       shutdown_ = false;
     }
   }
@@ -72,10 +163,38 @@ void CommandQueue::abort(bool restart_thread) {
   }
 }
 
-void CommandQueue::enqueue(ICommand::Ptr&& task) {
+void CommandQueue::abort(CommandType type) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    for (auto& e : running_) {
+      if (e.type == type) {
+        e.token->setAbort();
+      }
+    }
+    for (auto it = queue_.begin(); it != queue_.end();) {
+      it = it->type == type ? queue_.erase(it) : std::next(it);
+    }
+  }
+  // Dropped commands may have held others back
+  cv_.notify_all();
+}
+
+void CommandQueue::setBandwidthLimiter(std::shared_ptr<BandwidthLimiter> limiter) {
+  std::lock_guard<std::mutex> lock(m_);
+  limiter_ = std::move(limiter);
+}
+
+void CommandQueue::enqueue(ICommand::Ptr&& task, CommandType type) {
   {
     std::lock_guard<std::mutex> lock(m_);
-    queue_.push(std::move(task));
+    Entry entry;
+    entry.task = std::move(task);
+    entry.type = type;
+    entry.traits = CommandTraits::of(type);
+    entry.seq = next_seq_++;
+    entry.token = std::make_shared<api::FlowControlToken>();
+    entry.token->setBandwidthLimiter(limiter_);
+    queue_.push_back(std::move(entry));
   }
   cv_.notify_all();
 }
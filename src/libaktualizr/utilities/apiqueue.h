@@ -3,17 +3,61 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <future>
+#include <list>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <set>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include "utilities/flow_control.h"
 
 namespace api {
 
+/// What a command does, which decides where and alongside what it runs
+enum class CommandType {
+  kGeneric,  // Runs alone, as all commands did before lanes were introduced
+  kCheckUpdates,
+  kCampaignCheck,
+  kCampaignControl,
+  kDownload,
+  kInstall,
+  kSendManifest,
+  kSendDeviceData,
+};
+
+/// Commands of a lane run one at a time; commands of different lanes can run
+/// at the same time.
+enum class Lane {
+  kNetworkMetadata,
+  kBulkDownload,
+  kInstall,
+  kReporting,
+};
+
+struct CommandTraits {
+  // State of the client that commands may not use at the same time
+  static constexpr uint32_t kUptaneRepos{1U << 0U};  // Metadata, Targets and installation
+  static constexpr uint32_t kSecondaries{1U << 1U};  // Including the manifest and its report counter
+  static constexpr uint32_t kDeviceReports{1U << 2U};
+  static constexpr uint32_t kAll{~0U};
+
+  static CommandTraits of(CommandType type);
+
+  Lane lane;
+  /// Among the commands of a lane that can be started, the one with the
+  /// highest priority goes first.
+  int priority;
+  /// Commands using a common resource do not run at the same time, and run
+  /// in the order they have been enqueued in.
+  uint32_t resources;
+};
+
 struct Context {
   api::FlowControlToken* flow_control;
 };
@@ -96,6 +140,11 @@ class CommandFlowControl : public CommandBase<T> {
   std::function<T(const api::FlowControlToken*)> f_;
 };
 
+/**
+ * Runs commands on a thread per lane, see CommandTraits. Each command gets its
+ * own FlowControlToken, so that commands of one type can be paused or aborted
+ * without affecting the others.
+ */
 class CommandQueue {
  public:
   CommandQueue() = default;
@@ -107,42 +156,80 @@ class CommandQueue {
   CommandQueue& operator=(CommandQueue&&) = delete;
   void run();
   bool pause(bool do_pause);  // returns true iff pause→resume or resume→pause
+  /**
+   * Pause or resume the commands of one type: running ones through their
+   * token, pending ones by not starting them.
+   * @return true iff pause→resume or resume→pause
+   */
+  bool pause(CommandType type, bool do_pause);
   /**
    * Stop any current operation and flush the queue.
    * Any in-progress operation will have finished before this call returns.
    * @param restart_thread
    */
   void abort(bool restart_thread = true);
-
-  const api::FlowControlToken* FlowControlToken() const { return &token_; }
+  /**
+   * Abort the running commands of one type and drop the pending ones. Does not
+   * wait for the running ones to finish.
+   */
+  void abort(CommandType type);
+  /// Share a bandwidth limit between the commands enqueued from now on.
+  void setBandwidthLimiter(std::shared_ptr<BandwidthLimiter> limiter);
 
   template <class R>
   std::future<R> enqueue(std::function<R()>&& function) {
+    return enqueue(CommandType::kGeneric, std::move(function));
+  }
+
+  template <class R>
+  std::future<R> enqueue(std::function<R(const api::FlowControlToken*)>&& function) {
+    return enqueue(CommandType::kGeneric, std::move(function));
+  }
+
+  template <class R>
+  std::future<R> enqueue(CommandType type, std::function<R()>&& function) {
     auto task = std::make_shared<Command<R>>(std::move(function));
-    enqueue(task);
+    enqueue(task, type);
     return task->GetFuture();
   }
 
   template <class R>
-  std::future<R> enqueue(std::function<R(const api::FlowControlToken*)>&& function) {
+  std::future<R> enqueue(CommandType type, std::function<R(const api::FlowControlToken*)>&& function) {
     auto task = std::make_shared<CommandFlowControl<R>>(std::move(function));
-    enqueue(task);
+    enqueue(task, type);
     return task->GetFuture();
   }
 
-  void enqueue(ICommand::Ptr&& task);
+  void enqueue(ICommand::Ptr&& task, CommandType type = CommandType::kGeneric);
 
  private:
+  static constexpr size_t kLanes{4};
+
+  struct Entry {
+    ICommand::Ptr task;
+    CommandType type{CommandType::kGeneric};
+    CommandTraits traits{};
+    uint64_t seq{0};
+    std::shared_ptr<api::FlowControlToken> token;
+  };
+
+  void laneLoop(Lane lane);
+  bool takeNext(Lane lane, Entry* entry);
+
   std::atomic_bool shutdown_{false};
   std::atomic_bool paused_{false};
 
-  std::thread thread_;
+  std::vector<std::thread> threads_;
   std::mutex thread_m_;
 
-  std::queue<ICommand::Ptr> queue_;
+  // Pending commands, in the order they have been enqueued in
+  std::deque<Entry> queue_;
+  std::list<Entry> running_;
+  std::set<CommandType> paused_types_;
+  uint64_t next_seq_{0};
+  std::shared_ptr<BandwidthLimiter> limiter_;
   std::mutex m_;
   std::condition_variable cv_;
-  class api::FlowControlToken token_;
 };
 
 }  // namespace api
@@ -0,0 +1,189 @@
+#include "utilities/bandwidth_limiter.h"
+
+#include <algorithm>
+#include <ctime>
+#include <regex>
+#include <stdexcept>
+
+#include <boost/algorithm/string.hpp>
+
+#include "utilities/flow_control.h"
+
+namespace api {
+
+constexpr uint64_t BandwidthLimiter::kMinBytesPerSec;
+constexpr std::chrono::milliseconds BandwidthLimiter::kBurst;
+
+// How often the time of day is checked, and how often a waiting transfer
+// checks whether it has been aborted
+static constexpr std::chrono::seconds kRecheckInterval{10};
+static constexpr std::chrono::milliseconds kPollInterval{100};
+
+std::vector<BandwidthLimiter::Window> BandwidthLimiter::parseSchedule(const std::string& schedule) {
+  std::vector<Window> res;
+  if (boost::algorithm::trim_copy(schedule).empty()) {
+    return res;
+  }
+
+  static const std::regex window_re(R"(\s*(\d{1,2}):(\d{2})-(\d{1,2}):(\d{2})=(\d+)\s*)");
+  std::vector<std::string> windows;
+  boost::split(windows, schedule, boost::is_any_of(","));
+  for (const auto& window : windows) {
+    std::smatch match;
+    if (!std::regex_match(window, match, window_re)) {
+      throw std::invalid_argument("Invalid bandwidth schedule entry: \"" + window + "\"");
+    }
+    const auto begin_hour = std::stoul(match[1]);
+    const auto begin_minute = std::stoul(match[2]);
+    const auto end_hour = std::stoul(match[3]);
+    const auto end_minute = std::stoul(match[4]);
+    if (begin_hour * 60 + begin_minute > 24 * 60 || end_hour * 60 + end_minute > 24 * 60 || begin_minute > 59 ||
+        end_minute > 59) {
+      throw std::invalid_argument("Invalid time of day in bandwidth schedule entry: \"" + window + "\"");
+    }
+    Window w{};
+    w.begin = static_cast<unsigned int>((begin_hour * 60 + begin_minute) % (24 * 60));
+    w.end = static_cast<unsigned int>((end_hour * 60 + end_minute) % (24 * 60));
+    try {
+      w.bytes_per_sec = std::stoull(match[5]);
+    } catch (const std::out_of_range&) {
+      throw std::invalid_argument("Invalid limit in bandwidth schedule entry: \"" + window + "\"");
+    }
+    res.push_back(w);
+  }
+  return res;
+}
+
+BandwidthLimiter::BandwidthLimiter(uint64_t bytes_per_sec, uint64_t metered_bytes_per_sec,
+                                   std::vector<Window> schedule)
+    : bytes_per_sec_{normalize(bytes_per_sec)},
+      metered_bytes_per_sec_{normalize(metered_bytes_per_sec)},
+      schedule_{std::move(schedule)} {}
+
+uint64_t BandwidthLimiter::normalize(uint64_t bytes_per_sec) {
+  return bytes_per_sec == 0 ? 0 : std::max(bytes_per_sec, kMinBytesPerSec);
+}
+
+unsigned int BandwidthLimiter::localMinuteOfDay() {
+  const std::time_t now = std::time(nullptr);
+  struct tm local {};
+  if (localtime_r(&now, &local) == nullptr) {
+    return 0;
+  }
+  return static_cast<unsigned int>(local.tm_hour * 60 + local.tm_min);
+}
+
+uint64_t BandwidthLimiter::profileLimit(unsigned int minute_of_day, bool metered) const {
+  uint64_t limit = bytes_per_sec_;
+  // The first matching window wins
+  for (const auto& w : schedule_) {
+    const bool inside = w.begin < w.end ? (minute_of_day >= w.begin && minute_of_day < w.end)
+                                        : (minute_of_day >= w.begin || minute_of_day < w.end);
+    if (inside) {
+      limit = normalize(w.bytes_per_sec);
+      break;
+    }
+  }
+  if (metered && metered_bytes_per_sec_ != 0) {
+    limit = limit == 0 ? metered_bytes_per_sec_ : std::min(limit, metered_bytes_per_sec_);
+  }
+  return limit;
+}
+
+void BandwidthLimiter::refill(Clock::time_point now) {
+  const double capacity = static_cast<double>(limit_) * std::chrono::duration<double>(kBurst).count();
+  const double elapsed = std::chrono::duration<double>(now - refilled_).count();
+  tokens_ = std::min(capacity, tokens_ + static_cast<double>(limit_) * elapsed);
+  refilled_ = now;
+}
+
+void BandwidthLimiter::updateLimit(Clock::time_point now) {
+  if (!limit_stale_ && now - limit_checked_ < kRecheckInterval) {
+    return;
+  }
+  limit_stale_ = false;
+  limit_checked_ = now;
+
+  const uint64_t limit = has_override_ ? override_ : profileLimit(localMinuteOfDay(), metered_);
+  if (limit == limit_) {
+    return;
+  }
+  if (limit_ == 0) {
+    // Start with a full bucket, as after a long idle time
+    limit_ = limit;
+    tokens_ = static_cast<double>(limit_) * std::chrono::duration<double>(kBurst).count();
+    refilled_ = now;
+  } else {
+    // Whatever has accumulated so far at the old rate, capped to the new burst
+    refill(now);
+    limit_ = limit;
+    refill(now);
+  }
+}
+
+bool BandwidthLimiter::consume(uint64_t bytes, const FlowControlToken* token) {
+  std::unique_lock<std::mutex> lock(m_);
+  auto now = Clock::now();
+  updateLimit(now);
+  if (limit_ == 0) {
+    return true;
+  }
+  refill(now);
+  tokens_ -= static_cast<double>(bytes);
+
+  // Concurrent transfers all wait for the shared debt to be paid back, which
+  // keeps their total within the limit.
+  while (tokens_ < 0) {
+    if (token != nullptr && token->hasAborted()) {
+      return false;
+    }
+    const auto debt = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(-tokens_ / static_cast<double>(limit_)));
+    cv_.wait_for(lock, std::min<Clock::duration>(debt, kPollInterval));
+
+    now = Clock::now();
+    updateLimit(now);
+    if (limit_ == 0) {
+      tokens_ = 0;
+      return true;
+    }
+    refill(now);
+  }
+  return true;
+}
+
+void BandwidthLimiter::setOverride(uint64_t bytes_per_sec) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    has_override_ = true;
+    override_ = normalize(bytes_per_sec);
+    limit_stale_ = true;
+  }
+  cv_.notify_all();
+}
+
+void BandwidthLimiter::clearOverride() {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    has_override_ = false;
+    limit_stale_ = true;
+  }
+  cv_.notify_all();
+}
+
+void BandwidthLimiter::setMetered(bool metered) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    metered_ = metered;
+    limit_stale_ = true;
+  }
+  cv_.notify_all();
+}
+
+uint64_t BandwidthLimiter::currentLimit() {
+  std::lock_guard<std::mutex> lock(m_);
+  updateLimit(Clock::now());
+  return limit_;
+}
+
+}  // namespace api
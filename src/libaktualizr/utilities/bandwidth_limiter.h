@@ -0,0 +1,97 @@
+#ifndef AKTUALIZR_BANDWIDTH_LIMITER_H
+#define AKTUALIZR_BANDWIDTH_LIMITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace api {
+
+class FlowControlToken;
+
+///
+/// Token bucket shared by all the transfers that should not use more than a
+/// given bandwidth together. The limit depends on the time of day and on
+/// whether the network is metered, and can be overridden at runtime.
+///
+class BandwidthLimiter {
+ public:
+  /// Limit applied between two times of day, in minutes since midnight (local
+  /// time). A window may wrap around midnight.
+  struct Window {
+    unsigned int begin;
+    unsigned int end;
+    uint64_t bytes_per_sec;  // 0 for no limit
+  };
+
+  ///
+  /// Parse a schedule such as "08:00-18:00=65536,22:00-06:00=0".
+  /// @throw std::invalid_argument if the schedule is malformed
+  ///
+  static std::vector<Window> parseSchedule(const std::string& schedule);
+
+  /// Lower limits are raised to this, so that a few transfers sharing the
+  /// limit are not aborted by the low speed check of HttpClient.
+  static constexpr uint64_t kMinBytesPerSec{32768U};
+  /// How long a transfer may go at full speed after having been idle.
+  static constexpr std::chrono::milliseconds kBurst{1000};
+
+  ///
+  /// @param bytes_per_sec default limit, 0 for no limit
+  /// @param metered_bytes_per_sec limit while the network is metered, 0 for
+  /// the same as otherwise
+  /// @param schedule limits replacing the default one at given times of day
+  ///
+  explicit BandwidthLimiter(uint64_t bytes_per_sec, uint64_t metered_bytes_per_sec = 0,
+                            std::vector<Window> schedule = {});
+
+  ///
+  /// Called by the transferring thread for the data it has transferred or is
+  /// about to transfer. Sleeps as long as the limit requires.
+  /// @return `false` if the token was aborted while waiting, `true` otherwise
+  ///
+  bool consume(uint64_t bytes, const FlowControlToken* token = nullptr);
+
+  /// Replace the limits from the profiles, e.g. while other traffic uses the
+  /// link. 0 means no limit.
+  void setOverride(uint64_t bytes_per_sec);
+  /// Go back to the limits from the profiles.
+  void clearOverride();
+  void setMetered(bool metered);
+
+  /// The limit now in effect, 0 for no limit.
+  uint64_t currentLimit();
+  /// The limit from the profiles at a given time of day, ignoring overrides.
+  uint64_t profileLimit(unsigned int minute_of_day, bool metered) const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  static uint64_t normalize(uint64_t bytes_per_sec);
+  static unsigned int localMinuteOfDay();
+  void updateLimit(Clock::time_point now);
+  void refill(Clock::time_point now);
+
+  const uint64_t bytes_per_sec_;
+  const uint64_t metered_bytes_per_sec_;
+  const std::vector<Window> schedule_;
+
+  std::mutex m_;
+  std::condition_variable cv_;
+  bool metered_{false};
+  bool has_override_{false};
+  uint64_t override_{0};
+  uint64_t limit_{0};
+  // The time of day is only looked at now and then
+  bool limit_stale_{true};
+  Clock::time_point limit_checked_{};
+  // May be negative, while transfers wait for the debt to be paid back
+  double tokens_{0};
+  Clock::time_point refilled_{};
+};
+
+}  // namespace api
+#endif  // AKTUALIZR_BANDWIDTH_LIMITER_H
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <stdexcept>
+
+#include "utilities/bandwidth_limiter.h"
+#include "utilities/flow_control.h"
+
+using std::chrono::milliseconds;
+using Clock = std::chrono::steady_clock;
+
+static const uint64_t kRate = 4 * api::BandwidthLimiter::kMinBytesPerSec;
+
+TEST(BandwidthLimiter, ParseSchedule) {
+  EXPECT_TRUE(api::BandwidthLimiter::parseSchedule("").empty());
+  EXPECT_TRUE(api::BandwidthLimiter::parseSchedule("  ").empty());
+
+  const auto schedule = api::BandwidthLimiter::parseSchedule("08:00-18:30=65536, 22:00-6:00=0");
+  ASSERT_EQ(schedule.size(), 2U);
+  EXPECT_EQ(schedule[0].begin, 8U * 60);
+  EXPECT_EQ(schedule[0].end, 18U * 60 + 30);
+  EXPECT_EQ(schedule[0].bytes_per_sec, 65536U);
+  EXPECT_EQ(schedule[1].begin, 22U * 60);
+  EXPECT_EQ(schedule[1].end, 6U * 60);
+  EXPECT_EQ(schedule[1].bytes_per_sec, 0U);
+  EXPECT_EQ(api::BandwidthLimiter::parseSchedule("18:00-24:00=1")[0].end, 0U);
+
+  EXPECT_THROW(api::BandwidthLimiter::parseSchedule("08:00-18:00"), std::invalid_argument);
+  EXPECT_THROW(api::BandwidthLimiter::parseSchedule("08:00-18:00=1,"), std::invalid_argument);
+  EXPECT_THROW(api::BandwidthLimiter::parseSchedule("08:60-18:00=1"), std::invalid_argument);
+  EXPECT_THROW(api::BandwidthLimiter::parseSchedule("25:00-18:00=1"), std::invalid_argument);
+  EXPECT_THROW(api::BandwidthLimiter::parseSchedule("08:00-18:00=99999999999999999999999"),
+               std::invalid_argument);
+}
+
+/* The first matching window replaces the default limit, and a metered network
+ * lowers whatever limit applies. */
+TEST(BandwidthLimiter, Profiles) {
+  api::BandwidthLimiter limiter(kRate, 2 * api::BandwidthLimiter::kMinBytesPerSec,
+                                api::BandwidthLimiter::parseSchedule("08:00-18:00=1000000,22:00-06:00=0"));
+  EXPECT_EQ(limiter.profileLimit(7 * 60, false), kRate);
+  EXPECT_EQ(limiter.profileLimit(8 * 60, false), 1000000U);
+  EXPECT_EQ(limiter.profileLimit(18 * 60, false), kRate);
+  EXPECT_EQ(limiter.profileLimit(23 * 60, false), 0U);
+  EXPECT_EQ(limiter.profileLimit(5 * 60, false), 0U);
+
+  EXPECT_EQ(limiter.profileLimit(7 * 60, true), 2 * api::BandwidthLimiter::kMinBytesPerSec);
+  EXPECT_EQ(limiter.profileLimit(23 * 60, true), 2 * api::BandwidthLimiter::kMinBytesPerSec);
+
+  // Too low limits are raised
+  api::BandwidthLimiter low(1, 0, api::BandwidthLimiter::parseSchedule("00:00-12:00=2"));
+  EXPECT_EQ(low.profileLimit(13 * 60, true), api::BandwidthLimiter::kMinBytesPerSec);
+  EXPECT_EQ(low.profileLimit(11 * 60, false), api::BandwidthLimiter::kMinBytesPerSec);
+}
+
+/* After a burst, transfers sharing the limiter together go no faster than the
+ * limit. */
+TEST(BandwidthLimiter, Limit) {
+  api::BandwidthLimiter limiter(kRate);
+  EXPECT_EQ(limiter.currentLimit(), kRate);
+
+  auto start = Clock::now();
+  EXPECT_TRUE(limiter.consume(kRate));
+  EXPECT_LT(Clock::now() - start, milliseconds(500));
+
+  start = Clock::now();
+  auto other = std::async(std::launch::async, [&limiter]() { return limiter.consume(kRate / 4); });
+  EXPECT_TRUE(limiter.consume(kRate / 4));
+  EXPECT_TRUE(other.get());
+  EXPECT_GE(Clock::now() - start, milliseconds(400));
+}
+
+/* Lifting the limit at runtime releases the waiting transfers, and a waiting
+ * transfer stops when aborted. */
+TEST(BandwidthLimiter, OverrideAndAbort) {
+  auto limiter = std::make_shared<api::BandwidthLimiter>(0);
+  EXPECT_EQ(limiter->currentLimit(), 0U);
+  limiter->setOverride(kRate);
+  EXPECT_EQ(limiter->currentLimit(), kRate);
+  limiter->setMetered(true);
+  EXPECT_EQ(limiter->currentLimit(), kRate);
+
+  api::FlowControlToken token;
+  token.setBandwidthLimiter(limiter);
+  auto waiting = std::async(std::launch::async, [&token]() { return token.consume(100 * kRate); });
+  EXPECT_EQ(waiting.wait_for(milliseconds(200)), std::future_status::timeout);
+  limiter->setOverride(0);
+  ASSERT_EQ(waiting.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  EXPECT_TRUE(waiting.get());
+
+  limiter->clearOverride();
+  EXPECT_EQ(limiter->currentLimit(), 0U);
+  limiter->setOverride(kRate);
+  waiting = std::async(std::launch::async, [&token]() { return token.consume(100 * kRate); });
+  EXPECT_EQ(waiting.wait_for(milliseconds(200)), std::future_status::timeout);
+  token.setAbort();
+  ASSERT_EQ(waiting.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  EXPECT_FALSE(waiting.get());
+}
+
+/* Without a limiter, tokens do not wait. */
+TEST(BandwidthLimiter, NoLimiter) {
+  api::FlowControlToken token;
+  EXPECT_TRUE(token.consume(1000000000));
+  token.setAbort();
+  EXPECT_FALSE(token.consume(1));
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
@@ -2,6 +2,8 @@
 
 #include <cassert>
 
+#include "utilities/bandwidth_limiter.h"
+
 namespace api {
 
 bool FlowControlToken::IsValid() const { return sentinel_ == SENTINEL; }
@@ -56,4 +58,24 @@ void FlowControlToken::reset() {
   std::lock_guard<std::mutex> g(m_);
   state_ = State::kRunning;
 }
+
+void FlowControlToken::setBandwidthLimiter(std::shared_ptr<BandwidthLimiter> limiter) {
+  assert(IsValid());
+
+  std::lock_guard<std::mutex> g(m_);
+  limiter_ = std::move(limiter);
+}
+
+bool FlowControlToken::consume(uint64_t bytes) const {
+  assert(IsValid());
+  std::shared_ptr<BandwidthLimiter> limiter;
+  {
+    std::lock_guard<std::mutex> g(m_);
+    limiter = limiter_;
+  }
+  if (limiter == nullptr) {
+    return !hasAborted();
+  }
+  return limiter->consume(bytes, this);
+}
 }  // namespace api
\ No newline at end of file
@@ -2,10 +2,14 @@
 #define AKTUALIZR_FLOW_CONTROL_H
 
 #include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 
 namespace api {
 
+class BandwidthLimiter;
+
 ///
 /// Provides a thread-safe way to pause and terminate task execution.
 /// A task must call canContinue() method to check the current state.
@@ -55,6 +59,19 @@ class FlowControlToken {
   ////
   void reset();
 
+  ///
+  /// Called by the controlling thread to share a bandwidth limit between the
+  /// tasks of several tokens. Without a limiter, consume() never waits.
+  ///
+  void setBandwidthLimiter(std::shared_ptr<BandwidthLimiter> limiter);
+
+  ///
+  /// Called by the controlled thread for the data it transfers over the
+  /// network. Sleeps as long as the bandwidth limit requires.
+  /// @return `false` if the task was aborted while waiting, `true` otherwise.
+  ///
+  bool consume(uint64_t bytes) const;
+
  private:
   static const uint32_t SENTINEL = 0xced53470;
   const uint32_t sentinel_{SENTINEL};
@@ -65,6 +82,7 @@ class FlowControlToken {
   } state_{State::kRunning};
   mutable std::mutex m_;
   mutable std::condition_variable cv_;
+  std::shared_ptr<BandwidthLimiter> limiter_;
 };
 
 }  // namespace api
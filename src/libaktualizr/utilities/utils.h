@@ -120,7 +120,7 @@ class Socket {
   std::string ToString() const;
 
  protected:
-  void bind(in_port_t port, bool reuse = true) const;
+  void bind(in_port_t port, bool reuse = true, const std::string &address = "") const;
 
   int socket_fd_;
 };
@@ -142,7 +142,8 @@ class ConnectionSocket : public Socket {
 
 class ListenSocket : public Socket {
  public:
-  explicit ListenSocket(in_port_t port);
+  // Listens on all interfaces if the (IPv4) address is empty
+  explicit ListenSocket(in_port_t port, const std::string &address = "");
   in_port_t port() const { return _port; }
 
  private:
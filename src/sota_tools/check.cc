@@ -24,7 +24,7 @@ static size_t writeString(void *contents, size_t size, size_t nmemb, void *userp
 }
 
 int CheckRefValid(TreehubServer &treehub, const std::string &ref, RunMode mode, int max_curl_requests,
-                  const boost::filesystem::path &tree_dir) {
+                  const boost::filesystem::path &tree_dir, const bool deep) {
   // Check if the ref is present on treehub. The traditional use case is that it
   // should be a commit object, but we allow walking the tree given any OSTree
   // ref.
@@ -63,12 +63,22 @@ int CheckRefValid(TreehubServer &treehub, const std::string &ref, RunMode mode,
   }
 
   if (mode == RunMode::kWalkTree) {
-    // Walk the entire tree and check for all objects.
+    // Walk the entire tree and check for all objects, with the same
+    // concurrent requests and rate control as garage-push. Objects with
+    // children are downloaded to be parsed, file objects only with `deep`.
     OSTreeHttpRepo dest_repo(&treehub, tree_dir);
+    if (deep && !dest_repo.LooksValid()) {
+      // The configuration is needed to verify objects
+      LOG_FATAL << "Could not get a valid OSTree repository configuration from treehub";
+      return EXIT_FAILURE;
+    }
     OSTreeHash hash = OSTreeHash::Parse(ref);
     OSTreeObject::ptr input_object = dest_repo.GetObject(hash, type);
+    // Only from here: finding an object of unknown type relies on fetching it
+    dest_repo.set_fetch_files(deep);
 
     RequestPool request_pool(treehub, max_curl_requests, mode, false);
+    request_pool.set_verify_present(deep);
 
     // Add input object to the queue.
     request_pool.AddQuery(input_object);
@@ -81,11 +91,17 @@ int CheckRefValid(TreehubServer &treehub, const std::string &ref, RunMode mode,
       request_pool.Loop();
     } while (!request_pool.is_idle() && !request_pool.is_stopped());
 
-    if (input_object->is_on_server() == PresenceOnServer::kObjectPresent) {
-      LOG_INFO << "Dry run. No objects uploaded.";
-    } else {
-      LOG_ERROR << "One or more errors while pushing";
+    if (request_pool.is_stopped() || input_object->is_on_server() != PresenceOnServer::kObjectPresent) {
+      LOG_FATAL << "One or more errors while checking the tree of " << ref;
+      return EXIT_FAILURE;
+    }
+    if (request_pool.missing_objects() > 0) {
+      LOG_FATAL << request_pool.missing_objects() << " objects of the tree of " << ref << " are missing in treehub";
+      return EXIT_FAILURE;
     }
+    LOG_INFO << "All objects of the tree of " << ref << " are " << (deep ? "valid" : "present") << " in treehub, after "
+             << request_pool.head_requests_made() << " HEAD requests and " << request_pool.batch_requests_made()
+             << " batched presence checks";
   }
 
   // If we have a commit object, check if the ref is present in targets.json.
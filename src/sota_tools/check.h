@@ -10,8 +10,13 @@
 
 /**
  * Check if the ref is present on the server and in targets.json
+ * \param mode With RunMode::kWalkTree, also check that every object of the
+ *             tree is present on the server, with up to max_curl_requests
+ *             requests at once
+ * \param deep When walking the tree, download every object and verify its
+ *             checksum instead of only checking the presence of file objects
  */
 int CheckRefValid(TreehubServer& treehub, const std::string& ref, RunMode mode, int max_curl_requests,
-                  const boost::filesystem::path& tree_dir = "");
+                  const boost::filesystem::path& tree_dir = "", bool deep = false);
 
 #endif
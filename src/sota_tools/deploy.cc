@@ -24,7 +24,8 @@ bool CheckPoolState(const OSTreeObject::ptr &root_object, const RequestPool &req
 }
 
 bool UploadToTreehub(const OSTreeRepo::ptr &src_repo, TreehubServer &push_server, const OSTreeHash &ostree_commit,
-                     const RunMode mode, const int max_curl_requests, const bool fsck_on_upload) {
+                     const RunMode mode, const int max_curl_requests, const bool fsck_on_upload,
+                     PresenceCache *presence_cache, PushJournal *journal, const bool pack_uploads) {
   assert(max_curl_requests > 0);
 
   OSTreeObject::ptr root_object;
@@ -35,7 +36,19 @@ bool UploadToTreehub(const OSTreeRepo::ptr &src_repo, TreehubServer &push_server
     return false;
   }
 
-  RequestPool request_pool(push_server, max_curl_requests, mode, fsck_on_upload);
+  if (presence_cache != nullptr && mode != RunMode::kDefault) {
+    // Walking the tree is precisely about not trusting what is on the server,
+    // and a dry run does not upload anything that could be recorded.
+    LOG_INFO << "Not using the object cache in this mode";
+    presence_cache = nullptr;
+  }
+  if (journal != nullptr && mode != RunMode::kDefault) {
+    LOG_INFO << "Not using the push journal in this mode";
+    journal = nullptr;
+  }
+
+  RequestPool request_pool(push_server, max_curl_requests, mode, fsck_on_upload, presence_cache, journal,
+                           pack_uploads);
 
   // Add commit object to the queue.
   request_pool.AddQuery(root_object);
@@ -48,10 +61,30 @@ bool UploadToTreehub(const OSTreeRepo::ptr &src_repo, TreehubServer &push_server
     request_pool.Loop();
   } while (CheckPoolState(root_object, request_pool));
 
+  if (presence_cache != nullptr) {
+    LOG_INFO << request_pool.cache_hits() << " objects were found in the object cache.";
+    try {
+      // Also after a failure: what has been uploaded will not need to be checked next time
+      presence_cache->Save();
+    } catch (const std::exception &ex) {
+      LOG_WARNING << "Could not save the object cache: " << ex.what();
+    }
+  }
+  if (journal != nullptr) {
+    LOG_INFO << request_pool.journal_hits() << " objects were found in the push journal.";
+    if (root_object->is_on_server() == PresenceOnServer::kObjectPresent) {
+      journal->Complete();
+    } else {
+      LOG_INFO << "Run the same push again to resume it from " << journal->path();
+    }
+  }
+
   if (root_object->is_on_server() == PresenceOnServer::kObjectPresent) {
     if (mode == RunMode::kDefault || mode == RunMode::kPushTree) {
-      LOG_INFO << "Upload to Treehub complete after " << request_pool.head_requests_made() << " HEAD requests and "
-               << request_pool.put_requests_made() << " PUT requests.";
+      LOG_INFO << "Upload to Treehub complete after " << request_pool.head_requests_made() << " HEAD requests, "
+               << request_pool.batch_requests_made() << " batched presence checks, "
+               << request_pool.put_requests_made() << " PUT requests and " << request_pool.pack_requests_made()
+               << " pack uploads.";
       LOG_INFO << "Total size of uploaded objects: " << request_pool.total_object_size() << " bytes.";
     } else {
       LOG_INFO << "Dry run. No objects uploaded.";
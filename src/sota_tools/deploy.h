@@ -6,6 +6,8 @@
 #include "garage_common.h"
 #include "ostree_ref.h"
 #include "ostree_repo.h"
+#include "presence_cache.h"
+#include "push_journal.h"
 #include "server_credentials.h"
 
 /*
@@ -26,9 +28,18 @@ bool CheckPoolState(const OSTreeObject::ptr& root_object, const RequestPool& req
  * \param mode
  * \param max_curl_requests
  * \param fsck_on_upload Validate objects on disk before uploading them
+ * \param presence_cache Objects known to be on push_server, only used in
+ *                       RunMode::kDefault. Saved before returning.
+ * \param journal Progress of this push, replayed from an interrupted run of
+ *                it, only used in RunMode::kDefault. Removed once the push
+ *                has succeeded.
+ * \param pack_uploads Upload small objects in packs if the server supports
+ *                     it, see RequestPool::kPackUploadPath
  */
 bool UploadToTreehub(const OSTreeRepo::ptr& src_repo, TreehubServer& push_server, const OSTreeHash& ostree_commit,
-                     RunMode mode, int max_curl_requests, bool fsck_on_upload);
+                     RunMode mode, int max_curl_requests, bool fsck_on_upload,
+                     PresenceCache* presence_cache = nullptr, PushJournal* journal = nullptr,
+                     bool pack_uploads = false);
 
 /**
  * Use the garage-sign tool and the Image repo targets.json keys in credentials.zip
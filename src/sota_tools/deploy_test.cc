@@ -9,6 +9,8 @@
 #include "ostree_dir_repo.h"
 #include "ostree_http_repo.h"
 #include "ostree_ref.h"
+#include "presence_cache.h"
+#include "push_journal.h"
 #include "test_utils.h"
 
 std::string port = "2443";
@@ -44,6 +46,122 @@ TEST(deploy, UploadToTreehub) {
   EXPECT_EQ(result, 0) << "Diff between the source repo refs and the destination repos refs is nonzero.";
 }
 
+/* Record the objects found on or uploaded to the server, and use that record
+ * on the next push. */
+TEST(deploy, UploadToTreehubWithCache) {
+  OSTreeRepo::ptr src_repo = std::make_shared<OSTreeDirRepo>("tests/sota_tools/cmeta-repo");
+  boost::filesystem::path filepath = (temp_dir.Path() / "auth.json").string();
+  boost::filesystem::path cert_path = "tests/fake_http_server/server.crt";
+  auto server_creds = ServerCredentials(filepath);
+  TemporaryDirectory cache_dir;
+
+  const auto hash = OSTreeHash::Parse("2dc5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380");
+  const std::string commit_object = "objects/2d/c5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380.commit";
+  TreehubServer push_server;
+  EXPECT_EQ(authenticate(cert_path.string(), server_creds, push_server), EXIT_SUCCESS);
+  {
+    PresenceCache cache(cache_dir.Path(), push_server.root_url());
+    EXPECT_TRUE(UploadToTreehub(src_repo, push_server, hash, RunMode::kDefault, 2, true, &cache));
+  }
+
+  PresenceCache cache(cache_dir.Path(), push_server.root_url());
+  EXPECT_TRUE(cache.IsPresent(commit_object));
+  EXPECT_TRUE(UploadToTreehub(src_repo, push_server, hash, RunMode::kDefault, 2, true, &cache));
+}
+
+/* A push resumed from a journal does not check again the objects recorded
+ * there, and removes the journal once it has completed. */
+TEST(deploy, UploadToTreehubWithJournal) {
+  OSTreeRepo::ptr src_repo = std::make_shared<OSTreeDirRepo>("tests/sota_tools/cmeta-repo");
+  boost::filesystem::path filepath = (temp_dir.Path() / "auth.json").string();
+  boost::filesystem::path cert_path = "tests/fake_http_server/server.crt";
+  auto server_creds = ServerCredentials(filepath);
+  TemporaryDirectory journal_dir;
+
+  const auto hash = OSTreeHash::Parse("2dc5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380");
+  const std::string commit_object = "objects/2d/c5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380.commit";
+  TreehubServer push_server;
+  EXPECT_EQ(authenticate(cert_path.string(), server_creds, push_server), EXIT_SUCCESS);
+  {
+    // As left by a push interrupted right after uploading the commit
+    PushJournal journal(journal_dir / "journal", push_server.root_url(), hash);
+    journal.RecordMissing(commit_object);
+    journal.RecordPresent(commit_object);
+  }
+
+  PushJournal journal(journal_dir / "journal", push_server.root_url(), hash);
+  EXPECT_EQ(journal.replayed(), 1U);
+  EXPECT_TRUE(UploadToTreehub(src_repo, push_server, hash, RunMode::kDefault, 2, true, nullptr, &journal));
+  EXPECT_FALSE(boost::filesystem::exists(journal_dir / "journal"));
+}
+
+/* Upload to a treehub_server.py started with the given option. */
+static void UploadToTreehubWithServerOption(const std::string& option) {
+  TemporaryDirectory dst_dir;
+  const std::string dst_port = TestUtils::getFreePort();
+  Json::Value auth;
+  auth["ostree"]["server"] = std::string("https://localhost:") + dst_port;
+  Utils::writeFile(dst_dir.Path() / "auth.json", auth);
+  boost::process::child server_process("tests/sota_tools/treehub_server.py", std::string("-p"), dst_port,
+                                       std::string("-d"), dst_dir.PathString(), std::string("--tls"), option);
+  TestUtils::waitForServer("https://localhost:" + dst_port + "/");
+
+  OSTreeRepo::ptr src_repo = std::make_shared<OSTreeDirRepo>("tests/sota_tools/cmeta-repo");
+  boost::filesystem::path cert_path = "tests/fake_http_server/server.crt";
+  TreehubServer push_server;
+  EXPECT_EQ(authenticate(cert_path.string(), ServerCredentials(dst_dir.Path() / "auth.json"), push_server),
+            EXIT_SUCCESS);
+  const auto hash = OSTreeHash::Parse("2dc5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380");
+  EXPECT_TRUE(UploadToTreehub(src_repo, push_server, hash, RunMode::kDefault, 2, true));
+
+  int result = system(
+      (std::string("diff -rw ") + (dst_dir.Path() / "objects/").string() + " tests/sota_tools/cmeta-repo/objects/")
+          .c_str());
+  EXPECT_EQ(result, 0) << "Diff between the source repo objects and the destination repo objects is nonzero.";
+}
+
+/* Fall back to one presence check per object if the server does not support
+ * batched presence checks. */
+TEST(deploy, UploadToTreehubWithoutBatching) { UploadToTreehubWithServerOption("--no-batch"); }
+
+/* Objects left out of the answer to a batched presence check are checked on
+ * their own, rather than taken as present. */
+TEST(deploy, UploadToTreehubWithPartialBatching) { UploadToTreehubWithServerOption("--partial-batch"); }
+
+/* Upload small objects in packs, or one by one if the server does not support
+ * pack uploads. */
+class DeployPacks : public ::testing::TestWithParam<bool> {};
+
+TEST_P(DeployPacks, UploadToTreehubWithPacks) {
+  const bool server_supports_packs = GetParam();
+  TemporaryDirectory dst_dir;
+  const std::string dst_port = TestUtils::getFreePort();
+  Json::Value auth;
+  auth["ostree"]["server"] = std::string("https://localhost:") + dst_port;
+  Utils::writeFile(dst_dir.Path() / "auth.json", auth);
+  std::vector<std::string> server_args{"-p", dst_port, "-d", dst_dir.PathString(), "--tls"};
+  if (!server_supports_packs) {
+    server_args.emplace_back("--no-pack");
+  }
+  boost::process::child server_process("tests/sota_tools/treehub_server.py", boost::process::args(server_args));
+  TestUtils::waitForServer("https://localhost:" + dst_port + "/");
+
+  OSTreeRepo::ptr src_repo = std::make_shared<OSTreeDirRepo>("tests/sota_tools/cmeta-repo");
+  boost::filesystem::path cert_path = "tests/fake_http_server/server.crt";
+  TreehubServer push_server;
+  EXPECT_EQ(authenticate(cert_path.string(), ServerCredentials(dst_dir.Path() / "auth.json"), push_server),
+            EXIT_SUCCESS);
+  const auto hash = OSTreeHash::Parse("2dc5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380");
+  EXPECT_TRUE(UploadToTreehub(src_repo, push_server, hash, RunMode::kDefault, 2, true, nullptr, nullptr, true));
+
+  int result = system(
+      (std::string("diff -rw ") + (dst_dir.Path() / "objects/").string() + " tests/sota_tools/cmeta-repo/objects/")
+          .c_str());
+  EXPECT_EQ(result, 0) << "Diff between the source repo objects and the destination repo objects is nonzero.";
+}
+
+INSTANTIATE_TEST_SUITE_P(deploy, DeployPacks, ::testing::Values(true, false));
+
 #ifndef __NO_MAIN__
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
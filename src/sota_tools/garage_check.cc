@@ -40,6 +40,7 @@ int main(int argc, char **argv) {
     ("cacert", po::value<std::string>(&cacerts), "override path to CA root certificates, in the same format as curl --cacert")
     ("jobs", po::value<int>(&max_curl_requests)->default_value(30), "maximum number of parallel requests (only relevant with --walk-tree)")
     ("walk-tree,w", "walk entire tree and check presence of all objects")
+    ("deep", "walk entire tree, download all objects and verify their checksums (implies --walk-tree)")
     ("tree-dir,t", po::value<boost::filesystem::path>(&tree_dir), "directory to which to write the tree (only used with --walk-tree)");
   // clang-format on
 
@@ -80,7 +81,7 @@ int main(int argc, char **argv) {
 
     Utils::setUserAgent(std::string("garage-check/") + garage_tools_version());
 
-    if (vm.count("walk-tree") != 0U) {
+    if (vm.count("walk-tree") != 0U || vm.count("deep") != 0U) {
       mode = RunMode::kWalkTree;
     }
 
@@ -95,7 +96,7 @@ int main(int argc, char **argv) {
       return EXIT_FAILURE;
     }
 
-    if (CheckRefValid(treehub, ref, mode, max_curl_requests, tree_dir) != EXIT_SUCCESS) {
+    if (CheckRefValid(treehub, ref, mode, max_curl_requests, tree_dir, vm.count("deep") != 0U) != EXIT_SUCCESS) {
       LOG_FATAL << "Check if the ref is present on the server or in targets.json failed";
       return EXIT_FAILURE;
     }
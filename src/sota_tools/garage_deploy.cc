@@ -114,9 +114,9 @@ int main(int argc, char **argv) {
   try {
     OSTreeHash commit(OSTreeHash::Parse(ostree_commit));
     bool fsck = vm.count("disable-integrity-checks") == 0;
-    // Since the fetches happen on a single thread in OSTreeHttpRepo, there
-    // isn't much reason to upload in parallel, but why hold the system back if
-    // the fetching is faster than the uploading?
+    // The children of each directory are fetched concurrently by
+    // OSTreeHttpRepo::PrefetchObjects() while the objects fetched earlier are
+    // being uploaded.
     if (!UploadToTreehub(src_repo, push_server, commit, mode, max_curl_requests, fsck)) {
       LOG_FATAL << "Upload to treehub failed";
       return EXIT_FAILURE;
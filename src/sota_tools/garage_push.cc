@@ -10,6 +10,8 @@
 #include "logging/logging.h"
 #include "ostree_dir_repo.h"
 #include "ostree_repo.h"
+#include "presence_cache.h"
+#include "push_journal.h"
 #include "utilities/xml2json.h"
 
 namespace po = boost::program_options;
@@ -22,6 +24,8 @@ int main(int argc, char **argv) {
   boost::filesystem::path credentials_path;
   std::string cacerts;
   boost::filesystem::path manifest_path;
+  boost::filesystem::path cache_dir;
+  boost::filesystem::path journal_path;
   int max_curl_requests;
   RunMode mode = RunMode::kDefault;
   po::options_description desc("garage-push command line options");
@@ -40,7 +44,11 @@ int main(int argc, char **argv) {
     ("jobs", po::value<int>(&max_curl_requests)->default_value(30), "maximum number of parallel requests")
     ("dry-run,n", "check arguments and authenticate but don't upload")
     ("walk-tree,w", "walk entire tree and upload all missing objects")
-    ("disable-integrity-checks", "Don't validate the checksums of objects before uploading them");
+    ("disable-integrity-checks", "Don't validate the checksums of objects before uploading them")
+    ("object-cache", po::value<boost::filesystem::path>(&cache_dir), "directory where to record the objects known to be on the server, so that they are not checked again on the next push")
+    ("revalidate-cache", "check all objects on the server even if they are in the object cache, and update the cache")
+    ("pack-uploads", "upload small objects together in compressed packs, if the server supports it")
+    ("journal", po::value<boost::filesystem::path>(&journal_path), "file where to record the progress of the push, so that an interrupted push of the same commit resumes where it stopped");
   // clang-format on
 
   po::variables_map vm;
@@ -137,7 +145,17 @@ int main(int argc, char **argv) {
       return EXIT_FAILURE;
     }
     bool fsck = vm.count("disable-integrity-checks") == 0;
-    if (!UploadToTreehub(src_repo, push_server, *commit, mode, max_curl_requests, fsck)) {
+    std::unique_ptr<PresenceCache> presence_cache;
+    if (!cache_dir.empty()) {
+      presence_cache =
+          std_::make_unique<PresenceCache>(cache_dir, push_server.root_url(), vm.count("revalidate-cache") != 0);
+    }
+    std::unique_ptr<PushJournal> journal;
+    if (!journal_path.empty()) {
+      journal = std_::make_unique<PushJournal>(journal_path, push_server.root_url(), *commit);
+    }
+    if (!UploadToTreehub(src_repo, push_server, *commit, mode, max_curl_requests, fsck, presence_cache.get(),
+                         journal.get(), vm.count("pack-uploads") != 0)) {
       LOG_FATAL << "Upload to treehub failed";
       return EXIT_FAILURE;
     }
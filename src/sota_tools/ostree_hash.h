@@ -3,6 +3,7 @@
 
 #include <array>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <utility>
@@ -22,8 +23,21 @@ class OSTreeHash {
   std::string string() const;
 
   bool operator<(const OSTreeHash& other) const;
+  bool operator==(const OSTreeHash& other) const { return hash_ == other.hash_; }
   friend std::ostream& operator<<(std::ostream& os, const OSTreeHash& obj);
 
+  /**
+   * Hash functor for unordered containers. The value is already a SHA256
+   * digest, so its first bytes are used as is.
+   */
+  struct Hasher {
+    size_t operator()(const OSTreeHash& h) const {
+      size_t v = 0;
+      memcpy(&v, h.hash_.data(), sizeof(v));
+      return v;
+    }
+  };
+
  private:
   std::array<uint8_t, 32> hash_{};
 };
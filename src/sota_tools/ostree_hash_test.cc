@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <unordered_set>
+
 #include "ostree_hash.h"
 
 using std::string;
@@ -35,6 +37,18 @@ TEST(ostree_hash, parse_junk) {
   EXPECT_THROW(OSTreeHash::Parse(str), OSTreeCommitParseError);
 }
 
+/* Hashes can be used as keys of unordered containers. */
+TEST(ostree_hash, unordered_set) {
+  std::unordered_set<OSTreeHash, OSTreeHash::Hasher> set;
+  set.insert(OSTreeHash::Parse("1f3378927c2d062e40a372414c920219e506afeb8ef25f9ff72a27b792cd093a"));
+  set.insert(OSTreeHash::Parse("1F3378927C2d062e40a372414c920219e506afeb8ef25f9ff72a27b792cd093a"));
+  // Same first bytes, different digest
+  set.insert(OSTreeHash::Parse("1f3378927c2d062e40a372414c920219e506afeb8ef25f9ff72a27b792cd093b"));
+  EXPECT_EQ(set.size(), 2);
+  EXPECT_EQ(set.count(OSTreeHash::Parse("1f3378927c2d062e40a372414c920219e506afeb8ef25f9ff72a27b792cd093b")), 1);
+  EXPECT_EQ(set.count(OSTreeHash::Parse("2f3378927c2d062e40a372414c920219e506afeb8ef25f9ff72a27b792cd093a")), 0);
+}
+
 #ifndef __NO_MAIN__
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,6 +1,10 @@
 #include "ostree_http_repo.h"
 
 #include <fcntl.h>
+#include <cassert>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
 
 #include <boost/filesystem.hpp>
@@ -34,13 +38,23 @@ bool OSTreeHttpRepo::LooksValid() const {
 OSTreeRef OSTreeHttpRepo::GetRef(const std::string &refname) const { return OSTreeRef(*server_, refname); }
 
 bool OSTreeHttpRepo::FetchObject(const boost::filesystem::path &path) const {
+  const boost::filesystem::path target = root_ / path;
+  // Objects are content-addressed and only get their final name once complete,
+  // so one that is already there (e.g. prefetched) can be used as is.
+  if (*path.begin() == "objects" && boost::filesystem::is_regular_file(target)) {
+    return true;
+  }
+  if (!fetch_files_ && path.extension() == ".filez") {
+    return true;
+  }
+
   CURLcode err = CURLE_OK;
   server_->InjectIntoCurl(path.string(), easy_handle_.get());
-  boost::filesystem::create_directories((root_ / path).parent_path());
-  std::string filename = (root_ / path).string();
-  int fp = open(filename.c_str(), O_WRONLY | O_CREAT, S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH);
+  boost::filesystem::create_directories(target.parent_path());
+  const boost::filesystem::path partial = PartialPath(target);
+  int fp = open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH);
   if (fp == -1) {
-    LOG_ERROR << "Failed to open file: " << filename;
+    LOG_ERROR << "Failed to open file: " << partial.string();
     return false;
   }
   curlEasySetoptWrapper(easy_handle_.get(), CURLOPT_WRITEDATA, &fp);
@@ -50,7 +64,7 @@ bool OSTreeHttpRepo::FetchObject(const boost::filesystem::path &path) const {
   if (err == CURLE_HTTP_RETURNED_ERROR) {
     // http error (error code >= 400)
     // verbose mode will display the details
-    remove((root_ / path).c_str());
+    remove(partial.c_str());
     return false;
   } else if (err != CURLE_OK) {
     // other unexpected error
@@ -60,13 +74,120 @@ bool OSTreeHttpRepo::FetchObject(const boost::filesystem::path &path) const {
     if (last_url != nullptr) {
       LOG_ERROR << "Url: " << last_url;
     }
-    remove((root_ / path).c_str());
+    remove(partial.c_str());
     return false;
   }
 
+  boost::filesystem::rename(partial, target);
   return true;
 }
 
+void OSTreeHttpRepo::PrefetchObjects(const std::vector<ObjectRef> &objects) const {
+  std::set<boost::filesystem::path> paths;
+  for (const auto &object : objects) {
+    boost::filesystem::path path("objects");
+    path /= GetPathForHash(object.first, object.second);
+    if (FetchesObjects(object.second) && !boost::filesystem::is_regular_file(root_ / path)) {
+      paths.insert(path);
+    }
+  }
+  if (paths.empty()) {
+    return;
+  }
+
+  // Each call has its own handles, so that it can run on any thread
+  std::unique_ptr<CURLM, decltype(&curl_multi_cleanup)> multi(curl_multi_init(), &curl_multi_cleanup);
+  if (multi == nullptr) {
+    throw std::runtime_error("Could not initialize curl multi handle");
+  }
+  struct Fetch {
+    explicit Fetch(CURLM *multi_in) : multi(multi_in) {}
+    ~Fetch() {
+      curl_multi_remove_handle(multi, curl.get());
+      if (fd != -1) {
+        close(fd);
+        remove(partial.c_str());
+      }
+    }
+    Fetch(const Fetch &) = delete;
+    Fetch(Fetch &&) = delete;
+    Fetch &operator=(const Fetch &) = delete;
+    Fetch &operator=(Fetch &&) = delete;
+
+    CURLM *multi;
+    CurlEasyWrapper curl;
+    boost::filesystem::path target;
+    boost::filesystem::path partial;
+    int fd{-1};
+  };
+  std::map<CURL *, std::unique_ptr<Fetch>> running;
+  auto next = paths.cbegin();
+
+  size_t fetched = 0;
+  for (;;) {
+    while (running.size() < kMaxConcurrentFetches && next != paths.cend()) {
+      auto fetch = std_::make_unique<Fetch>(multi.get());
+      fetch->target = root_ / *next;
+      fetch->partial = PartialPath(fetch->target);
+      boost::filesystem::create_directories(fetch->target.parent_path());
+      fetch->fd = open(fetch->partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH);
+      if (fetch->fd == -1) {
+        LOG_WARNING << "Failed to open file: " << fetch->partial.string();
+        ++next;
+        continue;
+      }
+      CURL *curl = fetch->curl.get();
+      curlEasySetoptWrapper(curl, CURLOPT_VERBOSE, get_curlopt_verbose());
+      curlEasySetoptWrapper(curl, CURLOPT_WRITEFUNCTION, &OSTreeHttpRepo::curl_handle_write);
+      curlEasySetoptWrapper(curl, CURLOPT_WRITEDATA, &fetch->fd);
+      curlEasySetoptWrapper(curl, CURLOPT_FAILONERROR, true);
+      server_->InjectIntoCurl(next->string(), curl);
+      curl_multi_add_handle(multi.get(), curl);
+      running.emplace(curl, std::move(fetch));
+      ++next;
+    }
+    if (running.empty()) {
+      break;
+    }
+
+    int still_running = 0;
+    curl_multi_perform(multi.get(), &still_running);
+    int msgs_in_queue = 0;
+    while (CURLMsg *msg = curl_multi_info_read(multi.get(), &msgs_in_queue)) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      auto it = running.find(msg->easy_handle);
+      assert(it != running.end());
+      Fetch &fetch = *it->second;
+      close(fetch.fd);
+      fetch.fd = -1;
+      if (msg->data.result == CURLE_OK) {
+        boost::system::error_code ec;
+        boost::filesystem::rename(fetch.partial, fetch.target, ec);
+        if (ec) {
+          remove(fetch.partial.c_str());
+        } else {
+          fetched++;
+        }
+      } else {
+        // GetObject() will try again, and report the error if it persists
+        LOG_DEBUG << "Prefetching " << fetch.target.string() << " failed: " << curl_easy_strerror(msg->data.result);
+        remove(fetch.partial.c_str());
+      }
+      running.erase(it);
+    }
+    if (still_running > 0) {
+      curl_multi_wait(multi.get(), nullptr, 0, 1000, nullptr);
+    }
+  }
+  LOG_DEBUG << "Prefetched " << fetched << " of " << paths.size() << " objects";
+}
+
+boost::filesystem::path OSTreeHttpRepo::PartialPath(const boost::filesystem::path &path) {
+  return boost::filesystem::unique_path(path.string() + ".%%%%%%%%.part");
+}
+
 size_t OSTreeHttpRepo::curl_handle_write(void *buffer, size_t size, size_t nmemb, void *userp) {
   return static_cast<size_t>(write(*static_cast<int *>(userp), buffer, nmemb * size));
 }
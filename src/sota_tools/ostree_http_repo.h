@@ -25,14 +25,32 @@ class OSTreeHttpRepo : public OSTreeRepo {
   OSTreeRef GetRef(const std::string& refname) const override;
   boost::filesystem::path root() const override { return root_; }
 
+  /** Fetches up to kMaxConcurrentFetches objects at a time. */
+  void PrefetchObjects(const std::vector<ObjectRef>& objects) const override;
+
+  /**
+   * Whether to fetch file objects. Without them, the tree can still be walked
+   * but the content of the files is left on the server, e.g. to only check
+   * its presence there.
+   */
+  void set_fetch_files(bool fetch_files) { fetch_files_ = fetch_files; }
+  bool FetchesObjects(OstreeObjectType type) const override {
+    return fetch_files_ || type != OstreeObjectType::OSTREE_OBJECT_TYPE_FILE;
+  }
+
+  static constexpr size_t kMaxConcurrentFetches = 16;
+
  private:
   bool FetchObject(const boost::filesystem::path& path) const override;
+  // Temporary name of a file being fetched, renamed to the final one when complete
+  static boost::filesystem::path PartialPath(const boost::filesystem::path& path);
   static size_t curl_handle_write(void* buffer, size_t size, size_t nmemb, void* userp);
 
   TreehubServer* server_;
   boost::filesystem::path root_;
   const TemporaryDirectory root_tmp_;
   mutable CurlEasyWrapper easy_handle_;
+  bool fetch_files_{true};
 };
 
 // vim: set tabstop=2 shiftwidth=2 expandtab:
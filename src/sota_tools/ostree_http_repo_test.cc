@@ -63,6 +63,59 @@ TEST(http_repo, GetWrongObject) {
   EXPECT_THROW(src_repo->GetObject(hash, OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META), OSTreeObjectMissing);
 }
 
+/* Fetch several objects ahead of time, ignoring the missing ones. */
+TEST(http_repo, PrefetchObjects) {
+  TreehubServer server;
+  server.root_url("http://localhost:" + port);
+  TemporaryDirectory tree_dir;
+  OSTreeRepo::ptr src_repo = std::make_shared<OSTreeHttpRepo>(&server, tree_dir.Path());
+  const uint8_t present[32] = {0x44, 0x6a, 0x0e, 0xf1, 0x1b, 0x7c, 0xc1, 0x67, 0xf3, 0xb6, 0x03,
+                               0xe5, 0x85, 0xc7, 0xee, 0xee, 0xb6, 0x75, 0xfa, 0xa4, 0x12, 0xd5,
+                               0xec, 0x73, 0xf6, 0x29, 0x88, 0xeb, 0x0b, 0x6c, 0x54, 0x88};
+  const uint8_t missing[32] = {0x00, 0x28, 0xda, 0xc4, 0x2b, 0x76, 0xc2, 0x01, 0x5e, 0xe3, 0xc4,
+                               0x1c, 0xc4, 0x18, 0x3b, 0xb8, 0xb5, 0xc7, 0x90, 0xfd, 0x21, 0xfa,
+                               0x5c, 0xfa, 0x08, 0x02, 0xc6, 0xe1, 0x1f, 0xd0, 0xed, 0xbe};
+  src_repo->PrefetchObjects({{OSTreeHash(present), OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META},
+                             {OSTreeHash(missing), OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META}});
+
+  const boost::filesystem::path objects = tree_dir.Path() / "objects";
+  EXPECT_TRUE(boost::filesystem::is_regular_file(
+      objects / OSTreeRepo::GetPathForHash(OSTreeHash(present), OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META)));
+  EXPECT_FALSE(boost::filesystem::exists(
+      objects / OSTreeRepo::GetPathForHash(OSTreeHash(missing), OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META)));
+  for (const auto &entry : boost::filesystem::recursive_directory_iterator(objects)) {
+    EXPECT_NE(entry.path().extension(), ".part");
+  }
+
+  // Prefetched objects are used without contacting the server again
+  server.root_url("http://wronghost");
+  EXPECT_NO_THROW(src_repo->GetObject(present, OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META));
+}
+
+/* Without fetching file objects, only the other objects are downloaded. */
+TEST(http_repo, NoFileObjects) {
+  TreehubServer server;
+  server.root_url("http://localhost:" + port);
+  TemporaryDirectory tree_dir;
+  auto src_repo = std::make_shared<OSTreeHttpRepo>(&server, tree_dir.Path());
+  src_repo->set_fetch_files(false);
+  const uint8_t file[32] = {0x00, 0x28, 0xda, 0xc4, 0x2b, 0x76, 0xc2, 0x01, 0x5e, 0xe3, 0xc4,
+                            0x1c, 0xc4, 0x18, 0x3b, 0xb8, 0xb5, 0xc7, 0x90, 0xfd, 0x21, 0xfa,
+                            0x5c, 0xfa, 0x08, 0x02, 0xc6, 0xe1, 0x1f, 0xd0, 0xed, 0xbe};
+  const uint8_t dirmeta[32] = {0x44, 0x6a, 0x0e, 0xf1, 0x1b, 0x7c, 0xc1, 0x67, 0xf3, 0xb6, 0x03,
+                               0xe5, 0x85, 0xc7, 0xee, 0xee, 0xb6, 0x75, 0xfa, 0xa4, 0x12, 0xd5,
+                               0xec, 0x73, 0xf6, 0x29, 0x88, 0xeb, 0x0b, 0x6c, 0x54, 0x88};
+  src_repo->PrefetchObjects({{OSTreeHash(file), OstreeObjectType::OSTREE_OBJECT_TYPE_FILE}});
+  EXPECT_FALSE(boost::filesystem::exists(tree_dir / "objects"));
+
+  EXPECT_NO_THROW(src_repo->GetObject(file, OstreeObjectType::OSTREE_OBJECT_TYPE_FILE));
+  EXPECT_FALSE(boost::filesystem::exists(tree_dir / "objects" / OSTreeRepo::GetPathForHash(
+                                                                    OSTreeHash(file), OSTREE_OBJECT_TYPE_FILE)));
+  src_repo->GetObject(dirmeta, OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META);
+  EXPECT_TRUE(boost::filesystem::is_regular_file(
+      tree_dir / "objects" / OSTreeRepo::GetPathForHash(OSTreeHash(dirmeta), OSTREE_OBJECT_TYPE_DIR_META)));
+}
+
 /* Retry fetch if not found after first try.
  *
  * This test uses servers that drop every other request. The test should pass
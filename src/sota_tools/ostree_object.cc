@@ -18,13 +18,13 @@ using std::string;
 OSTreeObject::OSTreeObject(const OSTreeRepo &repo, OSTreeHash hash, OstreeObjectType object_type)
     : hash_(hash),
       type_(object_type),
-      repo_(repo),
       refcount_(0),
-      is_on_server_(PresenceOnServer::kObjectStateUnknown),
+      repo_(repo),
       curl_handle_(nullptr),
-      fd_(nullptr) {
+      fd_(nullptr),
+      is_on_server_(PresenceOnServer::kObjectStateUnknown) {
   auto file_path = PathOnDisk();
-  if (!boost::filesystem::is_regular_file(file_path)) {
+  if (repo_.FetchesObjects(type_) && !boost::filesystem::is_regular_file(file_path)) {
     throw std::runtime_error(file_path.native() + " is not a valid OSTree object.");
   }
 }
@@ -36,30 +36,38 @@ OSTreeObject::~OSTreeObject() {
   }
 }
 
-void OSTreeObject::AddParent(OSTreeObject *parent, std::list<OSTreeObject::ptr>::iterator parent_it) {
-  parentref par;
-
-  par.first = parent;
-  par.second = parent_it;
-  parents_.push_back(par);
-}
+void OSTreeObject::AddParent(OSTreeObject *parent) { parents_.push_back(parent); }
 
-void OSTreeObject::ChildNotify(std::list<OSTreeObject::ptr>::iterator child_it) {
-  assert((*child_it)->is_on_server() == PresenceOnServer::kObjectPresent);
-  children_.erase(child_it);
+void OSTreeObject::ChildNotify() {
+  assert(pending_children_ > 0);
+  if (--pending_children_ == 0) {
+    // The children are owned by the repository's object table as well, and
+    // are not needed anymore now that they are all on the server.
+    std::vector<OSTreeObject::ptr>().swap(children_);
+  }
 }
 
 void OSTreeObject::NotifyParents(RequestPool &pool) {
   assert(is_on_server_ == PresenceOnServer::kObjectPresent);
 
-  for (parentref parent : parents_) {
-    parent.first->ChildNotify(parent.second);
-    if (parent.first->children_ready()) {
-      pool.AddUpload(parent.first);
+  // Nothing is appended to parents_ once this object is on the server (see
+  // AppendChild()), so the list can be released here.
+  std::vector<OSTreeObject *> parents;
+  parents.swap(parents_);
+  for (OSTreeObject *parent : parents) {
+    parent->ChildNotify();
+    if (parent->children_ready()) {
+      pool.AddUpload(parent);
     }
   }
 }
 
+void OSTreeObject::NotifyKnownPresent(RequestPool &pool) {
+  LOG_DEBUG << "Known to be present: " << *this;
+  is_on_server_ = PresenceOnServer::kObjectPresent;
+  NotifyParents(pool);
+}
+
 void OSTreeObject::AppendChild(const OSTreeObject::ptr &child) {
   // the child could be already queried/uploaded by another parent
   if (child->is_on_server() == PresenceOnServer::kObjectPresent) {
@@ -67,13 +75,17 @@ void OSTreeObject::AppendChild(const OSTreeObject::ptr &child) {
   }
 
   children_.push_back(child);
-  auto last = children_.end();
-  last--;
-  child->AddParent(this, last);
+  ++pending_children_;
+  child->AddParent(this);
 }
 
-// Can throw OSTreeObjectMissing if the repo is corrupt
-void OSTreeObject::PopulateChildren() {
+bool OSTreeObject::HasChildren() const {
+  return type_ == OSTREE_OBJECT_TYPE_COMMIT || type_ == OSTREE_OBJECT_TYPE_DIR_TREE;
+}
+
+// Only reads the object file, so that it can run on a worker thread
+std::vector<OSTreeObject::ChildRef> OSTreeObject::ReadChildren() const {
+  std::vector<ChildRef> children;
   const GVariantType *content_type;
   bool is_commit;
 
@@ -84,7 +96,7 @@ void OSTreeObject::PopulateChildren() {
     content_type = OSTREE_TREE_GVARIANT_FORMAT;
     is_commit = false;
   } else {
-    return;
+    return children;
   }
 
   GError *gerror = nullptr;
@@ -101,16 +113,6 @@ void OSTreeObject::PopulateChildren() {
   g_variant_ref_sink(contents);
 
   if (is_commit) {
-    // Detached commit metadata is optional; add it as child only when present.
-    try {
-      OSTreeObject::ptr cmeta_object;
-      cmeta_object = repo_.GetObject(hash_, OstreeObjectType::OSTREE_OBJECT_TYPE_COMMIT_META);
-      LOG_INFO << "Commitmeta object found for commit " << hash_;
-      AppendChild(cmeta_object);
-    } catch (const OSTreeObjectMissing &error) {
-      LOG_INFO << "No commitmeta object found for commit " << hash_;
-    }
-
     // * - ay - Root tree contents
     GVariant *content_csum_variant = nullptr;
     g_variant_get_child(contents, 6, "@ay", &content_csum_variant);
@@ -118,14 +120,14 @@ void OSTreeObject::PopulateChildren() {
     gsize n_elts;
     const auto *csum = static_cast<const uint8_t *>(g_variant_get_fixed_array(content_csum_variant, &n_elts, 1));
     assert(n_elts == 32);
-    AppendChild(repo_.GetObject(csum, OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_TREE));
+    children.emplace_back(OSTreeHash(csum), OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_TREE);
 
     // * - ay - Root tree metadata
     GVariant *meta_csum_variant = nullptr;
     g_variant_get_child(contents, 7, "@ay", &meta_csum_variant);
     csum = static_cast<const uint8_t *>(g_variant_get_fixed_array(meta_csum_variant, &n_elts, 1));
     assert(n_elts == 32);
-    AppendChild(repo_.GetObject(csum, OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META));
+    children.emplace_back(OSTreeHash(csum), OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META);
 
     g_variant_unref(meta_csum_variant);
     g_variant_unref(content_csum_variant);
@@ -148,7 +150,7 @@ void OSTreeObject::PopulateChildren() {
       gsize n_elts;
       const auto *csum = static_cast<const uint8_t *>(g_variant_get_fixed_array(csum_variant, &n_elts, 1));
       assert(n_elts == 32);
-      AppendChild(repo_.GetObject(csum, OstreeObjectType::OSTREE_OBJECT_TYPE_FILE));
+      children.emplace_back(OSTreeHash(csum), OstreeObjectType::OSTREE_OBJECT_TYPE_FILE);
 
       g_variant_unref(csum_variant);
     }
@@ -163,12 +165,12 @@ void OSTreeObject::PopulateChildren() {
       // First the .dirtree:
       const auto *csum = static_cast<const uint8_t *>(g_variant_get_fixed_array(content_csum_variant, &n_elts, 1));
       assert(n_elts == 32);
-      AppendChild(repo_.GetObject(csum, OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_TREE));
+      children.emplace_back(OSTreeHash(csum), OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_TREE);
 
       // Then the .dirmeta:
       csum = static_cast<const uint8_t *>(g_variant_get_fixed_array(meta_csum_variant, &n_elts, 1));
       assert(n_elts == 32);
-      AppendChild(repo_.GetObject(csum, OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META));
+      children.emplace_back(OSTreeHash(csum), OstreeObjectType::OSTREE_OBJECT_TYPE_DIR_META);
 
       g_variant_unref(meta_csum_variant);
       g_variant_unref(content_csum_variant);
@@ -178,6 +180,25 @@ void OSTreeObject::PopulateChildren() {
     g_variant_unref(files_variant);
   }
   g_variant_unref(contents);
+  return children;
+}
+
+// Can throw OSTreeObjectMissing if the repo is corrupt
+void OSTreeObject::PopulateChildren(const std::vector<ChildRef> &children) {
+  if (type_ == OSTREE_OBJECT_TYPE_COMMIT) {
+    // Detached commit metadata is optional; add it as child only when present.
+    try {
+      OSTreeObject::ptr cmeta_object;
+      cmeta_object = repo_.GetObject(hash_, OstreeObjectType::OSTREE_OBJECT_TYPE_COMMIT_META);
+      LOG_INFO << "Commitmeta object found for commit " << hash_;
+      AppendChild(cmeta_object);
+    } catch (const OSTreeObjectMissing &error) {
+      LOG_INFO << "No commitmeta object found for commit " << hash_;
+    }
+  }
+  for (const ChildRef &child : children) {
+    AppendChild(repo_.GetObject(child.first, child.second));
+  }
 }
 
 void OSTreeObject::QueryChildren(RequestPool &pool) {
@@ -203,6 +224,16 @@ boost::filesystem::path OSTreeObject::PathOnDisk() const {
 
 uintmax_t OSTreeObject::GetSize() const { return boost::filesystem::file_size(PathOnDisk()); }
 
+std::string OSTreeObject::ReadContent() const { return Utils::readFile(PathOnDisk()); }
+
+void OSTreeObject::PackUploaded(RequestPool &pool) {
+  LOG_TRACE << "OSTree upload successful in a pack";
+  current_operation_ = CurrentOp::kOstreeObjectUploading;
+  is_on_server_ = PresenceOnServer::kObjectPresent;
+  last_operation_result_ = ServerResponse::kOk;
+  NotifyParents(pool);
+}
+
 void OSTreeObject::MakeTestRequest(const TreehubServer &push_target, CURLM *curl_multi_handle) {
   assert(!curl_handle_);
   curl_handle_ = curl_easy_init();
@@ -219,7 +250,7 @@ void OSTreeObject::MakeTestRequest(const TreehubServer &push_target, CURLM *curl
   curlEasySetoptWrapper(curl_handle_, CURLOPT_WRITEFUNCTION, &OSTreeObject::curl_handle_write);
   curlEasySetoptWrapper(curl_handle_, CURLOPT_WRITEDATA, this);
   curlEasySetoptWrapper(curl_handle_, CURLOPT_PRIVATE, this);  // Used by ostree_object_from_curl
-  http_response_.str("");                                      // Empty the response buffer
+  http_response_ = std_::make_unique<std::string>();
 
   const CURLMcode err = curl_multi_add_handle(curl_multi_handle, curl_handle_);
   if (err != 0) {
@@ -250,7 +281,7 @@ void OSTreeObject::Upload(TreehubServer &push_target, CURLM *curl_multi_handle,
   curlEasySetoptWrapper(curl_handle_, CURLOPT_USERAGENT, Utils::getUserAgent());
   curlEasySetoptWrapper(curl_handle_, CURLOPT_WRITEFUNCTION, &OSTreeObject::curl_handle_write);
   curlEasySetoptWrapper(curl_handle_, CURLOPT_WRITEDATA, this);
-  http_response_.str("");  // Empty the response buffer
+  http_response_ = std_::make_unique<std::string>();
 
   struct stat file_info{};
   auto file_path = PathOnDisk();
@@ -277,9 +308,43 @@ void OSTreeObject::Upload(TreehubServer &push_target, CURLM *curl_multi_handle,
 }
 
 void OSTreeObject::CheckChildren(RequestPool &pool, const long rescode) {  // NOLINT(google-runtime-int)
+  const bool verify = rescode == 200 && pool.verify_present();
+  if (!HasChildren() && !verify) {
+    ChildrenRead(pool, rescode, {});
+    return;
+  }
+  // Parse the object on a worker thread. The refcount of this object is not
+  // thread-safe: only a plain pointer is used there.
+  auto children = std::make_shared<std::vector<ChildRef>>();
+  auto valid = std::make_shared<bool>(true);
+  const OSTreeObject *self = this;
+  OSTreeObject::ptr object(this);
+  pool.RunInBackground(
+      [self, children, valid, verify]() {
+        if (verify) {
+          *valid = self->Fsck();
+        }
+        if (*valid && self->HasChildren()) {
+          *children = self->ReadChildren();
+          // Let remote repositories download the children, off the loop too
+          self->repo_.PrefetchObjects(*children);
+        }
+      },
+      [object, &pool, rescode, children, valid]() {
+        if (!*valid) {
+          LOG_ERROR << "Object " << *object << " is corrupt on the server";
+          pool.Abort();
+          return;
+        }
+        object->ChildrenRead(pool, rescode, *children);
+      });
+}
+
+void OSTreeObject::ChildrenRead(RequestPool &pool, const long rescode,  // NOLINT(google-runtime-int)
+                                const std::vector<ChildRef> &children) {
   try {
-    PopulateChildren();
-    LOG_DEBUG << "Children of " << *this << ": " << children_.size();
+    PopulateChildren(children);
+    LOG_DEBUG << "Children of " << *this << ": " << pending_children_;
     if (children_ready()) {
       if (rescode != 200) {
         pool.AddUpload(this);
@@ -297,7 +362,9 @@ void OSTreeObject::PresenceError(RequestPool &pool, const int64_t rescode) {
   is_on_server_ = PresenceOnServer::kObjectStateUnknown;
   LOG_WARNING << "OSTree query reported an error code: " << rescode << " retrying...";
   LOG_DEBUG << "Http response code:" << rescode;
-  LOG_DEBUG << http_response_.str();
+  if (http_response_) {
+    LOG_DEBUG << *http_response_;
+  }
   last_operation_result_ = ServerResponse::kTemporaryFailure;
   pool.AddQuery(this);
 }
@@ -305,7 +372,9 @@ void OSTreeObject::PresenceError(RequestPool &pool, const int64_t rescode) {
 void OSTreeObject::UploadError(RequestPool &pool, const int64_t rescode) {
   LOG_WARNING << "OSTree upload reported an error code:" << rescode << " retrying...";
   LOG_DEBUG << "Http response code:" << rescode;
-  LOG_DEBUG << http_response_.str();
+  if (http_response_) {
+    LOG_DEBUG << *http_response_;
+  }
   is_on_server_ = PresenceOnServer::kObjectMissing;
   last_operation_result_ = ServerResponse::kTemporaryFailure;
   pool.AddUpload(this);
@@ -326,19 +395,9 @@ void OSTreeObject::CurlDone(CURLM *curl_multi_handle, RequestPool &pool) {
     if (url == nullptr || strstr(url, OSTreeRepo::GetPathForHash(hash_, type_).c_str()) == nullptr) {
       PresenceError(pool, rescode);
     } else if (rescode == 200) {
-      LOG_INFO << "Already present: " << *this;
-      is_on_server_ = PresenceOnServer::kObjectPresent;
-      last_operation_result_ = ServerResponse::kOk;
-      if (pool.run_mode() == RunMode::kWalkTree || pool.run_mode() == RunMode::kPushTree) {
-        CheckChildren(pool, rescode);
-      } else {
-        NotifyParents(pool);
-      }
+      PresenceChecked(pool, true);
     } else if (rescode == 404) {
-      LOG_DEBUG << "Not present: " << *this;
-      is_on_server_ = PresenceOnServer::kObjectMissing;
-      last_operation_result_ = ServerResponse::kOk;
-      CheckChildren(pool, rescode);
+      PresenceChecked(pool, false);
     } else {
       PresenceError(pool, rescode);
     }
@@ -370,11 +429,32 @@ void OSTreeObject::CurlDone(CURLM *curl_multi_handle, RequestPool &pool) {
   curl_multi_remove_handle(curl_multi_handle, curl_handle_);
   curl_easy_cleanup(curl_handle_);
   curl_handle_ = nullptr;
+  http_response_.reset();
+}
+
+void OSTreeObject::PresenceChecked(RequestPool &pool, const bool present) {
+  current_operation_ = CurrentOp::kOstreeObjectPresenceCheck;
+  last_operation_result_ = ServerResponse::kOk;
+  if (present) {
+    LOG_INFO << "Already present: " << *this;
+    is_on_server_ = PresenceOnServer::kObjectPresent;
+    if (pool.run_mode() == RunMode::kWalkTree || pool.run_mode() == RunMode::kPushTree) {
+      CheckChildren(pool, 200);
+    } else {
+      NotifyParents(pool);
+    }
+  } else {
+    LOG_DEBUG << "Not present: " << *this;
+    is_on_server_ = PresenceOnServer::kObjectMissing;
+    CheckChildren(pool, 404);
+  }
 }
 
 size_t OSTreeObject::curl_handle_write(void *buffer, size_t size, size_t nmemb, void *userp) {
   auto *that = static_cast<OSTreeObject *>(userp);
-  that->http_response_.write(static_cast<const char *>(buffer), static_cast<std::streamsize>(size * nmemb));
+  if (that->http_response_) {
+    that->http_response_->append(static_cast<const char *>(buffer), size * nmemb);
+  }
   return size * nmemb;
 }
 
@@ -2,9 +2,12 @@
 #define SOTA_CLIENT_TOOLS_OSTREE_OBJECT_H_
 
 #include <chrono>
+#include <cstdint>
 #include <iostream>
-#include <list>
-#include <sstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <curl/curl.h>
 #include <boost/filesystem/path.hpp>
@@ -18,16 +21,16 @@
 class OSTreeRepo;
 class RequestPool;
 
-enum class PresenceOnServer { kObjectStateUnknown, kObjectPresent, kObjectMissing, kObjectInProgress };
+enum class PresenceOnServer : uint8_t { kObjectStateUnknown, kObjectPresent, kObjectMissing, kObjectInProgress };
 
-enum class CurrentOp { kOstreeObjectUploading, kOstreeObjectPresenceCheck };
+enum class CurrentOp : uint8_t { kOstreeObjectUploading, kOstreeObjectPresenceCheck };
 
 /**
  * Broad categories for the result of attempting an upload.
  * At the moment all errors from the server are considered temporary, because
  * we are unable to detect a server failure that is definitely permanent.
  */
-enum class ServerResponse {
+enum class ServerResponse : uint8_t {
   /** The upload hasn't been attempted yet */
   kNoResponse,
   /** The upload was successful */
@@ -51,6 +54,10 @@ class OSTreeObject {
    * children pending upload, add the parent to the upload queue. */
   void NotifyParents(RequestPool& pool);
 
+  /* This object is already known to be present on the destination server, with
+   * all its children: notify parents without querying the server. */
+  void NotifyKnownPresent(RequestPool& pool);
+
   /* Send a HEAD request to the destination server to check if this object is
    * present there. */
   void MakeTestRequest(const TreehubServer& push_target, CURLM* curl_multi_handle);
@@ -61,44 +68,72 @@ class OSTreeObject {
   /* Process a completed curl transaction (presence check or upload). */
   void CurlDone(CURLM* curl_multi_handle, RequestPool& pool);
 
+  /* Process the result of a presence check made for several objects at once,
+   * see RequestPool. */
+  void PresenceChecked(RequestPool& pool, bool present);
+
   uintmax_t GetSize() const;
 
   PresenceOnServer is_on_server() const { return is_on_server_; }
   CurrentOp operation() const { return current_operation_; }
-  bool children_ready() const { return children_.empty(); }
+  bool children_ready() const { return pending_children_ == 0; }
   void LaunchNotify() { is_on_server_ = PresenceOnServer::kObjectInProgress; }
   std::chrono::steady_clock::time_point RequestStartTime() const { return request_start_time_; }
   ServerResponse LastOperationResult() const { return last_operation_result_; }
 
+  /* Verify the object's checksum. This only reads the object from disk and
+   * can run on any thread. */
   bool Fsck() const;
 
- private:
-  using childiter = std::list<OSTreeObject::ptr>::iterator;
-  using parentref = std::pair<OSTreeObject*, childiter>;
+  /* Path of this object relative to the repository root, e.g.
+   * "objects/ab/cdef...dirtree". */
+  std::string Url() const;
+
+  /* Content of the object file. This only reads the object from disk and can
+   * run on any thread. */
+  std::string ReadContent() const;
+
+  /* The object has been uploaded as part of a pack, see
+   * RequestPool::kPackUploadPath. */
+  void PackUploaded(RequestPool& pool);
 
+ private:
   /* Add parent to this object. */
-  void AddParent(OSTreeObject* parent, std::list<OSTreeObject::ptr>::iterator parent_it);
+  void AddParent(OSTreeObject* parent);
 
-  /* Child object of this object has been uploaded, remove it from the list. */
-  void ChildNotify(std::list<OSTreeObject::ptr>::iterator child_it);
+  /* Child object of this object has been uploaded, one less to wait for. */
+  void ChildNotify();
 
   /* If the child has is not already on the server, add it to this object's list
    * of children and add this object as the parent of the new child. */
   void AppendChild(const OSTreeObject::ptr& child);
 
-  /* Parse this object for children. */
-  void PopulateChildren();
+  using ChildRef = std::pair<OSTreeHash, OstreeObjectType>;
+
+  /* Whether this type of object can have children. */
+  bool HasChildren() const;
+
+  /* Parse this object for children. This only reads the object from disk and
+   * can run on any thread. */
+  std::vector<ChildRef> ReadChildren() const;
+
+  /* Look up the children of this object, as returned by ReadChildren(), in the
+   * repository and append them. */
+  void PopulateChildren(const std::vector<ChildRef>& children);
 
   /* Add queries to the queue for any children whose presence on the server is
    * unknown. */
   void QueryChildren(RequestPool& pool);
 
-  std::string Url() const;
-
   /* Check for children. If they are all present and this object isn't present,
-   * upload it. If any children are missing, query them. */
+   * upload it. If any children are missing, query them. The object is parsed
+   * in the background, see RequestPool::RunInBackground(). */
   void CheckChildren(RequestPool& pool, long rescode);  // NOLINT(google-runtime-int)
 
+  /* Second half of CheckChildren(), once the object has been parsed. */
+  void ChildrenRead(RequestPool& pool, long rescode,  // NOLINT(google-runtime-int)
+                    const std::vector<ChildRef>& children);
+
   /* Handle an error from a presence check. */
   void PresenceError(RequestPool& pool, int64_t rescode);
 
@@ -118,23 +153,34 @@ class OSTreeObject {
   friend void intrusive_ptr_release(OSTreeObject* /*h*/);
   friend std::ostream& operator<<(std::ostream& stream, const OSTreeObject& o);
 
+  // There is one of these per object in the repository, which can be millions:
+  // members are ordered to avoid padding, and anything that is only needed
+  // while a request is in flight or until the object is on the server is
+  // released as soon as possible.
+
   // SHA256 Hash of the object
   const OSTreeHash hash_;
   // Type of the object
   const OstreeObjectType type_;
-  const OSTreeRepo& repo_;
   int refcount_;  // refcounts and intrusive_ptr are used to simplify
                   // interaction with curl
-  PresenceOnServer is_on_server_;
-  CurrentOp current_operation_{};
+  const OSTreeRepo& repo_;
 
-  std::stringstream http_response_;
+  // Only allocated while a request is in flight
+  std::unique_ptr<std::string> http_response_;
   CURL* curl_handle_;
   FILE* fd_;
-  std::list<parentref> parents_;
-  std::list<OSTreeObject::ptr> children_;
-
   std::chrono::steady_clock::time_point request_start_time_;
+
+  // Parents waiting for this object, cleared once it is on the server
+  std::vector<OSTreeObject*> parents_;
+  // Children of this object, released once they are all on the server
+  std::vector<OSTreeObject::ptr> children_;
+  // Number of entries of children_ not yet on the server
+  uint32_t pending_children_{0};
+
+  PresenceOnServer is_on_server_;
+  CurrentOp current_operation_{};
   ServerResponse last_operation_result_{ServerResponse::kNoResponse};
 };
 
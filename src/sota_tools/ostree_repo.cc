@@ -54,8 +54,7 @@ bool OSTreeRepo::CheckForObject(const OSTreeHash &hash, OstreeObjectType type, O
   path /= GetPathForHash(hash, type);
   if (FetchObject(path)) {
     auto object = OSTreeObject::ptr(new OSTreeObject(*this, hash, type));
-    auto objkey = std::make_pair(hash, type);
-    ObjectTable[objkey] = object;
+    ObjectTable.emplace(std::make_pair(hash, type), object);
     *object_out = object;
     LOG_DEBUG << "Fetched OSTree object " << path;
     return true;
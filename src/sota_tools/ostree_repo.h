@@ -1,8 +1,10 @@
 #ifndef SOTA_CLIENT_TOOLS_OSTREE_REPO_H_
 #define SOTA_CLIENT_TOOLS_OSTREE_REPO_H_
 
-#include <map>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <boost/filesystem/path.hpp>
 
@@ -37,6 +39,26 @@ class OSTreeRepo {
 
   static boost::filesystem::path GetPathForHash(OSTreeHash hash, OstreeObjectType type);
 
+  using ObjectRef = std::pair<OSTreeHash, OstreeObjectType>;
+
+  /**
+   * Hint that the given objects are about to be requested with GetObject().
+   * Remote repositories fetch them ahead of time, several at once. Objects
+   * that can't be fetched are reported later by GetObject(). This doesn't
+   * touch the object table and can be called from any thread.
+   */
+  virtual void PrefetchObjects(const std::vector<ObjectRef>& objects) const { (void)objects; }
+
+  /**
+   * Whether GetObject() makes objects of this type available on the local file
+   * system. If not, the objects returned only stand for the ones on the server
+   * and can't be read.
+   */
+  virtual bool FetchesObjects(OstreeObjectType type) const {
+    (void)type;
+    return true;
+  }
+
  protected:
   /**
    * Look for an object with a given path, downloading it if necessary and
@@ -52,7 +74,12 @@ class OSTreeRepo {
 
   bool CheckForObject(const OSTreeHash& hash, OstreeObjectType type, OSTreeObject::ptr* object) const;
 
-  using otable = std::map<std::pair<OSTreeHash, OstreeObjectType>, OSTreeObject::ptr>;
+  struct okey_hash {
+    size_t operator()(const ObjectRef& k) const {
+      return OSTreeHash::Hasher()(k.first) ^ static_cast<size_t>(k.second);
+    }
+  };
+  using otable = std::unordered_map<ObjectRef, OSTreeObject::ptr, okey_hash>;
   mutable otable ObjectTable;  // Makes sure that the same commit object is not added twice
 };
 
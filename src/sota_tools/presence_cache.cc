@@ -0,0 +1,81 @@
+#include "presence_cache.h"
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include "crypto/crypto.h"
+#include "logging/logging.h"
+
+PresenceCache::PresenceCache(boost::filesystem::path cache_dir, const std::string& server_url, bool revalidate)
+    : path_(cache_dir / (Crypto::sha256digestHex(server_url) + ".objects")), revalidate_(revalidate) {
+  boost::filesystem::create_directories(cache_dir);
+  Load(&present_);
+  LOG_DEBUG << "Loaded " << present_.size() << " objects known to be on " << server_url << " from " << path_;
+}
+
+bool PresenceCache::IsPresent(const std::string& object) const {
+  return !revalidate_ && present_.count(object) != 0;
+}
+
+void PresenceCache::SetPresent(const std::string& object) {
+  if (present_.insert(object).second) {
+    added_.insert(object);
+  }
+  removed_.erase(object);
+}
+
+void PresenceCache::SetMissing(const std::string& object) {
+  if (present_.erase(object) != 0) {
+    removed_.insert(object);
+  }
+  added_.erase(object);
+}
+
+void PresenceCache::Load(std::unordered_set<std::string>* objects) const {
+  std::ifstream file(path_.string());
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      objects->insert(line);
+    }
+  }
+}
+
+void PresenceCache::Save() {
+  if (added_.empty() && removed_.empty()) {
+    return;
+  }
+
+  // Another push to the same server may have saved its own results since we
+  // loaded the file: merge our changes into the current content.
+  std::unordered_set<std::string> objects;
+  Load(&objects);
+  objects.insert(added_.cbegin(), added_.cend());
+  for (const auto& object : removed_) {
+    objects.erase(object);
+  }
+
+  // Write to a temporary file first, so that the cache is never left
+  // truncated.
+  const boost::filesystem::path tmp_path = path_.string() + "." + boost::filesystem::unique_path().string();
+  {
+    std::ofstream file(tmp_path.string(), std::ios::out | std::ios::trunc);
+    for (const auto& object : objects) {
+      file << object << '\n';
+    }
+    file.close();
+    if (file.fail()) {
+      boost::system::error_code ec;
+      boost::filesystem::remove(tmp_path, ec);
+      throw std::runtime_error("Could not write object presence cache " + tmp_path.string());
+    }
+  }
+  boost::filesystem::rename(tmp_path, path_);
+
+  present_ = std::move(objects);
+  added_.clear();
+  removed_.clear();
+}
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
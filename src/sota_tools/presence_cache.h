@@ -0,0 +1,54 @@
+#ifndef SOTA_CLIENT_TOOLS_PRESENCE_CACHE_H_
+#define SOTA_CLIENT_TOOLS_PRESENCE_CACHE_H_
+
+#include <string>
+#include <unordered_set>
+
+#include <boost/filesystem/path.hpp>
+
+/**
+ * Local record of the objects known to be present on a Treehub server.
+ *
+ * Objects are only ever uploaded after all their children, so an object being
+ * present on the server means that its whole subtree is present too. A hit in
+ * this cache therefore allows skipping the presence checks of a whole subtree.
+ *
+ * There is one file per server in the cache directory, named after the hash of
+ * the server URL, which lists one object path (as in Treehub URLs) per line.
+ */
+class PresenceCache {
+ public:
+  /**
+   * Load the cache of the given server.
+   * \param cache_dir Directory holding the caches of all servers, created if needed
+   * \param server_url Root URL of the Treehub server
+   * \param revalidate Ignore the cached entries, the server is queried for every
+   *                   object and the cache is updated with the answers
+   */
+  PresenceCache(boost::filesystem::path cache_dir, const std::string& server_url, bool revalidate = false);
+
+  bool IsPresent(const std::string& object) const;
+  void SetPresent(const std::string& object);
+  void SetMissing(const std::string& object);
+
+  /**
+   * Write the cache back to disk. Entries added to the file by another process
+   * in the meantime are kept.
+   */
+  void Save();
+
+  size_t size() const { return present_.size(); }
+  boost::filesystem::path path() const { return path_; }
+
+ private:
+  void Load(std::unordered_set<std::string>* objects) const;
+
+  const boost::filesystem::path path_;
+  const bool revalidate_;
+  std::unordered_set<std::string> present_;
+  std::unordered_set<std::string> added_;
+  std::unordered_set<std::string> removed_;
+};
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
+#endif  // SOTA_CLIENT_TOOLS_PRESENCE_CACHE_H_
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include "presence_cache.h"
+#include "utilities/utils.h"
+
+const std::string kServer = "https://treehub.example.com/api/v3";
+const std::string kCommit = "objects/2d/c5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380.commit";
+const std::string kDirTree = "objects/6b/1604b586fcbe052bbc0bd9e1c8040f62e085ca2e228f37df957ac939dff361.dirtree";
+
+/* Objects recorded as present are found again after a reload. */
+TEST(PresenceCache, SaveAndLoad) {
+  TemporaryDirectory temp_dir;
+  {
+    PresenceCache cache(temp_dir / "cache", kServer);
+    EXPECT_FALSE(cache.IsPresent(kCommit));
+    cache.SetPresent(kCommit);
+    cache.SetPresent(kDirTree);
+    EXPECT_TRUE(cache.IsPresent(kCommit));
+    cache.Save();
+  }
+
+  PresenceCache cache(temp_dir / "cache", kServer);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_TRUE(cache.IsPresent(kCommit));
+  EXPECT_TRUE(cache.IsPresent(kDirTree));
+}
+
+/* Each server has its own cache. */
+TEST(PresenceCache, PerServer) {
+  TemporaryDirectory temp_dir;
+  {
+    PresenceCache cache(temp_dir.Path(), kServer);
+    cache.SetPresent(kCommit);
+    cache.Save();
+  }
+
+  PresenceCache other(temp_dir.Path(), "https://other.example.com/api/v3");
+  EXPECT_FALSE(other.IsPresent(kCommit));
+  PresenceCache same(temp_dir.Path(), kServer);
+  EXPECT_TRUE(same.IsPresent(kCommit));
+}
+
+/* Objects found missing are dropped from the cache. */
+TEST(PresenceCache, Missing) {
+  TemporaryDirectory temp_dir;
+  {
+    PresenceCache cache(temp_dir.Path(), kServer);
+    cache.SetPresent(kCommit);
+    cache.SetPresent(kDirTree);
+    cache.Save();
+  }
+  {
+    PresenceCache cache(temp_dir.Path(), kServer);
+    cache.SetMissing(kDirTree);
+    EXPECT_FALSE(cache.IsPresent(kDirTree));
+    cache.Save();
+  }
+
+  PresenceCache cache(temp_dir.Path(), kServer);
+  EXPECT_TRUE(cache.IsPresent(kCommit));
+  EXPECT_FALSE(cache.IsPresent(kDirTree));
+}
+
+/* When revalidating, the cached entries are ignored but still updated. */
+TEST(PresenceCache, Revalidate) {
+  TemporaryDirectory temp_dir;
+  {
+    PresenceCache cache(temp_dir.Path(), kServer);
+    cache.SetPresent(kCommit);
+    cache.SetPresent(kDirTree);
+    cache.Save();
+  }
+  {
+    PresenceCache cache(temp_dir.Path(), kServer, true);
+    EXPECT_FALSE(cache.IsPresent(kCommit));
+    cache.SetMissing(kCommit);
+    cache.Save();
+  }
+
+  PresenceCache cache(temp_dir.Path(), kServer);
+  EXPECT_FALSE(cache.IsPresent(kCommit));
+  EXPECT_TRUE(cache.IsPresent(kDirTree));
+}
+
+/* Results saved concurrently by another push are not lost. */
+TEST(PresenceCache, ConcurrentSave) {
+  TemporaryDirectory temp_dir;
+  PresenceCache first(temp_dir.Path(), kServer);
+  PresenceCache second(temp_dir.Path(), kServer);
+  first.SetPresent(kCommit);
+  second.SetPresent(kDirTree);
+  first.Save();
+  second.Save();
+
+  PresenceCache cache(temp_dir.Path(), kServer);
+  EXPECT_TRUE(cache.IsPresent(kCommit));
+  EXPECT_TRUE(cache.IsPresent(kDirTree));
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
@@ -0,0 +1,92 @@
+#include "push_journal.h"
+
+#include <boost/filesystem.hpp>
+
+#include "logging/logging.h"
+
+static const std::string kJournalMagic = "garage-push journal 1";
+
+PushJournal::PushJournal(boost::filesystem::path path, const std::string& server_url, const OSTreeHash& commit)
+    : path_(std::move(path)) {
+  const std::string header = kJournalMagic + "\nserver " + server_url + "\ncommit " + commit.string() + "\n";
+
+  std::uintmax_t valid_size = 0;
+  {
+    std::ifstream input(path_.string(), std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    if (!content.empty() && content.compare(0, header.size(), header) != 0) {
+      LOG_WARNING << "Journal " << path_ << " belongs to another push, starting a new one";
+    } else if (!content.empty()) {
+      // A partial last line is left by an interruption while writing it
+      valid_size = content.rfind('\n') + 1;
+      size_t pos = header.size();
+      while (pos < valid_size) {
+        const size_t end = content.find('\n', pos);
+        const std::string line = content.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.size() < 3 || line[1] != ' ') {
+          continue;
+        }
+        if (line[0] == 'P') {
+          entries_[line.substr(2)] = PresenceOnServer::kObjectPresent;
+        } else if (line[0] == 'M') {
+          entries_[line.substr(2)] = PresenceOnServer::kObjectMissing;
+        }
+      }
+    }
+  }
+
+  if (valid_size == 0) {
+    if (path_.has_parent_path()) {
+      boost::filesystem::create_directories(path_.parent_path());
+    }
+    file_.open(path_.string(), std::ios::binary | std::ios::trunc);
+    file_ << header;
+  } else {
+    boost::filesystem::resize_file(path_, valid_size);
+    file_.open(path_.string(), std::ios::binary | std::ios::app);
+    replayed_ = entries_.size();
+    LOG_INFO << "Resuming push from journal " << path_ << " with " << replayed_ << " known objects";
+  }
+  file_.flush();
+  if (!file_) {
+    throw std::runtime_error("Could not write journal " + path_.string());
+  }
+}
+
+PresenceOnServer PushJournal::Lookup(const std::string& object) const {
+  auto it = entries_.find(object);
+  if (it == entries_.end()) {
+    return PresenceOnServer::kObjectStateUnknown;
+  }
+  return it->second;
+}
+
+void PushJournal::RecordPresent(const std::string& object) { Record('P', object, PresenceOnServer::kObjectPresent); }
+
+void PushJournal::RecordMissing(const std::string& object) { Record('M', object, PresenceOnServer::kObjectMissing); }
+
+void PushJournal::Record(const char type, const std::string& object, const PresenceOnServer presence) {
+  auto& entry = entries_[object];
+  if (entry == presence) {
+    return;
+  }
+  entry = presence;
+  file_ << type << ' ' << object << '\n';
+  // Up to the OS from here: this survives the process being killed, which is
+  // what matters for resuming.
+  file_.flush();
+  if (!file_) {
+    LOG_WARNING << "Could not write to journal " << path_;
+    file_.clear();
+  }
+}
+
+void PushJournal::Complete() {
+  file_.close();
+  boost::system::error_code ec;
+  boost::filesystem::remove(path_, ec);
+  entries_.clear();
+}
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
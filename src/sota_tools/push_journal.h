@@ -0,0 +1,61 @@
+#ifndef SOTA_CLIENT_TOOLS_PUSH_JOURNAL_H_
+#define SOTA_CLIENT_TOOLS_PUSH_JOURNAL_H_
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include <boost/filesystem/path.hpp>
+
+#include "ostree_object.h"
+
+/**
+ * Append-only record of the progress of one push, so that an interrupted push
+ * can be resumed without checking again what was already done.
+ *
+ * Every presence check result and every completed upload is appended to the
+ * file as soon as it is known, and flushed, so that it survives the process
+ * being killed. The journal is only valid for the server and commit it was
+ * started for, and is removed once the push has completed.
+ *
+ * File format: a header of three lines, "garage-push journal 1", "server <url>"
+ * and "commit <hash>", then one line per result, "P <object>" or
+ * "M <object>" for an object (as in Treehub URLs) present or missing on the
+ * server. The last line for an object wins.
+ */
+class PushJournal {
+ public:
+  /**
+   * Open the journal at the given path, replaying it if it belongs to the same
+   * push and starting a new one otherwise.
+   */
+  PushJournal(boost::filesystem::path path, const std::string& server_url, const OSTreeHash& commit);
+  ~PushJournal() = default;
+  PushJournal(const PushJournal&) = delete;
+  PushJournal(PushJournal&&) = delete;
+  PushJournal& operator=(const PushJournal&) = delete;
+  PushJournal& operator=(PushJournal&&) = delete;
+
+  /** Result recorded for the object, kObjectStateUnknown if there is none. */
+  PresenceOnServer Lookup(const std::string& object) const;
+  void RecordPresent(const std::string& object);
+  void RecordMissing(const std::string& object);
+
+  /** The push has completed: remove the journal. */
+  void Complete();
+
+  /** Number of results replayed from a previous run */
+  size_t replayed() const { return replayed_; }
+  boost::filesystem::path path() const { return path_; }
+
+ private:
+  void Record(char type, const std::string& object, PresenceOnServer presence);
+
+  const boost::filesystem::path path_;
+  std::unordered_map<std::string, PresenceOnServer> entries_;
+  std::ofstream file_;
+  size_t replayed_{0};
+};
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
+#endif  // SOTA_CLIENT_TOOLS_PUSH_JOURNAL_H_
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include "push_journal.h"
+#include "utilities/utils.h"
+
+const std::string kServer = "https://treehub.example.com/api/v3";
+const OSTreeHash kCommitHash = OSTreeHash::Parse("2dc5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380");
+const std::string kCommit = "objects/2d/c5ec3e8c87c1653045dcdb663765ad0bfb44913f000aee9be37ea73c0de380.commit";
+const std::string kDirTree = "objects/6b/1604b586fcbe052bbc0bd9e1c8040f62e085ca2e228f37df957ac939dff361.dirtree";
+
+/* Recorded results are replayed when the same push is started again, the
+ * last one for an object winning. */
+TEST(PushJournal, Replay) {
+  TemporaryDirectory temp_dir;
+  {
+    PushJournal journal(temp_dir / "journal", kServer, kCommitHash);
+    EXPECT_EQ(journal.replayed(), 0U);
+    EXPECT_EQ(journal.Lookup(kCommit), PresenceOnServer::kObjectStateUnknown);
+    journal.RecordMissing(kCommit);
+    journal.RecordMissing(kDirTree);
+    journal.RecordPresent(kDirTree);
+    EXPECT_EQ(journal.Lookup(kDirTree), PresenceOnServer::kObjectPresent);
+  }
+
+  PushJournal journal(temp_dir / "journal", kServer, kCommitHash);
+  EXPECT_EQ(journal.replayed(), 2U);
+  EXPECT_EQ(journal.Lookup(kCommit), PresenceOnServer::kObjectMissing);
+  EXPECT_EQ(journal.Lookup(kDirTree), PresenceOnServer::kObjectPresent);
+}
+
+/* A journal of a push to another server or of another commit is discarded. */
+TEST(PushJournal, OtherPush) {
+  TemporaryDirectory temp_dir;
+  {
+    PushJournal journal(temp_dir / "journal", kServer, kCommitHash);
+    journal.RecordPresent(kDirTree);
+  }
+  {
+    PushJournal journal(temp_dir / "journal", "https://other.example.com/api/v3", kCommitHash);
+    EXPECT_EQ(journal.replayed(), 0U);
+    EXPECT_EQ(journal.Lookup(kDirTree), PresenceOnServer::kObjectStateUnknown);
+  }
+  const auto other_commit = OSTreeHash::Parse("6b1604b586fcbe052bbc0bd9e1c8040f62e085ca2e228f37df957ac939dff361");
+  PushJournal journal(temp_dir / "journal", kServer, other_commit);
+  EXPECT_EQ(journal.replayed(), 0U);
+}
+
+/* A line cut short by an interruption is ignored, and the journal can still be
+ * appended to. */
+TEST(PushJournal, TruncatedLine) {
+  TemporaryDirectory temp_dir;
+  {
+    PushJournal journal(temp_dir / "journal", kServer, kCommitHash);
+    journal.RecordPresent(kCommit);
+  }
+  {
+    std::ofstream file((temp_dir / "journal").string(), std::ios::app);
+    file << "P " << kDirTree.substr(0, 20);
+  }
+  {
+    PushJournal journal(temp_dir / "journal", kServer, kCommitHash);
+    EXPECT_EQ(journal.replayed(), 1U);
+    EXPECT_EQ(journal.Lookup(kDirTree), PresenceOnServer::kObjectStateUnknown);
+    journal.RecordMissing(kDirTree);
+  }
+
+  PushJournal journal(temp_dir / "journal", kServer, kCommitHash);
+  EXPECT_EQ(journal.replayed(), 2U);
+  EXPECT_EQ(journal.Lookup(kCommit), PresenceOnServer::kObjectPresent);
+  EXPECT_EQ(journal.Lookup(kDirTree), PresenceOnServer::kObjectMissing);
+}
+
+/* The journal is removed once the push has completed. */
+TEST(PushJournal, Complete) {
+  TemporaryDirectory temp_dir;
+  PushJournal journal(temp_dir / "journal", kServer, kCommitHash);
+  journal.RecordPresent(kCommit);
+  EXPECT_TRUE(boost::filesystem::exists(temp_dir / "journal"));
+  journal.Complete();
+  EXPECT_FALSE(boost::filesystem::exists(temp_dir / "journal"));
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
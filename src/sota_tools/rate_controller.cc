@@ -9,15 +9,23 @@ const RateController::clock::duration RateController::kMaxSleepTime = std::chron
 
 const RateController::clock::duration RateController::kInitialSleepTime = std::chrono::seconds(1);
 
-RateController::RateController(const int concurrency_cap) : concurrency_cap_(concurrency_cap) { CheckInvariants(); }
+const RateController::clock::duration RateController::kBaseRttWindow = std::chrono::seconds(30);
+
+RateController::RateController(const int concurrency_cap, const Algorithm algorithm)
+    : concurrency_cap_(concurrency_cap), algorithm_(algorithm) {
+  CheckInvariants();
+}
 
 void RateController::RequestCompleted(const clock::time_point start_time, const clock::time_point end_time,
                                       const bool succeeded) {
+  if (succeeded) {
+    UpdateRtt(end_time - start_time, end_time);
+  }
   if (last_concurrency_update_ < start_time) {
     const int prev_concurrency = max_concurrency_;
     last_concurrency_update_ = end_time;
     if (succeeded) {
-      max_concurrency_ = std::min(max_concurrency_ + 1, concurrency_cap_);
+      max_concurrency_ = std::max(1, std::min(max_concurrency_ + ConcurrencyStep(), concurrency_cap_));
       sleep_time_ = clock::duration(0);
     } else {
       if (max_concurrency_ >= 2) {
@@ -29,10 +37,45 @@ void RateController::RequestCompleted(const clock::time_point start_time, const
     if (prev_concurrency != max_concurrency_) {
       LOG_DEBUG << "Concurrency limit is now: " << max_concurrency_;
     }
+    round_min_rtt_ = clock::duration(0);
   }
   CheckInvariants();
 }
 
+void RateController::UpdateRtt(const clock::duration rtt, const clock::time_point end_time) {
+  if (round_min_rtt_ == clock::duration(0) || rtt < round_min_rtt_) {
+    round_min_rtt_ = rtt;
+  }
+  if (base_rtt_ == clock::duration(0) || rtt < base_rtt_) {
+    base_rtt_ = rtt;
+    base_rtt_time_ = end_time;
+  } else if (end_time - base_rtt_time_ > kBaseRttWindow) {
+    // The latency has changed for good, start again from the current round
+    base_rtt_ = round_min_rtt_;
+    base_rtt_time_ = end_time;
+  }
+}
+
+int RateController::ConcurrencyStep() const {
+  if (algorithm_ == Algorithm::kAimd || round_min_rtt_ == clock::duration(0)) {
+    return 1;
+  }
+  // Comparing the expected throughput (concurrency / base RTT) to the actual one
+  // (concurrency / RTT) gives the number of requests that the server has kept
+  // waiting. The fastest request of the round is used as RTT, which filters
+  // out large uploads that are slow because of their size.
+  const double base = std::chrono::duration<double>(base_rtt_).count();
+  const double rtt = std::chrono::duration<double>(round_min_rtt_).count();
+  const double queued = max_concurrency_ * (1.0 - base / rtt);
+  if (queued < kMinQueued) {
+    return 1;
+  }
+  if (queued > kMaxQueued) {
+    return -1;
+  }
+  return 0;
+}
+
 int RateController::MaxConcurrency() const {
   CheckInvariants();
   return max_concurrency_;
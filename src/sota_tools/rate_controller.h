@@ -10,13 +10,18 @@
  *    MaxConcurrency - The current estimate of the number of parallel requests that can be opened
  *    Sleep() - The number of seconds to sleep before sending the next request. 0.0 if MaxConcurrency is > 1
  *    Failed() - A boolean indicating that the server is broken, and to report an error up to the user.
- * The congestion control is loosely based on the original TCP AIMD scheme. Better performance might be available by
- * Stealing ideas from the later TCP conjection control algorithms
+ * The congestion control is loosely based on the original TCP AIMD scheme: the concurrency is increased by one after
+ * each round-trip without errors, and halved on errors.
+ * With the delay-based algorithm, the round-trip times are tracked as well, similarly to TCP Vegas: once requests
+ * take longer than the fastest round-trip recently seen, the server is queueing them and more concurrency would only
+ * add latency. The concurrency then stops growing, or shrinks, before the server gets overloaded and starts failing.
+ * See RateControllerSimulation to evaluate changes offline.
  */
 class RateController {
  public:
   using clock = std::chrono::steady_clock;
-  explicit RateController(int concurrency_cap = 30);
+  enum class Algorithm { kAimd, kDelayBased };
+  explicit RateController(int concurrency_cap = 30, Algorithm algorithm = Algorithm::kDelayBased);
   ~RateController() = default;
   RateController(const RateController&) = delete;
   RateController(RateController&&) = delete;
@@ -31,6 +36,9 @@ class RateController {
 
   bool ServerHasFailed() const;
 
+  /** Fastest round-trip time seen recently, zero before the first success */
+  clock::duration BaseRtt() const { return base_rtt_; }
+
  private:
   /**
    * After sleeping this long and still getting a 500 error, assume the
@@ -44,7 +52,22 @@ class RateController {
    */
   static const clock::duration kInitialSleepTime;
 
+  /**
+   * The base round-trip time is forgotten after this long, so that it follows
+   * lasting changes of the server or network latency.
+   */
+  static const clock::duration kBaseRttWindow;
+
+  /**
+   * Bounds on the estimated number of our requests waiting in queues at the
+   * server: below kMinQueued the concurrency is increased, above kMaxQueued it
+   * is decreased.
+   */
+  static constexpr double kMinQueued = 2.0;
+  static constexpr double kMaxQueued = 4.0;
+
   const int concurrency_cap_;
+  const Algorithm algorithm_;
   /**
    * After making a change to the system, we wait a full round-trip time to
    * see any effects of the change. This is the last time that an change was
@@ -55,6 +78,14 @@ class RateController {
   int max_concurrency_{1};
   clock::duration sleep_time_{0};
 
+  clock::duration base_rtt_{0};
+  clock::time_point base_rtt_time_;
+  // Fastest successful round-trip since the last change
+  clock::duration round_min_rtt_{0};
+
+  void UpdateRtt(clock::duration rtt, clock::time_point end_time);
+  // Change of concurrency after a successful round-trip
+  int ConcurrencyStep() const;
   void CheckInvariants() const;
 };
 
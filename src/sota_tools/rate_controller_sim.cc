@@ -0,0 +1,146 @@
+#include "rate_controller_sim.h"
+
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using clock_type = RateController::clock;
+
+RateControllerSimulation::RateControllerSimulation(std::vector<ServerConditions> trace, const uint32_t seed)
+    : trace_(std::move(trace)), seed_(seed) {
+  if (trace_.empty()) {
+    throw std::runtime_error("Empty trace");
+  }
+  for (const auto& conditions : trace_) {
+    if (conditions.capacity < 1 || conditions.latency <= clock_type::duration(0)) {
+      throw std::runtime_error("Invalid server conditions in trace");
+    }
+  }
+}
+
+std::vector<ServerConditions> RateControllerSimulation::ParseTrace(std::istream& input) {
+  std::vector<ServerConditions> trace;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(input, line)) {
+    line_number++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    double duration_s;
+    double latency_ms;
+    ServerConditions conditions;
+    if (!(fields >> duration_s >> latency_ms >> conditions.capacity >> conditions.failure_rate)) {
+      throw std::runtime_error("Invalid trace at line " + std::to_string(line_number) + ": " + line);
+    }
+    fields >> conditions.overload;
+    conditions.duration =
+        std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(duration_s));
+    conditions.latency =
+        std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::milli>(latency_ms));
+    trace.push_back(conditions);
+  }
+  return trace;
+}
+
+const ServerConditions& RateControllerSimulation::ConditionsAt(clock_type::duration elapsed) const {
+  for (const auto& conditions : trace_) {
+    if (elapsed < conditions.duration) {
+      return conditions;
+    }
+    elapsed -= conditions.duration;
+  }
+  return trace_.back();
+}
+
+RateControllerSimulation::Result RateControllerSimulation::Run(RateController& controller, const int requests) const {
+  struct Completion {
+    clock_type::time_point end_time;
+    clock_type::time_point start_time;
+    bool succeeded;
+    bool operator>(const Completion& other) const { return end_time > other.end_time; }
+  };
+  std::priority_queue<Completion, std::vector<Completion>, std::greater<Completion>> in_flight;
+
+  std::mt19937 random(seed_);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  Result result;
+  // RateController ignores requests started before its initial state
+  const clock_type::time_point start = clock_type::time_point() + std::chrono::seconds(1);
+  clock_type::time_point now = start;
+  clock_type::time_point launch_not_before = start;
+  int queued = requests;
+  double concurrency_area = 0.0;  // requests in flight, integrated over time in seconds
+  clock_type::duration total_latency{0};
+
+  auto advance = [&](const clock_type::time_point t) {
+    concurrency_area += static_cast<double>(in_flight.size()) * std::chrono::duration<double>(t - now).count();
+    now = t;
+  };
+
+  while (queued > 0 || !in_flight.empty()) {
+    while (now >= launch_not_before && queued > 0 &&
+           static_cast<int>(in_flight.size()) < controller.MaxConcurrency()) {
+      const ServerConditions& conditions = ConditionsAt(now - start);
+      const int load = static_cast<int>(in_flight.size()) + 1;
+      const double slowdown = std::max(1.0, static_cast<double>(load) / conditions.capacity);
+      const auto latency = std::chrono::duration_cast<clock_type::duration>(conditions.latency * slowdown);
+      const bool failed =
+          uniform(random) < conditions.failure_rate || (conditions.overload > 0 && load > conditions.overload);
+      in_flight.push(Completion{now + latency, now, !failed});
+      queued--;
+      result.requests++;
+    }
+
+    if (in_flight.empty() || (queued > 0 && now < launch_not_before && launch_not_before < in_flight.top().end_time)) {
+      // Sleeping after errors
+      advance(launch_not_before);
+      continue;
+    }
+
+    const Completion completion = in_flight.top();
+    advance(completion.end_time);
+    in_flight.pop();
+    controller.RequestCompleted(completion.start_time, completion.end_time, completion.succeeded);
+    if (completion.succeeded) {
+      total_latency += completion.end_time - completion.start_time;
+    } else {
+      result.failures++;
+      queued++;
+    }
+    if (controller.ServerHasFailed()) {
+      result.server_failed = true;
+      break;
+    }
+    const auto sleep_time = controller.GetSleepTime();
+    if (sleep_time > clock_type::duration(0)) {
+      launch_not_before = now + sleep_time;
+    }
+  }
+
+  result.total_time = now - start;
+  const double total_s = std::chrono::duration<double>(result.total_time).count();
+  if (total_s > 0) {
+    result.mean_concurrency = concurrency_area / total_s;
+  }
+  const int successes = result.requests - result.failures;
+  if (successes > 0) {
+    result.mean_latency = total_latency / successes;
+  }
+  return result;
+}
+
+std::ostream& operator<<(std::ostream& os, const RateControllerSimulation::Result& result) {
+  os << "time: " << std::chrono::duration<double>(result.total_time).count() << " s, requests: " << result.requests
+     << ", failures: " << result.failures << ", mean concurrency: " << result.mean_concurrency
+     << ", mean latency: " << std::chrono::duration<double, std::milli>(result.mean_latency).count() << " ms"
+     << (result.server_failed ? ", gave up" : "");
+  return os;
+}
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
@@ -0,0 +1,75 @@
+#ifndef SOTA_CLIENT_TOOLS_RATE_CONTROLLER_SIM_H_
+#define SOTA_CLIENT_TOOLS_RATE_CONTROLLER_SIM_H_
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "rate_controller.h"
+
+/**
+ * Behaviour of the simulated server during one segment of a trace.
+ */
+struct ServerConditions {
+  /** How long these conditions last */
+  RateController::clock::duration duration{0};
+  /** Round-trip time of a request to an idle server */
+  RateController::clock::duration latency{0};
+  /** Number of requests handled in parallel, further ones are queued and slow everything down */
+  int capacity{1};
+  /** Probability of a request failing, 1.0 for an outage */
+  double failure_rate{0.0};
+  /** If positive, requests beyond this many in flight fail, like a proxy answering 503 */
+  int overload{0};
+};
+
+/**
+ * Replays a trace of server conditions against a RateController, without any
+ * network or real time involved, to compare congestion control algorithms and
+ * their tuning offline.
+ *
+ * Requests are launched as RequestPool does: up to MaxConcurrency() at a time,
+ * failed requests are retried and nothing is launched while the controller
+ * asks to sleep.
+ */
+class RateControllerSimulation {
+ public:
+  struct Result {
+    RateController::clock::duration total_time{0};
+    int requests{0};
+    int failures{0};
+    // Average number of requests in flight
+    double mean_concurrency{0.0};
+    // Average round-trip time of the successful requests
+    RateController::clock::duration mean_latency{0};
+    bool server_failed{false};
+  };
+
+  /**
+   * \param trace conditions applied one after the other, the last one stays in
+   *              effect until the end of the simulation
+   */
+  explicit RateControllerSimulation(std::vector<ServerConditions> trace, uint32_t seed = 1);
+
+  /**
+   * Read a trace with one segment per line:
+   *   <duration s> <latency ms> <capacity> <failure rate> [<overload>]
+   * Empty lines and lines starting with '#' are ignored.
+   * @throws std::runtime_error on invalid input
+   */
+  static std::vector<ServerConditions> ParseTrace(std::istream& input);
+
+  /** Complete the given number of requests, or stop when the controller gives up. */
+  Result Run(RateController& controller, int requests) const;
+
+ private:
+  const ServerConditions& ConditionsAt(RateController::clock::duration elapsed) const;
+
+  std::vector<ServerConditions> trace_;
+  uint32_t seed_;
+};
+
+std::ostream& operator<<(std::ostream& os, const RateControllerSimulation::Result& result);
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
+#endif  // SOTA_CLIENT_TOOLS_RATE_CONTROLLER_SIM_H_
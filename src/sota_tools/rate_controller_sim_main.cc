@@ -0,0 +1,68 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "logging/logging.h"
+#include "rate_controller.h"
+#include "rate_controller_sim.h"
+
+namespace po = boost::program_options;
+
+/*
+ * Offline evaluation of the garage-push congestion control: replays a trace of
+ * server conditions (see RateControllerSimulation::ParseTrace()) against the
+ * available algorithms and prints the results side by side.
+ */
+int main(int argc, char **argv) {
+  logger_init();
+  logger_set_threshold(boost::log::trivial::warning);
+
+  boost::filesystem::path trace_path;
+  int requests;
+  int max_concurrency;
+  unsigned int seed;
+  po::options_description desc("rate-controller-sim command line options");
+  // clang-format off
+  desc.add_options()
+    ("help", "print usage")
+    ("trace", po::value<boost::filesystem::path>(&trace_path)->required(), "trace of server conditions to replay")
+    ("requests,n", po::value<int>(&requests)->default_value(10000), "number of requests to complete")
+    ("jobs", po::value<int>(&max_concurrency)->default_value(30), "maximum number of parallel requests, as in garage-push")
+    ("seed", po::value<unsigned int>(&seed)->default_value(1), "seed for the random failures");
+  // clang-format on
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, reinterpret_cast<const char *const *>(argv), desc), vm);
+    if (vm.count("help") != 0U) {
+      std::cout << desc;
+      return EXIT_SUCCESS;
+    }
+    po::notify(vm);
+  } catch (const po::error &o) {
+    std::cerr << o.what() << "\n" << desc;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    std::ifstream trace_file(trace_path.string());
+    if (!trace_file) {
+      throw std::runtime_error("Could not open " + trace_path.string());
+    }
+    RateControllerSimulation simulation(RateControllerSimulation::ParseTrace(trace_file), seed);
+
+    RateController aimd(max_concurrency, RateController::Algorithm::kAimd);
+    std::cout << "AIMD:        " << simulation.Run(aimd, requests) << "\n";
+    RateController delay_based(max_concurrency, RateController::Algorithm::kDelayBased);
+    std::cout << "Delay-based: " << simulation.Run(delay_based, requests) << "\n";
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
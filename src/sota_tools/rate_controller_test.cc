@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <sstream>
+
 #include "rate_controller.h"
+#include "rate_controller_sim.h"
 
 /* Initial rate controller status is good. */
 TEST(initial, initially_ok) {
@@ -48,6 +52,76 @@ TEST(control, good_results_improve_concurrency) {
   EXPECT_GT(dut.MaxConcurrency(), initial_concurrency);
 }
 
+/* Rate controller stops increasing concurrency when the server starts queueing requests. */
+TEST(control, latency_increase_limits_concurrency) {
+  RateController dut;
+  RateController::clock::time_point t = RateController::clock::now();
+  const RateController::clock::duration base_rtt = std::chrono::milliseconds(100);
+  for (int i = 0; i < 100; i++) {
+    // A server handling 5 requests at a time, the next ones wait
+    const auto rtt = base_rtt * std::max(1, dut.MaxConcurrency() / 5);
+    dut.RequestCompleted(t, t + rtt, true);
+    t += rtt;
+  }
+  EXPECT_EQ(dut.BaseRtt(), base_rtt);
+  EXPECT_LE(dut.MaxConcurrency(), 10);
+  EXPECT_GE(dut.MaxConcurrency(), 5);
+}
+
+/* The original AIMD algorithm only reacts to errors. */
+TEST(control, aimd_ignores_latency) {
+  RateController dut(30, RateController::Algorithm::kAimd);
+  RateController::clock::time_point t = RateController::clock::now();
+  for (int i = 0; i < 100; i++) {
+    const auto rtt = std::chrono::milliseconds(100) * dut.MaxConcurrency();
+    dut.RequestCompleted(t, t + rtt, true);
+    t += rtt;
+  }
+  EXPECT_EQ(dut.MaxConcurrency(), 30);
+}
+
+/* Read a trace of server conditions. */
+TEST(simulation, parse_trace) {
+  std::istringstream input("# comment\n\n10 100 8 0.5\n2.5 20 4 0 6\n");
+  const auto trace = RateControllerSimulation::ParseTrace(input);
+  ASSERT_EQ(trace.size(), 2);
+  EXPECT_EQ(trace[0].duration, std::chrono::seconds(10));
+  EXPECT_EQ(trace[0].latency, std::chrono::milliseconds(100));
+  EXPECT_EQ(trace[0].capacity, 8);
+  EXPECT_EQ(trace[0].failure_rate, 0.5);
+  EXPECT_EQ(trace[0].overload, 0);
+  EXPECT_EQ(trace[1].duration, std::chrono::milliseconds(2500));
+  EXPECT_EQ(trace[1].overload, 6);
+
+  std::istringstream invalid("10 100 eight 0\n");
+  EXPECT_THROW(RateControllerSimulation::ParseTrace(invalid), std::runtime_error);
+}
+
+/* Delay-based control avoids the errors of an overloaded server at the same throughput. */
+TEST(simulation, delay_based_avoids_overload) {
+  std::istringstream input("60 100 10 0 15\n");
+  RateControllerSimulation sim(RateControllerSimulation::ParseTrace(input));
+  RateController aimd(30, RateController::Algorithm::kAimd);
+  RateController delay_based(30, RateController::Algorithm::kDelayBased);
+
+  const auto aimd_result = sim.Run(aimd, 2000);
+  const auto delay_result = sim.Run(delay_based, 2000);
+  EXPECT_FALSE(delay_result.server_failed);
+  EXPECT_GT(aimd_result.failures, 0);
+  EXPECT_EQ(delay_result.failures, 0);
+  EXPECT_LE(delay_result.total_time, aimd_result.total_time);
+}
+
+/* The controller gives up during a long outage. */
+TEST(simulation, outage) {
+  std::istringstream input("1 100 10 0\n600 100 10 1\n");
+  RateControllerSimulation sim(RateControllerSimulation::ParseTrace(input));
+  RateController dut;
+  const auto result = sim.Run(dut, 2000);
+  EXPECT_TRUE(result.server_failed);
+  EXPECT_LT(result.requests, 2000);
+}
+
 #ifndef __NO_MAIN__
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
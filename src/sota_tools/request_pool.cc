@@ -1,22 +1,91 @@
 #include "request_pool.h"
 
+#include <sys/epoll.h>
+#include <unistd.h>
+
 #include <algorithm>  // min
+#include <array>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <exception>
-#include <thread>
+#include <memory>
+#include <sstream>
+#include <unordered_set>
 
 #include "logging/logging.h"
+#include "utilities/utils.h"
+
+struct RequestPool::BatchQuery {
+  BatchQuery() = default;
+  ~BatchQuery() {
+    if (handle != nullptr) {
+      curl_easy_cleanup(handle);
+    }
+    curl_slist_free_all(headers);
+  }
+  BatchQuery(const BatchQuery&) = delete;
+  BatchQuery(BatchQuery&&) = delete;
+  BatchQuery& operator=(const BatchQuery&) = delete;
+  BatchQuery& operator=(BatchQuery&&) = delete;
+
+  CURL* handle{nullptr};
+  struct curl_slist* headers{nullptr};
+  std::vector<OSTreeObject::ptr> objects;
+  std::string request_body;
+  std::string response;
+  RateController::clock::time_point start_time;
+};
+
+struct RequestPool::PackUpload {
+  PackUpload() = default;
+  ~PackUpload() {
+    if (handle != nullptr) {
+      curl_easy_cleanup(handle);
+    }
+  }
+  PackUpload(const PackUpload&) = delete;
+  PackUpload(PackUpload&&) = delete;
+  PackUpload& operator=(const PackUpload&) = delete;
+  PackUpload& operator=(PackUpload&&) = delete;
+
+  CURL* handle{nullptr};
+  std::vector<OSTreeObject::ptr> objects;
+  std::string request_body;
+  std::string response;
+  RateController::clock::time_point start_time;
+};
 
-RequestPool::RequestPool(TreehubServer& server, const int max_curl_requests, const RunMode mode, bool fsck_on_upload)
+RequestPool::RequestPool(TreehubServer& server, const int max_curl_requests, const RunMode mode, bool fsck_on_upload,
+                         PresenceCache* presence_cache, PushJournal* journal, const bool pack_uploads)
     : rate_controller_(max_curl_requests),
       running_requests_(0),
       server_(server),
       mode_(mode),
       fsck_on_upload_(fsck_on_upload),
+      presence_cache_(presence_cache),
+      journal_(journal),
+      pack_uploads_(pack_uploads && (mode == RunMode::kDefault || mode == RunMode::kPushTree)),
       stopped_(false) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    throw std::runtime_error(std::string("epoll_create1 failed with error: ") + std::strerror(errno));
+  }
+  // Wake up the loop when background work is done
+  struct epoll_event event {};
+  event.events = EPOLLIN;
+  event.data.fd = workers_.event_fd();
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, workers_.event_fd(), &event) < 0) {
+    close(epoll_fd_);
+    throw std::runtime_error(std::string("epoll_ctl failed with error: ") + std::strerror(errno));
+  }
   curl_global_init(CURL_GLOBAL_DEFAULT);
   multi_ = curl_multi_init();
   curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_HTTP1 | CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &RequestPool::SocketCallback);
+  curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+  curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &RequestPool::TimerCallback);
+  curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
 }
 
 RequestPool::~RequestPool() {
@@ -31,6 +100,7 @@ RequestPool::~RequestPool() {
 
     curl_multi_cleanup(multi_);
     curl_global_cleanup();
+    close(epoll_fd_);
   } catch (std::exception& ex) {
     LOG_ERROR << "Exception in RequestPool dtor: " << ex.what();
   } catch (...) {
@@ -47,132 +117,539 @@ void RequestPool::AddQuery(const OSTreeObject::ptr& request) {
 
 void RequestPool::AddUpload(const OSTreeObject::ptr& request) {
   request->LaunchNotify();
-  if (!stopped_) {
+  if (stopped_) {
+    return;
+  }
+  if (!fsck_on_upload_) {
     upload_queue_.push_back(request);
+    return;
+  }
+  // Check object's integrity before uploading them, but after we know they
+  // are not present on the server. Hashing large objects takes a while, so it
+  // runs in the background while other requests go on.
+  auto valid = std::make_shared<bool>(false);
+  const OSTreeObject* object = request.get();
+  RunInBackground([object, valid]() { *valid = object->Fsck(); },
+                  [this, request, valid]() {
+                    if (!*valid) {
+                      LOG_ERROR << "Local object " << request << " is corrupt. Aborting upload.";
+                      Abort();
+                    } else if (!stopped_) {
+                      upload_queue_.push_back(request);
+                    }
+                  });
+}
+
+OSTreeObject::ptr RequestPool::PopQuery() {
+  while (!query_queue_.empty()) {
+    OSTreeObject::ptr cur = query_queue_.front();
+    query_queue_.pop_front();
+    if (journal_ != nullptr) {
+      const PresenceOnServer recorded = journal_->Lookup(cur->Url());
+      if (recorded == PresenceOnServer::kObjectPresent) {
+        // Uploaded or found by the interrupted push, and objects are only
+        // uploaded after their children
+        cur->NotifyKnownPresent(*this);
+        journal_hits_++;
+        continue;
+      }
+      if (recorded == PresenceOnServer::kObjectMissing) {
+        // Skip the query, but still walk the children and upload it
+        cur->PresenceChecked(*this, false);
+        journal_hits_++;
+        continue;
+      }
+    }
+    if (presence_cache_ != nullptr && presence_cache_->IsPresent(cur->Url())) {
+      // Known to be on the server along with its whole subtree
+      cur->NotifyKnownPresent(*this);
+      cache_hits_++;
+      continue;
+    }
+    return cur;
   }
+  return nullptr;
 }
 
 void RequestPool::LoopLaunch() {
-  while (running_requests_ < rate_controller_.MaxConcurrency() && (!query_queue_.empty() || !upload_queue_.empty())) {
+  if (RateController::clock::now() < launch_not_before_) {
+    // Backing off because of server congestion. The requests already running
+    // go on in the meantime.
+    return;
+  }
+  while (running_requests_ + packs_in_preparation_ < rate_controller_.MaxConcurrency() &&
+         (!query_queue_.empty() || !upload_queue_.empty())) {
     OSTreeObject::ptr cur;
 
     // Queries first, uploads second
     if (query_queue_.empty()) {
       // Uploads
+      if (pack_uploads_ && pack_support_ != BatchSupport::kUnsupported && LaunchPackUpload()) {
+        // Counted in packs_in_preparation_ until the request is sent
+        continue;
+      }
       cur = upload_queue_.front();
       upload_queue_.pop_front();
-      // Check object's integrity before uploading them, but after we know they
-      // are not present on the server
-      if (fsck_on_upload_) {
-        if (!cur->Fsck()) {
-          LOG_ERROR << "Local object " << cur << " is corrupt. Aborting upload.";
-          Abort();
-          continue;
-        }
-      }
       cur->Upload(server_, multi_, mode_);
       put_requests_made_++;
-      total_object_size_ += cur->GetSize();
       if (mode_ == RunMode::kDryRun || mode_ == RunMode::kWalkTree) {
         // Don't send an actual upload message, just skip to the part where we
         // acknowledge that the object has been uploaded.
         cur->NotifyParents(*this);
+      } else {
+        total_object_size_ += cur->GetSize();
       }
     } else {
       // Queries
-      cur = query_queue_.front();
-      query_queue_.pop_front();
-      cur->MakeTestRequest(server_, multi_);
-      head_requests_made_++;
+      cur = PopQuery();
+      if (cur == nullptr) {
+        continue;
+      }
+      if (batch_support_ != BatchSupport::kUnsupported && !query_queue_.empty() &&
+          not_batched_.count(cur.get()) == 0) {
+        LaunchBatchQuery(cur);
+      } else {
+        cur->MakeTestRequest(server_, multi_);
+        head_requests_made_++;
+      }
     }
 
     running_requests_++;
   }
 }
 
-void RequestPool::LoopListen() {
-  // For more information about the timeout logic, read these:
-  // https://curl.haxx.se/libcurl/c/curl_multi_timeout.html
-  // https://curl.haxx.se/libcurl/c/curl_multi_fdset.html
-  CURLMcode mc;
-  // Poll for IO
-  fd_set fdread;
-  fd_set fdwrite;
-  fd_set fdexcept;
-  int maxfd = 0;
-  FD_ZERO(&fdread);    // NOLINT(readability-isolate-declaration)
-  FD_ZERO(&fdwrite);   // NOLINT(readability-isolate-declaration)
-  FD_ZERO(&fdexcept);  // NOLINT(readability-isolate-declaration)
-  long timeoutms = 0;  // NOLINT(google-runtime-int)
-  mc = curl_multi_timeout(multi_, &timeoutms);
-  if (mc != CURLM_OK) {
-    throw std::runtime_error("curl_multi_timeout failed with error");
-  }
-  // If timeoutms is 0, "it means you should proceed immediately without waiting
-  // for anything".
-  if (timeoutms != 0) {
-    mc = curl_multi_fdset(multi_, &fdread, &fdwrite, &fdexcept, &maxfd);
-    if (mc != CURLM_OK) {
-      throw std::runtime_error("curl_multi_fdset failed with error");
-    }
-
-    struct timeval timeout{};
-    if (maxfd != -1) {
-      // "Wait for activities no longer than the set timeout."
-      if (timeoutms == -1) {
-        // "You must not wait too long (more than a few seconds perhaps)".
-        timeout.tv_sec = 3;
-        timeout.tv_usec = 0;
-      } else {
-        timeout.tv_sec = timeoutms / 1000;
-        timeout.tv_usec = 1000 * (timeoutms % 1000);
-      }
-      if (select(maxfd + 1, &fdread, &fdwrite, &fdexcept, &timeout) < 0) {
-        throw std::runtime_error(std::string("select failed with error: ") + std::strerror(errno));
-      }
-    } else if (timeoutms > 0) {
-      // If maxfd == -1, then wait the lesser of timeoutms and 100 ms.
-      long nofd_timeoutms = std::min(timeoutms, static_cast<long>(100));  // NOLINT(google-runtime-int)
-      LOG_DEBUG << "Waiting " << nofd_timeoutms << " ms for curl";
-      timeout.tv_sec = 0;
-      timeout.tv_usec = 1000 * (nofd_timeoutms % 1000);
-      if (select(0, nullptr, nullptr, nullptr, &timeout) < 0) {
-        throw std::runtime_error(std::string("select failed with error: ") + std::strerror(errno));
-      }
-    }
+int RequestPool::SocketCallback(CURL* easy, curl_socket_t socket, int what, void* userp, void* socketp) {
+  (void)easy;
+  auto* pool = static_cast<RequestPool*>(userp);
+
+  if (what == CURL_POLL_REMOVE) {
+    // The socket may already be closed, in which case epoll has forgotten it
+    epoll_ctl(pool->epoll_fd_, EPOLL_CTL_DEL, socket, nullptr);
+    return 0;
+  }
+
+  struct epoll_event event {};
+  event.data.fd = socket;
+  if ((what & CURL_POLL_IN) != 0) {
+    event.events |= EPOLLIN;
+  }
+  if ((what & CURL_POLL_OUT) != 0) {
+    event.events |= EPOLLOUT;
+  }
+  // curl lets us attach a pointer to each socket: use it to know whether the
+  // socket has already been added to the epoll set.
+  // A descriptor that curl closed and reopened may be reported again before it
+  // is removed though, so fall back to the other operation.
+  const int op = (socketp == nullptr) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  int res = epoll_ctl(pool->epoll_fd_, op, socket, &event);
+  if (res < 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+    res = epoll_ctl(pool->epoll_fd_, EPOLL_CTL_MOD, socket, &event);
+  } else if (res < 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+    res = epoll_ctl(pool->epoll_fd_, EPOLL_CTL_ADD, socket, &event);
+  }
+  if (res < 0) {
+    LOG_ERROR << "epoll_ctl failed with error: " << std::strerror(errno);
+    return -1;
+  }
+  if (socketp == nullptr) {
+    curl_multi_assign(pool->multi_, socket, pool);
+  }
+  return 0;
+}
+
+int RequestPool::TimerCallback(CURLM* multi, long timeout_ms, void* userp) {  // NOLINT(google-runtime-int)
+  (void)multi;
+  auto* pool = static_cast<RequestPool*>(userp);
+  pool->timer_armed_ = timeout_ms >= 0;
+  if (pool->timer_armed_) {
+    pool->timer_deadline_ = RateController::clock::now() + std::chrono::milliseconds(timeout_ms);
   }
+  return 0;
+}
 
-  // Ask curl to handle IO
-  mc = curl_multi_perform(multi_, &running_requests_);
+void RequestPool::SocketAction(curl_socket_t socket, int events) {
+  const CURLMcode mc = curl_multi_socket_action(multi_, socket, events, &running_requests_);
   if (mc != CURLM_OK) {
-    throw std::runtime_error("curl_multi failed with error");
+    throw std::runtime_error(std::string("curl_multi_socket_action failed with error: ") + curl_multi_strerror(mc));
   }
   assert(running_requests_ >= 0);
+}
+
+void RequestPool::LoopListen() {
+  // For more information about the event logic, read these:
+  // https://curl.se/libcurl/c/curl_multi_socket_action.html
+  // https://curl.se/libcurl/c/CURLMOPT_TIMERFUNCTION.html
+  const auto now = RateController::clock::now();
+  // Without any timer set by curl, still wake up from time to time: curl
+  // might not have been told about new requests yet.
+  auto wait_until = now + std::chrono::seconds(3);
+  if (timer_armed_) {
+    wait_until = std::min(wait_until, timer_deadline_);
+  }
+  if (now < launch_not_before_ && (!query_queue_.empty() || !upload_queue_.empty())) {
+    // Wake up when the backoff is over to launch new requests
+    wait_until = std::min(wait_until, launch_not_before_);
+  }
+  const auto wait_ms = std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(wait_until - now).count());
+
+  // Poll for IO
+  static constexpr int kMaxEvents = 64;
+  std::array<struct epoll_event, kMaxEvents> events{};
+  const int n_events = epoll_wait(epoll_fd_, events.data(), kMaxEvents, static_cast<int>(wait_ms));
+  if (n_events < 0 && errno != EINTR) {
+    throw std::runtime_error(std::string("epoll_wait failed with error: ") + std::strerror(errno));
+  }
+
+  // Ask curl to handle IO, only on the sockets with activity
+  for (int k = 0; k < n_events; ++k) {
+    if (events[k].data.fd == workers_.event_fd()) {
+      continue;
+    }
+    int flags = 0;
+    if ((events[k].events & EPOLLIN) != 0) {
+      flags |= CURL_CSELECT_IN;
+    }
+    if ((events[k].events & EPOLLOUT) != 0) {
+      flags |= CURL_CSELECT_OUT;
+    }
+    if ((events[k].events & (EPOLLERR | EPOLLHUP)) != 0) {
+      flags |= CURL_CSELECT_ERR;
+    }
+    SocketAction(events[k].data.fd, flags);
+  }
+  if (timer_armed_ && RateController::clock::now() >= timer_deadline_) {
+    timer_armed_ = false;
+    SocketAction(CURL_SOCKET_TIMEOUT, 0);
+  }
+
+  HandleCompletedRequests();
+  workers_.RunCompleted();
+}
 
-  // Deal with any completed requests
+void RequestPool::HandleCompletedRequests() {
   int msgs_in_queue;
   do {
     CURLMsg* msg = curl_multi_info_read(multi_, &msgs_in_queue);
     if ((msg != nullptr) && msg->msg == CURLMSG_DONE) {
+      auto batch = batch_queries_.find(msg->easy_handle);
+      if (batch != batch_queries_.end()) {
+        BatchQueryDone(*batch->second, msg->data.result);
+        batch_queries_.erase(batch);
+        continue;
+      }
+      auto pack = pack_uploads_in_flight_.find(msg->easy_handle);
+      if (pack != pack_uploads_in_flight_.end()) {
+        PackUploadDone(*pack->second, msg->data.result);
+        pack_uploads_in_flight_.erase(pack);
+        continue;
+      }
+
       OSTreeObject::ptr completed_object = ostree_object_from_curl(msg->easy_handle);
       completed_object->CurlDone(multi_, *this);
-      auto start_time = completed_object->RequestStartTime();
-      auto end_time = RateController::clock::now();
+      RecordPresence(completed_object);
       bool server_responded_ok = completed_object->LastOperationResult() == ServerResponse::kOk;
-      rate_controller_.RequestCompleted(start_time, end_time, server_responded_ok);
+      RequestCompleted(completed_object->RequestStartTime(), RateController::clock::now(), server_responded_ok);
+    }
+  } while (msgs_in_queue > 0);
+}
 
-      if (rate_controller_.ServerHasFailed()) {
-        Abort();
-      } else {
-        auto duration = rate_controller_.GetSleepTime();
-        if (duration > RateController::clock::duration(0)) {
-          LOG_DEBUG << "Sleeping for " << std::chrono::duration_cast<std::chrono::seconds>(duration).count()
-                    << " seconds due to server congestion.";
-          std::this_thread::sleep_for(duration);
+void RequestPool::RequestCompleted(const RateController::clock::time_point start_time,
+                                   const RateController::clock::time_point end_time, const bool succeeded) {
+  rate_controller_.RequestCompleted(start_time, end_time, succeeded);
+
+  if (rate_controller_.ServerHasFailed()) {
+    Abort();
+  } else {
+    auto duration = rate_controller_.GetSleepTime();
+    if (duration > RateController::clock::duration(0)) {
+      LOG_DEBUG << "Delaying new requests for " << std::chrono::duration_cast<std::chrono::seconds>(duration).count()
+                << " seconds due to server congestion.";
+      launch_not_before_ = end_time + duration;
+    }
+  }
+}
+
+void RequestPool::RecordPresence(const OSTreeObject::ptr& object) {
+  if (object->LastOperationResult() != ServerResponse::kOk) {
+    return;
+  }
+  if (object->is_on_server() == PresenceOnServer::kObjectPresent) {
+    if (presence_cache_ != nullptr) {
+      presence_cache_->SetPresent(object->Url());
+    }
+    if (journal_ != nullptr) {
+      journal_->RecordPresent(object->Url());
+    }
+  } else if (object->operation() == CurrentOp::kOstreeObjectPresenceCheck) {
+    // The object may already be queued for upload: anything but present
+    missing_objects_++;
+    if (presence_cache_ != nullptr) {
+      presence_cache_->SetMissing(object->Url());
+    }
+    if (journal_ != nullptr) {
+      journal_->RecordMissing(object->Url());
+    }
+  }
+}
+
+void RequestPool::LaunchBatchQuery(const OSTreeObject::ptr& first) {
+  auto batch = std_::make_unique<BatchQuery>();
+  batch->objects.push_back(first);
+  // Objects that an earlier batch did not cover are queried on their own
+  std::list<OSTreeObject::ptr> not_batched;
+  while (batch->objects.size() < kMaxBatchSize) {
+    OSTreeObject::ptr next = PopQuery();
+    if (next == nullptr) {
+      break;
+    }
+    if (not_batched_.count(next.get()) != 0) {
+      not_batched.push_back(next);
+      continue;
+    }
+    batch->objects.push_back(next);
+  }
+  query_queue_.splice(query_queue_.begin(), not_batched);
+
+  Json::Value request;
+  request["objects"] = Json::arrayValue;
+  for (const auto& object : batch->objects) {
+    request["objects"].append(object->Url());
+  }
+  batch->request_body = Utils::jsonToCanonicalStr(request);
+
+  batch->handle = curl_easy_init();
+  if (batch->handle == nullptr) {
+    throw std::runtime_error("Could not initialize curl handle");
+  }
+  curlEasySetoptWrapper(batch->handle, CURLOPT_VERBOSE, get_curlopt_verbose());
+  server_.InjectIntoCurl(kBatchQueryPath, batch->handle);
+  curlEasySetoptWrapper(batch->handle, CURLOPT_USERAGENT, Utils::getUserAgent());
+  // The headers of server_ are shared by all the requests and may carry
+  // another content type: this request has its own list.
+  batch->headers = server_.HeadersWithContentType("Content-Type: application/json");
+  curlEasySetoptWrapper(batch->handle, CURLOPT_HTTPHEADER, batch->headers);
+  curlEasySetoptWrapper(batch->handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(batch->request_body.size()));
+  curlEasySetoptWrapper(batch->handle, CURLOPT_POSTFIELDS, batch->request_body.c_str());
+  curlEasySetoptWrapper(batch->handle, CURLOPT_WRITEFUNCTION, &RequestPool::BatchQueryWrite);
+  curlEasySetoptWrapper(batch->handle, CURLOPT_WRITEDATA, &batch->response);
+
+  const CURLMcode err = curl_multi_add_handle(multi_, batch->handle);
+  if (err != CURLM_OK) {
+    throw std::runtime_error(std::string("curl_multi_add_handle failed with error: ") + curl_multi_strerror(err));
+  }
+  LOG_DEBUG << "Checking presence of " << batch->objects.size() << " objects in one request";
+  batch->start_time = RateController::clock::now();
+  batch_requests_made_++;
+  CURL* handle = batch->handle;
+  batch_queries_.emplace(handle, std::move(batch));
+}
+
+void RequestPool::BatchQueryDone(BatchQuery& batch, const CURLcode result) {
+  long rescode = 0;  // NOLINT(google-runtime-int)
+  curl_easy_getinfo(batch.handle, CURLINFO_RESPONSE_CODE, &rescode);
+  curl_multi_remove_handle(multi_, batch.handle);
+  const auto end_time = RateController::clock::now();
+
+  bool valid = false;
+  std::unordered_set<std::string> present;
+  std::unordered_set<std::string> missing;
+  if (result == CURLE_OK && rescode == 200) {
+    const Json::Value response = Utils::parseJSON(batch.response);
+    if (response.isObject() && (response["present"].isArray() || response["missing"].isArray())) {
+      valid = true;
+      for (const auto& object : response["present"]) {
+        present.insert(object.asString());
+      }
+      for (const auto& object : response["missing"]) {
+        missing.insert(object.asString());
+      }
+    }
+  }
+
+  if (!valid) {
+    if (result == CURLE_OK && batch_support_ != BatchSupport::kSupported) {
+      // Anything but the expected answer from a server which has never
+      // answered batched queries means that it does not know about them.
+      if (batch_support_ == BatchSupport::kUnknown) {
+        LOG_INFO << "Server does not support batched presence checks (HTTP " << rescode
+                 << "), falling back to one request per object";
+      }
+      batch_support_ = BatchSupport::kUnsupported;
+    } else {
+      LOG_WARNING << "Batched presence check failed with "
+                  << (result != CURLE_OK ? curl_easy_strerror(result) : "HTTP " + std::to_string(rescode))
+                  << ", retrying...";
+      RequestCompleted(batch.start_time, end_time, false);
+    }
+    if (!stopped_) {
+      query_queue_.insert(query_queue_.begin(), batch.objects.cbegin(), batch.objects.cend());
+    }
+    return;
+  }
+
+  batch_support_ = BatchSupport::kSupported;
+  for (const auto& object : batch.objects) {
+    // Only trust what the reply says explicitly: a present object is recorded
+    // as such and never uploaded again.
+    const bool is_present = present.count(object->Url()) != 0;
+    if (!is_present && missing.count(object->Url()) == 0) {
+      LOG_WARNING << "Batched presence check did not cover " << *object << ", checking it on its own";
+      not_batched_.insert(object.get());
+      if (!stopped_) {
+        query_queue_.push_front(object);
+      }
+      continue;
+    }
+    object->PresenceChecked(*this, is_present);
+    RecordPresence(object);
+  }
+  RequestCompleted(batch.start_time, end_time, true);
+}
+
+size_t RequestPool::BatchQueryWrite(void* buffer, size_t size, size_t nmemb, void* userp) {
+  auto* response = static_cast<std::string*>(userp);
+  response->append(static_cast<const char*>(buffer), size * nmemb);
+  return size * nmemb;
+}
+
+bool RequestPool::LaunchPackUpload() {
+  // Take the small objects among the first ones of the queue. Large objects
+  // stay where they are and go one by one.
+  auto pack = std::make_shared<PackUpload>();
+  std::vector<std::list<OSTreeObject::ptr>::iterator> taken;
+  uintmax_t pack_size = 0;
+  size_t examined = 0;
+  for (auto it = upload_queue_.begin();
+       it != upload_queue_.end() && taken.size() < kMaxPackObjects && examined < 2 * kMaxPackObjects; ++it) {
+    ++examined;
+    if (not_packed_.count(it->get()) != 0) {
+      continue;
+    }
+    const uintmax_t size = (*it)->GetSize();
+    if (size > kMaxPackObjectSize || pack_size + size > kMaxPackSize) {
+      continue;
+    }
+    pack_size += size;
+    taken.push_back(it);
+  }
+  if (taken.size() < 2) {
+    return false;
+  }
+
+  std::vector<const OSTreeObject*> objects;
+  for (const auto& it : taken) {
+    objects.push_back(it->get());
+    pack->objects.push_back(*it);
+    upload_queue_.erase(it);
+  }
+  packs_in_preparation_++;
+
+  // Compressing is CPU-bound: put the archive together in the background
+  auto body = std::make_shared<std::string>();
+  RunInBackground(
+      [objects, body]() {
+        std::map<std::string, std::string> entries;
+        for (const OSTreeObject* object : objects) {
+          entries.emplace(object->Url(), object->ReadContent());
         }
+        std::ostringstream archive;
+        Utils::writeArchive(entries, archive);
+        *body = archive.str();
+      },
+      [this, pack, body]() {
+        packs_in_preparation_--;
+        pack->request_body = std::move(*body);
+        SendPackUpload(pack);
+      });
+  return true;
+}
+
+void RequestPool::SendPackUpload(const std::shared_ptr<PackUpload>& pack) {
+  if (stopped_) {
+    return;
+  }
+  pack->handle = curl_easy_init();
+  if (pack->handle == nullptr) {
+    throw std::runtime_error("Could not initialize curl handle");
+  }
+  curlEasySetoptWrapper(pack->handle, CURLOPT_VERBOSE, get_curlopt_verbose());
+  // Same content type as single uploads: it is shared by all the requests
+  server_.SetContentType("Content-Type: application/octet-stream");
+  server_.InjectIntoCurl(kPackUploadPath, pack->handle);
+  curlEasySetoptWrapper(pack->handle, CURLOPT_USERAGENT, Utils::getUserAgent());
+  curlEasySetoptWrapper(pack->handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(pack->request_body.size()));
+  curlEasySetoptWrapper(pack->handle, CURLOPT_POSTFIELDS, pack->request_body.c_str());
+  curlEasySetoptWrapper(pack->handle, CURLOPT_WRITEFUNCTION, &RequestPool::BatchQueryWrite);
+  curlEasySetoptWrapper(pack->handle, CURLOPT_WRITEDATA, &pack->response);
+
+  const CURLMcode err = curl_multi_add_handle(multi_, pack->handle);
+  if (err != CURLM_OK) {
+    throw std::runtime_error(std::string("curl_multi_add_handle failed with error: ") + curl_multi_strerror(err));
+  }
+  LOG_INFO << "Uploading " << pack->objects.size() << " objects in one pack of " << pack->request_body.size()
+           << " bytes";
+  pack->start_time = RateController::clock::now();
+  pack_requests_made_++;
+  running_requests_++;
+  pack_uploads_in_flight_.emplace(pack->handle, pack);
+}
+
+void RequestPool::PackUploadDone(PackUpload& pack, const CURLcode result) {
+  long rescode = 0;  // NOLINT(google-runtime-int)
+  curl_easy_getinfo(pack.handle, CURLINFO_RESPONSE_CODE, &rescode);
+  curl_multi_remove_handle(multi_, pack.handle);
+  const auto end_time = RateController::clock::now();
+
+  bool valid = false;
+  std::unordered_set<std::string> stored;
+  if (result == CURLE_OK && rescode == 200) {
+    const Json::Value response = Utils::parseJSON(pack.response);
+    if (response.isObject() && response["stored"].isArray()) {
+      valid = true;
+      for (const auto& object : response["stored"]) {
+        stored.insert(object.asString());
       }
     }
-  } while (msgs_in_queue > 0);
+  }
+
+  if (!valid) {
+    if (result == CURLE_OK && pack_support_ != BatchSupport::kSupported) {
+      // As for batched presence checks: anything but the expected answer from
+      // a server which has never accepted a pack means that it does not know
+      // about them.
+      if (pack_support_ == BatchSupport::kUnknown) {
+        LOG_INFO << "Server does not support pack uploads (HTTP " << rescode
+                 << "), falling back to one request per object";
+      }
+      pack_support_ = BatchSupport::kUnsupported;
+    } else {
+      LOG_WARNING << "Pack upload failed with "
+                  << (result != CURLE_OK ? curl_easy_strerror(result) : "HTTP " + std::to_string(rescode))
+                  << ", retrying...";
+      RequestCompleted(pack.start_time, end_time, false);
+    }
+    if (!stopped_) {
+      upload_queue_.insert(upload_queue_.begin(), pack.objects.cbegin(), pack.objects.cend());
+    }
+    return;
+  }
+
+  pack_support_ = BatchSupport::kSupported;
+  for (const auto& object : pack.objects) {
+    if (stored.count(object->Url()) == 0) {
+      LOG_WARNING << "Object " << *object << " was not stored from a pack, uploading it on its own";
+      not_packed_.insert(object.get());
+      if (!stopped_) {
+        upload_queue_.push_front(object);
+      }
+      continue;
+    }
+    // Only counted once stored: the others are uploaded again on their own
+    total_object_size_ += object->GetSize();
+    object->PackUploaded(*this);
+    RecordPresence(object);
+  }
+  RequestCompleted(pack.start_time, end_time, true);
 }
 
 void RequestPool::Loop() {
@@ -1,17 +1,34 @@
 #ifndef SOTA_CLIENT_TOOLS_REQUEST_POOL_H_
 #define SOTA_CLIENT_TOOLS_REQUEST_POOL_H_
 
+#include <functional>
 #include <list>
+#include <map>
+#include <memory>
+#include <unordered_set>
 
 #include <curl/curl.h>
 
 #include "garage_common.h"
 #include "ostree_object.h"
+#include "presence_cache.h"
+#include "push_journal.h"
 #include "rate_controller.h"
+#include "worker_pool.h"
 
 class RequestPool {
  public:
-  RequestPool(TreehubServer& server, int max_curl_requests, RunMode mode, bool fsck_on_upload);
+  /**
+   * \param presence_cache If not null, objects recorded there are not queried
+   *                       and the results of the queries and uploads are
+   *                       recorded there
+   * \param journal If not null, presence results from an interrupted push are
+   *                taken from there instead of being queried again, and new
+   *                results are appended to it
+   * \param pack_uploads Upload small objects in packs, see kPackUploadPath
+   */
+  RequestPool(TreehubServer& server, int max_curl_requests, RunMode mode, bool fsck_on_upload,
+              PresenceCache* presence_cache = nullptr, PushJournal* journal = nullptr, bool pack_uploads = false);
   ~RequestPool();
   // Non-Copyable, Non-Movable
   RequestPool(const RequestPool&) = delete;
@@ -26,13 +43,29 @@ class RequestPool {
     query_queue_.clear();
     upload_queue_.clear();
   };
-  bool is_idle() const { return query_queue_.empty() && upload_queue_.empty() && running_requests_ == 0; }
+  bool is_idle() const {
+    return query_queue_.empty() && upload_queue_.empty() && running_requests_ == 0 && workers_.pending() == 0;
+  }
   bool is_stopped() const { return stopped_; }
   RunMode run_mode() const { return mode_; }
+  /**
+   * When walking the tree, also verify the checksums of the objects found on
+   * the server. Corrupt objects stop the pool.
+   */
+  void set_verify_present(bool verify) { verify_present_ = verify; }
+  bool verify_present() const { return verify_present_; }
+
+  /**
+   * Run CPU-bound work, such as parsing an object, on a worker thread and then
+   * `done` from Loop(). See WorkerPool for what the functions may capture.
+   */
+  void RunInBackground(std::function<void()> work, std::function<void()> done) {
+    workers_.Submit(std::move(work), std::move(done));
+  }
 
   /**
    * One iteration of request-listen loop, launches multiple requests, then
-   * listens for the result.
+   * waits for network activity on the running ones and handles the results.
    */
   void Loop();
   /**
@@ -41,16 +74,89 @@ class RequestPool {
    */
   int put_requests_made() const { return put_requests_made_; }
   int head_requests_made() const { return head_requests_made_; }
+  /**
+   * The number of batched presence checks, each covering up to kMaxBatchSize
+   * objects, that have been sent to curl.
+   */
+  int batch_requests_made() const { return batch_requests_made_; }
+  /**
+   * The number of pack uploads, each covering up to kMaxPackObjects objects,
+   * that have been sent to curl.
+   */
+  int pack_requests_made() const { return pack_requests_made_; }
+  int cache_hits() const { return cache_hits_; }
+  /** The number of objects that presence checks found missing on the server. */
+  int missing_objects() const { return missing_objects_; }
+  int journal_hits() const { return journal_hits_; }
+
+  /**
+   * Presence checks are batched by sending a JSON object
+   * {"objects": ["objects/ab/cdef...dirtree", ...]} in a POST request to this
+   * path. The server answers with {"present": [...], "missing": [...]}, the
+   * objects that it has and those that it does not have. Objects listed in
+   * neither are queried again with one HEAD request each, as are all objects
+   * if the server does not support batched checks.
+   */
+  static constexpr const char* kBatchQueryPath = "objects/missing";
+  static constexpr size_t kMaxBatchSize = 256;
+
+  /**
+   * Small objects are uploaded together by sending a gzip-compressed tar
+   * archive, with one entry per object named like "objects/ab/cdef...dirtree",
+   * in a POST request to this path. The server answers with
+   * {"stored": [...]}, the objects of the pack that it has stored; the others
+   * are uploaded again one by one. If the server does not support it, all
+   * uploads fall back to one request per object.
+   */
+  static constexpr const char* kPackUploadPath = "objects/pack";
+  static constexpr uintmax_t kMaxPackObjectSize = 64 * 1024;
+  static constexpr uintmax_t kMaxPackSize = 4 * 1024 * 1024;
+  static constexpr size_t kMaxPackObjects = 1024;
   uintmax_t total_object_size() const { return total_object_size_; }
 
  private:
+  struct BatchQuery;
+  struct PackUpload;
+  enum class BatchSupport { kUnknown, kSupported, kUnsupported };
+
   void LoopLaunch();  // launches multiple requests from the queues
   void LoopListen();  // listens to the result of launched requests
+  void SocketAction(curl_socket_t socket, int events);
+  void HandleCompletedRequests();
+  void RequestCompleted(RateController::clock::time_point start_time, RateController::clock::time_point end_time,
+                        bool succeeded);
+  void RecordPresence(const OSTreeObject::ptr& object);
+  // Next object from the query queue whose presence is not already known, nullptr if there is none
+  OSTreeObject::ptr PopQuery();
+  void LaunchBatchQuery(const OSTreeObject::ptr& first);
+  void BatchQueryDone(BatchQuery& batch, CURLcode result);
+  static size_t BatchQueryWrite(void* buffer, size_t size, size_t nmemb, void* userp);
+  // Take small objects from the upload queue and upload them in one pack, false if there are not enough of them
+  bool LaunchPackUpload();
+  void SendPackUpload(const std::shared_ptr<PackUpload>& pack);
+  void PackUploadDone(PackUpload& pack, CURLcode result);
+
+  // curl_multi_socket_action() callbacks, see CURLMOPT_SOCKETFUNCTION and CURLMOPT_TIMERFUNCTION
+  static int SocketCallback(CURL* easy, curl_socket_t socket, int what, void* userp, void* socketp);
+  static int TimerCallback(CURLM* multi, long timeout_ms, void* userp);  // NOLINT(google-runtime-int)
 
   RateController rate_controller_;
   int running_requests_;
+  int epoll_fd_{-1};
+  // When curl wants to be called with CURL_SOCKET_TIMEOUT, if timer_armed_
+  bool timer_armed_{false};
+  RateController::clock::time_point timer_deadline_;
+  // Server congestion backoff: no new request is launched before this time
+  RateController::clock::time_point launch_not_before_;
   int head_requests_made_{0};
   int put_requests_made_{0};
+  int batch_requests_made_{0};
+  int pack_requests_made_{0};
+  // Packs being put together in the background, which will be requests soon
+  int packs_in_preparation_{0};
+  int cache_hits_{0};
+  int missing_objects_{0};
+  int journal_hits_{0};
   uintmax_t total_object_size_{0};
   TreehubServer& server_;
   CURLM* multi_;
@@ -58,6 +164,20 @@ class RequestPool {
   std::list<OSTreeObject::ptr> upload_queue_;
   RunMode mode_;
   bool fsck_on_upload_;
+  bool verify_present_{false};
+  PresenceCache* presence_cache_;
+  PushJournal* journal_;
+  BatchSupport batch_support_{BatchSupport::kUnknown};
+  std::map<CURL*, std::unique_ptr<BatchQuery>> batch_queries_;
+  bool pack_uploads_;
+  BatchSupport pack_support_{BatchSupport::kUnknown};
+  std::map<CURL*, std::shared_ptr<PackUpload>> pack_uploads_in_flight_;
+  // Objects that the server did not take from a pack, to be uploaded on their own
+  std::unordered_set<const OSTreeObject*> not_packed_;
+  // Objects that a batched presence check did not cover, to be queried on their own
+  std::unordered_set<const OSTreeObject*> not_batched_;
+  // Parses objects and verifies them before upload, off the event loop
+  WorkerPool workers_;
   bool stopped_;
 };
 // vim: set tabstop=2 shiftwidth=2 expandtab:
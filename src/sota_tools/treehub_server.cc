@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <iostream>
+#include <stdexcept>
 
 #include <boost/algorithm/string.hpp>
 
@@ -86,6 +87,22 @@ void TreehubServer::InjectIntoCurl(const string& url_suffix, CURL* curl_handle,
   }
 }
 
+struct curl_slist* TreehubServer::HeadersWithContentType(const string& content_type) const {
+  struct curl_slist* headers = nullptr;
+  for (const string& header : {auth_header_contents_, force_header_contents_, content_type}) {
+    if (header.empty()) {
+      continue;
+    }
+    struct curl_slist* appended = curl_slist_append(headers, header.c_str());
+    if (appended == nullptr) {
+      curl_slist_free_all(headers);
+      throw std::runtime_error("Could not allocate the request headers");
+    }
+    headers = appended;
+  }
+  return headers;
+}
+
 // Set the url of the treehub server, this should be something like
 // "https://treehub-staging.atsgarage.com/api/v2/"
 // The trailing slash is optional, and will be appended if required
@@ -17,6 +17,12 @@ class TreehubServer {
   void SetAuthBasic(const std::string &username, const std::string &password);
 
   void InjectIntoCurl(const std::string &url_suffix, CURL *curl_handle, bool tufrepo = false) const;
+  /**
+   * The headers that InjectIntoCurl() sets, but with the given content type
+   * instead of the shared one, for a request whose body is of another type.
+   * Free the list with curl_slist_free_all() once the request is done.
+   */
+  struct curl_slist *HeadersWithContentType(const std::string &content_type) const;
 
   void ca_certs(const std::string &cacerts) { ca_certs_ = cacerts; }
   void root_url(const std::string &_root_url);
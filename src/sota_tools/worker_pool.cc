@@ -0,0 +1,118 @@
+#include "worker_pool.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#include "utilities/utils.h"
+
+struct WorkerPool::Job {
+  std::function<void()> work;
+  std::function<void()> done;
+  std::exception_ptr error;
+};
+
+WorkerPool::WorkerPool(unsigned int threads) {
+  event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (event_fd_ < 0) {
+    throw std::runtime_error(std::string("eventfd failed with error: ") + std::strerror(errno));
+  }
+  threads = std::max(threads, 1U);
+  for (unsigned int i = 0; i < threads; ++i) {
+    threads_.emplace_back(&WorkerPool::Run, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  // Jobs that have not run are dropped, here on the owner's thread
+  queued_.clear();
+  completed_.clear();
+  close(event_fd_);
+}
+
+void WorkerPool::Submit(std::function<void()> work, std::function<void()> done) {
+  auto job = std_::make_unique<Job>();
+  job->work = std::move(work);
+  job->done = std::move(done);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_.push_back(std::move(job));
+  }
+  pending_++;
+  cv_.notify_one();
+}
+
+size_t WorkerPool::RunCompleted() {
+  // Reset the counter before looking at the queue, so that a job finishing in
+  // the meantime makes the descriptor readable again.
+  uint64_t count;
+  if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    throw std::runtime_error(std::string("Reading eventfd failed with error: ") + std::strerror(errno));
+  }
+
+  size_t completed = 0;
+  for (;;) {
+    std::unique_ptr<Job> job;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (completed_.empty()) {
+        break;
+      }
+      job = std::move(completed_.front());
+      completed_.pop_front();
+    }
+    pending_--;
+    completed++;
+    if (job->error) {
+      std::rethrow_exception(job->error);
+    }
+    job->done();
+  }
+  return completed;
+}
+
+void WorkerPool::Run() {
+  for (;;) {
+    std::unique_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return shutdown_ || !queued_.empty(); });
+      if (shutdown_) {
+        return;
+      }
+      job = std::move(queued_.front());
+      queued_.pop_front();
+    }
+
+    try {
+      job->work();
+    } catch (...) {
+      job->error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      completed_.push_back(std::move(job));
+    }
+    const uint64_t one = 1;
+    if (write(event_fd_, &one, sizeof(one)) < 0) {
+      // Only fails if the counter would overflow, the descriptor is readable then
+    }
+  }
+}
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
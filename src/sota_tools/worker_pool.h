@@ -0,0 +1,63 @@
+#ifndef SOTA_CLIENT_TOOLS_WORKER_POOL_H_
+#define SOTA_CLIENT_TOOLS_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs CPU-bound work, such as parsing or verifying OSTree objects, on a fixed
+ * set of threads so that it does not hold up the network event loop.
+ *
+ * A job has two parts: `work` runs on one of the worker threads, then `done`
+ * runs on the thread that calls RunCompleted(), normally the event loop. Both
+ * are created and destroyed on that thread, so `done` may hold references
+ * that are not thread-safe (e.g. OSTreeObject::ptr) while `work` must only
+ * capture plain pointers or thread-safe data. An exception thrown by `work`
+ * is rethrown by RunCompleted() instead of calling `done`.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(unsigned int threads = std::thread::hardware_concurrency());
+  ~WorkerPool();
+  // Non-Copyable, Non-Movable
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool(WorkerPool&&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+  WorkerPool& operator=(WorkerPool&&) = delete;
+
+  void Submit(std::function<void()> work, std::function<void()> done);
+
+  /**
+   * Run the `done` part of the jobs that have finished, without blocking.
+   * \return the number of jobs completed
+   */
+  size_t RunCompleted();
+
+  /** Becomes readable when finished jobs are waiting for RunCompleted(). */
+  int event_fd() const { return event_fd_; }
+  /** Number of jobs submitted that have not been through RunCompleted() yet. */
+  size_t pending() const { return pending_; }
+  size_t size() const { return threads_.size(); }
+
+ private:
+  struct Job;
+
+  void Run();
+
+  int event_fd_{-1};
+  size_t pending_{0};
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::unique_ptr<Job>> queued_;
+  std::deque<std::unique_ptr<Job>> completed_;
+  bool shutdown_{false};
+};
+
+// vim: set tabstop=2 shiftwidth=2 expandtab:
+#endif  // SOTA_CLIENT_TOOLS_WORKER_POOL_H_
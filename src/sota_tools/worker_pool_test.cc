@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <poll.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include "utilities/utils.h"
+#include "worker_pool.h"
+
+namespace {
+
+/* Wait for the pool to signal finished jobs, as RequestPool does. */
+void WaitForCompleted(const WorkerPool& pool) {
+  struct pollfd pfd {};
+  pfd.fd = pool.event_fd();
+  pfd.events = POLLIN;
+  EXPECT_EQ(poll(&pfd, 1, 10000), 1);
+}
+
+}  // namespace
+
+/* Work runs on a worker thread, completions on the caller's thread. */
+TEST(WorkerPool, RunsWorkInBackground) {
+  WorkerPool pool(4);
+  EXPECT_EQ(pool.size(), 4U);
+  const std::thread::id main_thread = std::this_thread::get_id();
+  std::atomic<int> worked{0};
+  int done = 0;
+
+  for (int i = 0; i < 100; ++i) {
+    pool.Submit(
+        [&worked, main_thread]() {
+          EXPECT_NE(std::this_thread::get_id(), main_thread);
+          worked++;
+        },
+        [&done, main_thread]() {
+          EXPECT_EQ(std::this_thread::get_id(), main_thread);
+          done++;
+        });
+  }
+  EXPECT_EQ(pool.pending(), 100U);
+  while (pool.pending() > 0) {
+    WaitForCompleted(pool);
+    pool.RunCompleted();
+  }
+  EXPECT_EQ(worked, 100);
+  EXPECT_EQ(done, 100);
+  EXPECT_EQ(pool.RunCompleted(), 0U);
+}
+
+/* Completions can submit new jobs. */
+TEST(WorkerPool, SubmitFromCompletion) {
+  WorkerPool pool(2);
+  int done = 0;
+  pool.Submit([]() {},
+              [&pool, &done]() {
+                done++;
+                pool.Submit([]() {}, [&done]() { done++; });
+              });
+  while (pool.pending() > 0) {
+    WaitForCompleted(pool);
+    pool.RunCompleted();
+  }
+  EXPECT_EQ(done, 2);
+}
+
+/* Exceptions thrown by the work are rethrown on the caller's thread. */
+TEST(WorkerPool, PropagatesExceptions) {
+  WorkerPool pool(1);
+  bool done = false;
+  pool.Submit([]() { throw std::runtime_error("failed"); }, [&done]() { done = true; });
+  WaitForCompleted(pool);
+  EXPECT_THROW(pool.RunCompleted(), std::runtime_error);
+  EXPECT_FALSE(done);
+  EXPECT_EQ(pool.pending(), 0U);
+}
+
+/* Jobs still queued when the pool is destroyed are dropped. */
+TEST(WorkerPool, DestroyWithPendingJobs) {
+  auto pool = std_::make_unique<WorkerPool>(1);
+  for (int i = 0; i < 10; ++i) {
+    pool->Submit([]() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }, []() {});
+  }
+  pool.reset();
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
@@ -0,0 +1,88 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+
+#include "asn1_message.h"
+#include "der_encoder.h"
+
+namespace {
+
+/* An uploadDataReq message carrying a single firmware chunk */
+Asn1Message::Ptr makeUploadDataReq(size_t size) {
+  Asn1Message::Ptr msg = Asn1Message::Empty();
+  msg->present(AKIpUptaneMes_PR_uploadDataReq);
+  auto req = msg->uploadDataReq();
+  SetString(&req->data, std::string(size, 'f'));
+  return msg;
+}
+
+void BM_Asn1DerEncodeUploadData(benchmark::State &state) {
+  const auto msg = makeUploadDataReq(static_cast<size_t>(state.range(0)));
+  std::string out;
+
+  for (auto _ : state) {
+    out.clear();
+    der_encode(&asn_DEF_AKIpUptaneMes, &msg->msg_, Asn1StringAppendCallback, &out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Asn1DerEncodeUploadData)->ArgName("bytes")->Range(1 << 10, 1 << 20);
+
+void BM_Asn1BerDecodeUploadData(benchmark::State &state) {
+  const auto msg = makeUploadDataReq(static_cast<size_t>(state.range(0)));
+  std::string encoded;
+  der_encode(&asn_DEF_AKIpUptaneMes, &msg->msg_, Asn1StringAppendCallback, &encoded);
+
+  for (auto _ : state) {
+    AKIpUptaneMes_t *m = nullptr;
+    asn_codec_ctx_s context{};
+    const asn_dec_rval_t res =
+        ber_decode(&context, &asn_DEF_AKIpUptaneMes, reinterpret_cast<void **>(&m), encoded.data(), encoded.size());
+    // Note that ber_decode allocates *m even on failure, so this must always be done
+    Asn1Message::Ptr decoded = Asn1Message::FromRaw(&m);
+    if (res.code != RC_OK) {
+      state.SkipWithError("ber_decode failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Asn1BerDecodeUploadData)->ArgName("bytes")->Range(1 << 10, 1 << 20);
+
+/* Encoding into a reused buffer, without copying the data */
+void BM_Asn1EncoderUploadData(benchmark::State &state) {
+  const auto msg = makeUploadDataReq(static_cast<size_t>(state.range(0)));
+  Asn1Encoder encoder;
+
+  for (auto _ : state) {
+    if (!encoder.encode(msg)) {
+      state.SkipWithError("Asn1Encoder failed");
+      break;
+    }
+    benchmark::DoNotOptimize(encoder.size());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Asn1EncoderUploadData)->ArgName("bytes")->Range(1 << 10, 1 << 20);
+
+/* Decoding with the data borrowed from the receive buffer */
+void BM_Asn1DecodeUploadData(benchmark::State &state) {
+  const auto msg = makeUploadDataReq(static_cast<size_t>(state.range(0)));
+  std::string encoded;
+  der_encode(&asn_DEF_AKIpUptaneMes, &msg->msg_, Asn1StringAppendCallback, &encoded);
+  const auto buffer = std::make_shared<const std::string>(std::move(encoded));
+
+  for (auto _ : state) {
+    Asn1Message::Ptr decoded = Asn1Decode(buffer->data(), buffer->size(), buffer);
+    if (decoded == nullptr) {
+      state.SkipWithError("Asn1Decode failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Asn1DecodeUploadData)->ArgName("bytes")->Range(1 << 10, 1 << 20);
+
+}  // namespace
@@ -0,0 +1,62 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include <boost/algorithm/hex.hpp>
+
+#include "crypto/crypto.h"
+#include "libaktualizr/types.h"
+
+namespace {
+
+// Roughly the size of a director targets.json with a handful of ECUs
+const std::string kMessage(4096, 'm');
+
+void BM_RSAPSSVerify(benchmark::State &state) {
+  const auto key_type = static_cast<KeyType>(state.range(0));
+  std::string public_key;
+  std::string private_key;
+  Crypto::generateRSAKeyPair(key_type, &public_key, &private_key);
+  const std::string signature = Crypto::RSAPSSSign(nullptr, private_key, kMessage);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Crypto::RSAPSSVerify(public_key, signature, kMessage));
+  }
+}
+// Arguments are KeyType values: RSA2048, RSA3072 and RSA4096
+BENCHMARK(BM_RSAPSSVerify)
+    ->ArgName("key_type")
+    ->Arg(static_cast<int64_t>(KeyType::kRSA2048))
+    ->Arg(static_cast<int64_t>(KeyType::kRSA3072))
+    ->Arg(static_cast<int64_t>(KeyType::kRSA4096));
+
+void BM_ED25519Verify(benchmark::State &state) {
+  std::string public_key;
+  std::string private_key;
+  Crypto::generateEDKeyPair(&public_key, &private_key);
+  public_key = boost::algorithm::unhex(public_key);
+  const std::string signature = Crypto::ED25519Sign(boost::algorithm::unhex(private_key), kMessage);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Crypto::ED25519Verify(public_key, signature, kMessage));
+  }
+}
+BENCHMARK(BM_ED25519Verify);
+
+template <class Hasher>
+void BM_MultiPartHasher(benchmark::State &state) {
+  // Same chunk size as the download and Secondary receive paths
+  const std::string chunk(static_cast<size_t>(state.range(0)), 'x');
+  const auto *data = reinterpret_cast<const unsigned char *>(chunk.data());
+
+  Hasher hasher;
+  for (auto _ : state) {
+    hasher.update(data, chunk.size());
+  }
+  benchmark::DoNotOptimize(hasher.getHexDigest());
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_MultiPartHasher, MultiPartSHA256Hasher)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_MultiPartHasher, MultiPartSHA512Hasher)->Range(1 << 10, 1 << 20);
+
+}  // namespace
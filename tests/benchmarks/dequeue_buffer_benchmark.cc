@@ -0,0 +1,30 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "utilities/dequeue_buffer.h"
+
+namespace {
+
+/* Simulates the recv()/ber_decode() loop: data is enqueued in chunks of the
+ * given size and consumed in smaller, message-sized pieces. */
+void BM_DequeueBufferThroughput(benchmark::State &state) {
+  const auto chunk = static_cast<size_t>(state.range(0));
+  const size_t consume = std::max<size_t>(chunk / 4, 1);
+  DequeueBuffer buffer;
+
+  for (auto _ : state) {
+    const size_t n = std::min(chunk, buffer.TailSpace());
+    std::memset(buffer.Tail(), 'b', n);
+    buffer.HaveEnqueued(n);
+    while (buffer.Size() >= consume) {
+      benchmark::DoNotOptimize(buffer.Head());
+      buffer.Consume(consume);
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_DequeueBufferThroughput)->ArgName("chunk")->Range(16, 4096);
+
+}  // namespace
@@ -0,0 +1,65 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include <json/json.h>
+
+#include "crypto/crypto.h"
+#include "uptane/tuf.h"
+#include "utilities/utils.h"
+
+namespace {
+
+/* A targets.json-like object with the given number of entries, similar to what
+ * is canonicalized before every signature check. */
+Json::Value makeTargetsObject(int64_t n_targets) {
+  Json::Value targets(Json::objectValue);
+  for (int64_t i = 0; i < n_targets; ++i) {
+    const std::string name = "target-" + std::to_string(i);
+    Json::Value target;
+    target["length"] = static_cast<Json::UInt64>(1024 * i);
+    target["hashes"]["sha256"] = Crypto::sha256digestHex(name);
+    target["hashes"]["sha512"] = Crypto::sha512digestHex(name);
+    target["custom"]["hardwareIds"][0] = "hw-id";
+    target["custom"]["targetFormat"] = "BINARY";
+    target["custom"]["version"] = std::to_string(i);
+    target["custom"]["ecuIdentifiers"]["ecu-" + std::to_string(i)]["hardwareId"] = "hw-id";
+    targets[name] = target;
+  }
+  Json::Value signed_part;
+  signed_part["_type"] = "Targets";
+  signed_part["expires"] = "2038-01-19T03:14:06Z";
+  signed_part["version"] = 1;
+  signed_part["targets"] = targets;
+  return signed_part;
+}
+
+void BM_JsonToCanonicalStr(benchmark::State &state) {
+  const Json::Value json = makeTargetsObject(state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) {
+    const std::string canonical = Utils::jsonToCanonicalStr(json);
+    bytes += canonical.size();
+    benchmark::DoNotOptimize(canonical.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_JsonToCanonicalStr)->ArgName("targets")->RangeMultiplier(10)->Range(1, 10000);
+
+/* Parse a serialized director targets.json, as done on every metadata fetch
+ * and on every load from storage. */
+void BM_TargetsParse(benchmark::State &state) {
+  Json::Value json;
+  json["signed"] = makeTargetsObject(state.range(0));
+  json["signatures"] = Json::Value(Json::arrayValue);
+  const std::string serialized = Utils::jsonToCanonicalStr(json);
+
+  for (auto _ : state) {
+    Uptane::Targets targets(Utils::parseJSON(serialized));
+    benchmark::DoNotOptimize(targets.targets.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * serialized.size()));
+}
+BENCHMARK(BM_TargetsParse)->ArgName("targets")->RangeMultiplier(10)->Range(1, 10000);
+
+}  // namespace
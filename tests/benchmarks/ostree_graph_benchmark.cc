@@ -0,0 +1,88 @@
+#include <benchmark/benchmark.h>
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "crypto/crypto.h"
+#include "ostree_dir_repo.h"
+#include "ostree_object.h"
+#include "utilities/utils.h"
+
+namespace {
+
+/* A synthetic OSTree repository with the given number of (empty) file
+ * objects. Only the presence of the files matters for building the object
+ * graph, so they are created once per size and shared by all benchmarks. */
+class SyntheticRepo {
+ public:
+  explicit SyntheticRepo(int64_t size) : temp_dir_("ostree-graph-benchmark") {
+    hashes_.reserve(static_cast<size_t>(size));
+    for (int64_t i = 0; i < size; ++i) {
+      const std::string digest = Crypto::sha256digest(std::to_string(i));
+      hashes_.emplace_back(reinterpret_cast<const uint8_t *>(digest.data()));
+      const boost::filesystem::path path =
+          temp_dir_.Path() / "objects" / OSTreeRepo::GetPathForHash(hashes_.back(), OSTREE_OBJECT_TYPE_FILE);
+      boost::filesystem::create_directories(path.parent_path());
+      std::ofstream{path.string()};
+    }
+  }
+
+  boost::filesystem::path root() const { return temp_dir_.Path(); }
+  const std::vector<OSTreeHash> &hashes() const { return hashes_; }
+
+  static const SyntheticRepo &get(int64_t size) {
+    static std::map<int64_t, std::unique_ptr<SyntheticRepo>> repos;
+    auto &repo = repos[size];
+    if (!repo) {
+      repo = std_::make_unique<SyntheticRepo>(size);
+    }
+    return *repo;
+  }
+
+ private:
+  TemporaryDirectory temp_dir_;
+  std::vector<OSTreeHash> hashes_;
+};
+
+/* Building the object table, as garage-push does while walking a commit. The
+ * size of a node is reported since it dominates the memory footprint of large
+ * repositories. */
+void BM_OstreeObjectTableBuild(benchmark::State &state) {
+  const SyntheticRepo &synthetic = SyntheticRepo::get(state.range(0));
+
+  for (auto _ : state) {
+    OSTreeDirRepo repo(synthetic.root());
+    for (const OSTreeHash &hash : synthetic.hashes()) {
+      benchmark::DoNotOptimize(repo.GetObject(hash, OSTREE_OBJECT_TYPE_FILE));
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+  state.counters["object_bytes"] = sizeof(OSTreeObject);
+}
+BENCHMARK(BM_OstreeObjectTableBuild)->ArgName("objects")->Arg(1 << 14)->Arg(1 << 17)->Unit(benchmark::kMillisecond);
+
+/* Objects shared by several directories are looked up again every time they
+ * are referenced. */
+void BM_OstreeObjectTableLookup(benchmark::State &state) {
+  const SyntheticRepo &synthetic = SyntheticRepo::get(state.range(0));
+  OSTreeDirRepo repo(synthetic.root());
+  for (const OSTreeHash &hash : synthetic.hashes()) {
+    repo.GetObject(hash, OSTREE_OBJECT_TYPE_FILE);
+  }
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> dist(0, synthetic.hashes().size() - 1);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(repo.GetObject(synthetic.hashes()[dist(gen)], OSTREE_OBJECT_TYPE_FILE));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_OstreeObjectTableLookup)->ArgName("objects")->Arg(1 << 14)->Arg(1 << 17);
+
+}  // namespace
@@ -0,0 +1,88 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include <boost/optional.hpp>
+
+#include "crypto/crypto.h"
+#include "libaktualizr/config.h"
+#include "storage/sqlstorage.h"
+#include "uptane/tuf.h"
+#include "utilities/utils.h"
+
+namespace {
+
+StorageConfig makeStorageConfig(const TemporaryDirectory &temp_dir) {
+  StorageConfig config;
+  config.type = StorageType::kSqlite;
+  config.path = temp_dir.Path();
+  return config;
+}
+
+Uptane::Target makeTarget(int64_t i) {
+  Json::Value target_json;
+  const std::string name = "target-" + std::to_string(i);
+  target_json["hashes"]["sha256"] = Crypto::sha256digestHex(name);
+  target_json["length"] = 1024;
+  return Uptane::Target(name, target_json);
+}
+
+/* Metadata is stored after every successful fetch and loaded again on every
+ * update check, so both sides are measured with a realistic document size. */
+void BM_SQLStorageStoreNonRoot(benchmark::State &state) {
+  TemporaryDirectory temp_dir;
+  SQLStorage storage(makeStorageConfig(temp_dir), false);
+  const std::string data(static_cast<size_t>(state.range(0)), 'd');
+
+  for (auto _ : state) {
+    storage.storeNonRoot(data, Uptane::RepositoryType::Director(), Uptane::Role::Targets());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SQLStorageStoreNonRoot)->ArgName("bytes")->Range(1 << 10, 1 << 20);
+
+void BM_SQLStorageLoadNonRoot(benchmark::State &state) {
+  TemporaryDirectory temp_dir;
+  SQLStorage storage(makeStorageConfig(temp_dir), false);
+  storage.storeNonRoot(std::string(static_cast<size_t>(state.range(0)), 'd'), Uptane::RepositoryType::Director(),
+                       Uptane::Role::Targets());
+
+  std::string data;
+  for (auto _ : state) {
+    storage.loadNonRoot(&data, Uptane::RepositoryType::Director(), Uptane::Role::Targets());
+    benchmark::DoNotOptimize(data.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SQLStorageLoadNonRoot)->ArgName("bytes")->Range(1 << 10, 1 << 20);
+
+void BM_SQLStorageSaveInstalledVersion(benchmark::State &state) {
+  TemporaryDirectory temp_dir;
+  SQLStorage storage(makeStorageConfig(temp_dir), false);
+
+  int64_t i = 0;
+  for (auto _ : state) {
+    storage.saveInstalledVersion("primary", makeTarget(i++), InstalledVersionUpdateMode::kCurrent, "");
+  }
+}
+BENCHMARK(BM_SQLStorageSaveInstalledVersion);
+
+/* Loading installed versions gets slower as the installation history grows */
+void BM_SQLStorageLoadInstalledVersions(benchmark::State &state) {
+  TemporaryDirectory temp_dir;
+  SQLStorage storage(makeStorageConfig(temp_dir), false);
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    storage.saveInstalledVersion("primary", makeTarget(i), InstalledVersionUpdateMode::kCurrent, "");
+    storage.saveInstalledVersion("secondary", makeTarget(i), InstalledVersionUpdateMode::kCurrent, "");
+  }
+
+  for (auto _ : state) {
+    boost::optional<Uptane::Target> current;
+    boost::optional<Uptane::Target> pending;
+    storage.loadInstalledVersions("primary", &current, &pending, nullptr);
+    benchmark::DoNotOptimize(current);
+  }
+}
+BENCHMARK(BM_SQLStorageLoadInstalledVersions)->ArgName("history")->RangeMultiplier(10)->Range(1, 1000);
+
+}  // namespace
@@ -9,6 +9,9 @@ import subprocess
 import sys
 import time
 import hashlib
+import io
+import json
+import tarfile
 from contextlib import ExitStack
 from http.server import BaseHTTPRequestHandler, HTTPServer
 from random import seed, randrange
@@ -53,6 +56,12 @@ class TreehubServerHandler(BaseHTTPRequestHandler):
             self.end_headers()
 
     def do_POST(self):
+        if self.path == '/objects/missing':
+            self.check_missing()
+            return
+        if self.path == '/objects/pack':
+            self.upload_pack()
+            return
         ctype, pdict = cgi.parse_header(self.headers['Content-Type'])
         print("Upload type: {}".format(ctype))
         if ctype == 'multipart/form-data':
@@ -93,6 +102,60 @@ class TreehubServerHandler(BaseHTTPRequestHandler):
         self.send_response_only(400)
         self.end_headers()
 
+    def check_missing(self):
+        # Batched presence check, returns which of the objects are in the repo
+        # and which are not
+        if args.no_batch:
+            self.send_response_only(404)
+            self.end_headers()
+            return
+        length = int(self.headers['content-length'])
+        request = self.rfile.read(length)
+        if self.headers['Content-Type'] != 'application/json':
+            self.send_response_only(415)
+            self.end_headers()
+            return
+        objects = json.loads(request)['objects']
+        print("Processing batched presence check of %d objects" % len(objects))
+        present = [o for o in objects if os.path.exists(os.path.join(repo_path, o))]
+        missing = [o for o in objects if o not in present]
+        if args.partial_batch:
+            # Leave out every other object, which has to be checked again
+            present = present[::2]
+            missing = missing[::2]
+        body = json.dumps({'present': present, 'missing': missing}).encode()
+        self.send_response_only(200)
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def upload_pack(self):
+        # Several objects in one gzip-compressed tar archive, returns the
+        # objects that have been stored
+        length = int(self.headers['content-length'])
+        body = self.rfile.read(length)
+        if args.no_pack:
+            self.send_response_only(404)
+            self.end_headers()
+            return
+        stored = []
+        with tarfile.open(fileobj=io.BytesIO(body), mode='r:gz') as pack:
+            for member in pack.getmembers():
+                name = os.path.normpath(member.name)
+                if not member.isfile() or not name.startswith('objects/'):
+                    continue
+                full_path = os.path.join(repo_path, name)
+                os.makedirs(os.path.dirname(full_path), exist_ok=True)
+                with open(full_path, 'wb') as f:
+                    f.write(pack.extractfile(member).read())
+                stored.append(member.name)
+        print("Processing pack upload of %d objects" % len(stored))
+        body = json.dumps({'stored': stored}).encode()
+        self.send_response_only(200)
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
     def drop_check(self):
         self.__class__.made_requests += 1
         if args.fail and args.fail > 0:
@@ -167,6 +230,12 @@ if __name__ == "__main__":
                         help='sleep for n.n seconds for every GET request')
     parser.add_argument('-t', '--tls', action='store_true',
                         help='require TLS from clients')
+    parser.add_argument('--no-batch', action='store_true',
+                        help='do not support batched presence checks')
+    parser.add_argument('--partial-batch', action='store_true',
+                        help='leave objects out of the answers to batched presence checks')
+    parser.add_argument('--no-pack', action='store_true',
+                        help='do not support pack uploads')
     args = parser.parse_args()
 
     signal.signal(signal.SIGTERM, sig_handler)